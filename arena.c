@@ -0,0 +1,200 @@
+/**
+ * @file arena.c
+ * @author Ricardo Fonseca
+ * @brief Aligned buffers and scratch memory arenas
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/**
+ * @brief Use default (POSIX + BSD / SVID) features (required for posix_memalign and madvise)
+ *
+ */
+#define _DEFAULT_SOURCE
+
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/**
+ * @brief Allocates an aligned buffer
+ *
+ * The buffer is aligned to ARENA_ALIGN bytes, or to ARENA_HUGE_PAGE bytes
+ * (and marked as a candidate for transparent huge pages) for large buffers.
+ * Memory is not initialized, see `arena_touch()`. The routine aborts the
+ * code if the allocation fails.
+ *
+ * @param size 	Buffer size (bytes)
+ * @return 		Pointer to buffer, NULL if size is 0
+ */
+void* arena_malloc( size_t size )
+{
+	if ( size == 0 ) return NULL;
+
+	// Large buffers use the huge page size
+	const size_t align = ( size >= ARENA_HUGE_PAGE ) ? ARENA_HUGE_PAGE : ARENA_ALIGN;
+	const size_t bytes = ( ( size + align - 1 ) / align ) * align;
+
+	void* buf;
+	if ( posix_memalign( &buf, align, bytes ) ) {
+		fprintf(stderr, "(*error*) Unable to allocate %zu bytes, aborting.\n", bytes );
+		exit(-1);
+	}
+
+#ifdef MADV_HUGEPAGE
+	// This is just a hint, failure is not an error
+	if ( align == ARENA_HUGE_PAGE ) madvise( buf, bytes, MADV_HUGEPAGE );
+#endif
+
+	return buf;
+}
+
+/**
+ * @brief Zeroes a buffer in parallel (first touch)
+ *
+ * Each thread zeroes the section of the buffer it gets with a static
+ * distribution, so memory pages are placed on the NUMA node of the thread
+ * that uses them. Small buffers, or calls from inside a parallel region,
+ * are zeroed by the calling thread only.
+ *
+ * @param buf 	Pointer to buffer
+ * @param size 	Buffer size (bytes)
+ */
+void arena_touch( void* buf, size_t size )
+{
+	if ( size < ARENA_TOUCH_MIN || omp_in_parallel() ) {
+		memset( buf, 0, size );
+		return;
+	}
+
+	#pragma omp parallel
+	{
+		const int nt  = omp_get_num_threads();
+		const int tid = omp_get_thread_num();
+		const size_t i0 = (size_t) ( ( (uint64_t) size *  tid      ) / nt );
+		const size_t i1 = (size_t) ( ( (uint64_t) size * (tid + 1) ) / nt );
+		memset( (char *) buf + i0, 0, i1 - i0 );
+	}
+}
+
+/**
+ * @brief Frees a buffer allocated with `arena_malloc()`
+ *
+ * @param ptr 	Pointer to buffer, may be NULL
+ */
+void arena_free( void* ptr )
+{
+	free( ptr );
+}
+
+/**
+ * @brief Initializes a scratch memory arena
+ *
+ * No memory is allocated until the first call to `arena_alloc()`.
+ *
+ * @param arena 	Memory arena
+ */
+void arena_new( t_arena* arena )
+{
+	arena -> buf = NULL;
+	arena -> size = 0;
+	arena -> used = 0;
+	arena -> peak = 0;
+	arena -> n_extra = 0;
+}
+
+/**
+ * @brief Frees all memory used by a scratch memory arena
+ *
+ * The arena is left empty and may be used again.
+ *
+ * @param arena 	Memory arena
+ */
+void arena_delete( t_arena* arena )
+{
+	for( int i = 0; i < arena -> n_extra; i++ ) arena_free( arena -> extra[i] );
+	arena_free( arena -> buf );
+	arena_new( arena );
+}
+
+/**
+ * @brief Allocates a temporary buffer from a scratch memory arena
+ *
+ * If the arena buffer is full a separate (overflow) allocation is made, and
+ * the arena grows to the peak size the next time it is completely released.
+ *
+ * @param arena 	Memory arena
+ * @param size 		Buffer size (bytes)
+ * @return 			Pointer to buffer, aligned to ARENA_ALIGN bytes
+ */
+void* arena_alloc( t_arena* arena, size_t size )
+{
+	// Keep all buffers aligned
+	size = ( ( size + ARENA_ALIGN - 1 ) / ARENA_ALIGN ) * ARENA_ALIGN;
+
+	void* ptr;
+	if ( arena -> used + size <= arena -> size ) {
+		ptr = arena -> buf + arena -> used;
+	} else {
+		// Arena buffer is full, use a separate allocation
+		if ( arena -> n_extra >= ARENA_MAX_EXTRA ) {
+			fprintf(stderr, "(*error*) Too many overflow allocations in memory arena, aborting.\n");
+			exit(-1);
+		}
+		ptr = arena_malloc( size > 0 ? size : ARENA_ALIGN );
+		arena -> extra[ arena -> n_extra ] = ptr;
+		arena -> extra_pos[ arena -> n_extra ] = arena -> used;
+		arena -> n_extra++;
+	}
+
+	arena -> used += size;
+	if ( arena -> used > arena -> peak ) arena -> peak = arena -> used;
+
+	return ptr;
+}
+
+/**
+ * @brief Current position of a scratch memory arena
+ *
+ * @param arena 	Memory arena
+ * @return 			Arena position, to be used with `arena_release()`
+ */
+size_t arena_mark( const t_arena* arena )
+{
+	return arena -> used;
+}
+
+/**
+ * @brief Releases all temporary buffers allocated after a given position
+ *
+ * @param arena 	Memory arena
+ * @param mark 		Arena position, see `arena_mark()`
+ */
+void arena_release( t_arena* arena, size_t mark )
+{
+	// Free overflow allocations made after mark
+	while( arena -> n_extra > 0 && arena -> extra_pos[ arena -> n_extra - 1 ] >= mark ) {
+		arena -> n_extra--;
+		arena_free( arena -> extra[ arena -> n_extra ] );
+	}
+
+	arena -> used = mark;
+
+	// Grow the arena buffer to the peak size once it is no longer in use
+	if ( arena -> used == 0 && arena -> peak > arena -> size ) {
+		arena_free( arena -> buf );
+		arena -> buf = arena_malloc( arena -> peak );
+		arena -> size = arena -> peak;
+	}
+}
@@ -0,0 +1,131 @@
+/**
+ * @file arena.h
+ * @author Ricardo Fonseca
+ * @brief Aligned buffers and scratch memory arenas
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __ARENA__
+#define __ARENA__
+
+#include <stddef.h>
+
+/// Alignment (bytes) of all buffers
+#define ARENA_ALIGN 64
+
+/// Buffers of at least this size (bytes) are aligned to, and padded to a multiple of, the huge page size
+#define ARENA_HUGE_PAGE ( 2 * 1024 * 1024 )
+
+/// Buffers of at least this size (bytes) are initialized in parallel by `arena_touch()`
+#define ARENA_TOUCH_MIN ( 64 * 1024 )
+
+/// Maximum number of overflow allocations of an arena
+#define ARENA_MAX_EXTRA 16
+
+/**
+ * @brief Scratch memory arena
+ *
+ * Temporary buffers are taken from a single buffer that is kept between
+ * calls, so that no memory allocation is required once the arena has
+ * grown to the largest size in use. Buffers are released in the reverse
+ * order of allocation, see `arena_mark()` and `arena_release()`. Must be
+ * initialized with `arena_new()`.
+ */
+typedef struct Arena {
+	char* buf;		///< Arena buffer
+	size_t size;	///< Size of arena buffer (bytes)
+	size_t used;	///< Bytes in use (including overflow allocations)
+	size_t peak;	///< Maximum number of bytes in use
+
+	int n_extra;					///< Number of overflow allocations
+	void* extra[ARENA_MAX_EXTRA];	///< Allocations that did not fit in the arena buffer
+	size_t extra_pos[ARENA_MAX_EXTRA];	///< Arena position of each overflow allocation
+} t_arena;
+
+/**
+ * @brief Allocates an aligned buffer
+ *
+ * The buffer is aligned to ARENA_ALIGN bytes. Large buffers (at least
+ * ARENA_HUGE_PAGE bytes) are aligned to the huge page size and, where
+ * supported, marked as candidates for transparent huge pages. Memory is not
+ * initialized, so pages are placed (first touch) by the threads that first
+ * write to them. The routine aborts the code if the allocation fails.
+ *
+ * @param size 	Buffer size (bytes)
+ * @return 		Pointer to buffer, NULL if size is 0. Must be freed with
+ * 				`arena_free()` (or `free()`).
+ */
+void* arena_malloc( size_t size );
+
+/**
+ * @brief Zeroes a buffer in parallel (first touch)
+ *
+ * The buffer is split evenly between the OpenMP threads using a static
+ * distribution, the same used by the compute loops, so that on NUMA
+ * systems each memory page is placed on the node of the thread that will
+ * use it. Small buffers (less than ARENA_TOUCH_MIN bytes) are zeroed
+ * serially; if called from inside a parallel region the buffer is zeroed
+ * by the calling thread only.
+ *
+ * @param buf 	Pointer to buffer
+ * @param size 	Buffer size (bytes)
+ */
+void arena_touch( void* buf, size_t size );
+
+/**
+ * @brief Frees a buffer allocated with `arena_malloc()`
+ *
+ * @param ptr 	Pointer to buffer, may be NULL
+ */
+void arena_free( void* ptr );
+
+/**
+ * @brief Initializes a scratch memory arena
+ *
+ * No memory is allocated until the first call to `arena_alloc()`.
+ *
+ * @param arena 	Memory arena
+ */
+void arena_new( t_arena* arena );
+
+/**
+ * @brief Frees all memory used by a scratch memory arena
+ *
+ * @param arena 	Memory arena
+ */
+void arena_delete( t_arena* arena );
+
+/**
+ * @brief Allocates a temporary buffer from a scratch memory arena
+ *
+ * The buffer is aligned to ARENA_ALIGN bytes and is not initialized. If the
+ * arena buffer is full a separate allocation is made; the arena buffer is
+ * grown to the peak size in use the next time it is completely released.
+ *
+ * @param arena 	Memory arena
+ * @param size 		Buffer size (bytes)
+ * @return 			Pointer to buffer
+ */
+void* arena_alloc( t_arena* arena, size_t size );
+
+/**
+ * @brief Current position of a scratch memory arena
+ *
+ * @param arena 	Memory arena
+ * @return 			Arena position, to be used with `arena_release()`
+ */
+size_t arena_mark( const t_arena* arena );
+
+/**
+ * @brief Releases all temporary buffers allocated after a given position
+ *
+ * @param arena 	Memory arena
+ * @param mark 		Arena position, see `arena_mark()`
+ */
+void arena_release( t_arena* arena, size_t mark );
+
+#endif
@@ -0,0 +1,675 @@
+/**
+ * @file bench.c
+ * @author Ricardo Fonseca
+ * @brief Micro-benchmarks for the ZPIC kernels
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Runs each kernel in isolation, sweeping over the number of cells, particles
+ * per cell, number of threads and sort frequency, and reports:
+ *
+ * - time per particle (particle kernels) or per cell (grid kernels) in ns
+ * - effective memory bandwidth in GB/s, from a simple model of the minimum
+ *   memory traffic of each kernel (see `bench_kernels`)
+ * - parallel scaling efficiency, T(1) / ( n T(n) ), for each configuration
+ *
+ * Usage: `zpic_bench [-q] [-t min_time] [-o file.csv] [kernel ...]`
+ *
+ * -q selects a small (quick) parameter sweep, -t sets the minimum run time of
+ * each measurement (seconds) and -o also saves the results in CSV format.
+ * Kernels are selected by name, all are run if none is specified. Thread
+ * counts go up to `omp_get_max_threads()`, use OMP_NUM_THREADS to change it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../zpic.h"
+#include "../emf.h"
+#include "../current.h"
+#include "../particles.h"
+#include "../timer.h"
+
+/// Maximum number of values in a parameter sweep
+#define MAX_SWEEP 8
+
+/// Maximum number of timed runs of the sort benchmark
+#define SORT_MAX_RUN 8
+
+/**
+ * @brief Parameter sweep
+ *
+ */
+typedef struct BenchSweep {
+	int nx[MAX_SWEEP];		///< Number of cells
+	int n_nx;
+	int ppc[MAX_SWEEP];		///< Particles per cell
+	int n_ppc;
+	int nsort[MAX_SWEEP];	///< Sort frequency (0 disables sorting)
+	int n_nsort;
+	int nthreads[MAX_SWEEP];	///< Number of threads
+	int n_nthreads;
+	double min_time;		///< Minimum run time of each measurement (seconds)
+	FILE* csv;				///< CSV output (may be NULL)
+} t_bench_sweep;
+
+/**
+ * @brief Benchmark configuration
+ *
+ */
+typedef struct BenchConfig {
+	int nx;			///< Number of cells
+	int ppc;		///< Particles per cell (0 for grid kernels)
+	int nsort;		///< Sort frequency (-1 if not applicable)
+	int variant;	///< Kernel variant (e.g. deposition method)
+} t_bench_config;
+
+/**
+ * @brief Benchmark state, created for a given configuration and reused for all thread counts
+ *
+ */
+typedef struct BenchState {
+	t_emf emf;
+	t_current current;
+	t_species spec;
+
+	// Deposit benchmark data
+	int np;
+	int *ix, *di;
+	float *x0, *dx, *qvy, *qvz;
+	t_current *priv;
+	int n_priv;
+
+	// Phasespace benchmark data
+	float *pha;
+} t_bench_state;
+
+/**
+ * @brief Kernel benchmark
+ *
+ */
+typedef struct BenchKernel {
+	const char* name;		///< Kernel name
+	const char* unit;		///< Work unit ("part" or "cell")
+	int particles;			///< Kernel uses particles (sweeps ppc)
+	int sorting;			///< Kernel sweeps sort frequency
+	int nvariant;			///< Number of kernel variants
+	const char* const* variant;	///< Variant names
+	void (*setup)( t_bench_state*, const t_bench_config* );
+	void (*run)( t_bench_state*, const t_bench_config* );
+	void (*cleanup)( t_bench_state*, const t_bench_config* );
+	double (*work)( const t_bench_state*, const t_bench_config* );	///< Work units per run
+	double bytes;			///< Minimum memory traffic per work unit (bytes)
+} t_bench_kernel;
+
+/// Cell size used by all benchmarks
+static const float bench_dx = 0.1f;
+
+/// Time step used by all benchmarks
+static const float bench_dt = 0.07f;
+
+/**
+ * @brief Simple 32 bit xorshift random number generator (uniform in [0,1[ )
+ *
+ * @param state 	Generator state (must not be zero)
+ * @return 			Random number
+ */
+static float bench_rand( uint32_t* state )
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return ( x >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+/*********************************************************************************************
+
+ Particle benchmarks
+
+ *********************************************************************************************/
+
+/**
+ * @brief Initializes fields, current and a thermal plasma species
+ *
+ * The kernel variant selects the particle shape (0 - linear, 1 - quadratic,
+ * 2 - cubic).
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void setup_plasma( t_bench_state* s, const t_bench_config* cfg )
+{
+	const float box = cfg -> nx * bench_dx;
+	const float uth[] = { 0.1f, 0.1f, 0.1f };
+	const int order = PART_SHAPE_LINEAR + cfg -> variant;
+
+	emf_new( &s -> emf, cfg -> nx, box, bench_dt, order );
+	current_new( &s -> current, cfg -> nx, box, bench_dt, order );
+	spec_new( &s -> spec, "electrons", -1.0f, cfg -> ppc, NULL, uth,
+		cfg -> nx, box, bench_dt, NULL );
+	spec_set_shape( &s -> spec, order );
+	s -> spec.n_sort = ( cfg -> nsort > 0 ) ? cfg -> nsort : 0;
+}
+
+/**
+ * @brief Frees data allocated by `setup_plasma()`
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void cleanup_plasma( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	spec_delete( &s -> spec );
+	current_delete( &s -> current );
+	emf_delete( &s -> emf );
+}
+
+/**
+ * @brief Number of particles
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ * @return 		Number of particles
+ */
+static double work_particles( const t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	return s -> spec.np;
+}
+
+/**
+ * @brief Number of cells
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ * @return 		Number of cells
+ */
+static double work_cells( const t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) s;
+	return cfg -> nx;
+}
+
+/**
+ * @brief Full particle advance (interpolation, push, deposit, sort every nsort steps)
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_advance( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	current_zero( &s -> current );
+	spec_advance( &s -> spec, &s -> emf, &s -> current );
+}
+
+/**
+ * @brief Particle sort, after nsort steps without sorting
+ *
+ * The particles are advanced outside the timed region, so the sort always
+ * starts from the disorder accumulated over nsort iterations.
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_sort( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	spec_sort( &s -> spec );
+}
+
+/**
+ * @brief Advances particles nsort steps without sorting, called before each `run_sort()`
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void disorder_sort( t_bench_state* s, const t_bench_config* cfg )
+{
+	s -> spec.n_sort = 0;
+	for( int i = 0; i < cfg -> nsort; i++ ) {
+		current_zero( &s -> current );
+		spec_advance( &s -> spec, &s -> emf, &s -> current );
+	}
+}
+
+/**
+ * @brief Phasespace deposit (x1, u1)
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_pha( t_bench_state* s, const t_bench_config* cfg )
+{
+	const int pha_nx[] = { 128, 128 };
+	const float pha_range[][2] = { { 0, cfg -> nx * bench_dx }, { -1, 1 } };
+
+	memset( s -> pha, 0, pha_nx[0] * pha_nx[1] * sizeof( float ) );
+	spec_deposit_pha( &s -> spec, PHASESPACE(X1,U1), pha_nx, pha_range, s -> pha );
+}
+
+/**
+ * @brief Initializes phasespace benchmark
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void setup_pha( t_bench_state* s, const t_bench_config* cfg )
+{
+	setup_plasma( s, cfg );
+	s -> pha = malloc( 128 * 128 * sizeof( float ) );
+}
+
+/**
+ * @brief Frees phasespace benchmark data
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void cleanup_pha( t_bench_state* s, const t_bench_config* cfg )
+{
+	free( s -> pha );
+	cleanup_plasma( s, cfg );
+}
+
+/*********************************************************************************************
+
+ Current deposition benchmark
+
+ *********************************************************************************************/
+
+/**
+ * @brief Initializes random particle trajectories and per thread current grids
+ *
+ * Each thread deposits its share of the trajectories on a private grid, so both
+ * deposition methods are compared without atomic operations.
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void setup_deposit( t_bench_state* s, const t_bench_config* cfg )
+{
+	const int np = cfg -> nx * cfg -> ppc;
+	s -> np = np;
+	s -> ix  = malloc( np * sizeof( int ) );
+	s -> di  = malloc( np * sizeof( int ) );
+	s -> x0  = malloc( np * sizeof( float ) );
+	s -> dx  = malloc( np * sizeof( float ) );
+	s -> qvy = malloc( np * sizeof( float ) );
+	s -> qvz = malloc( np * sizeof( float ) );
+
+	// Particles sorted by cell, moving at most half a cell
+	uint32_t state = 12345;
+	for( int i = 0; i < np; i++ ) {
+		s -> ix[i]  = 1 + (int)( ( (int64_t) i * ( cfg -> nx - 4 ) ) / np );
+		s -> x0[i]  = bench_rand( &state );
+		s -> dx[i]  = bench_rand( &state ) - 0.5f;
+		s -> di[i]  = (int) floorf( s -> x0[i] + s -> dx[i] );
+		s -> qvy[i] = 0.1f * ( bench_rand( &state ) - 0.5f );
+		s -> qvz[i] = 0.1f * ( bench_rand( &state ) - 0.5f );
+	}
+
+	s -> n_priv = omp_get_max_threads();
+	s -> priv = malloc( s -> n_priv * sizeof( t_current ) );
+	for( int i = 0; i < s -> n_priv; i++ )
+		current_new( &s -> priv[i], cfg -> nx, cfg -> nx * bench_dx, bench_dt, PART_SHAPE_LINEAR );
+}
+
+/**
+ * @brief Frees deposit benchmark data
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void cleanup_deposit( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	for( int i = 0; i < s -> n_priv; i++ ) current_delete( &s -> priv[i] );
+	free( s -> priv );
+	free( s -> ix ); free( s -> di ); free( s -> x0 );
+	free( s -> dx ); free( s -> qvy ); free( s -> qvz );
+}
+
+/**
+ * @brief Number of deposited trajectories
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ * @return 		Number of particles
+ */
+static double work_deposit( const t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	return s -> np;
+}
+
+/**
+ * @brief Current deposition, using `dep_current_zamb()` (variant 0) or `dep_current_esk()` (variant 1)
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_deposit( t_bench_state* s, const t_bench_config* cfg )
+{
+	const float qnx = 0.1f * bench_dx / bench_dt;
+	const int esk = ( cfg -> variant == 1 );
+
+	#pragma omp parallel
+	{
+		t_current* const current = &s -> priv[ omp_get_thread_num() ];
+
+		if ( esk ) {
+			#pragma omp for schedule(static)
+			for( int i = 0; i < s -> np; i++ ) {
+				dep_current_esk( s -> ix[i], s -> di[i], s -> x0[i],
+					s -> x0[i] + s -> dx[i] - s -> di[i],
+					qnx, s -> qvy[i], s -> qvz[i], current );
+			}
+		} else {
+			#pragma omp for schedule(static)
+			for( int i = 0; i < s -> np; i++ ) {
+				dep_current_zamb( s -> ix[i], s -> di[i], s -> x0[i], s -> dx[i],
+					qnx, s -> qvy[i], s -> qvz[i], current -> J, 0 );
+			}
+		}
+	}
+}
+
+/*********************************************************************************************
+
+ Grid benchmarks
+
+ *********************************************************************************************/
+
+/**
+ * @brief Initializes fields and current with random values
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void setup_grid( t_bench_state* s, const t_bench_config* cfg )
+{
+	const float box = cfg -> nx * bench_dx;
+	emf_new( &s -> emf, cfg -> nx, box, bench_dt, PART_SHAPE_LINEAR );
+	current_new( &s -> current, cfg -> nx, box, bench_dt, PART_SHAPE_LINEAR );
+
+	uint32_t state = 4321;
+	for( int i = 0; i < cfg -> nx; i++ ) {
+		s -> current.J[i] = (float3) { bench_rand( &state ), bench_rand( &state ), bench_rand( &state ) };
+		s -> emf.E[i] = (float3) { 1e-3f * bench_rand( &state ), 1e-3f * bench_rand( &state ), 0 };
+	}
+
+	s -> current.smooth = (t_smooth) { .xtype = COMPENSATED, .xlevel = 4 };
+}
+
+/**
+ * @brief Frees grid benchmark data
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void cleanup_grid( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	current_delete( &s -> current );
+	emf_delete( &s -> emf );
+}
+
+/**
+ * @brief Current smoothing (4 binomial passes + compensator), i.e. repeated `kernel_x()` calls
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_smooth( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	#pragma omp parallel
+	current_smooth( &s -> current );
+}
+
+/**
+ * @brief Field solver: B half step, E step and B half step, done in a single sweep
+ *
+ * @param s 	Benchmark state
+ * @param cfg 	Benchmark configuration
+ */
+static void run_yee( t_bench_state* s, const t_bench_config* cfg )
+{
+	(void) cfg;
+	emf_advance( &s -> emf, &s -> current );
+}
+
+/*********************************************************************************************
+
+ Driver
+
+ *********************************************************************************************/
+
+/// Current deposition variants
+static const char* const dep_variants[] = { "zamb", "esk" };
+
+/// Particle advance variants (particle shape)
+static const char* const adv_variants[] = { "advance", "advance_s2", "advance_s3" };
+
+/**
+ * @brief Available benchmarks
+ *
+ * Memory traffic models (per work unit):
+ * - advance: particle read + write
+ * - deposit: trajectory data read (2 int + 4 float)
+ * - sort: particle read + write, plus the cell index read
+ * - smooth: current read + write (filter passes are done in cache)
+ * - yee: E and B read + write, J read
+ * - pha: particle read
+ */
+static const t_bench_kernel bench_kernels[] = {
+	{ "advance", "part", 1, 1, 3, adv_variants, setup_plasma, run_advance, cleanup_plasma,
+		work_particles, 2 * sizeof( t_part ) },
+	{ "deposit", "part", 1, 0, 2, dep_variants, setup_deposit, run_deposit, cleanup_deposit,
+		work_deposit, 2 * sizeof( int ) + 4 * sizeof( float ) },
+	{ "sort", "part", 1, 1, 1, NULL, setup_plasma, run_sort, cleanup_plasma,
+		work_particles, 2 * sizeof( t_part ) + sizeof( int ) },
+	{ "smooth", "cell", 0, 0, 1, NULL, setup_grid, run_smooth, cleanup_grid,
+		work_cells, 2 * sizeof( float3 ) },
+	{ "yee", "cell", 0, 0, 1, NULL, setup_grid, run_yee, cleanup_grid,
+		work_cells, 5 * sizeof( float3 ) },
+	{ "pha", "part", 1, 0, 1, NULL, setup_pha, run_pha, cleanup_pha,
+		work_particles, sizeof( t_part ) },
+};
+
+/// Number of available benchmarks
+static const int n_bench_kernels = sizeof( bench_kernels ) / sizeof( bench_kernels[0] );
+
+/**
+ * @brief Times a kernel using the current number of threads
+ *
+ * The kernel is run once (warm up) and then repeatedly until the total time
+ * exceeds `min_time`. The sort benchmark is limited to SORT_MAX_RUN runs,
+ * since each run requires advancing the particles nsort steps.
+ *
+ * @param k 		Kernel
+ * @param s 		Benchmark state
+ * @param cfg 		Benchmark configuration
+ * @param min_time 	Minimum run time (seconds)
+ * @return 			Time per run (seconds)
+ */
+static double bench_time( const t_bench_kernel* k, t_bench_state* s,
+	const t_bench_config* cfg, double min_time )
+{
+	const int sort = ( k -> run == run_sort );
+
+	if ( sort ) disorder_sort( s, cfg );
+	k -> run( s, cfg );
+
+	double t = 0;
+	int nrun = 0;
+	do {
+		if ( sort ) disorder_sort( s, cfg );
+		const uint64_t t0 = timer_ticks();
+		k -> run( s, cfg );
+		t += timer_interval_seconds( t0, timer_ticks() );
+		nrun++;
+	} while ( t < min_time && ! ( sort && nrun >= SORT_MAX_RUN ) );
+
+	return t / nrun;
+}
+
+/**
+ * @brief Runs a kernel benchmark over all thread counts and prints the results
+ *
+ * @param k 		Kernel
+ * @param cfg 		Benchmark configuration
+ * @param sweep 	Parameter sweep
+ */
+static void bench_config( const t_bench_kernel* k, const t_bench_config* cfg,
+	const t_bench_sweep* sweep )
+{
+	t_bench_state s;
+	memset( &s, 0, sizeof( s ) );
+	k -> setup( &s, cfg );
+
+	const char* name = ( k -> variant ) ? k -> variant[ cfg -> variant ] : k -> name;
+	double t1 = 0;
+
+	for( int it = 0; it < sweep -> n_nthreads; it++ ) {
+		const int nt = sweep -> nthreads[it];
+		omp_set_num_threads( nt );
+
+		const double t = bench_time( k, &s, cfg, sweep -> min_time );
+		const double work = k -> work( &s, cfg );
+		if ( it == 0 ) t1 = t * nt;
+
+		const double ns = 1.e9 * t / work;
+		const double gbs = 1.e-9 * k -> bytes * work / t;
+		const double eff = 100 * t1 / ( t * nt );
+
+		char nsort[16] = "-";
+		if ( cfg -> nsort >= 0 ) snprintf( nsort, sizeof( nsort ), "%d", cfg -> nsort );
+		printf( "%-8s %-6s %8d %6d %6s %8d %12.3f %10.3f %9.1f%%\n", k -> name, name,
+			cfg -> nx, cfg -> ppc, nsort, nt, ns, gbs, eff );
+		fflush( stdout );
+
+		if ( sweep -> csv ) {
+			fprintf( sweep -> csv, "%s,%s,%d,%d,%d,%d,%s,%.6f,%.6f,%.3f\n", k -> name, name,
+				cfg -> nx, cfg -> ppc, cfg -> nsort, nt, k -> unit, ns, gbs, eff );
+		}
+	}
+
+	k -> cleanup( &s, cfg );
+}
+
+/**
+ * @brief Runs a kernel benchmark over the complete parameter sweep
+ *
+ * @param k 		Kernel
+ * @param sweep 	Parameter sweep
+ */
+static void bench_run( const t_bench_kernel* k, const t_bench_sweep* sweep )
+{
+	const int n_ppc = k -> particles ? sweep -> n_ppc : 1;
+	const int n_nsort = k -> sorting ? sweep -> n_nsort : 1;
+
+	for( int v = 0; v < k -> nvariant; v++ ) {
+		for( int i = 0; i < sweep -> n_nx; i++ ) {
+			for( int j = 0; j < n_ppc; j++ ) {
+				for( int l = 0; l < n_nsort; l++ ) {
+					t_bench_config cfg = {
+						.nx = sweep -> nx[i],
+						.ppc = k -> particles ? sweep -> ppc[j] : 0,
+						.nsort = k -> sorting ? sweep -> nsort[l] : -1,
+						.variant = v
+					};
+
+					// Sorting after 0 steps is meaningless
+					if ( k -> run == run_sort && cfg.nsort < 1 ) continue;
+
+					bench_config( k, &cfg, sweep );
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Prints usage information
+ *
+ * @param prog 	Program name
+ */
+static void usage( const char* prog )
+{
+	fprintf( stderr, "Usage: %s [-q] [-t min_time] [-o file.csv] [kernel ...]\n", prog );
+	fprintf( stderr, "Kernels:" );
+	for( int k = 0; k < n_bench_kernels; k++ ) fprintf( stderr, " %s", bench_kernels[k].name );
+	fprintf( stderr, "\n" );
+}
+
+int main( int argc, const char* argv[] )
+{
+	t_bench_sweep sweep = {
+		.nx = { 1024, 16384, 131072 }, .n_nx = 3,
+		.ppc = { 16, 128 }, .n_ppc = 2,
+		.nsort = { 0, 4, 16, 64 }, .n_nsort = 4,
+		.min_time = 0.2,
+		.csv = NULL
+	};
+
+	int run[ sizeof( bench_kernels ) / sizeof( bench_kernels[0] ) ] = {0};
+	int nrun = 0;
+
+	for( int i = 1; i < argc; i++ ) {
+		if ( ! strcmp( argv[i], "-q" ) ) {
+			sweep.nx[0] = 4096; sweep.n_nx = 1;
+			sweep.ppc[0] = 32; sweep.n_ppc = 1;
+			sweep.nsort[0] = 0; sweep.nsort[1] = 16; sweep.n_nsort = 2;
+			sweep.min_time = 0.05;
+		} else if ( ! strcmp( argv[i], "-t" ) && i + 1 < argc ) {
+			sweep.min_time = atof( argv[++i] );
+		} else if ( ! strcmp( argv[i], "-o" ) && i + 1 < argc ) {
+			sweep.csv = fopen( argv[++i], "w" );
+			if ( ! sweep.csv ) {
+				fprintf( stderr, "(*error*) Unable to open %s\n", argv[i] );
+				return 1;
+			}
+			fprintf( sweep.csv, "kernel,variant,nx,ppc,nsort,threads,unit,ns_per_unit,gb_per_s,efficiency\n" );
+		} else {
+			int k;
+			for( k = 0; k < n_bench_kernels; k++ ) {
+				if ( ! strcmp( argv[i], bench_kernels[k].name ) ) break;
+			}
+			if ( k == n_bench_kernels ) {
+				usage( argv[0] );
+				return 1;
+			}
+			run[k] = 1; nrun++;
+		}
+	}
+
+	// Thread counts: powers of 2 up to the maximum number of threads
+	const int max_threads = omp_get_max_threads();
+	sweep.n_nthreads = 0;
+	for( int nt = 1; nt < max_threads && sweep.n_nthreads < MAX_SWEEP - 1; nt *= 2 )
+		sweep.nthreads[ sweep.n_nthreads++ ] = nt;
+	sweep.nthreads[ sweep.n_nthreads++ ] = max_threads;
+
+	printf( "ZPIC kernel benchmarks (timer resolution %g s, up to %d threads)\n\n",
+		timer_resolution(), max_threads );
+	printf( "%-8s %-6s %8s %6s %6s %8s %12s %10s %10s\n", "Kernel", "Var.",
+		"nx", "ppc", "nsort", "threads", "ns/unit", "GB/s", "Eff." );
+
+	for( int k = 0; k < n_bench_kernels; k++ ) {
+		if ( nrun == 0 || run[k] ) bench_run( &bench_kernels[k], &sweep );
+	}
+
+	if ( sweep.csv ) fclose( sweep.csv );
+
+	return 0;
+}
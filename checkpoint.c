@@ -0,0 +1,349 @@
+/**
+ * @file checkpoint.c
+ * @author Ricardo Fonseca
+ * @brief Checkpoint / restart files
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Checkpoint files are regular ZDF files, holding one chunked dataset for
+ * each buffer of the simulation state. Each domain writes the chunk of the
+ * global arrays it owns into its own file, so all domains write in parallel;
+ * restart maps the file into memory (a single large read done by the OS)
+ * and copies the buffers directly from the mapped file.
+ *
+ * The same files are used to store reference states for bitwise comparisons
+ * of the simulation state, see `checkpoint_compare()`.
+ */
+
+#include "checkpoint.h"
+#include "domain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#define mkdir(path,mode) _mkdir(path)
+#endif
+
+/// Name of the checkpoint file being written
+static char _name[256];
+
+/// Name of the temporary file being written
+static char _tmp_name[264];
+
+/**
+ * @brief Gets the name of the checkpoint file of the local domain
+ *
+ * @param name 	(out) File name
+ * @param size 	Size of name buffer
+ * @param path 	Checkpoint directory
+ */
+static void checkpoint_name( char* name, size_t size, const char* path )
+{
+	snprintf( name, size, "%s/checkpoint-%04d.zdf", path, domain_rank() );
+}
+
+/**
+ * @brief Creates the checkpoint file of the local domain
+ *
+ * Data is written to a temporary file, `<path>/checkpoint-<rank>.zdf.tmp`,
+ * that replaces the previous checkpoint in `checkpoint_close()`.
+ *
+ * @param zdf 		ZDF file handle
+ * @param path 		Checkpoint directory (created if needed)
+ * @param iter 		Iteration information
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_open( t_zdf_file* zdf, const char* path, const t_zdf_iteration* iter )
+{
+	if ( mkdir( path, S_IRWXU | (S_IRGRP | S_IXGRP ) | (S_IROTH | S_IXOTH) ) && errno != EEXIST ) {
+		perror("(*error*) Unable to create checkpoint directory");
+		return 0;
+	}
+
+	checkpoint_name( _name, sizeof( _name ), path );
+	snprintf( _tmp_name, sizeof( _tmp_name ), "%s.tmp", _name );
+
+	if ( ! zdf_open_file( zdf, _tmp_name, ZDF_CREATE ) ) return 0;
+	if ( ! zdf_add_string( zdf, "TYPE", "checkpoint" ) ) return 0;
+	if ( ! zdf_add_iteration( zdf, iter ) ) return 0;
+
+	return 1;
+}
+
+/**
+ * @brief Closes the checkpoint file, replacing the previous checkpoint
+ *
+ * @param zdf 		ZDF file handle
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_close( t_zdf_file* zdf )
+{
+	if ( ! zdf_close_file( zdf ) ) return 0;
+
+	if ( rename( _tmp_name, _name ) ) {
+		perror("(*error*) Unable to replace checkpoint file");
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Maps the checkpoint file of the local domain into memory
+ *
+ * @param map 		Mapped file object, must be closed with `zdf_map_close()`
+ * @param path 		Checkpoint directory
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_map( t_zdf_map* map, const char* path )
+{
+	char name[256];
+	checkpoint_name( name, sizeof( name ), path );
+
+	return zdf_map_open( map, name );
+}
+
+/**
+ * @brief Writes a checkpoint dataset
+ *
+ * The local data is stored as the single chunk of a chunked dataset.
+ *
+ * @param zdf 		ZDF file handle
+ * @param name 		Dataset name
+ * @param type 		Data type
+ * @param data 		Local data
+ * @param count 	Number of local values
+ * @param start 	Global position of the first local value
+ * @param total 	Number of values in the global array
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_write( t_zdf_file* zdf, const char* name, enum zdf_data_type type,
+	const void* data, uint64_t count, uint64_t start, uint64_t total )
+{
+	t_zdf_dataset dataset = {
+		.name = (char *) name,
+		.data_type = type,
+		.ndims = 1,
+		.count = { total }
+	};
+
+	t_zdf_chunk chunk = {
+		.count = { count },
+		.start = { start },
+		.stride = { 1 },
+		.data = (void *) data
+	};
+
+	if ( ! zdf_start_cdset( zdf, &dataset ) ) return 0;
+	if ( count > 0 && ! zdf_write_cdset( zdf, &dataset, &chunk ) ) return 0;
+	if ( ! zdf_end_cdset( zdf, &dataset ) ) return 0;
+
+	return 1;
+}
+
+/**
+ * @brief Gets a checkpoint dataset from a mapped checkpoint file
+ *
+ * The routine aborts the code if the dataset is not found, or if the data
+ * type or number of values do not match.
+ *
+ * @param map 		Mapped checkpoint file
+ * @param name 		Dataset name
+ * @param type 		Data type
+ * @param count 	Number of local values
+ * @return 			Pointer to the data in the mapped file, NULL if count is 0
+ */
+const void* checkpoint_read( const t_zdf_map* map, const char* name, enum zdf_data_type type,
+	uint64_t count )
+{
+	t_zdf_dataset dataset = { .name = (char *) name };
+
+	if ( ! zdf_map_dataset( map, &dataset ) ) {
+		fprintf(stderr, "(*error*) Invalid checkpoint file, aborting.\n" );
+		exit(-1);
+	}
+
+	if ( dataset.data_type != type || dataset.ndims != 1 ) {
+		fprintf(stderr, "(*error*) Invalid type for checkpoint dataset %s, aborting.\n", name );
+		exit(-1);
+	}
+
+	if ( count == 0 ) return NULL;
+
+	t_zdf_chunk chunk;
+	if ( zdf_map_nchunks( map, &dataset ) != 1 || ! zdf_map_chunk( map, &dataset, 0, &chunk ) ||
+		 chunk.count[0] != count ) {
+		fprintf(stderr, "(*error*) Invalid size for checkpoint dataset %s (expected %llu values), aborting.\n",
+			name, (unsigned long long) count );
+		exit(-1);
+	}
+
+	return chunk.data;
+}
+
+/**
+ * @brief Gets the values of a checkpoint dataset
+ *
+ * @param map 		Mapped checkpoint file
+ * @param dataset 	(out) Dataset, `name` must be set
+ * @param count 	(out) Number of local values
+ * @return 			Pointer to the data in the mapped file, NULL if the dataset
+ * 					was not found or holds no local values
+ */
+static const void* checkpoint_values( const t_zdf_map* map, t_zdf_dataset* dataset, uint64_t* count )
+{
+	*count = 0;
+	if ( ! zdf_map_dataset( map, dataset ) || dataset -> ndims != 1 ) return NULL;
+
+	t_zdf_chunk chunk;
+	if ( zdf_map_nchunks( map, dataset ) != 1 || ! zdf_map_chunk( map, dataset, 0, &chunk ) ) return NULL;
+
+	*count = chunk.count[0];
+	return chunk.data;
+}
+
+/**
+ * @brief Converts a value of a checkpoint dataset to double precision
+ *
+ * @param data 	Dataset values
+ * @param type 	Data type
+ * @param i 	Value index
+ * @return 		Value
+ */
+static double checkpoint_value( const void* data, enum zdf_data_type type, uint64_t i )
+{
+	switch( type ) {
+	case zdf_int8:    return ( (const int8_t *) data )[i];
+	case zdf_uint8:   return ( (const uint8_t *) data )[i];
+	case zdf_int16:   return ( (const int16_t *) data )[i];
+	case zdf_uint16:  return ( (const uint16_t *) data )[i];
+	case zdf_int32:   return ( (const int32_t *) data )[i];
+	case zdf_uint32:  return ( (const uint32_t *) data )[i];
+	case zdf_int64:   return ( (const int64_t *) data )[i];
+	case zdf_uint64:  return ( (const uint64_t *) data )[i];
+	case zdf_float32: return ( (const float *) data )[i];
+	case zdf_float64: return ( (const double *) data )[i];
+	default:          return 0;
+	}
+}
+
+/**
+ * @brief Gets the first record of the dataset a record belongs to
+ *
+ * @param map 	Mapped checkpoint file
+ * @param r 	Record index
+ * @return 		Index of the first record with the same dataset id, or
+ * 				`map -> nrecords` if the record does not belong to a dataset
+ */
+static uint32_t checkpoint_dataset_record( const t_zdf_map* map, uint32_t r )
+{
+	const uint32_t id = map -> records[r].dataset_id;
+	if ( id == 0 ) return map -> nrecords;
+
+	uint32_t first = 0;
+	while( map -> records[first].dataset_id != id ) first++;
+	return first;
+}
+
+/**
+ * @brief Checks if a mapped checkpoint file holds a dataset
+ *
+ * Unlike `zdf_map_dataset()` no error is reported if the dataset is missing.
+ *
+ * @param map 	Mapped checkpoint file
+ * @param name 	Dataset name
+ * @return 		1 if the dataset was found, 0 otherwise
+ */
+static int checkpoint_find( const t_zdf_map* map, const char* name )
+{
+	for( uint32_t r = 0; r < map -> nrecords; r++ ) {
+		if ( checkpoint_dataset_record( map, r ) == r && map -> records[r].name &&
+			 ! strcmp( map -> records[r].name, name ) ) return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Compares two checkpoint files, value by value
+ *
+ * Every dataset of the candidate file is compared bitwise with the dataset
+ * of the same name in the reference file, and any difference is reported.
+ *
+ * @param ref 		Mapped reference file
+ * @param cand 		Mapped candidate file
+ * @param fp 		File to report differences to
+ * @return 			Number of datasets that differ
+ */
+int checkpoint_compare( const t_zdf_map* ref, const t_zdf_map* cand, FILE* fp )
+{
+	int ndiff = 0;
+
+	for( uint32_t r = 0; r < cand -> nrecords; r++ ) {
+
+		// Only the first record of each dataset is visited, skipping file
+		// metadata (no dataset id) and chunk records
+		if ( checkpoint_dataset_record( cand, r ) != r ) continue;
+
+		const char* name = cand -> records[r].name;
+		t_zdf_dataset dc = { .name = (char *) name };
+		if ( ! zdf_map_dataset( cand, &dc ) ) continue;
+
+		char label[16] = "";
+		if ( domain_size() > 1 ) snprintf( label, sizeof( label ), "[%d] ", domain_rank() );
+
+		t_zdf_dataset dr = { .name = (char *) name };
+		if ( ! checkpoint_find( ref, name ) || ! zdf_map_dataset( ref, &dr ) ) {
+			fprintf( fp, "  %s%s: missing from reference\n", label, name );
+			ndiff++;
+			continue;
+		}
+
+		uint64_t nr, nc;
+		const unsigned char* vr = checkpoint_values( ref, &dr, &nr );
+		const unsigned char* vc = checkpoint_values( cand, &dc, &nc );
+
+		if ( dr.data_type != dc.data_type ) {
+			fprintf( fp, "  %s%s: data type differs\n", label, name );
+			ndiff++;
+			continue;
+		}
+
+		if ( nr != nc ) {
+			fprintf( fp, "  %s%s: number of values differs (reference %llu, candidate %llu)\n",
+				label, name, (unsigned long long) nr, (unsigned long long) nc );
+			ndiff++;
+			continue;
+		}
+
+		// Bitwise comparison of each value
+		const size_t size = zdf_sizeof( dc.data_type );
+		uint64_t n = 0, first = 0;
+		double max_diff = 0;
+		for( uint64_t i = 0; i < nc; i++ ) {
+			if ( memcmp( vr + i * size, vc + i * size, size ) ) {
+				if ( n++ == 0 ) first = i;
+				const double d = fabs( checkpoint_value( vr, dr.data_type, i ) -
+				                       checkpoint_value( vc, dc.data_type, i ) );
+				if ( d > max_diff || isnan( d ) ) max_diff = d;
+			}
+		}
+
+		if ( n > 0 ) {
+			fprintf( fp, "  %s%s: %llu of %llu values differ (first at %llu, maximum difference %g)\n",
+				label, name, (unsigned long long) n, (unsigned long long) nc,
+				(unsigned long long) first, max_diff );
+			ndiff++;
+		}
+	}
+
+	return ndiff;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file checkpoint.h
+ * @author Ricardo Fonseca
+ * @brief Checkpoint / restart files
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __CHECKPOINT__
+#define __CHECKPOINT__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "zdf.h"
+
+/// Directory holding the checkpoint files
+#define CHECKPOINT_PATH "CHECKPOINT"
+
+/// Directory holding the reference state files for bitwise comparisons
+#define CHECKPOINT_REF_PATH "REFERENCE"
+
+/// Directory holding the candidate state files for bitwise comparisons
+#define CHECKPOINT_CAND_PATH "CANDIDATE"
+
+/**
+ * @brief Creates the checkpoint file of the local domain
+ *
+ * Each domain (MPI process) writes its own file, `<path>/checkpoint-<rank>.zdf`.
+ * Data is written to a temporary file that only replaces the previous
+ * checkpoint in `checkpoint_close()`, so that an interrupted write never
+ * destroys the last valid checkpoint.
+ *
+ * @param zdf 		ZDF file handle
+ * @param path 		Checkpoint directory, e.g. CHECKPOINT_PATH (created if needed)
+ * @param iter 		Iteration information
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_open( t_zdf_file* zdf, const char* path, const t_zdf_iteration* iter );
+
+/**
+ * @brief Closes the checkpoint file, replacing the previous checkpoint
+ *
+ * @param zdf 		ZDF file handle
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_close( t_zdf_file* zdf );
+
+/**
+ * @brief Maps the checkpoint file of the local domain into memory
+ *
+ * @param map 		Mapped file object, must be closed with `zdf_map_close()`
+ * @param path 		Checkpoint directory
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_map( t_zdf_map* map, const char* path );
+
+/**
+ * @brief Writes a checkpoint dataset
+ *
+ * Data is stored as a chunked dataset holding a single chunk, the local part
+ * of a global array of `total` values starting at position `start`.
+ *
+ * @param zdf 		ZDF file handle
+ * @param name 		Dataset name
+ * @param type 		Data type
+ * @param data 		Local data
+ * @param count 	Number of local values
+ * @param start 	Global position of the first local value
+ * @param total 	Number of values in the global array
+ * @return 			Returns 1 on success, 0 on error
+ */
+int checkpoint_write( t_zdf_file* zdf, const char* name, enum zdf_data_type type,
+	const void* data, uint64_t count, uint64_t start, uint64_t total );
+
+/**
+ * @brief Gets a checkpoint dataset from a mapped checkpoint file
+ *
+ * The routine aborts the code if the dataset is not found, or if the data
+ * type or number of values do not match.
+ *
+ * @param map 		Mapped checkpoint file
+ * @param name 		Dataset name
+ * @param type 		Data type
+ * @param count 	Number of local values
+ * @return 			Pointer to the data in the mapped file (aligned to at least 4
+ * 					bytes), valid until the file is closed
+ */
+const void* checkpoint_read( const t_zdf_map* map, const char* name, enum zdf_data_type type,
+	uint64_t count );
+
+/**
+ * @brief Compares two checkpoint files, value by value
+ *
+ * Every dataset of the candidate file is compared bitwise with the dataset
+ * of the same name in the reference file. Datasets that are missing, have
+ * a different type or number of values, or hold any value that is not
+ * bitwise identical are reported (with the number of values that differ,
+ * the first one and the maximum difference).
+ *
+ * @param ref 		Mapped reference file
+ * @param cand 		Mapped candidate file
+ * @param fp 		File to report differences to
+ * @return 			Number of datasets that differ
+ */
+int checkpoint_compare( const t_zdf_map* ref, const t_zdf_map* cand, FILE* fp );
+
+#endif
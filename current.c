@@ -14,33 +14,56 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <omp.h>
 
 #include "zdf.h"
+#include "timer.h"
+#include "domain.h"
+#include "arena.h"
+#include "checkpoint.h"
 
+/// Number of cells filtered at a time by current_smooth()
+#define SMOOTH_BLOCK 1024
 
 void current_smooth( t_current* const current );
 
 /**
  * @brief Initializes Electric current density object
  * 
+ * When using domain decomposition only the cells of the local domain are
+ * allocated, see `domain_decompose()`; `nx` and `box` refer to the global
+ * grid.
+ * 
  * @param current   Electric current density
- * @param nx        Number of grid cells
+ * @param nx        Number of grid cells (global)
  * @param box       Physical box size
  * @param dt        Simulation time step
+ * @param order     Highest particle shape order in use (sets the number of guard cells)
  */
-void current_new( t_current *current, int nx, float box, float dt )
+void current_new( t_current *current, int nx, float box, float dt, const int order )
 {
-    // Number of guard cells for linear interpolation
-    int gc[2] = {1,2}; 
+    // Number of guard cells for linear / higher order deposition
+    int gc[2] = { order > 1 ? 2 : 1, order > 1 ? 3 : 2 };
     
+    // Set cell sizes and box limits
+    current -> box = box;
+    current -> dx  = box / nx;
+
+    // Local domain
+    domain_decompose( nx, &nx, &current -> domain_ix0 );
+
     // Allocate global array
     size_t size;
     
     size = gc[0] + nx + gc[1];
     
-    current->J_buf = malloc( size * sizeof( float3 ) );
+    current->J_buf = arena_malloc( size * sizeof( float3 ) );
     assert( current->J_buf );
 
+    // Zero in parallel so that memory is placed close to the threads that
+    // will use it (first touch)
+    arena_touch( current->J_buf, size * sizeof( float3 ) );
+
     // store nx and gc values
     current->nx = nx;
     current->gc[0] = gc[0];
@@ -48,10 +71,6 @@ void current_new( t_current *current, int nx, float box, float dt )
     
     // Make J point to cell [0]
     current->J = current->J_buf + gc[0];
-    
-    // Set cell sizes and box limits
-    current -> box = box;
-    current -> dx  = box / nx;
 
     // Clear smoothing options
     current -> smooth = (t_smooth) {
@@ -66,6 +85,17 @@ void current_new( t_current *current, int nx, float box, float dt )
     // Default to periodic boundaries
     current -> bc_type = CURRENT_BC_PERIODIC;
 
+    // Default to atomic deposition on the shared grid
+    current -> dep_type = CURRENT_DEP_ATOMIC;
+    current -> J_priv = NULL;
+    current -> n_priv = 0;
+    current -> priv_stride = 0;
+
+    // Smoothing buffers are allocated on first use
+    current -> J_tmp_buf = NULL;
+    current -> smooth_buf = NULL;
+    current -> smooth_buf_size = 0;
+
     // Zero initial current
     // This is only relevant for diagnostics, current is always zeroed before deposition
     current_zero( current );
@@ -79,15 +109,144 @@ void current_new( t_current *current, int nx, float box, float dt )
  */
 void current_delete( t_current *current )
 {
-    free( current->J_buf );
+    arena_free( current->J_buf );
+    arena_free( current->J_priv );
+    free( current->J_tmp_buf );
+    free( current->smooth_buf );
     
     current->J_buf = NULL;
+    current->J_priv = NULL;
+    current->J_tmp_buf = NULL;
+    current->smooth_buf = NULL;
     
 }
 
+/**
+ * @brief Sets the current deposition type
+ * 
+ * When using private deposition one full copy of the current grid (including
+ * guard cells) is allocated for each of the available OpenMP threads. Buffer
+ * starts are padded to a multiple of 16 cells (3 cache lines) to avoid false
+ * sharing between threads.
+ * 
+ * @param current   Electric current density
+ * @param dep_type  Type of current deposition
+ */
+void current_set_deposit( t_current *current, enum current_deposit dep_type )
+{
+    arena_free( current -> J_priv );
+    current -> J_priv = NULL;
+    current -> n_priv = 0;
+    current -> priv_stride = 0;
+
+    current -> dep_type = dep_type;
+
+    if ( dep_type == CURRENT_DEP_PRIVATE ) {
+        const int size = current->gc[0] + current->nx + current->gc[1];
+
+        current -> n_priv = omp_get_max_threads();
+        current -> priv_stride = ( ( size + 15 ) / 16 ) * 16;
+
+        // Buffers must start zeroed, they are cleared again by current_reduce()
+        current -> J_priv = arena_malloc( (size_t) current -> n_priv * current -> priv_stride *
+            sizeof( float3 ) );
+        assert( current -> J_priv );
+
+        // Each buffer is zeroed by the thread that uses it (first touch)
+        #pragma omp parallel num_threads( current -> n_priv )
+        for( int tid = omp_get_thread_num(); tid < current -> n_priv; tid += omp_get_num_threads() )
+            memset( current -> J_priv + (size_t) tid * current -> priv_stride, 0,
+                current -> priv_stride * sizeof( float3 ) );
+    }
+}
+
+/**
+ * @brief Gets the current density grid to be used by a given thread
+ * 
+ * For atomic deposition this is always the shared grid, for private deposition
+ * this is the private buffer of the thread.
+ * 
+ * @param current   Electric current density
+ * @param tid       Thread id
+ * @return          Pointer to grid cell 0 of the current density grid
+ */
+float3* current_dep_grid( t_current *current, int tid )
+{
+    if ( current -> dep_type == CURRENT_DEP_PRIVATE ) {
+        assert( tid < current -> n_priv );
+        return current -> J_priv + (size_t) tid * current -> priv_stride + current -> gc[0];
+    }
+
+    return current -> J;
+}
+
+/**
+ * @brief Adds the private current buffers into the shared current density
+ * 
+ * The grid is split into chunks that are processed in parallel; each thread
+ * adds all the private buffers for its chunks and clears them for the next
+ * deposition. Does nothing if private deposition is not in use.
+ * 
+ * Must be called by all threads of the current parallel region (or outside
+ * of a parallel region, in which case it runs serially).
+ * 
+ * @param current   Electric current density
+ */
+static void current_reduce_omp( t_current *current )
+{
+    if ( current -> dep_type != CURRENT_DEP_PRIVATE ) return;
+
+    const int size   = current->gc[0] + current->nx + current->gc[1];
+    const int n_priv = current -> n_priv;
+    const int stride = current -> priv_stride;
+    const int chunk  = 256;
+
+    float3* restrict const J = current -> J_buf;
+    float3* restrict const J_priv = current -> J_priv;
+
+    #pragma omp for schedule(static)
+    for (int i0 = 0; i0 < size; i0 += chunk) {
+        const int i1 = ( i0 + chunk < size ) ? i0 + chunk : size;
+
+        for (int t = 0; t < n_priv; t++) {
+            float3* restrict const Jt = J_priv + (size_t) t * stride;
+            for (int i = i0; i < i1; i++) {
+                J[i].x += Jt[i].x;
+                J[i].y += Jt[i].y;
+                J[i].z += Jt[i].z;
+
+                Jt[i].x = Jt[i].y = Jt[i].z = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Adds the private current buffers into the shared current density
+ * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
+ * @param current   Electric current density
+ */
+void current_reduce( t_current *current )
+{
+    if ( current -> dep_type != CURRENT_DEP_PRIVATE ) return;
+
+    if ( omp_in_parallel() ) {
+        current_reduce_omp( current );
+    } else {
+        #pragma omp parallel
+        current_reduce_omp( current );
+    }
+}
+
 /**
  * @brief Sets all electric current density values to zero
  * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region.
+ * 
  * @param current   Electric current density
  */
 void current_zero( t_current *current )
@@ -96,7 +255,13 @@ void current_zero( t_current *current )
     size_t size;
     
     size = (current->gc[0] + current->nx + current->gc[1]) * sizeof( float3 );
-    memset( current->J_buf, 0, size );
+
+    if ( omp_in_parallel() ) {
+        #pragma omp single
+        memset( current->J_buf, 0, size );
+    } else {
+        memset( current->J_buf, 0, size );
+    }
     
 }
 
@@ -107,10 +272,21 @@ void current_zero( t_current *current )
  * the upper guard cells will be added to the corresponding lower grid
  * cells, and the values then copied to the upper grid cells
  * 
+ * When using domain decomposition the current in the guard cells is added
+ * to the corresponding cells of the neighbouring domains, and the guard
+ * cells are then copied from them.
+ * 
  * @param current Electric current density
  */
 void current_update_gc( t_current *current )
 {
+    if ( domain_size() > 1 ) {
+        const int periodic = ( current -> bc_type == CURRENT_BC_PERIODIC );
+        domain_halo_add( (float *) current -> J, 3, current -> nx, current -> gc, periodic );
+        domain_halo( (float *) current -> J, 3, current -> nx, current -> gc, periodic );
+        return;
+    }
+
     if ( current -> bc_type == CURRENT_BC_PERIODIC ) {
         float3* restrict const J = current -> J;
         const int nx = current -> nx;
@@ -134,27 +310,63 @@ void current_update_gc( t_current *current )
 /**
  * @brief Advances electric current density 1 time step
  * 
- * The routine will:
- * 1. Update the guard cells
- * 2. Apply digitial filtering (if configured)
- * 3. Advance iteration number
+ * Must be called by all threads of the current parallel region,
+ * see `current_update()`
  * 
  * @param current Electric current density
  */
-void current_update( t_current *current )
+static void current_update_omp( t_current *current )
 {
-    
+    // Add private current buffers
+    uint64_t t0 = timer_ticks();
+    current_reduce_omp( current );
+    timer_phase_add( TIMER_DEP_REDUCE, timer_ticks() - t0 );
+
     // Boundary conditions / guard cells
-    current_update_gc( current );
+    #pragma omp single
+    {
+        t0 = timer_ticks();
+        current_update_gc( current );
+        timer_phase_add( TIMER_CURRENT_GC, timer_ticks() - t0 );
+    }
 
     // Smoothing
-    current_smooth( current );
+    if ( current -> smooth.xtype != NONE ) {
+        t0 = timer_ticks();
+        current_smooth( current );
+        timer_phase_add( TIMER_SMOOTH, timer_ticks() - t0 );
+    }
 
     // Advance iteration number
+    #pragma omp single
     current -> iter++;
     
 }
 
+/**
+ * @brief Advances electric current density 1 time step
+ * 
+ * The routine will:
+ * 1. Add private current buffers (if configured)
+ * 2. Update the guard cells
+ * 3. Apply digitial filtering (if configured)
+ * 4. Advance iteration number
+ * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
+ * @param current Electric current density
+ */
+void current_update( t_current *current )
+{
+    if ( omp_in_parallel() ) {
+        current_update_omp( current );
+    } else {
+        #pragma omp parallel
+        current_update_omp( current );
+    }
+}
+
 /**
  * @brief Saves electric current density diagnostic information to disk
  * 
@@ -193,6 +405,13 @@ void current_report( const t_current *current, const int jc )
             break;
     }
 
+    // Gather data from all domains, only the root domain saves the data
+    float* gbuf = NULL;
+    if ( domain_size() > 1 ) {
+        gbuf = domain_gather( buf, current->nx, NULL );
+        if ( ! gbuf ) return;
+    }
+
 	char vfname[16];	// Dataset name
 	char vflabel[16];	// Dataset label (for plots)
 
@@ -217,7 +436,7 @@ void current_report( const t_current *current, const int jc )
         .axis = axis
     };
 
-    info.count[0] = current->nx;
+    info.count[0] = gbuf ? domain_nx() : current->nx;
 
     t_zdf_iteration iter = {
         .name = "ITERATION",
@@ -226,7 +445,8 @@ void current_report( const t_current *current, const int jc )
         .time_units = "1/\\omega_p"
     };
 
-    zdf_save_grid( (void *) buf, zdf_float32, &info, &iter, "CURRENT" );
+    zdf_save_grid( gbuf ? gbuf : buf, zdf_float32, &info, &iter, "CURRENT" );
+    free( gbuf );
 }
 
 /**
@@ -255,64 +475,112 @@ void get_smooth_comp( int n, float* sa, float* sb) {
 /**
  * @brief Applies a 3 point kernel convolution along x
  * 
- * The kernel has the form [a,b,a]. The routine accounts for periodic
- * boundaries.
+ * The kernel has the form [a,b,a]. Cells [i0, i1[ of `dst` are calculated
+ * from cells [i0-1, i1] of `src`.
  * 
- * @param current 
- * @param sa kernel a value
- * @param sb kernel b value
+ * @param src   Source values
+ * @param dst   Destination values
+ * @param i0    First cell to calculate
+ * @param i1    Last cell to calculate + 1
+ * @param sa    kernel a value
+ * @param sb    kernel b value
  */
-void kernel_x( t_current* const current, const float sa, const float sb )
+static inline void kernel_x( const float3* restrict const src, float3* restrict const dst,
+    const int i0, const int i1, const float sa, const float sb )
 {
-    const int nx  = current->nx;
-    const int gc0 = current->gc[0];
-    const int gc1 = current->gc[1];
-    const int total = gc0 + nx + gc1;
-
-    float3* restrict J = current->J;      // J[-gc0 .. nx-1+gc1]
-
-    // Alocar buffer temporário
-    float3* restrict tmp = malloc( total * sizeof(float3) );
-    if (!tmp) return;
+    for (int i = i0; i < i1; i++) {
+        const float3 fl = src[i - 1];
+        const float3 f0 = src[i];
+        const float3 fu = src[i + 1];
+
+        dst[i].x = sa * fl.x + sb * f0.x + sa * fu.x;
+        dst[i].y = sa * fl.y + sb * f0.y + sa * fu.y;
+        dst[i].z = sa * fl.z + sb * f0.z + sa * fu.z;
+    }
+}
 
-    // Copiar toda a estrutura linear J (ghost + interior)
-    memcpy(tmp, J - gc0, total * sizeof(float3));
+/**
+ * @brief Applies all filter passes to a block of cells
+ * 
+ * Input values for cells [c0 - npass, c1 + npass[ are loaded into the local
+ * buffer A, and each pass reduces the valid range by 1 cell on each side,
+ * ping-ponging between buffers A and B. The final values for cells [c0, c1[
+ * are stored in `out`.
+ * 
+ * For periodic boundaries values outside the box are taken from the opposite
+ * side of the box (the input guard cells must be up to date). When using
+ * domain decomposition values outside the local domain are taken from the
+ * halo buffers (if available). Otherwise the guard cell values are kept
+ * constant, as in a single pass filter.
+ * 
+ * @param J         Input current density
+ * @param out       Output current density
+ * @param c0        First cell of block
+ * @param c1        Last cell of block + 1
+ * @param nx        Number of grid cells
+ * @param periodic  Use periodic boundaries
+ * @param halo_lo   Values of cells [-npass, 0[, may be NULL
+ * @param halo_hi   Values of cells [nx, nx + npass[, may be NULL
+ * @param npass     Number of filter passes
+ * @param ka        a values of the kernel for each pass
+ * @param kb        b values of the kernel for each pass
+ * @param A         Local buffer, must hold (c1 - c0) + 2 * npass cells
+ * @param B         Local buffer, must hold (c1 - c0) + 2 * npass cells
+ */
+static void smooth_block( const float3* restrict const J, float3* restrict const out,
+    const int c0, const int c1, const int nx, const int periodic, 
+    const float3* restrict const halo_lo, const float3* restrict const halo_hi,
+    const int npass, const float ka[], const float kb[], 
+    float3* restrict const A, float3* restrict const B )
+{
+    // Local buffers cover cells [lo, hi[
+    const int lo = c0 - npass;
+    const int hi = c1 + npass;
+
+    float3* a = A - lo;
+    float3* b = B - lo;
+
+    // Boundaries where the guard cell values are kept constant
+    const int fixed_lo = ! ( periodic || halo_lo );
+    const int fixed_hi = ! ( periodic || halo_hi );
+
+    const int l0 = ( fixed_lo && lo < -1 ) ? -1 : lo;
+    const int l1 = ( fixed_hi && hi > nx + 1 ) ? nx + 1 : hi;
+
+    for( int i = l0; i < l1; i++ ) {
+        if ( i < 0 && halo_lo ) {
+            a[i] = halo_lo[ npass + i ];
+        } else if ( i >= nx && halo_hi ) {
+            a[i] = halo_hi[ i - nx ];
+        } else if ( periodic ) {
+            int k = i;
+            while( k < 0 ) k += nx;
+            while( k >= nx ) k -= nx;
+            a[i] = J[k];
+        } else {
+            a[i] = J[i];
+        }
+    }
 
-    // Loop principal: cada célula 0..nx-1 é independente
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < nx; i++) {
+    // Guard cell values are not changed by the filter
+    if ( fixed_lo && l0 == -1 ) b[-1] = J[-1];
+    if ( fixed_hi && l1 == nx + 1 ) b[nx] = J[nx];
 
-        // índice correspondente em tmp
-        int idx = gc0 + i;
+    for( int p = 0; p < npass; p++ ) {
+        int i0 = lo + p + 1;
+        int i1 = hi - p - 1;
 
-        float3 fl = tmp[idx - 1];
-        float3 f0 = tmp[idx];
-        float3 fu = tmp[idx + 1];
+        if ( fixed_lo && i0 < 0 ) i0 = 0;
+        if ( fixed_hi && i1 > nx ) i1 = nx;
 
-        float3 fs;
-        fs.x = sa * fl.x + sb * f0.x + sa * fu.x;
-        fs.y = sa * fl.y + sb * f0.y + sa * fu.y;
-        fs.z = sa * fl.z + sb * f0.z + sa * fu.z;
+        kernel_x( a, b, i0, i1, ka[p], kb[p] );
 
-        J[i] = fs;
+        float3* const t = a; a = b; b = t;
     }
 
-    free(tmp);
-
-    // Repor guard cells (periodic)
-    if ( current->bc_type == CURRENT_BC_PERIODIC ) {
-
-        // lower ghost cells
-        for (int i = -gc0; i < 0; i++)
-            J[i] = J[nx + i];
-
-        // upper ghost cells
-        for (int i = 0; i < gc1; i++)
-            J[nx + i] = J[i];
-    }
+    for( int i = c0; i < c1; i++ ) out[i] = a[i];
 }
 
-
 /**
  * @brief Applies digital filtering to the current density
  * 
@@ -320,29 +588,165 @@ void kernel_x( t_current* const current, const float sa, const float sb )
  * The routine will apply a binomial kernel ([1,2,1]) n times, followed by
  * an optional compensator kernel.
  * 
+ * All passes are applied in a single sweep over the grid: the grid is split
+ * into blocks of SMOOTH_BLOCK cells, and each block is filtered in a (per
+ * thread) local buffer using a halo of 1 cell per pass. Results are stored
+ * in the secondary current buffer, that is then swapped with the main one.
+ * Buffers are allocated on first use and reused afterwards.
+ * 
  * Filtering parameters are set by the `current -> smooth` variable.
  * 
+ * Must be called by all threads of the current parallel region (or outside
+ * of a parallel region, in which case it runs serially).
+ * 
  * @param current Electric current density
  */
 void current_smooth( t_current* const current ) {
 
-    // filter kernel [sa, sb, sa]
-    float sa, sb;
-
     // x-direction filtering
-    if ( current -> smooth.xtype != NONE ) {
-        // binomial filter
-        sa = 0.25; sb = 0.5;
-        for( int i = 0; i < current -> smooth.xlevel; i++) {
-            kernel_x( current, 0.25, 0.5 );
+    if ( current -> smooth.xtype == NONE ) return;
+
+    const int xlevel = current -> smooth.xlevel;
+    const int npass = xlevel + (( current -> smooth.xtype == COMPENSATED ) ? 1 : 0);
+
+    if ( npass < 1 ) return;
+
+    // filter kernels [sa, sb, sa]
+    float ka[npass], kb[npass];
+
+    // binomial filter
+    for( int i = 0; i < xlevel; i++) {
+        ka[i] = 0.25; kb[i] = 0.5;
+    }
+
+    // Compensator
+    if ( current -> smooth.xtype == COMPENSATED ) {
+        get_smooth_comp( xlevel, &ka[xlevel], &kb[xlevel] );
+    }
+
+    const int nx  = current->nx;
+    const int gc0 = current->gc[0];
+    const int gc1 = current->gc[1];
+    const int lsize = SMOOTH_BLOCK + 2 * npass;
+
+    #pragma omp single
+    {
+        if ( ! current -> J_tmp_buf ) {
+            current -> J_tmp_buf = malloc( ( gc0 + nx + gc1 ) * sizeof( float3 ) );
+            assert( current -> J_tmp_buf );
         }
 
-        // Compensator
-        if ( current -> smooth.xtype == COMPENSATED ) {
-            get_smooth_comp( current -> smooth.xlevel, &sa, &sb );
-            kernel_x( current, sa, sb );
+        // Local buffers for each thread, and halo buffers for domain decomposition
+        const int size = omp_get_num_threads() * 2 * lsize + 2 * npass;
+        if ( current -> smooth_buf_size < size ) {
+            free( current -> smooth_buf );
+            current -> smooth_buf = malloc( size * sizeof( float3 ) );
+            assert( current -> smooth_buf );
+            current -> smooth_buf_size = size;
         }
     }
 
+    const float3* restrict const J = current -> J;
+    float3* restrict const out = current -> J_tmp_buf + gc0;
+    const int periodic = ( current -> bc_type == CURRENT_BC_PERIODIC );
+
+    // When using domain decomposition cells outside the local domain are taken
+    // from the neighbouring domains
+    const int distributed = ( domain_size() > 1 );
+    float3* const halo = current -> smooth_buf + current -> smooth_buf_size - 2 * npass;
+    const float3* const halo_lo = ( distributed && domain_has_lower( periodic ) ) ? halo : NULL;
+    const float3* const halo_hi = ( distributed && domain_has_upper( periodic ) ) ? halo + npass : NULL;
+
+    if ( distributed ) {
+        if ( npass > nx ) {
+            fprintf(stderr, "(*error*) Number of filter passes larger than local domain, aborting.\n");
+            exit(-1);
+        }
+        #pragma omp single
+        domain_halo_get( (const float *) J, 3, nx, npass, periodic, (float *) halo, (float *) ( halo + npass ) );
+    }
+
+    float3* const A = current -> smooth_buf + omp_get_thread_num() * 2 * lsize;
+    float3* const B = A + lsize;
+
+    #pragma omp for schedule(static)
+    for( int c0 = 0; c0 < nx; c0 += SMOOTH_BLOCK ) {
+        const int c1 = ( c0 + SMOOTH_BLOCK < nx ) ? c0 + SMOOTH_BLOCK : nx;
+        smooth_block( J, out, c0, c1, nx, periodic && ! distributed, halo_lo, halo_hi,
+            npass, ka, kb, A, B );
+    }
+
+    #pragma omp single
+    {
+        if ( periodic && ! distributed ) {
+            for (int i = -gc0; i < 0; i++) out[i] = out[nx + i];
+            for (int i = 0; i < gc1; i++) out[nx + i] = out[i];
+        } else {
+            for (int i = -gc0; i < 0; i++) out[i] = J[i];
+            for (int i = 0; i < gc1; i++) out[nx + i] = J[nx + i];
+        }
+
+        // Swap current buffers
+        float3* const t = current -> J_buf;
+        current -> J_buf = current -> J_tmp_buf;
+        current -> J_tmp_buf = t;
+
+        current -> J = current -> J_buf + gc0;
+
+        // Get guard cells from neighbouring domains
+        if ( distributed ) domain_halo( (float *) current -> J, 3, nx, current -> gc, periodic );
+    }
+
 }
 
+
+/**
+ * @brief Writes the electric current density state to a checkpoint file
+ * 
+ * Stores the current density of the local domain (including guard cells) and
+ * the iteration number. Private deposition buffers are always zero between
+ * iterations and are not stored.
+ * 
+ * @param current   Electric current density
+ * @param zdf       Checkpoint file, see `checkpoint_open()`
+ * @return          Returns 1 on success, 0 on error
+ */
+int current_checkpoint( const t_current *current, t_zdf_file* zdf )
+{
+    const int size = current->gc[0] + current->nx + current->gc[1];
+    const uint64_t total = 3 * (uint64_t) ( current->gc[0] + domain_nx() + current->gc[1] );
+    const uint64_t start = 3 * (uint64_t) current -> domain_ix0;
+
+    const int32_t state[] = { current -> iter, current -> nx, current -> gc[0], current -> gc[1],
+        current -> domain_ix0 };
+
+    return checkpoint_write( zdf, "CURRENT.state", zdf_int32, state, 5, 0, 5 ) &&
+           checkpoint_write( zdf, "CURRENT.J", zdf_float32, current -> J_buf, 3 * size, start, total );
+}
+
+/**
+ * @brief Restores the electric current density state from a checkpoint file
+ * 
+ * The grid must be the same used when the checkpoint was written, otherwise the
+ * routine aborts the code.
+ * 
+ * @param current   Electric current density
+ * @param map       Mapped checkpoint file, see `checkpoint_map()`
+ */
+void current_restart( t_current *current, const t_zdf_map* map )
+{
+    const int size = current->gc[0] + current->nx + current->gc[1];
+
+    int32_t state[5];
+    memcpy( state, checkpoint_read( map, "CURRENT.state", zdf_int32, 5 ), sizeof( state ) );
+
+    if ( state[1] != current -> nx || state[2] != current->gc[0] || state[3] != current->gc[1] ||
+         state[4] != current -> domain_ix0 ) {
+        fprintf(stderr, "(*error*) Checkpoint current grid does not match the simulation grid, aborting.\n" );
+        exit(-1);
+    }
+
+    current -> iter = state[0];
+    memcpy( current -> J_buf, checkpoint_read( map, "CURRENT.J", zdf_float32, 3 * size ),
+        size * sizeof( float3 ) );
+}
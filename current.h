@@ -11,6 +11,7 @@
 #define __CURRENT__
 
 #include "zpic.h"
+#include "zdf.h"
 
 /**
  * @brief Types of digital filtering
@@ -31,6 +32,15 @@ enum current_boundary{
 	CURRENT_BC_PERIODIC		///< Periodic boundary conditions
 };
 
+/**
+ * @brief Types of current deposition
+ * 
+ */
+enum current_deposit {
+	CURRENT_DEP_ATOMIC,		///< Deposit directly on the shared grid using atomic operations
+	CURRENT_DEP_PRIVATE		///< Deposit on per-thread private grids, reduced before current update
+};
+
 /**
  * @brief Digital filtering parameters
  * 
@@ -58,6 +68,8 @@ typedef struct Current {
 	
 	float dx;		///< Grid cell size
 
+	int domain_ix0;	///< Global index of local cell 0 (see `domain_decompose()`)
+
 	t_smooth smooth;	///< Digital filtering parameters
 
 	float dt;			///< Time step
@@ -65,6 +77,16 @@ typedef struct Current {
 	int iter;			///< Current iteration number
 
 	enum current_boundary bc_type;	///< Type of boundary condition
+
+	enum current_deposit dep_type;	///< Type of current deposition
+
+	float3 *J_priv;		///< Per-thread private current buffers (includes guard cells)
+	int n_priv;			///< Number of private current buffers
+	int priv_stride;	///< Distance (in cells) between consecutive private buffers
+
+	float3 *J_tmp_buf;	///< Secondary current density buffer used for smoothing (includes guard cells)
+	float3 *smooth_buf;	///< Per-thread local buffers used for smoothing
+	int smooth_buf_size;	///< Size (in cells) of smooth_buf
 	
 } t_current;
 
@@ -72,11 +94,12 @@ typedef struct Current {
  * @brief Initializes Electric current density object
  * 
  * @param current 	Electric current density
- * @param nx 		Number of cells
+ * @param nx 		Number of cells (global)
  * @param box 		Physical box size
  * @param dt 		Simulation time step
+ * @param order 	Highest particle shape order in use (sets the number of guard cells)
   */
-void current_new( t_current *current, int nx, float box, float dt );
+void current_new( t_current *current, int nx, float box, float dt, const int order );
 
 /**
  * @brief Frees dynamic memory from electric current density
@@ -99,6 +122,40 @@ void current_zero( t_current *current );
  */
 void current_update( t_current *current );
 
+/**
+ * @brief Applies digital filtering to the electric current density
+ * 
+ * Must be called by all threads of the current parallel region (or outside
+ * of a parallel region, in which case it runs serially).
+ * 
+ * @param current Electric current density object
+ */
+void current_smooth( t_current* const current );
+
+/**
+ * @brief Sets the current deposition type
+ * 
+ * @param current 	Electric current density object
+ * @param dep_type 	Type of current deposition
+ */
+void current_set_deposit( t_current *current, enum current_deposit dep_type );
+
+/**
+ * @brief Gets the current density grid to be used by a given thread
+ * 
+ * @param current 	Electric current density object
+ * @param tid 		Thread id
+ * @return 			Pointer to grid cell 0 of the current density grid
+ */
+float3* current_dep_grid( t_current *current, int tid );
+
+/**
+ * @brief Adds the private current buffers into the shared current density
+ * 
+ * @param current Electric current density object
+ */
+void current_reduce( t_current *current );
+
 /**
  * @brief Saves electric current density diagnostic information to disk
  * 
@@ -107,4 +164,21 @@ void current_update( t_current *current );
  */
 void current_report( const t_current *current, const int jc );
 
+/**
+ * @brief Writes the electric current density state to a checkpoint file
+ * 
+ * @param current Electric current density object
+ * @param zdf Checkpoint file
+ * @return Returns 1 on success, 0 on error
+ */
+int current_checkpoint( const t_current *current, t_zdf_file* zdf );
+
+/**
+ * @brief Restores the electric current density state from a checkpoint file
+ * 
+ * @param current Electric current density object
+ * @param map Mapped checkpoint file
+ */
+void current_restart( t_current *current, const t_zdf_map* map );
+
 #endif
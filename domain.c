@@ -0,0 +1,529 @@
+/**
+ * @file domain.c
+ * @author Ricardo Fonseca
+ * @brief Domain decomposition
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * The global grid is split along x into contiguous domains, one per MPI
+ * process. Each domain holds the fields, current and particles of its own
+ * cells (plus guard cells); guard cells are filled from the neighbouring
+ * domains using halo exchanges, and particles leaving a domain are sent to
+ * the corresponding neighbour.
+ *
+ * When compiled without MPI support (or when running on a single process)
+ * there is a single domain, and none of the communication routines are
+ * used: the serial code paths (including periodic boundaries) are kept
+ * unchanged.
+ */
+
+#include "domain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Message tags, messages sent to the lower / upper neighbour
+enum domain_tag {
+	TAG_LOWER,		///< Halo data sent to the lower neighbour
+	TAG_UPPER,		///< Halo data sent to the upper neighbour
+	TAG_CNT_LOWER,	///< Message size sent to the lower neighbour
+	TAG_CNT_UPPER,	///< Message size sent to the upper neighbour
+	TAG_MSG_LOWER,	///< Message data sent to the lower neighbour
+	TAG_MSG_UPPER	///< Message data sent to the upper neighbour
+};
+
+/// Domain rank
+static int _rank = 0;
+
+/// Number of domains
+static int _size = 1;
+
+/// Global number of cells
+static int _nx = 0;
+
+/**
+ * @brief Initializes the domain decomposition
+ *
+ * When compiled with MPI support (USE_MPI) this initializes MPI, and the
+ * standard output of all processes except the root one is discarded. Must be
+ * called before any other domain_*() routine.
+ *
+ * Communication routines may be called by any thread, but only by one thread
+ * at a time (e.g. from inside an `omp single` construct).
+ */
+void domain_init( void )
+{
+#ifdef USE_MPI
+	int provided;
+	MPI_Init_thread( NULL, NULL, MPI_THREAD_SERIALIZED, &provided );
+	if ( provided < MPI_THREAD_SERIALIZED ) {
+		fprintf(stderr, "(*error*) MPI library does not support MPI_THREAD_SERIALIZED, aborting.\n");
+		MPI_Abort( MPI_COMM_WORLD, -1 );
+	}
+
+	MPI_Comm_rank( MPI_COMM_WORLD, &_rank );
+	MPI_Comm_size( MPI_COMM_WORLD, &_size );
+
+	// Only the root process prints reports
+	if ( _rank > 0 ) {
+		if ( ! freopen( "/dev/null", "w", stdout ) ) {
+			fprintf(stderr, "(*warning*) Unable to redirect standard output of domain %d\n", _rank );
+		}
+	}
+#endif
+}
+
+/**
+ * @brief Finalizes the domain decomposition
+ *
+ */
+void domain_finalize( void )
+{
+#ifdef USE_MPI
+	MPI_Finalize();
+#endif
+}
+
+/**
+ * @brief Rank of the local domain
+ *
+ * @return 	Domain rank, 0 is the root (lower) domain
+ */
+int domain_rank( void )
+{
+	return _rank;
+}
+
+/**
+ * @brief Number of domains
+ *
+ * @return 	Number of domains
+ */
+int domain_size( void )
+{
+	return _size;
+}
+
+/**
+ * @brief Checks if the local domain is the root one
+ *
+ * @return 	1 if this is the root domain, 0 otherwise
+ */
+int domain_root( void )
+{
+	return ( _rank == 0 );
+}
+
+/**
+ * @brief Splits the global grid between domains along x
+ *
+ * Cells are split evenly, the first `nx % size` domains getting one
+ * extra cell. All objects (fields, current and particles) of a simulation
+ * must use the same global grid. The code aborts if the domains would have
+ * fewer than 4 cells.
+ *
+ * @param nx 		Global number of cells
+ * @param nx_local 	(out) Number of cells of the local domain
+ * @param ix0 		(out) Global index of the first local cell
+ */
+void domain_decompose( int nx, int* nx_local, int* ix0 )
+{
+	_nx = nx;
+
+	const int n = nx / _size;
+	const int r = nx % _size;
+
+	if ( _size > 1 && n < 4 ) {
+		fprintf(stderr, "(*error*) Grid is too small for %d domains (%d cells), aborting.\n", _size, nx );
+		exit(-1);
+	}
+
+	*nx_local = n + ( ( _rank < r ) ? 1 : 0 );
+	*ix0 = _rank * n + ( ( _rank < r ) ? _rank : r );
+}
+
+/**
+ * @brief Global number of cells
+ *
+ * @return 	Number of cells set by the last `domain_decompose()` call
+ */
+int domain_nx( void )
+{
+	return _nx;
+}
+
+/**
+ * @brief Checks if the local domain has a lower neighbour
+ *
+ * @param periodic 	Use periodic boundaries
+ * @return 			1 if there is a lower neighbour, 0 otherwise
+ */
+int domain_has_lower( int periodic )
+{
+	return ( _rank > 0 || periodic );
+}
+
+/**
+ * @brief Checks if the local domain has an upper neighbour
+ *
+ * @param periodic 	Use periodic boundaries
+ * @return 			1 if there is an upper neighbour, 0 otherwise
+ */
+int domain_has_upper( int periodic )
+{
+	return ( _rank < _size - 1 || periodic );
+}
+
+#ifdef USE_MPI
+
+/**
+ * @brief Gets the rank of the neighbouring domains
+ *
+ * @param periodic 	Use periodic boundaries
+ * @param lower 	(out) Rank of the lower neighbour, MPI_PROC_NULL if none
+ * @param upper 	(out) Rank of the upper neighbour, MPI_PROC_NULL if none
+ */
+static void neighbours( int periodic, int* lower, int* upper )
+{
+	*lower = domain_has_lower( periodic ) ? ( _rank + _size - 1 ) % _size : MPI_PROC_NULL;
+	*upper = domain_has_upper( periodic ) ? ( _rank + 1 ) % _size : MPI_PROC_NULL;
+}
+
+/**
+ * @brief Adds a request to a message set
+ *
+ * @param msg 	Message set
+ * @return 		Pointer to new request
+ */
+static MPI_Request* new_req( t_domain_msg* msg )
+{
+	if ( msg -> nreq >= DOMAIN_MAX_REQ ) {
+		fprintf(stderr, "(*error*) Too many pending messages, aborting.\n");
+		exit(-1);
+	}
+	return &msg -> req[ msg -> nreq++ ];
+}
+
+#endif
+
+/**
+ * @brief Starts updating guard cell values from the neighbouring domains
+ *
+ * The lower guard cells get the last `gc[0]` cells of the lower neighbour
+ * and the upper guard cells get the first `gc[1]` cells of the upper
+ * neighbour. Guard cells without a neighbour (open boundaries) are not
+ * changed. The grid interior must not be modified, and the guard cells must
+ * not be used, until the messages complete, see `domain_wait()`.
+ *
+ * @param msg 		Message set
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo_start( t_domain_msg* msg, float* f, int ncomp, int nx, const int gc[2], int periodic )
+{
+#ifdef USE_MPI
+	int lower, upper;
+	neighbours( periodic, &lower, &upper );
+
+	// Receive guard cells
+	MPI_Irecv( f - gc[0] * ncomp, gc[0] * ncomp, MPI_FLOAT, lower, TAG_UPPER, MPI_COMM_WORLD, new_req( msg ) );
+	MPI_Irecv( f + nx * ncomp,    gc[1] * ncomp, MPI_FLOAT, upper, TAG_LOWER, MPI_COMM_WORLD, new_req( msg ) );
+
+	// Send boundary cells
+	MPI_Isend( f,                      gc[1] * ncomp, MPI_FLOAT, lower, TAG_LOWER, MPI_COMM_WORLD, new_req( msg ) );
+	MPI_Isend( f + (nx - gc[0]) * ncomp, gc[0] * ncomp, MPI_FLOAT, upper, TAG_UPPER, MPI_COMM_WORLD, new_req( msg ) );
+#else
+	(void) msg; (void) f; (void) ncomp; (void) nx; (void) gc; (void) periodic;
+#endif
+}
+
+/**
+ * @brief Updates guard cell values from the neighbouring domains
+ *
+ * Blocking version of `domain_halo_start()`
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo( float* f, int ncomp, int nx, const int gc[2], int periodic )
+{
+	t_domain_msg msg = {0};
+	domain_halo_start( &msg, f, ncomp, nx, gc, periodic );
+	domain_wait( &msg );
+}
+
+/**
+ * @brief Adds guard cell values to the corresponding cells of the neighbouring domains
+ *
+ * Values in the lower guard cells are added to the last `gc[0]` cells of the
+ * lower neighbour, and values in the upper guard cells are added to the first
+ * `gc[1]` cells of the upper neighbour. Guard cell values are not changed, use
+ * `domain_halo()` afterwards to update them. Values in guard cells without a
+ * neighbour (open boundaries) are discarded.
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo_add( float* f, int ncomp, int nx, const int gc[2], int periodic )
+{
+#ifdef USE_MPI
+	int lower, upper;
+	neighbours( periodic, &lower, &upper );
+
+	// Contributions from the lower neighbour go into the first gc[1] cells,
+	// contributions from the upper neighbour into the last gc[0] cells
+	float recv_lo[ gc[1] * ncomp + 1 ];
+	float recv_hi[ gc[0] * ncomp + 1 ];
+
+	t_domain_msg msg = {0};
+	MPI_Irecv( recv_lo, gc[1] * ncomp, MPI_FLOAT, lower, TAG_UPPER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Irecv( recv_hi, gc[0] * ncomp, MPI_FLOAT, upper, TAG_LOWER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Isend( f - gc[0] * ncomp, gc[0] * ncomp, MPI_FLOAT, lower, TAG_LOWER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Isend( f + nx * ncomp,    gc[1] * ncomp, MPI_FLOAT, upper, TAG_UPPER, MPI_COMM_WORLD, new_req( &msg ) );
+	domain_wait( &msg );
+
+	if ( lower != MPI_PROC_NULL ) {
+		for( int i = 0; i < gc[1] * ncomp; i++ ) f[ i ] += recv_lo[ i ];
+	}
+	if ( upper != MPI_PROC_NULL ) {
+		float* const fu = f + ( nx - gc[0] ) * ncomp;
+		for( int i = 0; i < gc[0] * ncomp; i++ ) fu[ i ] += recv_hi[ i ];
+	}
+#else
+	(void) f; (void) ncomp; (void) nx; (void) gc; (void) periodic;
+#endif
+}
+
+/**
+ * @brief Gets the cell values closest to the local domain from the neighbouring domains
+ *
+ * `lo` gets the last `n` cells of the lower neighbour and `hi` gets the first
+ * `n` cells of the upper neighbour. Buffers without a neighbour (open
+ * boundaries) are not changed. Used when a wider halo than the guard cells
+ * is required (e.g. for multi pass filtering).
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param n 		Number of cells to get from each neighbour
+ * @param periodic 	Use periodic boundaries
+ * @param lo 		(out) Values from lower neighbour, must hold n * ncomp values
+ * @param hi 		(out) Values from upper neighbour, must hold n * ncomp values
+ */
+void domain_halo_get( const float* f, int ncomp, int nx, int n, int periodic, float* lo, float* hi )
+{
+#ifdef USE_MPI
+	int lower, upper;
+	neighbours( periodic, &lower, &upper );
+
+	t_domain_msg msg = {0};
+	MPI_Irecv( lo, n * ncomp, MPI_FLOAT, lower, TAG_UPPER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Irecv( hi, n * ncomp, MPI_FLOAT, upper, TAG_LOWER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Isend( (void *) f, n * ncomp, MPI_FLOAT, lower, TAG_LOWER, MPI_COMM_WORLD, new_req( &msg ) );
+	MPI_Isend( (void *) ( f + ( nx - n ) * ncomp ), n * ncomp, MPI_FLOAT, upper, TAG_UPPER, MPI_COMM_WORLD, new_req( &msg ) );
+	domain_wait( &msg );
+#else
+	(void) f; (void) ncomp; (void) nx; (void) n; (void) periodic; (void) lo; (void) hi;
+#endif
+}
+
+/**
+ * @brief Starts exchanging variable size messages with the neighbouring domains
+ *
+ * The message sizes are exchanged first (blocking), the message data is then
+ * sent / received in the background. After `domain_wait()` the receive
+ * buffer `msg->buf` holds the `msg->count[0]` elements sent by the lower
+ * neighbour followed by the `msg->count[1]` elements sent by the upper
+ * neighbour. The send buffers must not be changed until then. The receive
+ * buffer is kept (and reused) by the message set, and must be freed by the
+ * caller.
+ *
+ * @param msg 		Message set
+ * @param send_lo 	Data for the lower neighbour
+ * @param n_lo 		Number of elements for the lower neighbour
+ * @param send_hi 	Data for the upper neighbour
+ * @param n_hi 		Number of elements for the upper neighbour
+ * @param elsize 	Element size (bytes)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_exchange_start( t_domain_msg* msg, const void* send_lo, int n_lo,
+	const void* send_hi, int n_hi, size_t elsize, int periodic )
+{
+	msg -> count[0] = msg -> count[1] = 0;
+
+#ifdef USE_MPI
+	int lower, upper;
+	neighbours( periodic, &lower, &upper );
+
+	// Exchange message sizes
+	int nsend[2] = { n_lo, n_hi };
+	t_domain_msg cnt = {0};
+	MPI_Irecv( &msg -> count[0], 1, MPI_INT, lower, TAG_CNT_UPPER, MPI_COMM_WORLD, new_req( &cnt ) );
+	MPI_Irecv( &msg -> count[1], 1, MPI_INT, upper, TAG_CNT_LOWER, MPI_COMM_WORLD, new_req( &cnt ) );
+	MPI_Isend( &nsend[0], 1, MPI_INT, lower, TAG_CNT_LOWER, MPI_COMM_WORLD, new_req( &cnt ) );
+	MPI_Isend( &nsend[1], 1, MPI_INT, upper, TAG_CNT_UPPER, MPI_COMM_WORLD, new_req( &cnt ) );
+	domain_wait( &cnt );
+
+	// Grow receive buffer if needed
+	const size_t size = ( msg -> count[0] + msg -> count[1] ) * elsize;
+	if ( size > msg -> buf_size ) {
+		free( msg -> buf );
+		msg -> buf_size = size + size / 2;
+		msg -> buf = malloc( msg -> buf_size );
+		if ( ! msg -> buf ) {
+			fprintf(stderr, "(*error*) Unable to allocate message buffer, aborting.\n");
+			exit(-1);
+		}
+	}
+
+	// Exchange data, sent as bytes
+	char* const buf = msg -> buf;
+	if ( msg -> count[0] > 0 )
+		MPI_Irecv( buf, msg -> count[0] * elsize, MPI_BYTE, lower, TAG_MSG_UPPER, MPI_COMM_WORLD, new_req( msg ) );
+	if ( msg -> count[1] > 0 )
+		MPI_Irecv( buf + msg -> count[0] * elsize, msg -> count[1] * elsize, MPI_BYTE, upper, TAG_MSG_LOWER, MPI_COMM_WORLD, new_req( msg ) );
+	if ( n_lo > 0 )
+		MPI_Isend( (void *) send_lo, n_lo * elsize, MPI_BYTE, lower, TAG_MSG_LOWER, MPI_COMM_WORLD, new_req( msg ) );
+	if ( n_hi > 0 )
+		MPI_Isend( (void *) send_hi, n_hi * elsize, MPI_BYTE, upper, TAG_MSG_UPPER, MPI_COMM_WORLD, new_req( msg ) );
+#else
+	(void) send_lo; (void) n_lo; (void) send_hi; (void) n_hi; (void) elsize; (void) periodic;
+#endif
+}
+
+/**
+ * @brief Waits for all pending messages in a message set to complete
+ *
+ * @param msg 	Message set
+ */
+void domain_wait( t_domain_msg* msg )
+{
+#ifdef USE_MPI
+	if ( msg -> nreq > 0 ) MPI_Waitall( msg -> nreq, msg -> req, MPI_STATUSES_IGNORE );
+#endif
+	msg -> nreq = 0;
+}
+
+/**
+ * @brief Gathers data from all domains in the root domain
+ *
+ * Data is concatenated in domain order (i.e. grid data from all domains
+ * becomes global grid data).
+ *
+ * @param buf 		Local data
+ * @param n 		Number of local values
+ * @param n_total 	(out) Total number of values, may be NULL. Only set on the root domain.
+ * @return 			On the root domain a newly allocated buffer holding the
+ * 					gathered data, that must be freed by the caller. NULL on
+ * 					all other domains.
+ */
+float* domain_gather( const float* buf, int n, int* n_total )
+{
+#ifdef USE_MPI
+	int* cnt = NULL;
+	int* off = NULL;
+	float* all = NULL;
+
+	if ( _rank == 0 ) {
+		cnt = malloc( 2 * _size * sizeof( int ) );
+		off = cnt + _size;
+	}
+
+	MPI_Gather( &n, 1, MPI_INT, cnt, 1, MPI_INT, 0, MPI_COMM_WORLD );
+
+	if ( _rank == 0 ) {
+		int total = 0;
+		for( int i = 0; i < _size; i++ ) {
+			off[i] = total;
+			total += cnt[i];
+		}
+		if ( n_total ) *n_total = total;
+
+		all = malloc( ( total > 0 ? total : 1 ) * sizeof( float ) );
+		if ( ! all ) {
+			fprintf(stderr, "(*error*) Unable to allocate gather buffer, aborting.\n");
+			exit(-1);
+		}
+	}
+
+	MPI_Gatherv( (void *) buf, n, MPI_FLOAT, all, cnt, off, MPI_FLOAT, 0, MPI_COMM_WORLD );
+
+	free( cnt );
+	return all;
+#else
+	float* all = malloc( ( n > 0 ? n : 1 ) * sizeof( float ) );
+	if ( ! all ) {
+		fprintf(stderr, "(*error*) Unable to allocate gather buffer, aborting.\n");
+		exit(-1);
+	}
+	memcpy( all, buf, n * sizeof( float ) );
+	if ( n_total ) *n_total = n;
+	return all;
+#endif
+}
+
+/**
+ * @brief Adds data from all domains in the root domain
+ *
+ * @param buf 	Local data, replaced by the sum over all domains on the root domain
+ * @param n 	Number of values
+ * @return 		1 on the root domain, 0 otherwise
+ */
+int domain_reduce( float* buf, int n )
+{
+#ifdef USE_MPI
+	if ( _rank == 0 ) {
+		MPI_Reduce( MPI_IN_PLACE, buf, n, MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD );
+	} else {
+		MPI_Reduce( buf, NULL, n, MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD );
+	}
+#else
+	(void) buf; (void) n;
+#endif
+	return ( _rank == 0 );
+}
+
+/**
+ * @brief Adds data from all domains, the result is available on all domains
+ *
+ * @param buf 	Local data, replaced by the sum over all domains
+ * @param n 	Number of values
+ */
+void domain_allreduce( double* buf, int n )
+{
+#ifdef USE_MPI
+	MPI_Allreduce( MPI_IN_PLACE, buf, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+#else
+	(void) buf; (void) n;
+#endif
+}
+
+/**
+ * @brief Exclusive prefix sum over domains
+ *
+ * @param n 	Local value
+ * @return 		Sum of the values of all lower domains (0 on the root domain)
+ */
+uint64_t domain_exscan( uint64_t n )
+{
+	uint64_t s = 0;
+#ifdef USE_MPI
+	MPI_Exscan( &n, &s, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD );
+	if ( _rank == 0 ) s = 0;
+#else
+	(void) n;
+#endif
+	return s;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file domain.h
+ * @author Ricardo Fonseca
+ * @brief Domain decomposition
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __DOMAIN__
+#define __DOMAIN__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+/// Maximum number of pending requests in a single message set
+#define DOMAIN_MAX_REQ 8
+
+/**
+ * @brief Set of pending (nonblocking) messages
+ *
+ * Used to overlap communication with computation, see `domain_halo_start()`
+ * and `domain_exchange_start()`. Must be zero initialized.
+ */
+typedef struct DomainMsg {
+	int nreq;					///< Number of pending requests
+#ifdef USE_MPI
+	MPI_Request req[DOMAIN_MAX_REQ];	///< Pending requests
+#endif
+	int count[2];				///< Number of elements received from the lower / upper neighbour
+	void* buf;					///< Receive buffer (domain_exchange_start())
+	size_t buf_size;			///< Size of receive buffer (bytes)
+} t_domain_msg;
+
+/**
+ * @brief Initializes the domain decomposition
+ *
+ * When compiled with MPI support (USE_MPI) this initializes MPI, and the
+ * standard output of all processes except the root one is discarded. Must be
+ * called before any other domain_*() routine.
+ */
+void domain_init( void );
+
+/**
+ * @brief Finalizes the domain decomposition
+ *
+ */
+void domain_finalize( void );
+
+/**
+ * @brief Rank of the local domain
+ *
+ * @return 	Domain rank, 0 is the root (lower) domain
+ */
+int domain_rank( void );
+
+/**
+ * @brief Number of domains
+ *
+ * @return 	Number of domains. If 1 all the code paths are the serial ones.
+ */
+int domain_size( void );
+
+/**
+ * @brief Checks if the local domain is the root one
+ *
+ * Only the root domain writes diagnostic files and prints reports.
+ *
+ * @return 	1 if this is the root domain, 0 otherwise
+ */
+int domain_root( void );
+
+/**
+ * @brief Splits the global grid between domains along x
+ *
+ * @param nx 		Global number of cells
+ * @param nx_local 	(out) Number of cells of the local domain
+ * @param ix0 		(out) Global index of the first local cell
+ */
+void domain_decompose( int nx, int* nx_local, int* ix0 );
+
+/**
+ * @brief Global number of cells
+ *
+ * @return 	Number of cells set by the last `domain_decompose()` call
+ */
+int domain_nx( void );
+
+/**
+ * @brief Checks if the local domain has a lower neighbour
+ *
+ * @param periodic 	Use periodic boundaries
+ * @return 			1 if there is a lower neighbour, 0 otherwise
+ */
+int domain_has_lower( int periodic );
+
+/**
+ * @brief Checks if the local domain has an upper neighbour
+ *
+ * @param periodic 	Use periodic boundaries
+ * @return 			1 if there is an upper neighbour, 0 otherwise
+ */
+int domain_has_upper( int periodic );
+
+/**
+ * @brief Starts updating guard cell values from the neighbouring domains
+ *
+ * @param msg 		Message set
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo_start( t_domain_msg* msg, float* f, int ncomp, int nx, const int gc[2], int periodic );
+
+/**
+ * @brief Updates guard cell values from the neighbouring domains
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo( float* f, int ncomp, int nx, const int gc[2], int periodic );
+
+/**
+ * @brief Adds guard cell values to the corresponding cells of the neighbouring domains
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param gc 		Number of guard cells (lower / upper)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_halo_add( float* f, int ncomp, int nx, const int gc[2], int periodic );
+
+/**
+ * @brief Gets the cell values closest to the local domain from the neighbouring domains
+ *
+ * @param f 		Pointer to cell 0 of grid
+ * @param ncomp 	Number of (float) values per cell
+ * @param nx 		Number of local cells
+ * @param n 		Number of cells to get from each neighbour
+ * @param periodic 	Use periodic boundaries
+ * @param lo 		(out) Values from lower neighbour, must hold n * ncomp values
+ * @param hi 		(out) Values from upper neighbour, must hold n * ncomp values
+ */
+void domain_halo_get( const float* f, int ncomp, int nx, int n, int periodic, float* lo, float* hi );
+
+/**
+ * @brief Starts exchanging variable size messages with the neighbouring domains
+ *
+ * @param msg 		Message set
+ * @param send_lo 	Data for the lower neighbour
+ * @param n_lo 		Number of elements for the lower neighbour
+ * @param send_hi 	Data for the upper neighbour
+ * @param n_hi 		Number of elements for the upper neighbour
+ * @param elsize 	Element size (bytes)
+ * @param periodic 	Use periodic boundaries
+ */
+void domain_exchange_start( t_domain_msg* msg, const void* send_lo, int n_lo,
+	const void* send_hi, int n_hi, size_t elsize, int periodic );
+
+/**
+ * @brief Waits for all pending messages in a message set to complete
+ *
+ * @param msg 	Message set
+ */
+void domain_wait( t_domain_msg* msg );
+
+/**
+ * @brief Gathers data from all domains in the root domain
+ *
+ * @param buf 		Local data
+ * @param n 		Number of local values
+ * @param n_total 	(out) Total number of values, may be NULL
+ * @return 			Newly allocated buffer with the data from all domains on
+ * 					the root domain, NULL otherwise
+ */
+float* domain_gather( const float* buf, int n, int* n_total );
+
+/**
+ * @brief Adds data from all domains in the root domain
+ *
+ * @param buf 	Local data, replaced by the sum over all domains on the root domain
+ * @param n 	Number of values
+ * @return 		1 on the root domain, 0 otherwise
+ */
+int domain_reduce( float* buf, int n );
+
+/**
+ * @brief Adds data from all domains, the result is available on all domains
+ *
+ * @param buf 	Local data, replaced by the sum over all domains
+ * @param n 	Number of values
+ */
+void domain_allreduce( double* buf, int n );
+
+/**
+ * @brief Exclusive prefix sum over domains
+ *
+ * @param n 	Local value
+ * @return 		Sum of the values of all lower domains
+ */
+uint64_t domain_exscan( uint64_t n );
+
+#endif
@@ -18,10 +18,17 @@
 #include "emf.h"
 #include "zdf.h"
 #include "timer.h"
+#include "arena.h"
+#include "checkpoint.h"
 
 void emf_move_window( t_emf *emf );
 void emf_update_part_fld( t_emf *emf );
 void emf_update_gc( t_emf *emf );
+static void update_part_fld( t_emf* const emf, const int i0, const int i1, const int iter );
+static void ext_fld_move_window( t_emf* const emf );
+
+/// Number of cells processed at a time by the field solver
+#define YEE_BLOCK 512
 
 /// Time spent advancing the EM fields
 static double _emf_time = 0.0;
@@ -48,28 +55,42 @@ double emf_time( void )
  * Fields are initialized with 0 values, if you require other initial
  * values use the `init_fld()` function.
  * 
+ * When using domain decomposition only the cells of the local domain are
+ * allocated, see `domain_decompose()`; `nx` and `box` refer to the global
+ * grid.
+ * 
  * @param emf 	EM fields
- * @param nx 	Number of grid cells
+ * @param nx 	Number of grid cells (global)
  * @param box 	Physical box size
  * @param dt 	Simulation time step
+ * @param order Highest particle shape order in use (sets the number of guard cells)
  */
-void emf_new( t_emf *emf, int nx, float box, const float dt )
+void emf_new( t_emf *emf, int nx, float box, const float dt, const int order )
 {
 
-	// Number of guard cells for linear interpolation
-	int gc[2] = {1,2};
+	// Number of guard cells for linear / higher order interpolation
+	int gc[2] = { order > 1 ? 2 : 1, order > 1 ? 3 : 2 };
+
+	// Set cell sizes and box limits
+	emf -> box = box;
+	emf -> dx = box / nx;
+
+	// Local domain
+	emf -> halo = (t_domain_msg) {0};
+	domain_decompose( nx, &nx, &emf -> domain_ix0 );
 
 	// Allocate global arrays
 	size_t size = (gc[0] + nx + gc[1]) * sizeof( float3 ) ;
 
-	emf->E_buf = malloc( size );
-	emf->B_buf = malloc( size );
+	emf->E_buf = arena_malloc( size );
+	emf->B_buf = arena_malloc( size );
 
 	assert( emf->E_buf && emf->B_buf );
 
-	// zero fields
-	memset( emf->E_buf, 0, size );
-	memset( emf->B_buf, 0, size );
+	// zero fields, in parallel so that memory is placed close to the threads
+	// that will update it (first touch)
+	arena_touch( emf->E_buf, size );
+	arena_touch( emf->B_buf, size );
 
 	// store nx and gc values
 	emf->nx = nx;
@@ -83,9 +104,8 @@ void emf_new( t_emf *emf, int nx, float box, const float dt )
 	emf->E = emf->E_buf + gc[0];
 	emf->B = emf->B_buf + gc[0];
 
-	// Set cell sizes and box limits
-	emf -> box = box;
-	emf -> dx = box / nx;
+	emf->buf_size = gc[0] + nx + gc[1];
+	emf->buf_off = 0;
 
 	// Set time step
 	emf -> dt = dt;
@@ -100,6 +120,9 @@ void emf_new( t_emf *emf, int nx, float box, const float dt )
 	// Default to periodic boundary condtions
 	emf -> bc_type = EMF_BC_PERIODIC;
 
+	// Sweep ranges (and results at the range edges) depend on the number of threads
+	emf -> deterministic = 0;
+
 	emf -> mur_fld[0].x = emf -> mur_fld[0].y = emf -> mur_fld[0].z = 0;
 	emf -> mur_fld[1].x = emf -> mur_fld[1].y = emf -> mur_fld[1].z = 0;
 
@@ -109,6 +132,12 @@ void emf_new( t_emf *emf, int nx, float box, const float dt )
 	// Disable external fields by default
 	emf -> ext_fld.E_type = EMF_FLD_TYPE_NONE;
 	emf -> ext_fld.B_type = EMF_FLD_TYPE_NONE;
+	emf -> ext_fld.E_part_buf = NULL;
+	emf -> ext_fld.B_part_buf = NULL;
+	emf -> ext_fld.E_ext_buf = NULL;
+	emf -> ext_fld.B_ext_buf = NULL;
+	emf -> ext_fld.E_nphase = 0;
+	emf -> ext_fld.B_nphase = 0;
 	emf -> E_part = emf->E;
 	emf -> B_part = emf->B;
 }
@@ -123,19 +152,21 @@ void emf_new( t_emf *emf, int nx, float box, const float dt )
  */
 void emf_delete( t_emf *emf )
 {
-	free( emf->E_buf );
-	free( emf->B_buf );
+	arena_free( emf->E_buf );
+	arena_free( emf->B_buf );
 
 	emf->E_buf = NULL;
 	emf->B_buf = NULL;
 
-	if ( emf -> ext_fld.E_type > EMF_FLD_TYPE_NONE ) {
-		free( emf -> ext_fld.E_part_buf );
-	}
+	free( emf -> ext_fld.E_part_buf );
+	free( emf -> ext_fld.B_part_buf );
+	free( emf -> ext_fld.E_ext_buf );
+	free( emf -> ext_fld.B_ext_buf );
 
-	if ( emf -> ext_fld.B_type > EMF_FLD_TYPE_NONE ) {
-		free( emf -> ext_fld.B_part_buf );
-	}
+	emf -> ext_fld.E_part_buf = NULL;
+	emf -> ext_fld.B_part_buf = NULL;
+	emf -> ext_fld.E_ext_buf = NULL;
+	emf -> ext_fld.B_ext_buf = NULL;
 
 	emf->E_part = NULL;
 	emf->B_part = NULL;
@@ -238,7 +269,7 @@ void emf_add_laser( t_emf* const emf, t_emf_laser* laser )
 	k = laser -> omega0;
 
 	for (int i = 0; i < emf->nx; i++) {
-		z = i * dx;
+		z = (i + emf -> domain_ix0) * dx;
 		z_2 = z + dx/2;
 
 		lenv   = amp * lon_env( laser, z );
@@ -254,8 +285,8 @@ void emf_add_laser( t_emf* const emf, t_emf_laser* laser )
 
 	}
 
-	// Set guard cell values for periodic boundaries
-	if ( emf -> bc_type == EMF_BC_PERIODIC ) emf_update_gc( emf );
+	// Set guard cell values for periodic boundaries / neighbouring domains
+	if ( emf -> bc_type == EMF_BC_PERIODIC || domain_size() > 1 ) emf_update_gc( emf );
 
 }
 
@@ -335,6 +366,22 @@ void emf_report( const t_emf *emf, const char field, const int fc )
 			break;
 	}
 
+	// Uniform external fields are not stored on the particle field grids
+	const float3* f0 = NULL;
+	if ( field == EPART && emf -> ext_fld.E_type == EMF_FLD_TYPE_UNIFORM ) f0 = &emf -> ext_fld.E_0;
+	if ( field == BPART && emf -> ext_fld.B_type == EMF_FLD_TYPE_UNIFORM ) f0 = &emf -> ext_fld.B_0;
+	if ( f0 ) {
+		const float v0 = ( fc == 0 ) ? f0 -> x : ( ( fc == 1 ) ? f0 -> y : f0 -> z );
+		for ( int i = 0; i < emf->nx; i++ ) buf[i] += v0;
+	}
+
+	// Gather data from all domains, only the root domain saves the data
+	float* gbuf = NULL;
+	if ( domain_size() > 1 ) {
+		gbuf = domain_gather( buf, emf->nx, NULL );
+		if ( ! gbuf ) return;
+	}
+
     t_zdf_grid_axis axis[1];
     axis[0] = (t_zdf_grid_axis) {
     	.min = 0.0 + emf->n_move * emf->dx,
@@ -352,7 +399,7 @@ void emf_report( const t_emf *emf, const char field, const int fc )
     	.axis = axis
     };
 
-    info.count[0] = emf->nx;
+    info.count[0] = gbuf ? domain_nx() : emf->nx;
 
     t_zdf_iteration iter = {
         .name = "ITERATION",
@@ -361,7 +408,8 @@ void emf_report( const t_emf *emf, const char field, const int fc )
     	.time_units = "1/\\omega_p"
     };
 
-	zdf_save_grid( (float *) buf, zdf_float32, &info, &iter, "EMF" );
+	zdf_save_grid( gbuf ? gbuf : buf, zdf_float32, &info, &iter, "EMF" );
+	free( gbuf );
 }
 
 /*********************************************************************************************
@@ -372,39 +420,48 @@ void emf_report( const t_emf *emf, const char field, const int fc )
  *********************************************************************************************/
 
 /**
- * @brief Applies 1st order MUR absorbing boundary conditions
+ * @brief Applies 1st order MUR absorbing boundary condition to the lower boundary
+ * 
+ * Must be called after E[0] has been advanced
  * 
  * @param emf 	EM Fields
  */
-void mur_abc( t_emf *emf ) {
+static inline void mur_abc_lower( t_emf *emf ) {
 
-    const int nx = emf->nx;
     float const S = (emf->dt - emf->dx) / (emf->dt + emf->dx);
 
-	if ( emf -> bc_type == EMF_BC_OPEN) {
-		// lower boundary
-        emf -> mur_fld[0].y = emf -> mur_tmp[0].y + S * (emf -> E[0].y - emf -> mur_fld[0].y);
-        emf -> mur_fld[0].z = emf -> mur_tmp[0].z + S * (emf -> E[0].z - emf -> mur_fld[0].z);
+    emf -> mur_fld[0].y = emf -> mur_tmp[0].y + S * (emf -> E[0].y - emf -> mur_fld[0].y);
+    emf -> mur_fld[0].z = emf -> mur_tmp[0].z + S * (emf -> E[0].z - emf -> mur_fld[0].z);
+
+    emf ->  E[-1].y = emf -> mur_fld[0].y;
+    emf ->  E[-1].z = emf -> mur_fld[0].z;
 
-        emf ->  E[-1].y = emf -> mur_fld[0].y;
-        emf ->  E[-1].z = emf -> mur_fld[0].z;
+    // Store Eperp for next iteration
+    emf -> mur_tmp[0].y = emf -> E[0].y;
+    emf -> mur_tmp[0].z = emf -> E[0].z;
+}
 
-        // Store Eperp for next iteration
-        emf -> mur_tmp[0].y = emf -> E[0].y;
-        emf -> mur_tmp[0].z = emf -> E[0].z;
+/**
+ * @brief Applies 1st order MUR absorbing boundary condition to the upper boundary
+ * 
+ * Must be called after E[nx-1] and E[nx] have been advanced
+ * 
+ * @param emf 	EM Fields
+ */
+static inline void mur_abc_upper( t_emf *emf ) {
 
-		// upper boundary
-        emf -> mur_fld[1].y = emf -> mur_tmp[1].y + S * (emf -> E[nx-1].y - emf -> mur_fld[1].y);
-        emf -> mur_fld[1].z = emf -> mur_tmp[1].z + S * (emf -> E[nx-1].z - emf -> mur_fld[1].z);
+    const int nx = emf->nx;
+    float const S = (emf->dt - emf->dx) / (emf->dt + emf->dx);
 
-        emf ->  E[nx].y = emf -> mur_fld[1].y;
-        emf ->  E[nx].z = emf -> mur_fld[1].z;
+    emf -> mur_fld[1].y = emf -> mur_tmp[1].y + S * (emf -> E[nx-1].y - emf -> mur_fld[1].y);
+    emf -> mur_fld[1].z = emf -> mur_tmp[1].z + S * (emf -> E[nx-1].z - emf -> mur_fld[1].z);
 
-        // Store Eperp for next iteration
-        emf -> mur_tmp[1].y = emf -> E[nx-1].y;
-        emf -> mur_tmp[1].z = emf -> E[nx-1].z;
-	}
+    emf ->  E[nx].y = emf -> mur_fld[1].y;
+    emf ->  E[nx].z = emf -> mur_fld[1].z;
 
+    // Store Eperp for next iteration
+    emf -> mur_tmp[1].y = emf -> E[nx-1].y;
+    emf -> mur_tmp[1].z = emf -> E[nx-1].z;
 }
 
 /*********************************************************************************************
@@ -414,58 +471,170 @@ void mur_abc( t_emf *emf ) {
  *********************************************************************************************/
 
 /**
- * @brief Advance magnetic field using Yee scheme
+ * @brief Advance magnetic field in a single cell using Yee scheme
  * 
- * @param emf 	EM fields
- * @param dt 	Time step
+ * @param b 	B field value at cell i
+ * @param e 	E field value at cell i
+ * @param e1 	E field value at cell i+1
+ * @param dt_dx Time step over cell size
+ * @return      New B field value
  */
-void yee_b( t_emf *emf, const float dt )
+static inline float3 yee_b_cell( float3 b, const float3 e, const float3 e1, const float dt_dx )
 {
-    float3* const restrict B = emf -> B;
-    const float3* const restrict E = emf -> E;
-
-	float dt_dx = dt / emf->dx;
+	// b.x += 0;  // Bx does not evolve in 1D
+	b.y += (   dt_dx * ( e1.z - e.z) );
+	b.z += ( - dt_dx * ( e1.y - e.y) );
+	return b;
+}
 
-	// Canonical implementation
-	#pragma omp parallel for 
-	for (int i=-1; i<=emf->nx; i++) {
-		// B[ i ].x += 0;  // Bx does not evolve in 1D
-		B[ i ].y += (   dt_dx * ( E[i+1].z - E[ i ].z) );
-		B[ i ].z += ( - dt_dx * ( E[i+1].y - E[ i ].y) );
-	}
+/**
+ * @brief Advance electric field in a single cell using Yee scheme
+ * 
+ * @param e 	E field value at cell i
+ * @param b0 	B field value at cell i-1
+ * @param b 	B field value at cell i
+ * @param j 	Current density at cell i
+ * @param dt_dx Time step over cell size
+ * @param dt 	Time step
+ * @return      New E field value
+ */
+static inline float3 yee_e_cell( float3 e, const float3 b0, const float3 b, const float3 j,
+	const float dt_dx, const float dt )
+{
+	e.x += (                           - dt * j.x );
+	e.y += ( - dt_dx * ( b.z - b0.z) - dt * j.y );
+	e.z += ( + dt_dx * ( b.y - b0.y) - dt * j.z );
+	return e;
 }
 
 /**
- * @brief Advance Electric field using Yee scheme
+ * @brief Advance E and B fields over a range of cells in a single sweep
+ * 
+ * Performs the B half step, E full step (including Mur boundaries) and
+ * second B half step over cells [a, b] of the update range [-1, nx+1].
+ * Cells are processed in blocks of YEE_BLOCK cells, applying all 3 steps
+ * to each block before moving to the next one, with the second B half
+ * step lagging one cell behind, so that field data is only read once from
+ * main memory. When using custom external fields the fields seen by the
+ * particles ( E + E_ext, B + B_ext ) are also updated on each block, on
+ * interior cells only.
+ * 
+ * Must be called by all threads in a parallel region, each one with its own
+ * cell range. Values required from the neighboring ranges are copied before
+ * a barrier, so all ranges are processed concurrently. The first range must
+ * include cells [-1, 0] and the last range cells [nx-1, nx+1], and all other
+ * ranges must lay in between.
  * 
  * @param emf 		EM fields
- * @param current 	Electric current density
- * @param dt 		Time step
+ * @param J 		Electric current density
+ * @param a 		First cell
+ * @param b 		Last cell (if b < a the thread has no cells to process)
  */
-void yee_e( t_emf *emf, const t_current *current, const float dt )
+static void yee_sweep( t_emf *emf, const float3* restrict const J, const int a, const int b )
 {
-	float dt_dx = dt / emf->dx;
-
     float3* const restrict E = emf -> E;
-    const float3* const restrict B = emf -> B;
-    const float3* const restrict J = current -> J;
+    float3* const restrict B = emf -> B;
     const int nx = emf->nx;
 
-	// Canonical implementation
-        #pragma omp parallel for		
-        for (int i = 0; i <= nx+1; i++) {
-		E[i].x += (                                - dt * J[i].x );
-		E[i].y += ( - dt_dx * ( B[i].z - B[i-1].z) - dt * J[i].y );
-		E[i].z += ( + dt_dx * ( B[i].y - B[i-1].y) - dt * J[i].z );
+	const float dt = emf->dt;
+	const float dt_2 = dt / 2.0f;
+	const float dt_dx_b = dt_2 / emf->dx;
+	const float dt_dx_e = dt / emf->dx;
+
+	// Mur boundaries are only applied at the edges of the global grid
+	const int open = ( emf->bc_type == EMF_BC_OPEN );
+	const int mur_lo = open && ! domain_has_lower( 0 );
+	const int mur_hi = open && ! domain_has_upper( 0 );
+
+	// Copy initial values from neighboring ranges
+	float3 bl = {0}, el = {0}, br = {0}, er = {0}, er1 = {0};
+	if ( a <= b ) {
+		if ( a > -1 ) {
+			bl = B[a-1]; el = E[a-1];
+		}
+		if ( b < nx+1 ) {
+			br = B[b+1]; er = E[b+1]; er1 = E[b+2];
+		}
+	}
+
+	#pragma omp barrier
+
+	if ( a > b ) return;
+
+	// Fields seen by particles need updating (custom external fields), these
+	// correspond to the next iteration
+	const int part_fld = ( emf -> ext_fld.E_type == EMF_FLD_TYPE_CUSTOM ||
+	                       emf -> ext_fld.B_type == EMF_FLD_TYPE_CUSTOM );
+	const int iter = emf -> iter + 1;
+
+	const uint64_t t0 = timer_ticks();
+	uint64_t t_mur = 0, t_pf = 0;
+
+	for( int c0 = a; c0 <= b; c0 += YEE_BLOCK ) {
+		const int c1 = ( c0 + YEE_BLOCK < b + 1 ) ? c0 + YEE_BLOCK : b + 1;
+
+		// B 1st half step on cells [c0, c1[ ( limited to [-1, nx] )
+		const int i1 = ( c1 < nx + 1 ) ? c1 : nx + 1;
+		const int iv = ( i1 == b + 1 ) ? i1 - 1 : i1;
+		for( int i = c0; i < iv; i++ ) B[i] = yee_b_cell( B[i], E[i], E[i+1], dt_dx_b );
+		if ( iv < i1 ) B[iv] = yee_b_cell( B[iv], E[iv], er, dt_dx_b );
+
+		// E full step on cells [c0, c1[ ( limited to [0, nx+1] )
+		int j0 = ( c0 > 0 ) ? c0 : 0;
+		if ( j0 == a ) {
+			const float3 b0 = yee_b_cell( bl, el, E[a], dt_dx_b );
+			E[a] = yee_e_cell( E[a], b0, B[a], J[a], dt_dx_e, dt );
+			j0++;
+		}
+		for( int i = j0; i < c1; i++ ) E[i] = yee_e_cell( E[i], B[i-1], B[i], J[i], dt_dx_e, dt );
+
+		// Process open boundaries if needed
+		if ( open ) {
+			const uint64_t tm = timer_ticks();
+			if ( mur_lo && c0 <= 0  && 0  < c1 ) mur_abc_lower( emf );
+			if ( mur_hi && c0 <= nx && nx < c1 ) mur_abc_upper( emf );
+			t_mur += timer_ticks() - tm;
+		}
+
+		// B 2nd half step on cells [c0-1, c1-1[ ( limited to [a, nx] )
+		const int k0 = ( c0 - 1 > a ) ? c0 - 1 : a;
+		const int k1 = ( c1 - 1 < nx + 1 ) ? c1 - 1 : nx + 1;
+		for( int k = k0; k < k1; k++ ) B[k] = yee_b_cell( B[k], E[k], E[k+1], dt_dx_b );
+
+		// Fields on cells [k0, k1[ are final, update fields seen by particles ( limited to [0, nx[ )
+		if ( part_fld ) {
+			const uint64_t tp = timer_ticks();
+			const int p0 = ( k0 > 0 ) ? k0 : 0;
+			const int p1 = ( k1 < nx ) ? k1 : nx;
+			if ( p0 < p1 ) update_part_fld( emf, p0, p1, iter );
+			t_pf += timer_ticks() - tp;
+		}
+	}
+
+	// B 2nd half step for last cell, using E from the next range
+	if ( b <= nx ) {
+		const float3 b1 = yee_b_cell( br, er, er1, dt_dx_b );
+		const float3 e1 = yee_e_cell( er, B[b], b1, J[b+1], dt_dx_e, dt );
+		B[b] = yee_b_cell( B[b], E[b], e1, dt_dx_b );
+	}
+	if ( part_fld && b >= 0 && b < nx ) {
+		const uint64_t tp = timer_ticks();
+		update_part_fld( emf, b, b+1, iter );
+		t_pf += timer_ticks() - tp;
 	}
 
+	// Mur boundaries and the update of the fields seen by particles are timed separately
+	if ( open && ( a <= 0 || b >= nx ) ) timer_phase_add( TIMER_MUR, t_mur );
+	if ( part_fld ) timer_phase_add( TIMER_PART_FLD, t_pf );
+	timer_phase_add( TIMER_YEE, timer_ticks() - t0 - t_mur - t_pf );
 }
 
 /**
  * @brief Updates guard cell values.
  * 
  * When using periodic boundaries copies the lower cells to the upper guard
- * cells and vice-versa.
+ * cells and vice-versa. When using domain decomposition the guard cells are
+ * copied from the neighbouring domains instead.
  * 
  * @param emf 	EM fields
  */
@@ -475,6 +644,14 @@ void emf_update_gc( t_emf *emf )
     float3* const restrict B = emf -> B;
     const int nx = emf->nx;
 
+	if ( domain_size() > 1 ) {
+		const int periodic = ( emf -> bc_type == EMF_BC_PERIODIC );
+		domain_halo_start( &emf -> halo, (float *) E, 3, nx, emf -> gc, periodic );
+		domain_halo_start( &emf -> halo, (float *) B, 3, nx, emf -> gc, periodic );
+		domain_wait( &emf -> halo );
+		return;
+	}
+
 	if ( emf -> bc_type == EMF_BC_PERIODIC ) {
 		// x
 
@@ -503,6 +680,66 @@ void emf_update_gc( t_emf *emf )
 
 }
 
+/**
+ * @brief Enables / disables the deterministic (reproducible) field advance
+ * 
+ * The field sweep (see `yee_sweep()`) recomputes some values at the edges of
+ * the cell range of each thread, and these may round differently from the
+ * values computed inside the range (e.g. vectorized or contracted to fused
+ * multiply-add operations), so results depend on the number of threads.
+ * When enabled, the sweep is done by a single thread over the whole grid.
+ * 
+ * @param emf 		EM fields
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void emf_set_deterministic( t_emf* const emf, const int enable )
+{
+	emf -> deterministic = ( enable != 0 );
+}
+
+/**
+ * @brief Enables the moving window algorithm for the EM fields
+ * 
+ * The E and B buffers are grown by `nx` cells, so that the window can be
+ * moved by just shifting the origin of the grids inside the buffers, see
+ * `emf_move_window()`.
+ * 
+ * @param emf 	EM fields
+ */
+void emf_set_moving_window( t_emf* const emf )
+{
+	emf -> moving_window = 1;
+
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
+	if ( emf -> buf_size > win ) return;
+
+	const int size = win + emf->nx;
+
+	float3* E_buf = arena_malloc( size * sizeof( float3 ) );
+	float3* B_buf = arena_malloc( size * sizeof( float3 ) );
+
+	// Zero in parallel (first touch)
+	arena_touch( E_buf, size * sizeof( float3 ) );
+	arena_touch( B_buf, size * sizeof( float3 ) );
+
+	memcpy( E_buf, emf -> E - emf->gc[0], win * sizeof( float3 ) );
+	memcpy( B_buf, emf -> B - emf->gc[0], win * sizeof( float3 ) );
+
+	arena_free( emf -> E_buf );
+	arena_free( emf -> B_buf );
+
+	emf -> E_buf = E_buf;
+	emf -> B_buf = B_buf;
+	emf -> buf_size = size;
+	emf -> buf_off = 0;
+
+	emf -> E = E_buf + emf->gc[0];
+	emf -> B = B_buf + emf->gc[0];
+
+	if ( emf -> ext_fld.E_type != EMF_FLD_TYPE_CUSTOM ) emf -> E_part = emf -> E;
+	if ( emf -> ext_fld.B_type != EMF_FLD_TYPE_CUSTOM ) emf -> B_part = emf -> B;
+}
+
 /**
  * @brief Move simulation window
  * 
@@ -510,76 +747,170 @@ void emf_update_gc( t_emf *emf )
  * at the current iteration and if so shifts left the data and zeroes
  * rightmost cells.
  * 
+ * The data is shifted by moving the origin of the E and B grids 1 cell
+ * forward inside the buffers. When the end of the buffers is reached the
+ * data is copied back to the beginning of the buffers, so the (amortized)
+ * cost of a window move is O(gc).
+ * 
+ * When using domain decomposition only the upper domain zeroes the
+ * rightmost cells, the other domains get them from the upper neighbour (the
+ * guard cells must be up to date).
+ * 
  * @param emf 
  */
 void emf_move_window( t_emf *emf ){
 	if ( ( emf -> iter * emf -> dt ) > emf->dx*( emf -> n_move + 1 ) ) {
 
-	    float3* const restrict E = emf -> E;
-	    float3* const restrict B = emf -> B;
+		const int gc0 = emf->gc[0];
+		const int win = gc0 + emf->nx + emf->gc[1];
 
-		// Shift data left 1 cell and zero rightmost cells
+		// Shift data left 1 cell
+		emf -> buf_off++;
 
-		for (int i = -emf->gc[0]; i < emf->nx+emf->gc[1] - 1; i++) {
-			E[ i ] = E[ i + 1 ];
-			B[ i ] = B[ i + 1 ];
+		if ( emf -> buf_off + win > emf -> buf_size ) {
+			// The last guard cell is updated below
+			memmove( emf -> E_buf, emf -> E_buf + emf -> buf_off, ( win - 1 ) * sizeof( float3 ) );
+			memmove( emf -> B_buf, emf -> B_buf + emf -> buf_off, ( win - 1 ) * sizeof( float3 ) );
+			emf -> buf_off = 0;
 		}
 
-	    const float3 zero_fld = {0.,0.,0.};
-		for(int i = emf->nx - 1; i < emf->nx+emf->gc[1]; i ++) {
-			E[ i ] = zero_fld;
-			B[ i ] = zero_fld;
+		emf -> E = emf -> E_buf + emf -> buf_off + gc0;
+		emf -> B = emf -> B_buf + emf -> buf_off + gc0;
+
+		// Particle fields just point to the self-consistent fields
+		if ( emf -> ext_fld.E_type != EMF_FLD_TYPE_CUSTOM ) emf -> E_part = emf -> E;
+		if ( emf -> ext_fld.B_type != EMF_FLD_TYPE_CUSTOM ) emf -> B_part = emf -> B;
+
+		// Zero rightmost cells
+		if ( ! domain_has_upper( 0 ) ) {
+		    float3* const restrict E = emf -> E;
+		    float3* const restrict B = emf -> B;
+
+		    const float3 zero_fld = {0.,0.,0.};
+			for(int i = emf->nx - 1; i < emf->nx+emf->gc[1]; i ++) {
+				E[ i ] = zero_fld;
+				B[ i ] = zero_fld;
+			}
 		}
 
+		// The other domains got the new rightmost cell from the upper domain,
+		// update the guard cells
+		if ( domain_size() > 1 ) emf_update_gc( emf );
+
 		// Increase moving window counter
 		emf -> n_move++;
+
+		// Shift cached external fields and update the fields seen by particles
+		if ( emf -> ext_fld.E_type == EMF_FLD_TYPE_CUSTOM || emf -> ext_fld.B_type == EMF_FLD_TYPE_CUSTOM ) {
+			ext_fld_move_window( emf );
+			emf_update_part_fld( emf );
+		}
 	}
 }
 
 /**
  * @brief Advance EM fields 1 timestep
  * 
- * Fields are advanced in time using a FDTD algorith. The routine will also:
- * 1. Update guard cell values / apply boundary conditions
- * 2. Update "particle" fields if using external fields
- * 3. Move simulation window 
+ * Must be called by all threads of the current parallel region,
+ * see `emf_advance()`
  * 
  * @param emf 		EM fields
  * @param current 	Electric current density
  */
-void emf_advance( t_emf *emf, const t_current *current )
+static void emf_advance_omp( t_emf *emf, const t_current *current )
 {
-	uint64_t t0 = timer_ticks();
-	const float dt = emf->dt;
+	uint64_t t0 = 0;
+	#pragma omp master
+	t0 = timer_ticks();
+
+	const int nx = emf->nx;
+	const int nt  = omp_get_num_threads();
+	const int tid = omp_get_thread_num();
+
+	// Split update range [-1, nx+1] between threads, making sure that
+	// Mur boundaries are processed by the first / last thread
+	int a = -1 + (int) ( ( (int64_t) (nx + 3) *  tid      ) / nt );
+	int b = -1 + (int) ( ( (int64_t) (nx + 3) * (tid + 1) ) / nt ) - 1;
+	if ( tid > 0 ) {
+		if ( a < 1 ) a = 1;
+		if ( a > nx-1 ) a = nx-1;
+	}
+	if ( tid < nt - 1 ) {
+		if ( b < 0 ) b = 0;
+		if ( b > nx-2 ) b = nx-2;
+	}
 
-	// Advance EM field using Yee algorithm modified for having E and B time centered
-        
-		
-	  yee_b( emf, dt/2.0f );
+	// Deterministic advance uses a single range
+	if ( emf -> deterministic ) {
+		a = ( tid == 0 ) ? -1 : 0;
+		b = ( tid == 0 ) ? nx+1 : -1;
+	}
 
-	  yee_e( emf, current, dt );
-	
+	// Advance EM field using Yee algorithm modified for having E and B time
+	// centered, this also updates the fields seen by particles on interior cells
+	yee_sweep( emf, current -> J, a, b );
 
-    // Process open boundaries if needed
-    if ( emf->bc_type == EMF_BC_OPEN ) mur_abc( emf );
+	#pragma omp barrier
 
-	
-    	yee_b( emf, dt/2.0f );
+	#pragma omp master
+	{
+		// Update guard cells
+		uint64_t t1 = timer_ticks();
+		emf_update_gc( emf );
 
-	// Update guard cells
-	emf_update_gc( emf );
+		// Update contribuition of external fields on guard cells
+		update_part_fld( emf, -emf->gc[0], 0, emf -> iter + 1 );
+		update_part_fld( emf, nx, nx+emf->gc[1], emf -> iter + 1 );
+		timer_phase_add( TIMER_EMF_GC, timer_ticks() - t1 );
 
-	// Update contribuition of external fields if necessary
-	emf_update_part_fld( emf );
+		// Advance internal iteration number
+		emf -> iter += 1;
 
-	// Advance internal iteration number
-    emf -> iter += 1;
+		// Move simulation window if needed
+		if ( emf -> moving_window ) {
+			t1 = timer_ticks();
+			emf_move_window( emf );
+			timer_phase_add( TIMER_MOVE_WINDOW, timer_ticks() - t1 );
+		}
 
-    // Move simulation window if needed
-    if ( emf -> moving_window ) emf_move_window( emf );
+		// Update timing information
+		_emf_time += timer_interval_seconds(t0, timer_ticks());
+	}
+
+	#pragma omp barrier
+}
 
-    // Update timing information
-	_emf_time += timer_interval_seconds(t0, timer_ticks());
+/**
+ * @brief Advance EM fields 1 timestep
+ * 
+ * Fields are advanced in time using a FDTD algorith. The routine will also:
+ * 1. Update guard cell values / apply boundary conditions
+ * 2. Update "particle" fields if using external fields
+ * 3. Move simulation window 
+ * 
+ * The field advance (B half step, E step and B half step) is done in a
+ * single sweep over the grid (see `yee_sweep()`), with each thread
+ * processing a contiguous range of cells. The "particle" fields for the
+ * interior cells are updated by the same thread immediately afterwards,
+ * while the data is still in cache. Custom external field functions may
+ * therefore be called concurrently by multiple threads. When using domain
+ * decomposition this update is done after the sweep, overlapping with the
+ * guard cell exchange with the neighbouring domains.
+ * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
+ * @param emf 		EM fields
+ * @param current 	Electric current density
+ */
+void emf_advance( t_emf *emf, const t_current *current )
+{
+	if ( omp_in_parallel() ) {
+		emf_advance_omp( emf, current );
+	} else {
+		#pragma omp parallel
+		emf_advance_omp( emf, current );
+	}
 }
 
 /**
@@ -621,71 +952,173 @@ External Fields
  *********************************************************************************************/
 
 /**
- * @brief Sets the external fields to be used for the simulation
+ * @brief Number of time samples to cache for a custom external field
  * 
  * @param emf 		EM field
- * @param ext_fld 	External fields
+ * @param mode 		Time / space dependence of the field
+ * @param period 	Field period (periodic fields only)
+ * @return 			Number of time samples
  */
-void emf_set_ext_fld( t_emf* const emf, t_emf_ext_fld* ext_fld ) {
+static int ext_fld_nphase( const t_emf* emf, const enum emf_ext_fld_mode mode, const float period )
+{
+	if ( mode != EMF_EXT_FLD_PERIODIC ) return 1;
 
-	emf -> ext_fld.E_type = ext_fld -> E_type;
+	const int nphase = lrint( period / emf -> dt );
+	if ( nphase < 1 || fabs( nphase * emf -> dt - period ) > 1e-3 * period ) {
+		fprintf(stderr, "(*error*) External field period (%g) must be a multiple of the time step (%g), aborting.\n",
+			period, emf -> dt );
+		exit(-1);
+	}
+	return nphase;
+}
 
-	if ( emf -> ext_fld.E_type == EMF_FLD_TYPE_NONE ) {
-		// Particle fields just point to the self-consistent fields
-		emf -> E_part = emf -> E;
-		emf -> ext_fld.E_part_buf = NULL;
+/**
+ * @brief Samples a custom external field into the cache grids
+ * 
+ * All cached time samples are updated for cells [i0, i1[.
+ * 
+ * @param emf 	EM field
+ * @param fld 	Field to sample, one of {EFLD, BFLD}
+ * @param i0 	First cell
+ * @param i1 	Last cell + 1
+ */
+static void ext_fld_sample( t_emf* const emf, const enum emf_diag fld, const int i0, const int i1 )
+{
+	t_emf_ext_fld* const ext = &emf -> ext_fld;
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
+
+	const enum emf_ext_fld_mode mode = ( fld == EFLD ) ? ext -> E_mode : ext -> B_mode;
+	const int nphase = ( fld == EFLD ) ? ext -> E_nphase : ext -> B_nphase;
+	float3* const buf = ( ( fld == EFLD ) ? ext -> E_ext_buf : ext -> B_ext_buf ) + emf->gc[0];
+	void* const data = ( fld == EFLD ) ? ext -> E_custom_data : ext -> B_custom_data;
+
+	// Static fields are fixed in the lab frame
+	const int ix_off = emf -> domain_ix0 + ( ( mode == EMF_EXT_FLD_STATIC ) ? emf -> n_move : 0 );
+
+	if ( mode == EMF_EXT_FLD_PERIODIC ) {
+		float3 (*f)(int, float, float, void*) = ( fld == EFLD ) ? ext -> E_custom_t : ext -> B_custom_t;
+		for( int k = 0; k < nphase; k++ ) {
+			const float t = k * emf -> dt;
+			for( int i = i0; i < i1; i++ ) buf[ k * win + i ] = (*f)( i + ix_off, emf -> dx, t, data );
+		}
 	} else {
-	    switch( emf -> ext_fld.E_type ) {
-	        case( EMF_FLD_TYPE_UNIFORM ):
-	        	emf -> ext_fld.E_0 = ext_fld->E_0;
-	        	break;
+		float3 (*f)(int, float, void*) = ( fld == EFLD ) ? ext -> E_custom : ext -> B_custom;
+		for( int i = i0; i < i1; i++ ) buf[ i ] = (*f)( i + ix_off, emf -> dx, data );
+	}
+}
 
-	        case( EMF_FLD_TYPE_CUSTOM ):
-	        	emf -> ext_fld.E_custom = ext_fld->E_custom;
-	        	emf -> ext_fld.E_custom_data = ext_fld->E_custom_data;
-	        	break;
+/**
+ * @brief Initializes the particle field grid and the cache of a custom external field
+ * 
+ * @param emf 	EM field
+ * @param fld 	Field to initialize, one of {EFLD, BFLD}
+ */
+static void ext_fld_new( t_emf* const emf, const enum emf_diag fld )
+{
+	t_emf_ext_fld* const ext = &emf -> ext_fld;
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
 
-	    	default:
-	    		fprintf(stderr, "Invalid external field type, aborting.\n" );
-				exit(-1);
-	    }
+	const enum emf_ext_fld_mode mode = ( fld == EFLD ) ? ext -> E_mode : ext -> B_mode;
 
-		// Allocate space for additional field grids
-        size_t size = (emf->gc[0] + emf->nx + emf->gc[1]) * sizeof( float3 ) ;
-	
-		emf->ext_fld.E_part_buf = malloc( size );
-        emf->E_part = emf->ext_fld.E_part_buf + emf->gc[0];
+	if ( mode == EMF_EXT_FLD_PERIODIC ) {
+		if ( ( fld == EFLD && ! ext -> E_custom_t ) || ( fld == BFLD && ! ext -> B_custom_t ) ) {
+			fprintf(stderr, "(*error*) Periodic external fields require a time dependent function, aborting.\n" );
+			exit(-1);
+		}
+	} else {
+		if ( ( fld == EFLD && ! ext -> E_custom ) || ( fld == BFLD && ! ext -> B_custom ) ) {
+			fprintf(stderr, "(*error*) Custom external fields require a field function, aborting.\n" );
+			exit(-1);
+		}
 	}
 
-	emf -> ext_fld.B_type = ext_fld -> B_type;
+	const int nphase = ext_fld_nphase( emf, mode, ( fld == EFLD ) ? ext -> E_period : ext -> B_period );
 
-	if ( emf -> ext_fld.B_type == EMF_FLD_TYPE_NONE ) {
-		// Particle fields just point to the self-consistent fields
-		emf -> B_part = emf -> B;
-		emf -> ext_fld.B_part_buf = NULL;
+	float3* part_buf = malloc( win * sizeof( float3 ) );
+	float3* ext_buf  = malloc( (size_t) nphase * win * sizeof( float3 ) );
+	if ( ! part_buf || ! ext_buf ) {
+		fprintf(stderr, "(*error*) Unable to allocate external field grids, aborting.\n" );
+		exit(-1);
+	}
+
+	if ( fld == EFLD ) {
+		ext -> E_part_buf = part_buf;
+		ext -> E_ext_buf  = ext_buf;
+		ext -> E_nphase   = nphase;
 	} else {
-	    switch( emf -> ext_fld.B_type ) {
-	        case( EMF_FLD_TYPE_UNIFORM ):
-	        	emf -> ext_fld.B_0 = ext_fld->B_0;
-	        	break;
+		ext -> B_part_buf = part_buf;
+		ext -> B_ext_buf  = ext_buf;
+		ext -> B_nphase   = nphase;
+	}
+
+	ext_fld_sample( emf, fld, -emf->gc[0], emf->nx + emf->gc[1] );
+}
 
-	        case( EMF_FLD_TYPE_CUSTOM ):
-	        	emf -> ext_fld.B_custom = ext_fld->B_custom;
-	        	emf -> ext_fld.B_custom_data = ext_fld->B_custom_data;
-	        	break;
+/**
+ * @brief Sets the external fields to be used for the simulation
+ * 
+ * Uniform external fields are added directly to the fields interpolated at
+ * the particle positions by the particle push, so the particle fields
+ * (`E_part`, `B_part`) just point to the self-consistent fields.
+ * 
+ * Custom external fields are sampled once into cached grids (one grid per
+ * time step of the period for periodic fields), and the total field seen
+ * by the particles is updated during the field solve (see `yee_sweep()`).
+ * Static (lab frame) fields are resampled only on the new cells when the
+ * simulation window moves.
+ * 
+ * @param emf 		EM field
+ * @param ext_fld 	External fields
+ */
+void emf_set_ext_fld( t_emf* const emf, t_emf_ext_fld* ext_fld ) {
 
-	    	default:
-	    		fprintf(stderr, "Invalid external field type, aborting.\n" );
-				exit(-1);
-	    }
+	// Discard previous external field grids, if any
+	free( emf -> ext_fld.E_part_buf );
+	free( emf -> ext_fld.B_part_buf );
+	free( emf -> ext_fld.E_ext_buf );
+	free( emf -> ext_fld.B_ext_buf );
+
+	// Copy parameters
+	emf -> ext_fld = *ext_fld;
+	emf -> ext_fld.E_part_buf = NULL;
+	emf -> ext_fld.B_part_buf = NULL;
+	emf -> ext_fld.E_ext_buf = NULL;
+	emf -> ext_fld.B_ext_buf = NULL;
+	emf -> ext_fld.E_nphase = 0;
+	emf -> ext_fld.B_nphase = 0;
+
+	switch( emf -> ext_fld.E_type ) {
+		case( EMF_FLD_TYPE_NONE ):
+		case( EMF_FLD_TYPE_UNIFORM ):
+			break;
 
-		// Allocate space for additional field grids
-        size_t size = (emf->gc[0] + emf->nx + emf->gc[1]) * sizeof( float3 ) ;
-	
-		emf->ext_fld.B_part_buf = malloc( size );
-        emf->B_part = emf->ext_fld.B_part_buf + emf->gc[0];
+		case( EMF_FLD_TYPE_CUSTOM ):
+			ext_fld_new( emf, EFLD );
+			break;
+
+		default:
+			fprintf(stderr, "Invalid external field type, aborting.\n" );
+			exit(-1);
 	}
 
+	switch( emf -> ext_fld.B_type ) {
+		case( EMF_FLD_TYPE_NONE ):
+		case( EMF_FLD_TYPE_UNIFORM ):
+			break;
+
+		case( EMF_FLD_TYPE_CUSTOM ):
+			ext_fld_new( emf, BFLD );
+			break;
+
+		default:
+			fprintf(stderr, "Invalid external field type, aborting.\n" );
+			exit(-1);
+	}
+
+	// Particle fields point either to the self-consistent fields or to the additional grids
+	emf -> E_part = emf -> ext_fld.E_part_buf ? emf -> ext_fld.E_part_buf + emf->gc[0] : emf -> E;
+	emf -> B_part = emf -> ext_fld.B_part_buf ? emf -> ext_fld.B_part_buf + emf->gc[0] : emf -> B;
+
     // Initialize values on E/B_part grids
     emf_update_part_fld( emf );
 
@@ -693,73 +1126,80 @@ void emf_set_ext_fld( t_emf* const emf, t_emf_ext_fld* ext_fld ) {
 
 /**
  * @brief Updates field values seen by particles with externally imposed fields
+ * in the cell range [i0, i1[
+ * 
+ * Only custom external fields are stored on the particle field grids, the
+ * external field values are taken from the cached grids.
  * 
  * @param emf 	EM fields
+ * @param i0 	First cell
+ * @param i1 	Last cell + 1
+ * @param iter 	Iteration of the self-consistent fields (selects the time
+ * 				sample of periodic fields)
  */
-void emf_update_part_fld( t_emf* const emf ) {
+static void update_part_fld( t_emf* const emf, const int i0, const int i1, const int iter ) {
 
-    // Restrict pointers to E_part
-    float3* const restrict E_part = emf->E_part;
+    const t_emf_ext_fld* const ext = &emf -> ext_fld;
+    const int win = emf->gc[0] + emf->nx + emf->gc[1];
 
-    switch (emf->ext_fld.E_type)
-    {
-    case EMF_FLD_TYPE_UNIFORM: {
+    if ( ext -> E_type == EMF_FLD_TYPE_CUSTOM ) {
+        const float3* const restrict E = emf -> E;
+        const float3* const restrict E_ext = ext -> E_ext_buf + ( iter % ext -> E_nphase ) * win + emf->gc[0];
+        float3* const restrict E_part = emf -> E_part;
 
-        for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
-            float3 e = emf -> E[i];
-            e.x += emf->ext_fld.E_0.x;
-            e.y += emf->ext_fld.E_0.y;
-            e.z += emf->ext_fld.E_0.z;
-            E_part[i] = e;
+        for (int i=i0; i<i1; i++) {
+            E_part[i].x = E[i].x + E_ext[i].x;
+            E_part[i].y = E[i].y + E_ext[i].y;
+            E_part[i].z = E[i].z + E_ext[i].z;
         }
-        break; }
-    case EMF_FLD_TYPE_CUSTOM: {
-				      
-        for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
-            float3 ext_E = (*emf->ext_fld.E_custom)(i,emf->dx,emf->ext_fld.E_custom_data);
+    }
 
-            float3 e = emf -> E[i];
-            e.x += ext_E.x;
-            e.y += ext_E.y;
-            e.z += ext_E.z;
-            E_part[i] = e;
+    if ( ext -> B_type == EMF_FLD_TYPE_CUSTOM ) {
+        const float3* const restrict B = emf -> B;
+        const float3* const restrict B_ext = ext -> B_ext_buf + ( iter % ext -> B_nphase ) * win + emf->gc[0];
+        float3* const restrict B_part = emf -> B_part;
+
+        for (int i=i0; i<i1; i++) {
+            B_part[i].x = B[i].x + B_ext[i].x;
+            B_part[i].y = B[i].y + B_ext[i].y;
+            B_part[i].z = B[i].z + B_ext[i].z;
         }
-        break; }
-    case EMF_FLD_TYPE_NONE:
-        break;
     }
 
-    // Restrict pointers to B_part
-    float3* const restrict B_part = emf->B_part;
+}
 
-    switch (emf->ext_fld.B_type)
-    {
-    case EMF_FLD_TYPE_UNIFORM: {
-        for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
-            float3 b = emf -> B[i];
-            b.x += emf->ext_fld.B_0.x;
-            b.y += emf->ext_fld.B_0.y;
-            b.z += emf->ext_fld.B_0.z;
-            B_part[i] = b;
-        }
+/**
+ * @brief Shifts the cached static (lab frame) external fields after a window move
+ * 
+ * The cached values are shifted left 1 cell and the new rightmost cell is
+ * sampled. Window relative and periodic fields do not change.
+ * 
+ * @param emf 	EM fields
+ */
+static void ext_fld_move_window( t_emf* const emf )
+{
+	t_emf_ext_fld* const ext = &emf -> ext_fld;
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
 
-    }
-        break; 
-    case EMF_FLD_TYPE_CUSTOM: {
-        for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
-            float3 ext_B = (*emf->ext_fld.B_custom)(i,emf->dx,emf->ext_fld.B_custom_data);
+	if ( ext -> E_type == EMF_FLD_TYPE_CUSTOM && ext -> E_mode == EMF_EXT_FLD_STATIC ) {
+		memmove( ext -> E_ext_buf, ext -> E_ext_buf + 1, ( win - 1 ) * sizeof( float3 ) );
+		ext_fld_sample( emf, EFLD, emf->nx + emf->gc[1] - 1, emf->nx + emf->gc[1] );
+	}
 
-            float3 b = emf -> B[i];
-            b.x += ext_B.x;
-            b.y += ext_B.y;
-            b.z += ext_B.z;
-            B_part[i] = b;
-        }
-    }
-        break; 
-    case EMF_FLD_TYPE_NONE:
-        break;
-    }
+	if ( ext -> B_type == EMF_FLD_TYPE_CUSTOM && ext -> B_mode == EMF_EXT_FLD_STATIC ) {
+		memmove( ext -> B_ext_buf, ext -> B_ext_buf + 1, ( win - 1 ) * sizeof( float3 ) );
+		ext_fld_sample( emf, BFLD, emf->nx + emf->gc[1] - 1, emf->nx + emf->gc[1] );
+	}
+}
+
+/**
+ * @brief Updates field values seen by particles with externally imposed fields
+ * 
+ * @param emf 	EM fields
+ */
+void emf_update_part_fld( t_emf* const emf ) {
+
+    update_part_fld( emf, -emf->gc[0], emf->nx+emf->gc[1], emf->iter );
 
 }
 
@@ -792,7 +1232,7 @@ void emf_init_fld( t_emf* const emf, t_emf_init_fld* init_fld )
     case EMF_FLD_TYPE_CUSTOM:
         for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
             float3 init_E = (init_fld->E_custom)
-                (i,emf->dx, init_fld->E_custom_data);
+                (i + emf->domain_ix0,emf->dx, init_fld->E_custom_data);
             E[ i ] = init_E;
         }
         break;
@@ -811,9 +1251,88 @@ void emf_init_fld( t_emf* const emf, t_emf_init_fld* init_fld )
     case EMF_FLD_TYPE_CUSTOM:
         for (int i=-emf->gc[0]; i<emf->nx+emf->gc[1]; i++) {
             float3 init_B = (init_fld->B_custom)
-                (i,emf->dx, init_fld->B_custom_data);
+                (i + emf->domain_ix0,emf->dx, init_fld->B_custom_data);
             B[ i ] = init_B;
         }
         break;
     }
 }
+
+/*********************************************************************************************
+
+ Checkpoint / Restart
+
+ *********************************************************************************************/
+
+/**
+ * @brief Writes the EM fields state to a checkpoint file
+ * 
+ * Stores the E and B fields of the local domain (including guard cells), the
+ * iteration number, the moving window counter and the Mur boundary state.
+ * Since each domain stores its guard cells, the chunks of neighbouring
+ * domains overlap.
+ * 
+ * @param emf 	EM fields
+ * @param zdf 	Checkpoint file, see `checkpoint_open()`
+ * @return 		Returns 1 on success, 0 on error
+ */
+int emf_checkpoint( const t_emf* emf, t_zdf_file* zdf )
+{
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
+	const uint64_t total = 3 * (uint64_t) ( emf->gc[0] + domain_nx() + emf->gc[1] );
+	const uint64_t start = 3 * (uint64_t) emf -> domain_ix0;
+
+	const int32_t state[] = { emf -> iter, emf -> n_move, emf -> nx, emf -> gc[0], emf -> gc[1],
+		emf -> domain_ix0 };
+	const float3 mur[] = { emf -> mur_fld[0], emf -> mur_fld[1], emf -> mur_tmp[0], emf -> mur_tmp[1] };
+
+	return checkpoint_write( zdf, "EMF.state", zdf_int32, state, 6, 0, 6 ) &&
+		   checkpoint_write( zdf, "EMF.mur", zdf_float32, mur, 12, 0, 12 ) &&
+		   checkpoint_write( zdf, "EMF.E", zdf_float32, emf -> E - emf->gc[0], 3 * win, start, total ) &&
+		   checkpoint_write( zdf, "EMF.B", zdf_float32, emf -> B - emf->gc[0], 3 * win, start, total );
+}
+
+/**
+ * @brief Restores the EM fields state from a checkpoint file
+ * 
+ * The grid (number of cells, guard cells and domain decomposition) must be the
+ * same used when the checkpoint was written, otherwise the routine aborts the
+ * code. Cached custom external fields are resampled for the restored moving
+ * window position, and the fields seen by the particles are updated.
+ * 
+ * @param emf 	EM fields
+ * @param map 	Mapped checkpoint file, see `checkpoint_map()`
+ */
+void emf_restart( t_emf* emf, const t_zdf_map* map )
+{
+	const int win = emf->gc[0] + emf->nx + emf->gc[1];
+
+	int32_t state[6];
+	memcpy( state, checkpoint_read( map, "EMF.state", zdf_int32, 6 ), sizeof( state ) );
+
+	if ( state[2] != emf -> nx || state[3] != emf->gc[0] || state[4] != emf->gc[1] ||
+		 state[5] != emf -> domain_ix0 ) {
+		fprintf(stderr, "(*error*) Checkpoint EM field grid does not match the simulation grid, aborting.\n" );
+		exit(-1);
+	}
+
+	emf -> iter   = state[0];
+	emf -> n_move = state[1];
+
+	float3 mur[4];
+	memcpy( mur, checkpoint_read( map, "EMF.mur", zdf_float32, 12 ), sizeof( mur ) );
+	emf -> mur_fld[0] = mur[0];
+	emf -> mur_fld[1] = mur[1];
+	emf -> mur_tmp[0] = mur[2];
+	emf -> mur_tmp[1] = mur[3];
+
+	memcpy( emf -> E - emf->gc[0], checkpoint_read( map, "EMF.E", zdf_float32, 3 * win ),
+		win * sizeof( float3 ) );
+	memcpy( emf -> B - emf->gc[0], checkpoint_read( map, "EMF.B", zdf_float32, 3 * win ),
+		win * sizeof( float3 ) );
+
+	// Custom external fields
+	if ( emf -> ext_fld.E_type == EMF_FLD_TYPE_CUSTOM ) ext_fld_sample( emf, EFLD, -emf->gc[0], emf->nx + emf->gc[1] );
+	if ( emf -> ext_fld.B_type == EMF_FLD_TYPE_CUSTOM ) ext_fld_sample( emf, BFLD, -emf->gc[0], emf->nx + emf->gc[1] );
+	emf_update_part_fld( emf );
+}
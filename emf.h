@@ -12,6 +12,8 @@
 
 #include "zpic.h"
 #include "current.h"
+#include "domain.h"
+#include "zdf.h"
 
 /**
  * @brief External/initial EM field types
@@ -23,9 +25,25 @@ enum emf_fld_type {
     EMF_FLD_TYPE_CUSTOM     ///< Defined from an external function
 };
 
+/**
+ * @brief Time / space dependence of custom external fields
+ * 
+ * Custom external fields are sampled into cached grids, so the custom
+ * field functions are not called at every time step.
+ */
+enum emf_ext_fld_mode {
+    EMF_EXT_FLD_WINDOW,     ///< Constant in time, position relative to the simulation window (default)
+    EMF_EXT_FLD_STATIC,     ///< Constant in time, fixed in the lab frame
+    EMF_EXT_FLD_PERIODIC    ///< Periodic in time, position relative to the simulation window
+};
+
 /**
  * @brief EM external field parameters
  * 
+ * Custom fields are defined by a function of the cell index, the cell size
+ * and the additional data pointer. For `EMF_EXT_FLD_PERIODIC` fields the
+ * function also takes the simulation time (argument 3, sampled at every
+ * time step in [0, period[ ) and must be set in `E_custom_t` / `B_custom_t`.
  */
 typedef struct EMF_ExternalField {
 
@@ -41,8 +59,22 @@ typedef struct EMF_ExternalField {
     void *E_custom_data; ///< Additional data to be passed to the E_custom function
     void *B_custom_data; ///< Additional data to be passed to the B_custom function
 
-    float3 *E_part_buf; ///< E field seen by particles
-    float3 *B_part_buf; ///< B field seen by particles
+    enum emf_ext_fld_mode E_mode;   ///< Time / space dependence of custom external E field
+    enum emf_ext_fld_mode B_mode;   ///< Time / space dependence of custom external B field
+
+    float3 (*E_custom_t)(int, float, float, void*);  ///< Custom periodic external E-field function
+    float3 (*B_custom_t)(int, float, float, void*);  ///< Custom periodic external B-field function
+
+    float E_period; ///< Period of custom periodic external E field, must be a multiple of dt
+    float B_period; ///< Period of custom periodic external B field, must be a multiple of dt
+
+    int E_nphase;       ///< Number of cached time samples of custom external E field
+    int B_nphase;       ///< Number of cached time samples of custom external B field
+    float3 *E_ext_buf;  ///< Cached custom external E field values
+    float3 *B_ext_buf;  ///< Cached custom external B field values
+
+    float3 *E_part_buf; ///< E field seen by particles (custom external fields only)
+    float3 *B_part_buf; ///< B field seen by particles (custom external fields only)
 } t_emf_ext_fld;
 
 /**
@@ -99,13 +131,16 @@ typedef struct EMF {
     float3 *E_buf;  ///< E field buffer (includes guard cells)
     float3 *B_buf;  ///< B field buffer (includes guard cells)
 
+    int buf_size;   ///< Size of E / B buffers (cells)
+    int buf_off;    ///< Position of cell -gc[0] inside the E / B buffers (moving window)
+
     // Fields seen by particles
     // When using external fields these will be a combination of the simulation
     // fields and the externally imposed ones. When external fields are off
     // these just point to E and B.
     
-    float3 *E_part; ///< Pointer to grid cell 0 of particles E field
-    float3 *B_part; ///< Pointer to grid cell 0 of particles B field
+    float3 *E_part; ///< Pointer to grid cell 0 of particles E field (excluding uniform external fields)
+    float3 *B_part; ///< Pointer to grid cell 0 of particles B field (excluding uniform external fields)
 
     // Simulation box info
     int nx;  ///< Number of grid points (excluding guard cells) 
@@ -113,6 +148,10 @@ typedef struct EMF {
     float box;  ///< Physical size of simulation box
     float dx;   ///< Grid cell size
 
+    // Domain decomposition
+    int domain_ix0;     ///< Global index of local cell 0 (see `domain_decompose()`)
+    t_domain_msg halo;  ///< Pending guard cell messages
+
     float dt;   ///< Time step
 
     int iter;   ///< Current iteration number
@@ -129,6 +168,9 @@ typedef struct EMF {
     /// External fields configuration
     t_emf_ext_fld ext_fld;
 
+    /// Deterministic advance (results independent of the number of threads)
+    int deterministic;
+
 } t_emf;
 
 
@@ -165,11 +207,12 @@ void emf_get_energy( const t_emf *emf, double energy[] );
  * @brief Initalized EM fields object
  * 
  * @param emf 	EM fields
- * @param nx 	Number of grid cells
+ * @param nx 	Number of grid cells (global)
  * @param box 	Physical box size
  * @param dt 	Simulation time step
+ * @param order Highest particle shape order in use (sets the number of guard cells)
  */
-void emf_new( t_emf *emf, int nx, float box, const float dt );
+void emf_new( t_emf *emf, int nx, float box, const float dt, const int order );
 
 /**
  * @brief Frees dynamic memory from EM fields.
@@ -220,6 +263,21 @@ void emf_init_fld( t_emf* const emf, t_emf_init_fld* inifloat );
  */
 void emf_set_ext_fld( t_emf* const emf, t_emf_ext_fld* exfloat );
 
+/**
+ * @brief Enables the moving window algorithm for the EM fields
+ * 
+ * @param emf 		EM field
+ */
+void emf_set_moving_window( t_emf* const emf );
+
+/**
+ * @brief Enables / disables the deterministic (reproducible) field advance
+ * 
+ * @param emf 		EM field
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void emf_set_deterministic( t_emf* const emf, const int enable );
+
 /**
  * @brief Advance EM fields 1 timestep
  * 
@@ -240,4 +298,21 @@ void emf_advance( t_emf *emf, const t_current *current );
  */
 double emf_time( void );
 
+/**
+ * @brief Writes the EM fields state to a checkpoint file
+ * 
+ * @param emf 	EM fields
+ * @param zdf 	Checkpoint file
+ * @return 		Returns 1 on success, 0 on error
+ */
+int emf_checkpoint( const t_emf* emf, t_zdf_file* zdf );
+
+/**
+ * @brief Restores the EM fields state from a checkpoint file
+ * 
+ * @param emf 	EM fields
+ * @param map 	Mapped checkpoint file
+ */
+void emf_restart( t_emf* emf, const t_zdf_map* map );
+
 #endif
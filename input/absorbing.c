@@ -19,6 +19,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 1000;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 50;
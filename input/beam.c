@@ -16,6 +16,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 1000;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 50;
@@ -24,7 +25,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 128 particles per cell
-	int ppc = 128;
+	int ppc = sim_param_int( "ppc", 128 );
 
 	// Initial fluid and thermal velocities
 	float ufl[] = { 0.2, 0.0, 0.0 };
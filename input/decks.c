@@ -0,0 +1,119 @@
+/**
+ * @file decks.c
+ * @author Ricardo Fonseca
+ * @brief Input deck registry
+ * @version 0.1
+ * @date 2022-02-04
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * All input decks are compiled into the code, so that the deck can be
+ * selected at launch time. Each deck is included here with its `sim_init()`
+ * and `sim_report()` routines renamed to `<deck>_init()` and `<deck>_report()`.
+ * 
+ * To add a new deck, write it as usual (see the other files in this
+ * directory), include it below with the routine names redefined and add it
+ * to the `decks[]` list.
+ */
+
+#include <string.h>
+
+#include "decks.h"
+
+#define sim_init   absorbing_init
+#define sim_report absorbing_report
+#include "absorbing.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   beam_init
+#define sim_report beam_report
+#include "beam.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   density_init
+#define sim_report density_report
+#include "density.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   laser_init
+#define sim_report laser_report
+#include "laser.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   laser_particles_init
+#define sim_report laser_particles_report
+#include "laser_particles.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   lwfa_init
+#define sim_report lwfa_report
+#include "lwfa.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   magnetized_init
+#define sim_report magnetized_report
+#include "magnetized.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   movwindow_init
+#define sim_report movwindow_report
+#include "movwindow.c"
+#undef sim_init
+#undef sim_report
+
+#define sim_init   twostream_init
+#define sim_report twostream_report
+#include "twostream.c"
+#undef sim_init
+#undef sim_report
+
+/// Available input decks
+static const t_deck decks[] = {
+	{ "absorbing",       "Demonstration of the absorbing boundary conditions", absorbing_init, absorbing_report },
+	{ "beam",            "Initializing fluid velocity", beam_init, beam_report },
+	{ "density",         "Initializing different density profiles", density_init, density_report },
+	{ "laser",           "Laser pulse propagation", laser_init, laser_report },
+	{ "laser_particles", "Laser Wakefield Acceleration (in-situ diagnostics)", laser_particles_init, laser_particles_report },
+	{ "lwfa",            "Laser Wakefield Acceleration", lwfa_init, lwfa_report },
+	{ "magnetized",      "Magnetized plasma", magnetized_init, magnetized_report },
+	{ "movwindow",       "Moving simulation window with different density profiles", movwindow_init, movwindow_report },
+	{ "twostream",       "Two-stream instability", twostream_init, twostream_report },
+};
+
+/// Number of available input decks
+static const int n_decks = sizeof( decks ) / sizeof( decks[0] );
+
+/**
+ * @brief Finds input deck by name
+ * 
+ * @param name 	Deck name
+ * @return 		Pointer to deck or NULL if not found
+ */
+const t_deck* deck_find( const char* name )
+{
+	for( int i = 0; i < n_decks; i++ ) {
+		if ( ! strcmp( decks[i].name, name ) ) return &decks[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Prints the list of available input decks
+ * 
+ * @param fp 	Output stream
+ */
+void deck_list( FILE* fp )
+{
+	fprintf( fp, "Available input decks:\n" );
+	for( int i = 0; i < n_decks; i++ ) {
+		fprintf( fp, "  %-16s %s%s\n", decks[i].name, decks[i].description,
+			strcmp( decks[i].name, DECK_DEFAULT ) ? "" : " (default)" );
+	}
+}
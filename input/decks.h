@@ -0,0 +1,52 @@
+/**
+ * @file decks.h
+ * @author Ricardo Fonseca
+ * @brief Input deck registry
+ * @version 0.1
+ * @date 2022-02-04
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef __DECKS__
+#define __DECKS__
+
+#include <stdio.h>
+#include "../simulation.h"
+
+/**
+ * @brief Input deck
+ * 
+ * Each input deck supplies a `sim_init()` and a `sim_report()` routine, that
+ * are renamed when the deck is included in decks.c
+ */
+typedef struct Deck {
+	const char* name;					///< Deck name (input file name without extension)
+	const char* description;			///< Short description
+	void (*init)( t_simulation* );		///< Initializes simulation (deck `sim_init()`)
+	void (*report)( t_simulation* );	///< Saves diagnostic information (deck `sim_report()`)
+} t_deck;
+
+/**
+ * @brief Default input deck name
+ * 
+ */
+#define DECK_DEFAULT "laser_particles"
+
+/**
+ * @brief Finds input deck by name
+ * 
+ * @param name 	Deck name
+ * @return 		Pointer to deck or NULL if not found
+ */
+const t_deck* deck_find( const char* name );
+
+/**
+ * @brief Prints the list of available input decks
+ * 
+ * @param fp 	Output stream
+ */
+void deck_list( FILE* fp );
+
+#endif
@@ -12,6 +12,8 @@
 
 float custom_n0( float x, void *data ) {
 
+	(void) data;
+
 	return 1.0 + 0.5*sin(x/M_PI)*sin(x/M_PI);
 
 }
@@ -25,6 +27,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 64;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 100;
@@ -33,7 +36,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 128 particles per cell
-	int ppc = 128;
+	int ppc = sim_param_int( "ppc", 128 );
 
 	// Density profile
 //	t_density density = { .type = UNIFORM };
@@ -18,6 +18,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 10000;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 0;
@@ -26,7 +27,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 1 particles per cell
-	int ppc = 1;
+	int ppc = sim_param_int( "ppc", 1 );
 
 	// Density profile
 	t_density density = { .type = STEP, .start = 20000000.0 };
@@ -63,6 +64,8 @@ void sim_init( t_simulation* sim ){
 
 void sim_report( t_simulation* sim ){
 
+	(void) sim;
+
 	// All electric field components
 	//emf_report( &sim->emf, EFLD, 0 );
 	//emf_report( &sim->emf, EFLD, 1 );
@@ -18,6 +18,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 20000;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 1;
@@ -26,7 +27,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 1 particles per cell
-	int ppc = 10;
+	int ppc = sim_param_int( "ppc", 10 );
 
 	// Density profile
 	t_density density = { .type = STEP, .start = 54.0 };//55
@@ -58,11 +59,34 @@ void sim_init( t_simulation* sim ){
 
 	sim_set_smooth( sim, &smooth );
 
+	// Example in-situ diagnostics, enabled with the "insitu=1" override
+	// (this must come after sim_new)
+	if ( sim_param_int( "insitu", 0 ) ) {
+		t_insitu envelope = {
+			.type = INSITU_ENVELOPE,
+			.name = "envelope",
+			.n_iter = 10
+		};
+		sim_add_insitu( sim, &envelope );
+
+		t_insitu ene = {
+			.type = INSITU_ENERGY_HIST,
+			.name = "energy",
+			.n_iter = 100,
+			.species = 0,
+			.nbins = 256,
+			.range = {0.0, 20.0}
+		};
+		sim_add_insitu( sim, &ene );
+	}
+
 }
 
 
 void sim_report( t_simulation* sim ){
 
+	(void) sim;
+
 	// All electric field components
 	//emf_report( &sim->emf, EFLD, 0 );
 	//emf_report( &sim->emf, EFLD, 1 );
@@ -18,6 +18,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 1000;
 	float box = 20.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 50;
@@ -26,7 +27,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 128 particles per cell
-	int ppc = 128;
+	int ppc = sim_param_int( "ppc", 128 );
 
 	// Density profile
 	t_density density = { .type = STEP, .start = 20.0 };
@@ -58,6 +59,10 @@ void sim_init( t_simulation* sim ){
 
 	sim_set_smooth( sim, &smooth );
 
+	// Run the time loop inside a single OpenMP parallel region, may be
+	// disabled with the "persistent=0" override (this must come after sim_new)
+	sim_set_omp_persistent( sim, sim_param_int( "persistent", 1 ) );
+
 }
 
 
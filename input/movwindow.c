@@ -18,6 +18,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 1024;
 	float box = 82.0;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 50;
@@ -26,7 +27,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 1;
 
 	// Use 128 particles per cell
-	int ppc = 256;
+	int ppc = sim_param_int( "ppc", 256 );
 
 	// Density profile
 //	t_density density = { .type = UNIFORM };
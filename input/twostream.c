@@ -18,6 +18,7 @@ void sim_init( t_simulation* sim ){
 	// Simulation box
 	int   nx  = 120;
 	float box = 4*M_PI;
+	sim_param_grid( &nx, &box );
 
 	// Diagnostic frequency
 	int ndump = 0;
@@ -26,7 +27,7 @@ void sim_init( t_simulation* sim ){
 	const int n_species = 2;
 
 	// Use 1000 particles per cell
-	int ppc = 500;
+	int ppc = sim_param_int( "ppc", 500 );
 
 	t_species* species = (t_species *) malloc( n_species * sizeof( t_species ));
 
@@ -0,0 +1,473 @@
+/**
+ * @file insitu.c
+ * @author Ricardo Fonseca
+ * @brief In-situ reduced diagnostics
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * In-situ diagnostics compute reduced quantities (e.g. histograms or moments)
+ * directly from the simulation data, in parallel, and store only the result.
+ * Reductions use per thread buffers (allocated once in `insitu_new()`) that
+ * are then added together, so no atomic operations are required.
+ *
+ * When using domain decomposition each domain computes the diagnostic for
+ * its own data, and the results are combined in the root domain before
+ * writing: peak values are taken over all domains, per cell moments are
+ * gathered, and histograms (and custom reductions) are added together.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "insitu.h"
+#include "domain.h"
+#include "timer.h"
+
+/// Number of values stored per cell by INSITU_MOMENTS reductions (count, q, ux, uy, uz)
+#define MOMENTS_NQ 5
+
+/**
+ * @brief Initializes in-situ diagnostic internal data
+ *
+ * @param diag 		In-situ diagnostic (parameters must already be set)
+ * @param emf 		EM fields
+ * @param species 	Particle species (NULL if the diagnostic has no species)
+ */
+void insitu_new( t_insitu* diag, const t_emf* emf, const t_species* species )
+{
+	const int nthreads = omp_get_max_threads();
+
+	switch( diag -> type ) {
+	case INSITU_ENVELOPE:
+		// Peak |E_perp| and position
+		diag -> ndims = 1;
+		diag -> count[0] = 2;
+		diag -> priv_stride = 2;
+		break;
+
+	case INSITU_ENERGY_HIST:
+		if ( species == NULL || diag -> nbins < 1 || !( diag -> range[1] > diag -> range[0] ) ) {
+			fprintf(stderr, "(*error*) Invalid parameters for energy histogram diagnostic %s\n", diag -> name );
+			exit(-1);
+		}
+		diag -> ndims = 1;
+		diag -> count[0] = diag -> nbins;
+		diag -> priv_stride = diag -> nbins;
+		break;
+
+	case INSITU_MOMENTS:
+		if ( species == NULL ) {
+			fprintf(stderr, "(*error*) Invalid species for moments diagnostic %s\n", diag -> name );
+			exit(-1);
+		}
+		// rho, <ux>, <uy>, <uz> for each cell
+		diag -> ndims = 2;
+		diag -> count[0] = domain_nx();
+		diag -> count[1] = 4;
+		diag -> priv_stride = MOMENTS_NQ * emf -> nx;
+		break;
+
+	case INSITU_CUSTOM:
+		if ( diag -> reduce == NULL || diag -> nout < 1 ) {
+			fprintf(stderr, "(*error*) Invalid parameters for custom diagnostic %s\n", diag -> name );
+			exit(-1);
+		}
+		diag -> ndims = 1;
+		diag -> count[0] = diag -> nout;
+		diag -> priv_stride = 0;
+		break;
+
+	default:
+		fprintf(stderr, "(*error*) Invalid in-situ diagnostic type\n" );
+		exit(-1);
+	}
+
+	int nout = diag -> count[0] * ( ( diag -> ndims > 1 ) ? diag -> count[1] : 1 );
+	diag -> out = malloc( nout * sizeof( float ) );
+	diag -> priv = ( diag -> priv_stride > 0 ) ?
+		malloc( nthreads * diag -> priv_stride * sizeof( float ) ) : NULL;
+	diag -> open = 0;
+
+	if ( diag -> n_iter < 1 ) diag -> n_iter = 1;
+}
+
+/**
+ * @brief Closes the output file and frees dynamic memory from in-situ diagnostic
+ *
+ * @param diag 		In-situ diagnostic
+ */
+void insitu_delete( t_insitu* diag )
+{
+	if ( diag -> open ) {
+		zdf_close_grid_series( &diag -> series );
+		diag -> open = 0;
+	}
+
+	free( diag -> out );
+	free( diag -> priv );
+	diag -> out = NULL;
+	diag -> priv = NULL;
+}
+
+/**
+ * @brief Finds the peak of the transverse electric field
+ *
+ * Stores the peak value of sqrt(Ey^2+Ez^2) and its position (including the
+ * moving window motion) in `out`. Must be called by all threads of the current
+ * parallel region.
+ *
+ * @param diag 		In-situ diagnostic
+ * @param emf 		EM fields
+ */
+static void envelope_omp( t_insitu* diag, const t_emf* emf )
+{
+	const float3* restrict const E = emf -> E;
+	float* restrict const priv = diag -> priv + omp_get_thread_num() * diag -> priv_stride;
+
+	float emax = -1.0f;
+	int imax = 0;
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < emf -> nx; i++ ) {
+		float e2 = E[i].y * E[i].y + E[i].z * E[i].z;
+		if ( e2 > emax ) {
+			emax = e2;
+			imax = i;
+		}
+	}
+
+	priv[0] = emax;
+	priv[1] = imax;
+
+	// Threads enumerate the grid in order, keep the first thread holding the maximum
+	#pragma omp barrier
+	#pragma omp single
+	{
+		const int nthreads = omp_get_num_threads();
+		emax = -1.0f; imax = 0;
+		for( int tid = 0; tid < nthreads; tid++ ) {
+			const float* p = diag -> priv + tid * diag -> priv_stride;
+			if ( p[0] > emax ) {
+				emax = p[0];
+				imax = p[1];
+			}
+		}
+		diag -> out[0] = ( emax > 0 ) ? sqrtf( emax ) : 0;
+		diag -> out[1] = ( emf -> n_move + emf -> domain_ix0 + imax ) * emf -> dx;
+	}
+}
+
+/**
+ * @brief Adds the per thread reduction buffers into the diagnostic output
+ *
+ * Must be called by all threads of the current parallel region, after the per
+ * thread buffers have been filled (and the threads synchronized).
+ *
+ * @param diag 		In-situ diagnostic
+ * @param n 		Number of values in each buffer
+ */
+static void reduce_priv_omp( t_insitu* diag, const int n )
+{
+	const int nthreads = omp_get_num_threads();
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < n; i++ ) {
+		float s = 0;
+		for( int tid = 0; tid < nthreads; tid++ ) s += diag -> priv[ tid * diag -> priv_stride + i ];
+		diag -> out[i] = s;
+	}
+}
+
+/**
+ * @brief Builds the kinetic energy histogram of a particle species
+ *
+ * Each bin holds the number of particles with kinetic energy (gamma - 1, in
+ * units of m c^2) inside the bin. Must be called by all threads of the current
+ * parallel region.
+ *
+ * @param diag 		In-situ diagnostic
+ * @param spec 		Particle species
+ */
+static void energy_hist_omp( t_insitu* diag, const t_species* spec )
+{
+	const int nbins = diag -> nbins;
+	const float emin = diag -> range[0];
+	const float rde = nbins / ( diag -> range[1] - diag -> range[0] );
+
+	float* restrict const hist = diag -> priv + omp_get_thread_num() * diag -> priv_stride;
+	for( int i = 0; i < nbins; i++ ) hist[i] = 0;
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < spec -> np; i++ ) {
+		const float ux = PART_UX( spec, i );
+		const float uy = PART_UY( spec, i );
+		const float uz = PART_UZ( spec, i );
+		const float u2 = ux*ux + uy*uy + uz*uz;
+
+		// gamma - 1, avoiding roundoff for small u
+		const float ekin = u2 / ( 1.0f + sqrtf( 1.0f + u2 ) );
+
+		const float pos = ( ekin - emin ) * rde;
+		if ( pos >= 0 && pos < nbins ) hist[ (int) pos ] += 1.0f;
+	}
+
+	reduce_priv_omp( diag, nbins );
+}
+
+/**
+ * @brief Gets per cell moments of a particle species
+ *
+ * Stores the (nearest grid point) charge density and the mean generalized
+ * velocity of each cell. Must be called by all threads of the current
+ * parallel region.
+ *
+ * @param diag 		In-situ diagnostic
+ * @param spec 		Particle species
+ */
+static void moments_omp( t_insitu* diag, const t_species* spec )
+{
+	const int nx = spec -> nx;
+	const float q = spec -> q;
+
+	float* restrict const mom = diag -> priv + omp_get_thread_num() * diag -> priv_stride;
+	for( int i = 0; i < MOMENTS_NQ * nx; i++ ) mom[i] = 0;
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < spec -> np; i++ ) {
+		const int ix = PART_IX( spec, i ) - spec -> ix_off;
+		if ( ix >= 0 && ix < nx ) {
+			float* restrict const m = mom + MOMENTS_NQ * ix;
+			m[0] += 1.0f;
+			m[1] += q;
+			m[2] += PART_UX( spec, i );
+			m[3] += PART_UY( spec, i );
+			m[4] += PART_UZ( spec, i );
+		}
+	}
+
+	// The implicit barrier of the loop above ensures all buffers are complete
+	const int nthreads = omp_get_num_threads();
+	float* restrict const out = diag -> out;
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < nx; i++ ) {
+		float s[MOMENTS_NQ] = {0};
+		for( int tid = 0; tid < nthreads; tid++ ) {
+			const float* m = diag -> priv + tid * diag -> priv_stride + MOMENTS_NQ * i;
+			for( int k = 0; k < MOMENTS_NQ; k++ ) s[k] += m[k];
+		}
+		const float rn = ( s[0] > 0 ) ? 1.0f / s[0] : 0;
+		out[ i          ] = s[1];
+		out[ i +     nx ] = s[2] * rn;
+		out[ i + 2 * nx ] = s[3] * rn;
+		out[ i + 3 * nx ] = s[4] * rn;
+	}
+}
+
+/**
+ * @brief Combines the diagnostic output of all domains in the root domain
+ *
+ * @param diag 		In-situ diagnostic
+ * @param emf 		EM fields
+ * @return 			1 on the root domain, 0 otherwise
+ */
+static int insitu_reduce_domains( t_insitu* diag, const t_emf* emf )
+{
+	if ( domain_size() == 1 ) return 1;
+
+	switch( diag -> type ) {
+	case INSITU_ENVELOPE: {
+		float* all = domain_gather( diag -> out, 2, NULL );
+		if ( ! all ) return 0;
+
+		// Keep the first domain holding the maximum
+		int dmax = 0;
+		for( int d = 1; d < domain_size(); d++ )
+			if ( all[ 2*d ] > all[ 2*dmax ] ) dmax = d;
+
+		diag -> out[0] = all[ 2*dmax ];
+		diag -> out[1] = all[ 2*dmax + 1 ];
+		free( all );
+		return 1;
+	}
+
+	case INSITU_MOMENTS: {
+		float* all[4];
+		for( int q = 0; q < 4; q++ ) all[q] = domain_gather( diag -> out + q * emf -> nx, emf -> nx, NULL );
+		if ( ! all[0] ) return 0;
+
+		for( int q = 0; q < 4; q++ ) {
+			memcpy( diag -> out + q * diag -> count[0], all[q], diag -> count[0] * sizeof( float ) );
+			free( all[q] );
+		}
+		return 1;
+	}
+
+	default:
+		return domain_reduce( diag -> out, diag -> count[0] );
+	}
+}
+
+/**
+ * @brief Appends the diagnostic output to the output file
+ *
+ * @param diag 		In-situ diagnostic
+ * @param emf 		EM fields
+ * @param species 	Particle species (NULL if the diagnostic has no species)
+ */
+static void insitu_write( t_insitu* diag, const t_emf* emf, const t_species* species )
+{
+	t_zdf_grid_axis axis[2];
+	t_zdf_grid_info info = {
+		.name = diag -> name,
+		.ndims = diag -> ndims,
+		.count[0] = diag -> count[0],
+		.count[1] = diag -> count[1],
+		.axis = NULL
+	};
+
+	switch( diag -> type ) {
+	case INSITU_ENVELOPE:
+		info.label = "|E_\\perp|_{max}, x_{max}";
+		info.units = "";
+		break;
+
+	case INSITU_ENERGY_HIST:
+		info.label = "dN/d\\epsilon";
+		info.units = "a.u.";
+		axis[0] = (t_zdf_grid_axis) {
+			.name = "e", .type = zdf_linear,
+			.min = diag -> range[0], .max = diag -> range[1],
+			.label = "\\gamma - 1", .units = "m_e c^2"
+		};
+		info.axis = axis;
+		break;
+
+	case INSITU_MOMENTS:
+		info.label = "\\rho, \\langle u_x \\rangle, \\langle u_y \\rangle, \\langle u_z \\rangle";
+		info.units = "";
+		axis[0] = (t_zdf_grid_axis) {
+			.name = "x", .type = zdf_linear,
+			.min = emf -> n_move * emf -> dx, .max = emf -> box + emf -> n_move * emf -> dx,
+			.label = "x", .units = "c/\\omega_p"
+		};
+		axis[1] = (t_zdf_grid_axis) {
+			.name = "q", .type = zdf_linear,
+			.min = 0, .max = 4,
+			.label = "quantity", .units = ""
+		};
+		info.axis = axis;
+		break;
+
+	default:
+		info.label = diag -> name;
+		info.units = "";
+	}
+
+	t_zdf_iteration iter = {
+		.name = "ITERATION",
+		.n = emf -> iter,
+		.t = emf -> iter * emf -> dt,
+		.time_units = "1/\\omega_p"
+	};
+
+	// Particle diagnostics are stored in a per species directory
+	char path[1024];
+	if ( diag -> type == INSITU_ENERGY_HIST || diag -> type == INSITU_MOMENTS )
+		snprintf( path, 1024, "INSITU/%s", species -> name );
+	else
+		snprintf( path, 1024, "INSITU" );
+
+	if ( ! diag -> open ) {
+		if ( ! zdf_open_grid_series( &diag -> series, &info, &iter, zdf_float32, path ) ) {
+			fprintf(stderr, "(*error*) Unable to open output file for in-situ diagnostic %s\n", diag -> name );
+			exit(-1);
+		}
+		diag -> open = 1;
+	}
+
+	zdf_add_grid_series( &diag -> series, diag -> out, zdf_float32, &info, &iter );
+}
+
+/**
+ * @brief Runs in-situ diagnostics that are due at the current iteration
+ *
+ * Must be called by all threads of the current parallel region, see
+ * `insitu_run()`
+ *
+ * @param diag 		Array of in-situ diagnostics
+ * @param n_diag 	Number of in-situ diagnostics
+ * @param emf 		EM fields
+ * @param species 	Array of particle species
+ */
+static void insitu_run_omp( t_insitu* diag, int n_diag, const t_emf* emf, const t_species* species )
+{
+	const uint64_t t0 = timer_ticks();
+	int ran = 0;
+
+	for( int d = 0; d < n_diag; d++ ) {
+		t_insitu* const dg = &diag[d];
+		if ( emf -> iter % dg -> n_iter ) continue;
+		ran = 1;
+
+		const t_species* spec = ( dg -> species >= 0 && species ) ? &species[ dg -> species ] : NULL;
+
+		switch( dg -> type ) {
+		case INSITU_ENVELOPE:
+			envelope_omp( dg, emf );
+			break;
+		case INSITU_ENERGY_HIST:
+			energy_hist_omp( dg, spec );
+			break;
+		case INSITU_MOMENTS:
+			moments_omp( dg, spec );
+			break;
+		case INSITU_CUSTOM:
+			#pragma omp for schedule(static)
+			for( int i = 0; i < dg -> nout; i++ ) dg -> out[i] = 0;
+			dg -> reduce( dg, emf, spec, dg -> out );
+			#pragma omp barrier
+			break;
+		}
+
+		// Implicit barrier at the end of single keeps the buffers in use until written
+		#pragma omp single
+		{
+			if ( insitu_reduce_domains( dg, emf ) ) insitu_write( dg, emf, spec );
+		}
+	}
+
+	if ( ran ) timer_phase_add( TIMER_DIAG, timer_ticks() - t0 );
+}
+
+/**
+ * @brief Runs in-situ diagnostics that are due at the current iteration
+ *
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ *
+ * @param diag 		Array of in-situ diagnostics
+ * @param n_diag 	Number of in-situ diagnostics
+ * @param emf 		EM fields
+ * @param species 	Array of particle species
+ */
+void insitu_run( t_insitu* diag, int n_diag, const t_emf* emf, const t_species* species )
+{
+	if ( n_diag < 1 ) return;
+
+	if ( omp_in_parallel() ) {
+		insitu_run_omp( diag, n_diag, emf, species );
+	} else {
+		// Only open a parallel region if a diagnostic is due
+		int due = 0;
+		for( int d = 0; d < n_diag; d++ ) due |= ( emf -> iter % diag[d].n_iter == 0 );
+		if ( due ) {
+			#pragma omp parallel
+			insitu_run_omp( diag, n_diag, emf, species );
+		}
+	}
+}
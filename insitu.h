@@ -0,0 +1,109 @@
+/**
+ * @file insitu.h
+ * @author Ricardo Fonseca
+ * @brief In-situ reduced diagnostics
+ * @version 0.1
+ * @date 2022-02-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __INSITU__
+#define __INSITU__
+
+#include "emf.h"
+#include "particles.h"
+#include "zdf.h"
+
+/**
+ * @brief Types of in-situ diagnostics
+ *
+ */
+enum insitu_type {
+	INSITU_ENVELOPE,		///< Peak value and position of the transverse E field (laser envelope)
+	INSITU_ENERGY_HIST,		///< Kinetic energy histogram of a particle species
+	INSITU_MOMENTS,			///< Per cell charge density and mean generalized velocity of a particle species
+	INSITU_CUSTOM			///< User supplied reduction
+};
+
+struct Insitu;
+
+/**
+ * @brief User supplied in-situ reduction
+ *
+ * Called by all threads of a parallel region, so it must only use orphaned
+ * worksharing constructs. `out` holds `diag->nout` values, set to zero before
+ * the call, and is shared by all threads.
+ *
+ * @param diag 		In-situ diagnostic
+ * @param emf 		EM fields
+ * @param species 	Particle species (NULL if the diagnostic has no species)
+ * @param out 		Output values
+ */
+typedef void (*insitu_reduce_fn)( struct Insitu* diag, const t_emf* emf,
+	const t_species* species, float* out );
+
+/**
+ * @brief In-situ diagnostic
+ *
+ * Every `n_iter` iterations the diagnostic is computed in parallel from the
+ * live simulation data and appended, as a small grid, to the time series file
+ * "INSITU/name.zdf" (see `zdf_open_grid_series()`). When using domain
+ * decomposition custom reductions are added over all domains.
+ */
+typedef struct Insitu {
+
+	enum insitu_type type;	///< Type of diagnostic
+	char name[64];			///< Diagnostic name (also used for the output file)
+	int n_iter;				///< Diagnostic frequency (iterations)
+	int species;			///< Species index (particle diagnostics)
+
+	int nbins;				///< Number of histogram bins (INSITU_ENERGY_HIST)
+	float range[2];			///< Histogram energy range, particles outside are ignored (INSITU_ENERGY_HIST)
+
+	int nout;				///< Number of output values (INSITU_CUSTOM)
+	insitu_reduce_fn reduce;	///< Reduction function (INSITU_CUSTOM)
+	void* data;				///< User data available to the reduction function (INSITU_CUSTOM)
+
+	// Internal data, set by insitu_new()
+	int ndims;				///< Output grid dimensions
+	int count[2];			///< Output grid size
+	float* out;				///< Output values
+	float* priv;			///< Per thread reduction buffers
+	int priv_stride;		///< Size of each per thread reduction buffer
+	int open;				///< Output file has been opened
+	t_zdf_grid_series series;	///< Output file
+
+} t_insitu;
+
+/**
+ * @brief Initializes in-situ diagnostic internal data
+ *
+ * @param diag 		In-situ diagnostic (parameters must already be set)
+ * @param emf 		EM fields
+ * @param species 	Particle species (NULL if the diagnostic has no species)
+ */
+void insitu_new( t_insitu* diag, const t_emf* emf, const t_species* species );
+
+/**
+ * @brief Closes the output file and frees dynamic memory from in-situ diagnostic
+ *
+ * @param diag 		In-situ diagnostic
+ */
+void insitu_delete( t_insitu* diag );
+
+/**
+ * @brief Runs in-situ diagnostics that are due at the current iteration
+ *
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ *
+ * @param diag 		Array of in-situ diagnostics
+ * @param n_diag 	Number of in-situ diagnostics
+ * @param emf 		EM fields
+ * @param species 	Array of particle species
+ */
+void insitu_run( t_insitu* diag, int n_diag, const t_emf* emf, const t_species* species );
+
+#endif
@@ -17,10 +17,22 @@ You should have received a copy of the GNU Affero General Public License
 along with the ZPIC Educational code suite. If not, see <http://www.gnu.org/licenses/>.
 */
 
+/**
+ * @brief Use GNU extensions (required for sched_getcpu)
+ * 
+ */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <math.h>
+#include <omp.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 #include "zpic.h"
 #include "simulation.h"
@@ -28,56 +40,186 @@ along with the ZPIC Educational code suite. If not, see <http://www.gnu.org/lice
 #include "current.h"
 #include "particles.h"
 #include "timer.h"
+#include "domain.h"
+#include "checkpoint.h"
 
-// Include Simulation parameters here
-//#include "input/twostream.c"
-//#include "input/magnetized.c"
-//#include "input/lwfa.c"
-//#include "input/beam.c"
-//#include "input/laser.c"
-#include "input/laser_particles.c"
-//#include "input/absorbing.c"
-//#include "input/density.c"
+#include "input/decks.h"
 
-int main (int argc, const char * argv[]) {
+/**
+ * @brief Prints usage information
+ * 
+ * @param prog 	Program name
+ */
+static void usage( const char* prog )
+{
+	fprintf(stderr, "Usage: %s [-h] [-l] [-a] [-v] [-r] [-d deck] [-c config] [name=value ...]\n\n", prog );
+	fprintf(stderr, "  -h         Print this message\n");
+	fprintf(stderr, "  -l         List available input decks\n");
+	fprintf(stderr, "  -a         Print the thread affinity (place and cpu of each OpenMP thread)\n");
+	fprintf(stderr, "  -v         Validate the compact particle layout (layout=2) against the\n");
+	fprintf(stderr, "             selected one, comparing energy conservation and performance\n");
+	fprintf(stderr, "  -r         Restart from the last checkpoint (directory %s)\n", CHECKPOINT_PATH );
+	fprintf(stderr, "  -d deck    Input deck to run (default is %s)\n", DECK_DEFAULT );
+	fprintf(stderr, "  -c config  Read parameter overrides from file (name = value lines)\n");
+	fprintf(stderr, "  name=value Override deck parameter, valid names are nx, ppc, tmax, ndump, n_sort,\n");
+	fprintf(stderr, "             sort_auto, tile_nx, tile_lb, shape, layout, persistent, tasks, deposit,\n");
+	fprintf(stderr, "             checkpoint, deterministic, reference, compare, insitu, series, timing\n\n");
+	fprintf(stderr, "Parameters are applied in the order given, later values take precedence.\n");
+	fprintf(stderr, "Setting deposit=atomic or deposit=private selects the current deposition (atomic\n");
+	fprintf(stderr, "updates of the shared grid, or per thread grids); tasks=1 always uses private grids.\n");
+	fprintf(stderr, "Setting timing=file.json (or file.csv) saves the per phase / per thread timings.\n");
+	fprintf(stderr, "Setting series=1 saves each grid diagnostic to a single time series file.\n");
+	fprintf(stderr, "Setting reference=n saves the state after n iterations (directory %s) and\n", CHECKPOINT_REF_PATH );
+	fprintf(stderr, "stops, a later run with compare=n compares its state bitwise with it.\n");
+}
+
+/**
+ * @brief Prints the OpenMP thread affinity
+ * 
+ * Prints the thread binding policy and, for each thread, the OpenMP place it
+ * is bound to (and the processors of that place) and the cpu it is running
+ * on, so that thread placement (e.g. OMP_PROC_BIND / OMP_PLACES settings)
+ * can be checked.
+ * 
+ * @param fp 	File to print to
+ */
+static void affinity_report( FILE* fp )
+{
+	static const char* bind_name[] = { "false", "true", "master", "close", "spread" };
+
+	const int nthreads = omp_get_max_threads();
+	const int bind = omp_get_proc_bind();
+
+	fprintf( fp, "Thread affinity: %d threads, proc_bind = %s, %d places\n", nthreads,
+		( bind >= 0 && bind <= 4 ) ? bind_name[bind] : "unknown", omp_get_num_places() );
+
+	int place[ nthreads ], cpu[ nthreads ];
+	for( int i = 0; i < nthreads; i++ ) place[i] = cpu[i] = -1;
+
+	#pragma omp parallel
+	{
+		const int tid = omp_get_thread_num();
+		place[tid] = omp_get_place_num();
+#if defined(__linux__)
+		cpu[tid] = sched_getcpu();
+#endif
+	}
+
+	for( int i = 0; i < nthreads; i++ ) {
+		fprintf( fp, "  thread %3d: ", i );
+		if ( place[i] >= 0 ) {
+			const int nprocs = omp_get_place_num_procs( place[i] );
+			int ids[ nprocs > 0 ? nprocs : 1 ];
+			omp_get_place_proc_ids( place[i], ids );
+			fprintf( fp, "place %d {", place[i] );
+			for( int k = 0; k < nprocs; k++ ) fprintf( fp, k ? ",%d" : "%d", ids[k] );
+			fprintf( fp, "}, " );
+		} else {
+			fprintf( fp, "unbound, " );
+		}
+		if ( cpu[i] >= 0 ) fprintf( fp, "cpu %d\n", cpu[i] );
+		else fprintf( fp, "cpu unknown\n" );
+	}
+	fprintf( fp, "\n" );
+}
+
+/**
+ * @brief Runs an input deck
+ * 
+ * When restarting, the initial energy is the energy after the first
+ * iteration run from the checkpoint.
+ * 
+ * @param deck 		Input deck
+ * @param restart 	Restart from the last checkpoint, see `sim_restart()`
+ * @param ratio 	(out) Change in total energy (%)
+ * @return 			Exit code, 1 if the change in total energy is above 5 % or if
+ * 					the state differs from the reference state (see `sim_set_diff()`)
+ */
+static int run_deck( const t_deck* deck, int restart, double* ratio ) {
 
 	// Initialize simulation
 	t_simulation sim;
-	sim_init( &sim );
+	deck -> init( &sim );
+
+	// First iteration
+	const int n0 = restart ? sim_restart( &sim ) : 0;
 
     // Run simulation
-	int n;
-	float t;
     double en_in, en_out;
     
 	printf("Starting simulation ...\n\n");
 
 	uint64_t t0,t1;
 	t0 = timer_ticks();
-    printf("n = 0, t = 0.0\n");
+    printf("n = %i, t = %f\n", n0, n0 * sim.dt);
 
-	for (n=0,t=0.0; t<=sim.tmax; n++, t=n*sim.dt) {
+	// The time loop runs inside a single parallel region if sim.omp_persistent is set,
+	// all serial code must be run by a single thread
+	int n_end = 0;
+	float t_end = 0.0;
+	int stop = 0;
+	int diff_stop = 0;
+
+	#pragma omp parallel if ( sim.omp_persistent )
+	{
+	int n;
+	float t;
+	for (n=n0,t=n0*sim.dt; t<=sim.tmax; n++, t=n*sim.dt) {
         //printf("n = %i, t = %f\n",n,t);
 
-		if ( report ( n , sim.ndump ) )	sim_report( &sim );
+		if ( report ( n , sim.ndump ) )	{
+			#pragma omp single
+			{
+			uint64_t tr = timer_ticks();
+			deck -> report( &sim );
+			timer_phase_add( TIMER_DIAG, timer_ticks() - tr );
+			}
+		}
 
 		sim_iter( &sim );
 
-        if (n==0){
+        if (n==n0){
+			#pragma omp single
+			{
             sim_report_energy_ret( &sim, &en_in);
             sim_report_energy (&sim);
+			}
         }
+
+		// Checkpoints, the simulation may be stopped by a signal
+		if ( sim.n_checkpoint >= 0 ) {
+			#pragma omp single
+			stop = sim_checkpoint_step( &sim );
+
+			if ( stop ) { n++; t=n*sim.dt; break; }
+		}
+
+		// Bitwise comparison with a reference state, stops the simulation
+		if ( sim.n_reference > 0 || sim.n_compare > 0 ) {
+			#pragma omp single
+			diff_stop = sim_diff_step( &sim );
+
+			if ( diff_stop ) { n++; t=n*sim.dt; break; }
+		}
+	}
+
+	#pragma omp single
+	{
+	n_end = n; t_end = t;
+	}
 	}
-    printf("n = %i, t = %f\n",n,t);
+    printf("n = %i, t = %f\n",n_end,t_end);
+	if ( stop ) printf("Simulation stopped after checkpoint.\n");
 
 	t1 = timer_ticks();
-	fprintf(stderr, "\nSimulation ended.\n\n");
+	if ( domain_root() ) fprintf(stderr, "\nSimulation ended.\n\n");
     sim_report_energy( &sim );
     sim_report_energy_ret( &sim, &en_out );
     printf("Initial energy: %e, Final energy: %e\n", en_in, en_out);
-    double ratio=100*fabs((en_in-en_out)/en_out);
-    printf("\nFinal energy different from Initial Energy. Change in total energy is: %.2f %% \n",ratio);
-    if (ratio>5) { printf("ERROR: Large Change\n"); return 1; }
+    *ratio=100*fabs((en_in-en_out)/en_out);
+    printf("\nFinal energy different from Initial Energy. Change in total energy is: %.2f %% \n",*ratio);
+    if (*ratio>5) { printf("ERROR: Large Change\n"); return 1; }
+    if ( sim.diff_count > 0 ) { printf("ERROR: State differs from reference\n"); return 1; }
 
 
 	// Simulation times
@@ -88,3 +230,130 @@ int main (int argc, const char * argv[]) {
     
 	return 0;
 }
+
+/**
+ * @brief Maximum change in total energy (%) allowed for the compact layout
+ * 
+ * The validation fails if the change in total energy using the compact
+ * layout exceeds VALIDATE_FACTOR times the reference change plus
+ * VALIDATE_TOL.
+ */
+#define VALIDATE_FACTOR 2.0
+#define VALIDATE_TOL    0.1		///< See VALIDATE_FACTOR
+
+/**
+ * @brief Validates the compact particle layout
+ * 
+ * The deck is run twice, first with the selected particle layout (reference)
+ * and then with the compact (reduced precision) layout. Diagnostic output is
+ * disabled for both runs. The energy conservation and the particle push
+ * performance of both runs are reported.
+ * 
+ * @param deck 	Input deck
+ * @return 		Exit code, 1 if the compact layout energy conservation is
+ * 				significantly worse than the reference one
+ */
+static int validate( const t_deck* deck ) {
+
+	const char* label[2] = { "reference", "compact" };
+	double ratio[2], perf[2];
+
+	sim_set_param( "ndump", "0" );
+
+	for( int k = 0; k < 2; k++ ) {
+		if ( k == 1 ) sim_set_param( "layout", "2" );
+
+		printf("\nValidation run: %s layout\n", label[k] );
+
+		const uint64_t np0 = spec_npush();
+		const double time0 = spec_time();
+
+		run_deck( deck, 0, &ratio[k] );
+
+		const double time = spec_time() - time0;
+		perf[k] = ( time > 0 ) ? 1.0e-6 * ( spec_npush() - np0 ) / time : 0;
+	}
+
+	const double max_ratio = VALIDATE_FACTOR * ratio[0] + VALIDATE_TOL;
+
+	printf("\nCompact layout validation:\n");
+	for( int k = 0; k < 2; k++ )
+		printf("  %-9s change in total energy: %.4f %%, push performance: %.2f MPart/s\n",
+			label[k], ratio[k], perf[k] );
+
+	if ( ratio[1] > max_ratio ) {
+		printf("ERROR: compact layout change in total energy above %.4f %%\n", max_ratio );
+		return 1;
+	}
+
+	printf("Compact layout validation passed.\n");
+	return 0;
+}
+
+/**
+ * @brief Runs the simulation
+ * 
+ * @param argc 	Number of command line arguments
+ * @param argv 	Command line arguments
+ * @return 		Exit code
+ */
+static int run( int argc, const char * argv[] ) {
+
+	// Select input deck and parameter overrides
+	const char* deck_name = DECK_DEFAULT;
+	int valid = 0;
+	int affinity = 0;
+	int restart = 0;
+	for( int i = 1; i < argc; i++ ) {
+		if ( ! strcmp( argv[i], "-h" ) ) {
+			usage( argv[0] );
+			return 0;
+		} else if ( ! strcmp( argv[i], "-l" ) ) {
+			deck_list( stdout );
+			return 0;
+		} else if ( ! strcmp( argv[i], "-a" ) ) {
+			affinity = 1;
+		} else if ( ! strcmp( argv[i], "-v" ) ) {
+			valid = 1;
+		} else if ( ! strcmp( argv[i], "-r" ) ) {
+			restart = 1;
+		} else if ( ! strcmp( argv[i], "-d" ) && i + 1 < argc ) {
+			deck_name = argv[++i];
+		} else if ( ! strcmp( argv[i], "-c" ) && i + 1 < argc ) {
+			if ( sim_read_params( argv[++i] ) ) return 1;
+		} else if ( strchr( argv[i], '=' ) ) {
+			if ( sim_set_param_str( argv[i] ) ) return 1;
+		} else {
+			usage( argv[0] );
+			return 1;
+		}
+	}
+
+	const t_deck* deck = deck_find( deck_name );
+	if ( ! deck ) {
+		fprintf(stderr, "(*error*) Unknown input deck '%s'\n", deck_name );
+		deck_list( stderr );
+		return 1;
+	}
+
+	printf("Input deck: %s\n", deck -> name );
+	sim_print_params( stdout );
+
+	if ( affinity ) affinity_report( stdout );
+
+	if ( valid ) return validate( deck );
+
+	double ratio;
+	return run_deck( deck, restart, &ratio );
+}
+
+int main (int argc, const char * argv[]) {
+
+	// Domain decomposition (MPI) must be initialized first
+	domain_init();
+
+	int ret = run( argc, argv );
+
+	domain_finalize();
+	return ret;
+}
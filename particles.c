@@ -9,10 +9,17 @@
  * 
  */
 
+/**
+ * @brief  Use 2001 edition of the POSIX standard (required for posix_memalign)
+ * 
+ */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 #include <omp.h>
 #include "particles.h"
 
@@ -22,6 +29,59 @@
 
 #include "zdf.h"
 #include "timer.h"
+#include "domain.h"
+#include "arena.h"
+#include "checkpoint.h"
+
+/// Number of particles processed by each call of the vectorized (SoA) pusher
+#define SOA_BLOCK 64
+
+/// Number of guard cells (on each side) available in the tile buffers
+#define TILE_HALO 8
+
+/// Maximum tile size, relative to the nominal one, when load balancing the tiles
+#define TILE_LB_MAX 4
+
+/// Estimated cost of a cell in the tiled advance, relative to the cost of a particle
+#define TILE_LB_CELL_COST 2.0
+
+/// Number of work items per thread for untiled species in `spec_advance_tasks()`
+#define SPEC_TASK_SPLIT 4
+
+/// Minimum number of particles in a work item of `spec_advance_tasks()`
+#define SPEC_TASK_MIN 1024
+
+/// Number of particles in a work item of the deterministic advance (untiled species)
+#define SPEC_DET_BLOCK 4096
+
+/// Maximum number of work items of the deterministic advance holding current buffers at the same time
+#define SPEC_DET_BATCH 64
+
+/// Size (cells) of the grid chunks used for merging the work item current buffers
+#define SPEC_DET_CHUNK 256
+
+/// Weight decay, per iteration, of the past samples used by the automatic sort frequency
+#define SORT_AUTO_DECAY 0.99
+
+/// Minimum (weighted) number of samples before the automatic sort frequency uses the fit
+#define SORT_AUTO_MIN_SAMPLES 8
+
+/// Maximum number of iterations without sorting when using the automatic sort frequency
+#define SORT_AUTO_PROBE 1000
+
+/// Push kernel templates are always inlined, so that they get specialized
+/// for the (constant) configuration flags of each kernel, see `push_kernels`
+#ifdef __GNUC__
+#define PUSH_INLINE static inline __attribute__((always_inline))
+#else
+#define PUSH_INLINE static inline
+#endif
+
+/// Number of particles initialized at a time by spec_set_u()
+#define RAND_BLOCK 256
+
+/// Number of particles processed at a time by phasespace deposition
+#define PHA_BLOCK 1024
 
 static double _spec_time = 0.0;
 static uint64_t _spec_npush = 0;
@@ -67,6 +127,12 @@ double spec_perf( void )
 /**
  * @brief Sets the momentum of the range of particles supplieds using a thermal distribution
  * 
+ * Thermal momenta are generated using the counter based random number
+ * generator (see `rand_norm_n()`), keyed on the species name and on the
+ * global injection index of each particle, so results do not depend on
+ * the number of threads. The particles in the range must be the last ones
+ * injected.
+ * 
  * @param spec  Particle species
  * @param start Index of the first particle to set the momentum
  * @param end   Index of the last particle to set the momentum
@@ -75,37 +141,55 @@ void spec_set_u( t_species* spec, const int start, const int end )
 {
 #if 0
     for (int i = start; i <= end; i++) {
-        spec->part[i].ux = spec -> ufl[0] + spec -> uth[0] * rand_norm();
-        spec->part[i].uy = spec -> ufl[1] + spec -> uth[1] * rand_norm();
-        spec->part[i].uz = spec -> ufl[2] + spec -> uth[2] * rand_norm();
+        PART_SET_UX( spec, i, spec -> ufl[0] + spec -> uth[0] * rand_norm() );
+        PART_SET_UY( spec, i, spec -> ufl[1] + spec -> uth[1] * rand_norm() );
+        PART_SET_UZ( spec, i, spec -> ufl[2] + spec -> uth[2] * rand_norm() );
     }
 #else
     /**
      * Version 1 momentum initialization
      */
 
+    if ( end < start ) return;
+
+    // Random stream for this species
+    const uint64_t key = rand_key( spec -> name );
+
+    // Global injection index of particle start
+    const uint64_t id0 = (uint64_t) spec -> density.total_np_inj - (uint64_t) ( end + 1 - start );
+
     // Initialize thermal component
-    for (int i = start; i <= end; i++) {
-        spec->part[i].ux = spec -> uth[0] * rand_norm();
-        spec->part[i].uy = spec -> uth[1] * rand_norm();
-        spec->part[i].uz = spec -> uth[2] * rand_norm();
+    #pragma omp parallel for schedule(static) if ( end - start > 4 * RAND_BLOCK )
+    for (int i0 = start; i0 <= end; i0 += RAND_BLOCK) {
+        const int n = ( end + 1 - i0 < RAND_BLOCK ) ? end + 1 - i0 : RAND_BLOCK;
+
+        double r[ 3 * RAND_BLOCK ];
+        rand_norm_n( r, 3 * n, key, 3 * ( id0 + (uint64_t) ( i0 - start ) ) );
+
+        for (int k = 0; k < n; k++) {
+            PART_SET_UX( spec, i0 + k, spec -> uth[0] * r[ 3*k     ] );
+            PART_SET_UY( spec, i0 + k, spec -> uth[1] * r[ 3*k + 1 ] );
+            PART_SET_UZ( spec, i0 + k, spec -> uth[2] * r[ 3*k + 2 ] );
+        }
     }
 
     // Calculate net momentum in each cell
-    float3 * restrict net_u = (float3 *) malloc( spec->nx * sizeof(float3));
-    int * restrict    npc   = (int *) malloc( spec->nx * sizeof(int));
+    const size_t mark = arena_mark( spec -> scratch );
+    float3 * restrict net_u = (float3 *) arena_alloc( spec -> scratch, spec->nx * sizeof(float3));
+    int * restrict    npc   = (int *) arena_alloc( spec -> scratch, spec->nx * sizeof(int));
 
     // Zero momentum grids
     memset(net_u, 0, spec->nx * sizeof(float3) );
     memset(npc, 0, (spec->nx) * sizeof(int) );
 
     // Accumulate momentum in each cell
+    // This is done serially to keep the summation order fixed
     for (int i = start; i <= end; i++) {
-        const int idx  = spec -> part[i].ix;
+        const int idx  = PART_IX( spec, i ) - spec -> ix_off;
 
-        net_u[ idx ].x += spec->part[i].ux;
-        net_u[ idx ].y += spec->part[i].uy;
-        net_u[ idx ].z += spec->part[i].uz;
+        net_u[ idx ].x += PART_UX( spec, i );
+        net_u[ idx ].y += PART_UY( spec, i );
+        net_u[ idx ].z += PART_UZ( spec, i );
 
         npc[ idx ] += 1;
     }
@@ -121,17 +205,17 @@ void spec_set_u( t_species* spec, const int start, const int end )
     }
 
     // Subtract average momentum and add fluid component
+    #pragma omp parallel for schedule(static) if ( end - start > 4 * RAND_BLOCK )
     for (int i = start; i <= end; i++) {
-        const int idx  = spec -> part[i].ix;
+        const int idx  = PART_IX( spec, i ) - spec -> ix_off;
 
-        spec->part[i].ux += spec -> ufl[0] - net_u[ idx ].x;
-        spec->part[i].uy += spec -> ufl[1] - net_u[ idx ].y;
-        spec->part[i].uz += spec -> ufl[2] - net_u[ idx ].z;
+        PART_SET_UX( spec, i, PART_UX( spec, i ) + ( spec -> ufl[0] - net_u[ idx ].x ) );
+        PART_SET_UY( spec, i, PART_UY( spec, i ) + ( spec -> ufl[1] - net_u[ idx ].y ) );
+        PART_SET_UZ( spec, i, PART_UZ( spec, i ) + ( spec -> ufl[2] - net_u[ idx ].z ) );
     }
 
     // Free temporary memory
-    free( npc );
-    free( net_u );
+    arena_release( spec -> scratch, mark );
 
 #endif
 }
@@ -151,10 +235,13 @@ int spec_np_inj( t_species* spec, const int range[] )
 {
     int np_inj;
 
+    // Global cell index of local cell 0
+    const int cell_off = spec -> n_move + spec -> domain_ix0;
+
     switch ( spec -> density.type ) {
     case STEP: // Step like density profile
         {
-            int i0 = spec -> density.start / spec -> dx - spec -> n_move;
+            int i0 = spec -> density.start / spec -> dx - cell_off;
 
             if ( i0 > range[1] ) {
                 np_inj = 0;
@@ -167,8 +254,8 @@ int spec_np_inj( t_species* spec, const int range[] )
 
     case SLAB: // Slab like density profile
         {
-            int i0 = spec -> density.start / spec -> dx - spec -> n_move;
-            int i1 = spec -> density.end / spec -> dx - spec -> n_move;
+            int i0 = spec -> density.start / spec -> dx - cell_off;
+            int i1 = spec -> density.end / spec -> dx - cell_off;
 
             if ( (i0 > range[1]) || (i1 < range[0]) ) {
                 np_inj = 0;
@@ -187,8 +274,8 @@ int spec_np_inj( t_species* spec, const int range[] )
             float x1 = spec -> density.end;
 
             // Injection start / finish positions (in simulation units)
-            float a = (range[0] + spec -> n_move) * spec->dx;
-            float b = (range[1] + 1 + spec -> n_move) * spec->dx;
+            float a = (range[0] + cell_off) * spec->dx;
+            float b = (range[1] + 1 + cell_off) * spec->dx;
 
             // If outside of ramp (or invalid ramp) return 0
             if ( (x1 <= x0) || (a > x1) || (b < x0) ) {
@@ -213,13 +300,13 @@ int spec_np_inj( t_species* spec, const int range[] )
     case CUSTOM: // custom density profile
         {
             // Integrate total charge
-            double q = 0.5 * ( (*spec -> density.custom)((range[0] + spec -> n_move) * spec->dx,
+            double q = 0.5 * ( (*spec -> density.custom)((range[0] + cell_off) * spec->dx,
                                                          spec -> density.custom_data) +
-                               (*spec -> density.custom)((range[1] + 1 + spec -> n_move) * spec->dx,
+                               (*spec -> density.custom)((range[1] + 1 + cell_off) * spec->dx,
                                                             spec -> density.custom_data) );
 
             for( int i = range[0]+1; i <= range[1]; i++) {
-                q += (*spec -> density.custom)((i + spec -> n_move) * spec->dx,
+                q += (*spec -> density.custom)((i + cell_off) * spec->dx,
                                                spec -> density.custom_data);
             }
 
@@ -253,6 +340,9 @@ void spec_set_x( t_species* spec, const int range[] )
     int i, k, ip;
     float start, end;
 
+    // Global cell index of local cell 0
+    const int cell_off = spec -> n_move + spec -> domain_ix0;
+
     // Calculate particle positions inside the cell
     const int npc = spec->ppc;
 
@@ -269,14 +359,14 @@ void spec_set_x( t_species* spec, const int range[] )
     case STEP: // Step like density profile
 
         // Get edge position normalized to cell size;
-        start = spec -> density.start / spec -> dx - spec -> n_move;
+        start = spec -> density.start / spec -> dx - cell_off;
 
         for (i = range[0]; i <= range[1]; i++) {
 
             for (k=0; k<npc; k++) {
                 if ( i + poscell[k] > start ) {
-                    spec->part[ip].ix = i;
-                    spec->part[ip].x = poscell[k];
+                    PART_IX( spec, ip ) = i;
+                    PART_SET_X( spec, ip, poscell[k] );
                     ip++;
                 }
             }
@@ -288,15 +378,15 @@ void spec_set_x( t_species* spec, const int range[] )
     case SLAB: // Slab like density profile
 
         // Get edge position normalized to cell size;
-        start = spec -> density.start / spec -> dx - spec -> n_move;
-        end   = spec -> density.end / spec -> dx - spec -> n_move;
+        start = spec -> density.start / spec -> dx - cell_off;
+        end   = spec -> density.end / spec -> dx - cell_off;
 
         for (i = range[0]; i <= range[1]; i++) {
 
             for (k=0; k<npc; k++) {
                 if ( i + poscell[k] > start &&  i + poscell[k] < end ) {
-                    spec->part[ip].ix = i;
-                    spec->part[ip].x = poscell[k];
+                    PART_IX( spec, ip ) = i;
+                    PART_SET_X( spec, ip, poscell[k] );
                     ip++;
                 }
             }
@@ -313,8 +403,8 @@ void spec_set_x( t_species* spec, const int range[] )
             double r1 = spec -> density.end / spec -> dx;
 
             // If outside ramp return
-            if (((range[0] + spec -> n_move) > r1 ) ||
-                ((range[1] + spec -> n_move) < r0 )) break;
+            if (((range[0] + cell_off) > r1 ) ||
+                ((range[1] + cell_off) < r0 )) break;
 
             double n0 = spec -> density.ramp[0];
             double n1 = spec -> density.ramp[1];
@@ -345,18 +435,21 @@ void spec_set_x( t_species* spec, const int range[] )
                 // Injection cell
                 int ix = pos;
 
-                // (*debug*) This must never happen
-                if ( ix - spec -> n_move < range[0] ) {
+                if ( ix - cell_off < range[0] ) {
+                    // Particle belongs to a lower domain
+                    if ( spec -> domain_ix0 > 0 ) continue;
+
+                    // (*debug*) This must never happen
                     fprintf(stderr, "(*error*) attempting to inject outside of valid range.\n");
                     break;
                 }
 
                 // If outside injection range we are done
-                if ( ix - spec -> n_move > range[1] ) break;
+                if ( ix - cell_off > range[1] ) break;
 
                 // Inject particle
-                spec->part[ip].ix = ix - spec -> n_move;
-                spec->part[ip].x = pos - ix;
+                PART_IX( spec, ip ) = ix - cell_off;
+                PART_SET_X( spec, ip, pos - ix );
                 ip++;
 
             }
@@ -381,7 +474,7 @@ void spec_set_x( t_species* spec, const int range[] )
 
             // Density on cell edges
             double n0;
-            double n1 = (*spec -> density.custom)((ix + spec -> n_move) * dx, spec -> density.custom_data);
+            double n1 = (*spec -> density.custom)((ix + cell_off) * dx, spec -> density.custom_data);
 
             // Accumulated density on cell edges
             double d0;
@@ -393,7 +486,7 @@ void spec_set_x( t_species* spec, const int range[] )
 
                 // Get density on the edges of current cell
                 n0 = n1;
-                n1 = (*spec -> density.custom)((ix + 1 + spec -> n_move)*dx, spec -> density.custom_data);
+                n1 = (*spec -> density.custom)((ix + 1 + cell_off)*dx, spec -> density.custom_data);
 
                 // Get cumulative density on the edges of current cell
                 d0 = d1;
@@ -407,8 +500,8 @@ void spec_set_x( t_species* spec, const int range[] )
                     // This version avoids a division by 0 if n1 = n0
                     double pos = 2 * (Rs-d0) /( sqrt( n0*n0 + 2 * (n1-n0) * (Rs-d0) ) + n0 );
 
-                    spec->part[ip].ix = ix;
-                    spec->part[ip].x = pos;
+                    PART_IX( spec, ip ) = ix;
+                    PART_SET_X( spec, ip, pos );
                     ip++;
 
                     k++;
@@ -431,8 +524,8 @@ void spec_set_x( t_species* spec, const int range[] )
         for (i = range[0]; i <= range[1]; i++) {
 
             for (k=0; k<npc; k++) {
-                spec->part[ip].ix = i;
-                spec->part[ip].x = poscell[k];
+                PART_IX( spec, ip ) = i;
+                PART_SET_X( spec, ip, poscell[k] );
                 ip++;
             }
         }
@@ -440,6 +533,11 @@ void spec_set_x( t_species* spec, const int range[] )
 
     }
 
+    // Store cell indices using the particle buffer offset
+    if ( spec -> ix_off ) {
+        for (k = spec -> np; k < ip; k++) PART_IX( spec, k ) += spec -> ix_off;
+    }
+
     // Update total number of injected particles
     spec -> density.total_np_inj += ip - spec -> np;
 
@@ -448,21 +546,254 @@ void spec_set_x( t_species* spec, const int range[] )
 
 }
 
+/**
+ * @brief Reallocates an aligned buffer
+ * 
+ * The new buffer is allocated with `arena_malloc()` (aligned to PART_ALIGN
+ * bytes, large buffers use huge pages) and first touched in parallel using
+ * the same static thread distribution as the particle push (see
+ * `arena_touch()`); the first `count` elements of the previous buffer are
+ * then copied and the previous buffer is freed. The routine aborts the code
+ * if the memory allocation fails.
+ * 
+ * @param ptr       Pointer to buffer, will be updated with the new buffer
+ * @param count     Number of elements to preserve
+ * @param size      New buffer size (number of elements)
+ * @param elsize    Size of each element
+ */
+static void realloc_aligned( void ** ptr, const int count, const int size, const size_t elsize )
+{
+    void * buf = arena_malloc( (size_t) size * elsize );
+    if ( buf ) arena_touch( buf, (size_t) size * elsize );
+    if ( count > 0 ) memcpy( buf, *ptr, count * elsize );
+
+    arena_free( *ptr );
+    *ptr = buf;
+}
+
+/**
+ * @brief Frees structure of arrays particle data
+ * 
+ * @param spec  Particle species
+ */
+static void spec_free_soa( t_species* spec )
+{
+    arena_free( spec -> soa.ix );
+    arena_free( spec -> soa.x );
+    arena_free( spec -> soa.ux );
+    arena_free( spec -> soa.uy );
+    arena_free( spec -> soa.uz );
+
+    spec -> soa = (t_part_soa) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+}
+
+/**
+ * @brief Frees reduced precision particle data
+ * 
+ * @param spec  Particle species
+ */
+static void spec_free_compact( t_species* spec )
+{
+    arena_free( spec -> cpt.ix );
+    arena_free( spec -> cpt.x );
+    arena_free( spec -> cpt.ux );
+    arena_free( spec -> cpt.uy );
+    arena_free( spec -> cpt.uz );
+
+    spec -> cpt = (t_part_compact) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+}
+
+/**
+ * @brief Allocates reduced precision particle data
+ * 
+ * @param cpt       Particle buffer
+ * @param count     Number of particles to keep from the previous buffer
+ * @param size      New buffer size
+ */
+static void alloc_compact( t_part_compact* cpt, const int count, const int size )
+{
+    realloc_aligned( (void **) &cpt -> ix, count, size, sizeof(int) );
+    realloc_aligned( (void **) &cpt -> x,  count, size, sizeof(uint16_t) );
+    realloc_aligned( (void **) &cpt -> ux, count, size, sizeof(float) );
+    realloc_aligned( (void **) &cpt -> uy, count, size, sizeof(float) );
+    realloc_aligned( (void **) &cpt -> uz, count, size, sizeof(float) );
+}
+
+/**
+ * @brief Frees the secondary particle buffer used by `spec_sort()`
+ * 
+ * The buffer will be reallocated (with the current buffer size and layout)
+ * on the next call to `spec_sort()`
+ * 
+ * @param spec  Particle species
+ */
+static void spec_free_sort_tmp( t_species* spec )
+{
+    arena_free( spec -> part_tmp );
+    spec -> part_tmp = NULL;
+
+    arena_free( spec -> soa_tmp.ix );
+    arena_free( spec -> soa_tmp.x );
+    arena_free( spec -> soa_tmp.ux );
+    arena_free( spec -> soa_tmp.uy );
+    arena_free( spec -> soa_tmp.uz );
+    spec -> soa_tmp = (t_part_soa) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+
+    arena_free( spec -> cpt_tmp.ix );
+    arena_free( spec -> cpt_tmp.x );
+    arena_free( spec -> cpt_tmp.ux );
+    arena_free( spec -> cpt_tmp.uy );
+    arena_free( spec -> cpt_tmp.uz );
+    spec -> cpt_tmp = (t_part_compact) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+
+    spec -> np_tmp = 0;
+}
+
+/**
+ * @brief Swaps 2 particles inside the particle buffer
+ * 
+ * @param spec  Particle species
+ * @param i     Index of first particle
+ * @param k     Index of second particle
+ */
+static inline void part_swap( t_species* spec, const int i, const int k )
+{
+    if ( spec -> layout == PART_SOA ) {
+        int   ix = spec -> soa.ix[k]; spec -> soa.ix[k] = spec -> soa.ix[i]; spec -> soa.ix[i] = ix;
+        float x  = spec -> soa.x[k];  spec -> soa.x[k]  = spec -> soa.x[i];  spec -> soa.x[i]  = x;
+        float ux = spec -> soa.ux[k]; spec -> soa.ux[k] = spec -> soa.ux[i]; spec -> soa.ux[i] = ux;
+        float uy = spec -> soa.uy[k]; spec -> soa.uy[k] = spec -> soa.uy[i]; spec -> soa.uy[i] = uy;
+        float uz = spec -> soa.uz[k]; spec -> soa.uz[k] = spec -> soa.uz[i]; spec -> soa.uz[i] = uz;
+    } else if ( spec -> layout == PART_COMPACT ) {
+        int      ix = spec -> cpt.ix[k]; spec -> cpt.ix[k] = spec -> cpt.ix[i]; spec -> cpt.ix[i] = ix;
+        uint16_t x  = spec -> cpt.x[k];  spec -> cpt.x[k]  = spec -> cpt.x[i];  spec -> cpt.x[i]  = x;
+        float    ux = spec -> cpt.ux[k]; spec -> cpt.ux[k] = spec -> cpt.ux[i]; spec -> cpt.ux[i] = ux;
+        float    uy = spec -> cpt.uy[k]; spec -> cpt.uy[k] = spec -> cpt.uy[i]; spec -> cpt.uy[i] = uy;
+        float    uz = spec -> cpt.uz[k]; spec -> cpt.uz[k] = spec -> cpt.uz[i]; spec -> cpt.uz[i] = uz;
+    } else {
+        t_part tmp = spec->part[k];
+        spec->part[k] = spec->part[i];
+        spec->part[i] = tmp;
+    }
+}
+
 /**
  * @brief Grows particle buffer to specified size.
  * 
  * If the new size is smaller than the previous size the buffer size is not changed
- * and the function returns silently.
+ * and the function returns silently. The buffer grows by at least 50 %, so
+ * that repeated injection (e.g. moving window) does not reallocate the
+ * buffer every time step.
  * 
  * @param spec  Particle species
  * @param size  New buffer size (will be rounded up to next multiple of 1024)
  **/
 void spec_grow_buffer( t_species* spec, const int size ) {
     if ( size > spec -> np_max ) {
-        // Increase by chunks of 1024 particles
-        spec -> np_max = ( size/1024 + 1) * 1024;
-        spec -> part = realloc( (void*) spec -> part, spec -> np_max * sizeof(t_part) );
+        // Grow geometrically, in chunks of 1024 particles
+        int np_max = spec -> np_max + spec -> np_max / 2;
+        if ( np_max < size ) np_max = size;
+        np_max = ( np_max/1024 + 1) * 1024;
+
+        if ( spec -> layout == PART_SOA ) {
+            realloc_aligned( (void **) &spec -> soa.ix, spec -> np, np_max, sizeof(int) );
+            realloc_aligned( (void **) &spec -> soa.x,  spec -> np, np_max, sizeof(float) );
+            realloc_aligned( (void **) &spec -> soa.ux, spec -> np, np_max, sizeof(float) );
+            realloc_aligned( (void **) &spec -> soa.uy, spec -> np, np_max, sizeof(float) );
+            realloc_aligned( (void **) &spec -> soa.uz, spec -> np, np_max, sizeof(float) );
+        } else if ( spec -> layout == PART_COMPACT ) {
+            alloc_compact( &spec -> cpt, spec -> np, np_max );
+        } else {
+            realloc_aligned( (void **) &spec -> part, spec -> np, np_max, sizeof(t_part) );
+        }
+
+        spec -> np_max = np_max;
+
+        // The secondary sort buffer will be resized on the next sort
+        spec_free_sort_tmp( spec );
+    }
+}
+
+/**
+ * @brief Sets the memory layout of the particle buffer
+ * 
+ * Existing particles are copied into the new layout. When using the
+ * `PART_SOA` layout particle quantities are stored in separate arrays,
+ * aligned to PART_ALIGN bytes, allowing the particle push to be vectorized.
+ * The `PART_COMPACT` layout also uses separate arrays but stores positions
+ * with reduced precision; converting to this layout rounds the existing
+ * particle positions.
+ * 
+ * @param spec      Particle species
+ * @param layout    New memory layout
+ */
+void spec_set_layout( t_species* spec, const enum part_layout layout )
+{
+    if ( layout == spec -> layout ) return;
+
+    const int np = spec -> np;
+
+    // Convert to PART_AOS layout first
+    if ( spec -> layout != PART_AOS ) {
+        t_part* part = NULL;
+        realloc_aligned( (void **) &part, 0, spec -> np_max, sizeof(t_part) );
+
+        for( int i = 0; i < np; i++ ) {
+            part[i].ix = PART_IX( spec, i );
+            part[i].x  = PART_X( spec, i );
+            part[i].ux = PART_UX( spec, i );
+            part[i].uy = PART_UY( spec, i );
+            part[i].uz = PART_UZ( spec, i );
+        }
+
+        spec_free_soa( spec );
+        spec_free_compact( spec );
+        spec -> part = part;
+        spec -> layout = PART_AOS;
+    }
+
+    if ( layout == PART_SOA ) {
+        t_part_soa soa = { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+
+        realloc_aligned( (void **) &soa.ix, 0, spec -> np_max, sizeof(int) );
+        realloc_aligned( (void **) &soa.x,  0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &soa.ux, 0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &soa.uy, 0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &soa.uz, 0, spec -> np_max, sizeof(float) );
+
+        for( int i = 0; i < np; i++ ) {
+            soa.ix[i] = spec -> part[i].ix;
+            soa.x[i]  = spec -> part[i].x;
+            soa.ux[i] = spec -> part[i].ux;
+            soa.uy[i] = spec -> part[i].uy;
+            soa.uz[i] = spec -> part[i].uz;
+        }
+
+        arena_free( spec -> part );
+        spec -> part = NULL;
+        spec -> soa = soa;
+
+    } else if ( layout == PART_COMPACT ) {
+        t_part_compact cpt = { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+
+        alloc_compact( &cpt, 0, spec -> np_max );
+
+        for( int i = 0; i < np; i++ ) {
+            cpt.ix[i] = spec -> part[i].ix;
+            cpt.x[i]  = part_float_to_fix( spec -> part[i].x );
+            cpt.ux[i] = spec -> part[i].ux;
+            cpt.uy[i] = spec -> part[i].uy;
+            cpt.uz[i] = spec -> part[i].uz;
+        }
+
+        arena_free( spec -> part );
+        spec -> part = NULL;
+        spec -> cpt = cpt;
     }
+
+    spec -> layout = layout;
+
+    spec_free_sort_tmp( spec );
 }
 
 /**
@@ -491,19 +822,68 @@ void spec_inject_particles( t_species* spec, const int range[] )
 
 }
 
+/**
+ * @brief Injects the initial particle distribution of a distributed simulation
+ * 
+ * Particles are injected in the local domain, using the same positions and
+ * momenta as the serial code: the injection of custom density profiles
+ * continues from the density integral of the lower domains, and the global
+ * injection index of the first local particle (used for the thermal momenta
+ * random stream, see `spec_set_u()`) is the number of particles injected by
+ * the lower domains.
+ * 
+ * @param spec      Particle species
+ * @param range     Grid range [ix0, ix1] where to inject particles
+ */
+static void spec_inject_domain( t_species* spec, const int range[] )
+{
+    // Custom profiles, density integral and number of particles of lower domains
+    if ( spec -> density.type == CUSTOM && spec -> domain_ix0 > 0 ) {
+        const double dx = spec -> dx;
+        const double cpp = 1.0 / spec->ppc;
+
+        double n1 = (*spec -> density.custom)( 0, spec -> density.custom_data);
+        double d1 = 0;
+        for( int ix = 0; ix < spec -> domain_ix0; ix++ ) {
+            double n0 = n1;
+            n1 = (*spec -> density.custom)((ix + 1)*dx, spec -> density.custom_data);
+            d1 += 0.5 * (n0+n1);
+        }
+
+        unsigned long k = 0;
+        while( (k+0.5) * cpp < d1 ) k++;
+
+        spec -> density.custom_q_inj = d1;
+        spec -> density.total_np_inj = k;
+    }
+
+    spec_grow_buffer( spec, spec -> np + spec_np_inj( spec, range ) );
+    spec_set_x( spec, range );
+
+    // Global injection index
+    const uint64_t np_inj = spec -> np;
+    spec -> density.total_np_inj = domain_exscan( np_inj ) + np_inj;
+
+    spec_set_u( spec, 0, spec -> np - 1 );
+}
+
 /**
  * @brief Initialize particle Species object
  * 
  * This routine will also inject the initial particle distribution,
  * setting thermal/fluid velocities.
  * 
+ * When using domain decomposition only the particles of the local domain
+ * are injected, see `domain_decompose()`; `nx` and `box` refer to the
+ * global grid.
+ * 
  * @param spec      Particle species
  * @param name      Name for the species (used for diagnostic output)
  * @param m_q       Mass over charge ratio for species, in simulation units
  * @param ppc       Reference number of particles per cell
  * @param ufl       Initial fluid momentum of particles, may be set to NULL 
  * @param uth       Initial thermal momentum of particles, may be set to NULL
- * @param nx        Number of grid points
+ * @param nx        Number of grid points (global)
  * @param box       Simulation box size in simulation units
  * @param dt        Simulation time step, in simulation units
  * @param density   Density profile for particle injection, may be set to NULL
@@ -518,13 +898,18 @@ void spec_new( t_species* spec, char name[], const float m_q, const int ppc,
     // Species name
     strncpy( spec -> name, name, MAX_SPNAME_LEN );
 
-    spec->nx = nx;
     spec->ppc = ppc;
     npc = ppc;
 
     spec->box = box;
     spec->dx = box / nx;
 
+    // Local domain
+    domain_decompose( nx, &spec -> nx, &spec -> domain_ix0 );
+    spec -> mig_buf = NULL;
+    spec -> mig_buf_size = 0;
+    spec -> mig_msg = (t_domain_msg) {0};
+
     spec -> m_q = m_q;
     spec -> q = copysign( 1.0f, m_q ) / npc;
 
@@ -532,7 +917,26 @@ void spec_new( t_species* spec, char name[], const float m_q, const int ppc,
 
     // Initialize particle buffer
     spec->np_max = 0;
+    spec->layout = PART_AOS;
     spec->part = NULL;
+    spec->soa = (t_part_soa) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+    spec->cpt = (t_part_compact) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+
+    // Sorting work buffers are allocated on first use
+    spec -> part_tmp = NULL;
+    spec -> soa_tmp = (t_part_soa) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+    spec -> cpt_tmp = (t_part_compact) { .ix = NULL, .x = NULL, .ux = NULL, .uy = NULL, .uz = NULL };
+    spec -> np_tmp = 0;
+    spec -> sort_buf = NULL;
+    spec -> sort_buf_size = 0;
+
+    // Scratch memory, kept between calls
+    spec -> scratch = malloc( sizeof( t_arena ) );
+    if ( ! spec -> scratch ) {
+        fprintf(stderr, "(*error*) Unable to allocate scratch memory arena, aborting.\n");
+        exit(-1);
+    }
+    arena_new( spec -> scratch );
 
     // Initialize density profile
     if ( density ) {
@@ -567,16 +971,40 @@ void spec_new( t_species* spec, char name[], const float m_q, const int ppc,
     // Reset moving window information
     spec -> moving_window = 0;
     spec -> n_move = 0;
+    spec -> ix_off = 0;
 
     // Inject initial particle distribution
     spec -> np = 0;
 
-    const int range[2] = {0, nx-1};
+    const int range[2] = {0, spec -> nx - 1};
 
-    spec_inject_particles( spec, range );
+    if ( domain_size() > 1 ) {
+        spec_inject_domain( spec, range );
+    } else {
+        spec_inject_particles( spec, range );
+    }
 
     // Set default sorting frequency
     spec -> n_sort = 16;
+    spec_set_sort_auto( spec, 0 );
+
+    // Default to linear particle shapes
+    spec -> shape = PART_SHAPE_LINEAR;
+
+    // Tiling is disabled by default
+    spec -> tile_nx = 0;
+    spec -> n_tiles = 0;
+    spec -> tile_max_nx = 0;
+    spec -> tile_lb = 0;
+    spec -> tile_cell = NULL;
+    spec -> tile_off = NULL;
+    spec -> tile_win = NULL;
+    spec -> tile_buf = NULL;
+    spec -> tile_imb_sum = 0;
+    spec -> tile_imb_n = 0;
+
+    // Push order (and floating point results) may depend on the number of threads
+    spec -> deterministic = 0;
 
     // Default to periodic boundary condtions
     spec -> bc_type = PART_BC_PERIODIC;
@@ -589,6 +1017,10 @@ void spec_new( t_species* spec, char name[], const float m_q, const int ppc,
  * When using a moving simulation window checks if a window move is due
  * at the current iteration and if so shifts left the particle cell indices
  * 
+ * Particle data is not changed, the shift is done by incrementing the
+ * cell index offset `spec -> ix_off`. The particle cell indices are
+ * corrected the next time the particle buffer is sorted or compacted.
+ * 
  * @param spec      Particle species
  */
 void spec_move_window( t_species *spec ){
@@ -597,17 +1029,16 @@ void spec_move_window( t_species *spec ){
 
         // shift all particles left
         // particles leaving the box will be removed later
-        int i;
-        for( i = 0; i < spec->np; i++ ) {
-            spec->part[i].ix--;
-        }
+        spec -> ix_off++;
 
         // Increase moving window counter
         spec -> n_move++;
 
         // Inject particles in the right edge of the simulation box
-        const int range[2] = {spec->nx-1,spec->nx-1};
-        spec_inject_particles( spec, range );
+        if ( ! domain_has_upper( 0 ) ) {
+            const int range[2] = {spec->nx-1,spec->nx-1};
+            spec_inject_particles( spec, range );
+        }
 
     }
 
@@ -620,8 +1051,18 @@ void spec_move_window( t_species *spec ){
  */
 void spec_delete( t_species* spec )
 {
-    free(spec->part);
+    arena_free( spec -> part );
+    spec_free_soa( spec );
+    spec_free_compact( spec );
+    spec_free_sort_tmp( spec );
+    free( spec -> sort_buf );
+    arena_delete( spec -> scratch );
+    free( spec -> scratch );
+    free( spec -> mig_buf );
+    free( spec -> mig_msg.buf );
     spec->np = -1;
+
+    spec_set_tiles( spec, 0 );
 }
 
 /*********************************************************************************************
@@ -630,6 +1071,190 @@ void spec_delete( t_species* spec )
 
  *********************************************************************************************/
 
+/// Number of cells below the particle cell accessed by interpolation / deposition, for a given shape
+#define SHAPE_EXT_LO( shape ) ( (shape) > PART_SHAPE_LINEAR ? 2 : 1 )
+
+/// Number of cells above the particle cell accessed by interpolation / deposition, for a given shape
+#define SHAPE_EXT_HI( shape ) ( (shape) > PART_SHAPE_LINEAR ? 3 : 2 )
+
+/**
+ * @brief First grid point of the particle shape stencil
+ * 
+ * For a particle at position `i + x` (grid point units, 0 <= x < 1) the
+ * stencil covers grid points [base, base + order]. Odd order shapes start
+ * from the grid points of the particle cell, even order shapes are centered
+ * on the nearest grid point.
+ * 
+ * The `order` parameter is meant to be a compile time constant.
+ * 
+ * @param order     Shape order {1,2,3}
+ * @param i         Particle cell index
+ * @param x         Position inside cell
+ * @param d         (out) Position relative to the stencil reference point,
+ *                  used by `shape_weights()`
+ * @return          First grid point of the stencil
+ */
+PUSH_INLINE int shape_base( const int order, const int i, const float x, float* restrict const d )
+{
+    if ( order == 2 ) {
+        const int up = ( x >= 0.5f );
+        *d = x - up;
+        return i + up - 1;
+    }
+
+    *d = x;
+    return ( order == 3 ) ? i - 1 : i;
+}
+
+/**
+ * @brief B-spline particle shape weights
+ * 
+ * The `order` parameter is meant to be a compile time constant.
+ * 
+ * @param order     Shape order {1,2,3}
+ * @param d         Position relative to the stencil reference point, see `shape_base()`
+ * @param w         (out) Weights of the order + 1 stencil points
+ */
+PUSH_INLINE void shape_weights( const int order, const float d, float* restrict const w )
+{
+    if ( order == 1 ) {
+        w[0] = 1.0f - d;
+        w[1] = d;
+    } else if ( order == 2 ) {
+        w[0] = 0.5f * ( 0.5f - d ) * ( 0.5f - d );
+        w[1] = 0.75f - d * d;
+        w[2] = 0.5f * ( 0.5f + d ) * ( 0.5f + d );
+    } else {
+        const float d2 = d * d;
+        const float d3 = d2 * d;
+        const float c = 1.0f - d;
+        w[0] = ( c * c * c ) * ( 1.0f / 6.0f );
+        w[1] = ( 4.0f - 6.0f * d2 + 3.0f * d3 ) * ( 1.0f / 6.0f );
+        w[2] = ( 1.0f + 3.0f * d + 3.0f * d2 - 3.0f * d3 ) * ( 1.0f / 6.0f );
+        w[3] = d3 * ( 1.0f / 6.0f );
+    }
+}
+
+/**
+ * @brief Esirkepov current deposition weights for a single particle
+ * 
+ * The particle shape moves at most 1 grid point, so the current is deposited
+ * on an `order + 2` point stencil starting at the returned grid point `b`:
+ * `wx[k]` is added to `J[b+k].x` (k <= order) and `wy[k]`, `wz[k]` to
+ * `J[b+k].y`, `J[b+k].z` (k <= order + 1). Weights are stored with a stride of
+ * `stride` values, so that they can be computed for a block of particles in a
+ * vectorized loop.
+ * 
+ * The `order` parameter is meant to be a compile time constant.
+ * 
+ * @param order     Shape order {1,2,3}
+ * @param ix0       Initial cell index of particle
+ * @param di        Number of cells moved {-1,0,1}
+ * @param x0        Initial position of particle inside cell
+ * @param x1        Final position of particle inside (new) cell
+ * @param qnx       Normalization for x current (q * cell size / dt)
+ * @param qvy       Y current ( q * vy )
+ * @param qvz       Z current ( q * vz )
+ * @param wx        (out) X current weights
+ * @param wy        (out) Y current weights
+ * @param wz        (out) Z current weights
+ * @param stride    Distance between consecutive weights
+ * @return          First grid point of the stencil
+ */
+PUSH_INLINE int esk_weights( const int order, const int ix0, const int di,
+    const float x0, const float x1, const float qnx, const float qvy, const float qvz,
+    float* restrict const wx, float* restrict const wy, float* restrict const wz,
+    const int stride )
+{
+    float d0, d1, S0[4], S1[4];
+
+    const int b0 = shape_base( order, ix0, x0, &d0 );
+    const int b1 = shape_base( order, ix0 + di, x1, &d1 );
+    shape_weights( order, d0, S0 );
+    shape_weights( order, d1, S1 );
+
+    // Initial and final shapes, on the common stencil
+    const int b = ( b1 < b0 ) ? b1 : b0;
+    const int o0 = b0 - b;
+    const int o1 = b1 - b;
+
+    float c = 0;
+    for( int k = 0; k < order + 2; k++ ) {
+        const float s0 = o0 ? ( k > 0 ? S0[k-1] : 0.0f ) : ( k <= order ? S0[k] : 0.0f );
+        const float s1 = o1 ? ( k > 0 ? S1[k-1] : 0.0f ) : ( k <= order ? S1[k] : 0.0f );
+
+        // jx from the continuity equation
+        c -= qnx * ( s1 - s0 );
+        if ( k <= order ) wx[ k * stride ] = c;
+
+        wy[ k * stride ] = qvy * 0.5f * ( s0 + s1 );
+        wz[ k * stride ] = qvz * 0.5f * ( s0 + s1 );
+    }
+
+    return b;
+}
+
+/**
+ * @brief Adds the current deposition weights of a single particle to the grid
+ * 
+ * See `esk_weights()` for details.
+ * 
+ * @param order     Shape order {1,2,3}
+ * @param b         First grid point of the stencil
+ * @param wx        X current weights
+ * @param wy        Y current weights
+ * @param wz        Z current weights
+ * @param stride    Distance between consecutive weights
+ * @param J         Current density grid (pointer to cell 0)
+ * @param atomic    Use atomic updates
+ */
+PUSH_INLINE void esk_scatter( const int order, const int b,
+    const float* restrict const wx, const float* restrict const wy, const float* restrict const wz,
+    const int stride, float3* restrict const J, const int atomic )
+{
+    for( int k = 0; k < order + 2; k++ ) {
+        if ( atomic ) {
+            if ( k <= order ) {
+                #pragma omp atomic
+                J[ b + k ].x += wx[ k * stride ];
+            }
+            #pragma omp atomic
+            J[ b + k ].y += wy[ k * stride ];
+            #pragma omp atomic
+            J[ b + k ].z += wz[ k * stride ];
+        } else {
+            if ( k <= order ) J[ b + k ].x += wx[ k * stride ];
+            J[ b + k ].y += wy[ k * stride ];
+            J[ b + k ].z += wz[ k * stride ];
+        }
+    }
+}
+
+/**
+ * @brief Deposit single particle current using Esirkepov method, arbitrary shape
+ * 
+ * Used for the quadratic and cubic particle shapes, see `esk_weights()`.
+ * 
+ * @param order     Shape order {1,2,3}
+ * @param ix0       Initial cell index of particle
+ * @param di        Number of cells moved {-1,0,1}
+ * @param x0        Initial position of particle inside cell
+ * @param x1        Final position of particle inside (new) cell
+ * @param qnx       Normalization for x current (q * cell size / dt)
+ * @param qvy       Y current ( q * vy )
+ * @param qvz       Z current ( q * vz )
+ * @param J         Current density grid (pointer to cell 0)
+ * @param atomic    Use atomic updates
+ */
+PUSH_INLINE void deposit_esk( const int order, const int ix0, const int di,
+    const float x0, const float x1, const float qnx, const float qvy, const float qvz,
+    float3* restrict const J, const int atomic )
+{
+    float wx[4], wy[5], wz[5];
+    const int b = esk_weights( order, ix0, di, x0, x1, qnx, qvy, qvz, wx, wy, wz, 1 );
+    esk_scatter( order, b, wx, wy, wz, 1, J, atomic );
+}
+
 /**
  * @brief Deposit single particle current using Esirkepov method
  * 
@@ -693,21 +1318,14 @@ void dep_current_esk( int ix0, int di,
 }
 
 /**
- * @brief Deposit single particle current using zamb method
+ * @brief Deposit single particle current using zamb method (inlined version)
  * 
- * @param ix0       Initial cell index of particle
- * @param di        Number of cells moved {-1,0,1}
- * @param x0        Initial position of particle inside cell
- * @param dx        Particle motion normalized to cell size
- * @param qnx       Normalization for x current (q * cell size / dt)
- * @param qvy       Y current ( q * vy )
- * @param qvz       Z current ( q * vz )
- * @param current   Electric current density
+ * See `dep_current_zamb()` for details.
  */
-void dep_current_zamb( int ix0, int di,
+PUSH_INLINE void deposit_zamb( int ix0, int di,
                         float x0, float dx,
                         float qnx, float qvy, float qvz,
-                        t_current *current )
+                        float3* restrict const J, const int atomic )
 {
     // Split the particle trajectory
     typedef struct {
@@ -758,8 +1376,6 @@ void dep_current_zamb( int ix0, int di,
     }
 
     // Deposit virtual particle currents
-    float3* restrict const J = current -> J;
-
     for (int k = 0; k < vnp; k++) {
         float S0x[2], S1x[2];
 
@@ -768,20 +1384,56 @@ void dep_current_zamb( int ix0, int di,
 
         S1x[0] = 1.0f - vp[k].x1;
         S1x[1] = vp[k].x1;
-	#pragma omp atomic
-        J[ vp[k].ix     ].x += qnx * vp[k].dx;
-	#pragma omp atomic
-        J[ vp[k].ix     ].y += vp[k].qvy * (S0x[0]+S1x[0]+(S0x[0]-S1x[0])/2.0f);
-	#pragma omp atomic
-        J[ vp[k].ix + 1 ].y += vp[k].qvy * (S0x[1]+S1x[1]+(S0x[1]-S1x[1])/2.0f);
-	#pragma omp atomic
-        J[ vp[k].ix     ].z += vp[k].qvz * (S0x[0]+S1x[0]+(S0x[0]-S1x[0])/2.0f);
-	#pragma omp atomic
-        J[ vp[k].ix  +1 ].z += vp[k].qvz * (S0x[1]+S1x[1]+(S0x[1]-S1x[1])/2.0f);
+
+        const float jx  = qnx * vp[k].dx;
+        const float jy0 = vp[k].qvy * (S0x[0]+S1x[0]+(S0x[0]-S1x[0])/2.0f);
+        const float jy1 = vp[k].qvy * (S0x[1]+S1x[1]+(S0x[1]-S1x[1])/2.0f);
+        const float jz0 = vp[k].qvz * (S0x[0]+S1x[0]+(S0x[0]-S1x[0])/2.0f);
+        const float jz1 = vp[k].qvz * (S0x[1]+S1x[1]+(S0x[1]-S1x[1])/2.0f);
+
+        if ( atomic ) {
+            #pragma omp atomic
+            J[ vp[k].ix     ].x += jx;
+            #pragma omp atomic
+            J[ vp[k].ix     ].y += jy0;
+            #pragma omp atomic
+            J[ vp[k].ix + 1 ].y += jy1;
+            #pragma omp atomic
+            J[ vp[k].ix     ].z += jz0;
+            #pragma omp atomic
+            J[ vp[k].ix + 1 ].z += jz1;
+        } else {
+            J[ vp[k].ix     ].x += jx;
+            J[ vp[k].ix     ].y += jy0;
+            J[ vp[k].ix + 1 ].y += jy1;
+            J[ vp[k].ix     ].z += jz0;
+            J[ vp[k].ix + 1 ].z += jz1;
+        }
     }
 
 }
 
+/**
+ * @brief Deposit single particle current using zamb method
+ * 
+ * @param ix0       Initial cell index of particle
+ * @param di        Number of cells moved {-1,0,1}
+ * @param x0        Initial position of particle inside cell
+ * @param dx        Particle motion normalized to cell size
+ * @param qnx       Normalization for x current (q * cell size / dt)
+ * @param qvy       Y current ( q * vy )
+ * @param qvz       Z current ( q * vz )
+ * @param J         Current density grid (pointer to cell 0)
+ * @param atomic    Use atomic updates (required when J is shared by multiple threads)
+ */
+void dep_current_zamb( int ix0, int di,
+                        float x0, float dx,
+                        float qnx, float qvy, float qvz,
+                        float3* restrict const J, const int atomic )
+{
+    deposit_zamb( ix0, di, x0, dx, qnx, qvy, qvz, J, atomic );
+}
+
 /*********************************************************************************************
 
  Sorting
@@ -789,62 +1441,291 @@ void dep_current_zamb( int ix0, int di,
  *********************************************************************************************/
 
 /**
- * @brief Sorts particle buffer.
+ * @brief Allocates the secondary particle buffer, if required
  * 
- * Sorts particles inside the particle buffer according to their cell
- * index to optimize memory cache use. Note: this is a performance
- * optimization only and is not required by the algorithm
+ * The buffer has the same size and layout as the main particle buffer and
+ * is kept between calls.
  * 
- * @param spec      Particle species
+ * @param spec  Particle species
  */
-void spec_sort( t_species* spec )
+static void spec_alloc_tmp( t_species* spec )
 {
-
-    const int ncell = spec->nx;
-
-    // Allocate index memory
-    int * restrict idx  = (int *) malloc(spec->np*sizeof(int));
-
-    // Allocate temp. array with number of particles in cell
-    int * restrict npic = (int *) malloc( ncell * sizeof(int));
-    memset( npic, 0, ncell * sizeof(int));
-
-    // Generate sorted index
-    for (int i=0; i<spec->np; i++) {
-        idx[i] = spec->part[i].ix;
-        npic[idx[i]]++;
+    if ( spec -> np_tmp == spec -> np_max ) return;
+
+    spec_free_sort_tmp( spec );
+    if ( spec -> layout == PART_SOA ) {
+        realloc_aligned( (void **) &spec -> soa_tmp.ix, 0, spec -> np_max, sizeof(int) );
+        realloc_aligned( (void **) &spec -> soa_tmp.x,  0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &spec -> soa_tmp.ux, 0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &spec -> soa_tmp.uy, 0, spec -> np_max, sizeof(float) );
+        realloc_aligned( (void **) &spec -> soa_tmp.uz, 0, spec -> np_max, sizeof(float) );
+    } else if ( spec -> layout == PART_COMPACT ) {
+        alloc_compact( &spec -> cpt_tmp, 0, spec -> np_max );
+    } else {
+        realloc_aligned( (void **) &spec -> part_tmp, 0, spec -> np_max, sizeof(t_part) );
     }
+    spec -> np_tmp = spec -> np_max;
+}
 
-    int isum = 0;
-    for (int i=0; i<ncell; i++) {
-        int j = npic[i];
-        npic[i] = isum;
-        isum += j;
+/**
+ * @brief Swaps the main and secondary particle buffers
+ * 
+ * @param spec  Particle species
+ */
+static void spec_swap_tmp( t_species* spec )
+{
+    if ( spec -> layout == PART_SOA ) {
+        t_part_soa tmp = spec -> soa;
+        spec -> soa = spec -> soa_tmp;
+        spec -> soa_tmp = tmp;
+    } else if ( spec -> layout == PART_COMPACT ) {
+        t_part_compact tmp = spec -> cpt;
+        spec -> cpt = spec -> cpt_tmp;
+        spec -> cpt_tmp = tmp;
+    } else {
+        t_part * tmp = spec -> part;
+        spec -> part = spec -> part_tmp;
+        spec -> part_tmp = tmp;
     }
+}
 
-    for (int i=0; i< spec->np; i++) {
-        int j = idx[i];
-        idx[i] = npic[j]++;
-    }
+/**
+ * @brief Grows the integer work buffer used by the sort / compaction routines
+ * 
+ * @param spec  Particle species
+ * @param size  Minimum buffer size
+ */
+static void spec_grow_sort_buf( t_species* spec, const int size )
+{
+    if ( size > spec -> sort_buf_size ) {
+        free( spec -> sort_buf );
+        spec -> sort_buf = malloc( size * sizeof(int) );
+        if ( !spec -> sort_buf ) {
+            fprintf(stderr, "(*error*) Unable to allocate sort buffer, aborting.\n");
+            exit(-1);
+        }
+        spec -> sort_buf_size = size;
+    }
+}
+
+/**
+ * @brief Sets the tile boundaries and particle buffer offsets of each tile
+ * 
+ * Called after sorting the particle buffer. The load of each tile is
+ * estimated from the number of particles it holds plus a fixed cost per cell
+ * (`TILE_LB_CELL_COST`). If load balancing is enabled the tile boundaries are
+ * first moved so that all tiles hold approximately the same load, keeping
+ * tiles between 1 and `tile_max_nx` cells wide. The imbalance (maximum /
+ * average tile load) of the resulting tiles is then measured.
+ * 
+ * @param spec      Particle species
+ * @param cell      Particle buffer offset of each cell
+ */
+static void spec_tile_partition( t_species* spec, const int* restrict cell )
+{
+    const int nx      = spec -> nx;
+    const int n_tiles = spec -> n_tiles;
+    const int max_nx  = spec -> tile_max_nx;
+    int* restrict const tc = spec -> tile_cell;
+
+    // Load of cells [0, c[
+    #define TILE_LOAD( c ) ( ( (c) < nx ? cell[c] : spec -> np ) + TILE_LB_CELL_COST * (c) )
+
+    const double total = TILE_LOAD( nx );
+
+    if ( spec -> tile_lb ) {
+        // Each tile gets an even share of the load not yet assigned, as long
+        // as the remaining tiles can still cover the remaining cells
+        int c = 0;
+        for (int t=0; t<n_tiles-1; t++) {
+            const int left = n_tiles - 1 - t;
+            int lo = nx - left * max_nx;
+            int hi = nx - left;
+            if ( lo < c + 1 ) lo = c + 1;
+            if ( hi > c + max_nx ) hi = c + max_nx;
+
+            const double start = TILE_LOAD( c );
+            const double target = start + ( total - start ) / ( left + 1 );
+            c = lo;
+            while( c < hi && TILE_LOAD( c ) < target ) c++;
+            tc[t+1] = c;
+        }
+    }
+
+    // Measure imbalance, the particles of each tile are kept together until the next sort
+    double max_load = 0;
+    for (int t=0; t<n_tiles; t++) {
+        const double load = TILE_LOAD( tc[t+1] ) - TILE_LOAD( tc[t] );
+        if ( load > max_load ) max_load = load;
+    }
+    spec -> tile_imb_sum += max_load * n_tiles / total;
+    spec -> tile_imb_n++;
+
+    #undef TILE_LOAD
+
+    for (int t=0; t<n_tiles; t++) spec->tile_off[t] = cell[ tc[t] ];
+    spec->tile_off[ n_tiles ] = spec->np;
+}
+
+/**
+ * @brief Sorts particle buffer.
+ * 
+ * Must be called by all threads of the current parallel region,
+ * see `spec_sort()`
+ * 
+ * @param spec      Particle species
+ */
+static void spec_sort_omp( t_species* spec )
+{
+
+    const int ncell = spec->nx;
+    const int np    = spec->np;
+    const int ix_off = spec->ix_off;
+    const int nt    = omp_get_num_threads();
+    const int tid   = omp_get_thread_num();
 
-    // free temp. array
-    free(npic);
+    #pragma omp single
+    {
+        spec_alloc_tmp( spec );
 
-    // low mem
-    for (int i=0; i < spec->np; i++) {
-        int k = idx[i];
-        while ( k > i ) {
-            t_part tmp = spec->part[k];
-            spec->part[k] = spec->part[i];
-            spec->part[i] = tmp;
+        // Histogram / prefix sum memory
+        spec_grow_sort_buf( spec, ( nt + 1 ) * ncell + nt + 1 );
+    }
+
+    // Cell offsets, per thread histograms and per thread cell block sums
+    int * restrict const cell = spec -> sort_buf;
+    int * restrict const npic = spec -> sort_buf + ncell;
+    int * restrict const blk  = spec -> sort_buf + ( nt + 1 ) * ncell;
+
+    // Particle and cell ranges for this thread
+    const int i0 = (int) ( ( (int64_t) np *  tid      ) / nt );
+    const int i1 = (int) ( ( (int64_t) np * (tid + 1) ) / nt );
+    const int c0 = (int) ( ( (int64_t) ncell *  tid      ) / nt );
+    const int c1 = (int) ( ( (int64_t) ncell * (tid + 1) ) / nt );
+
+    // Local histogram, shifted to use the particle cell indices directly
+    memset( npic + tid * ncell, 0, ncell * sizeof(int) );
+    int * restrict const cnt = npic + tid * ncell - ix_off;
+
+    if ( spec -> layout != PART_AOS ) {
+        const int * restrict const ix = ( spec -> layout == PART_SOA ) ? spec -> soa.ix : spec -> cpt.ix;
+        for (int i=i0; i<i1; i++) cnt[ ix[i] ]++;
+    } else {
+        const t_part * restrict const part = spec -> part;
+        for (int i=i0; i<i1; i++) cnt[ part[i].ix ]++;
+    }
+
+    #pragma omp barrier
+
+    // Offsets of each thread inside each cell, and total for block of cells
+    int bsum = 0;
+    for (int c=c0; c<c1; c++) {
+        int sum = 0;
+        for (int t=0; t<nt; t++) {
+            int j = npic[ t * ncell + c ];
+            npic[ t * ncell + c ] = sum;
+            sum += j;
+        }
+        cell[c] = sum;
+        bsum += sum;
+    }
+    blk[tid] = bsum;
+
+    #pragma omp barrier
+
+    #pragma omp single
+    {
+        int isum = 0;
+        for (int t=0; t<nt; t++) {
+            int j = blk[t];
+            blk[t] = isum;
+            isum += j;
+        }
+    }
+
+    // Global offset of each cell / thread
+    int isum = blk[tid];
+    for (int c=c0; c<c1; c++) {
+        int j = cell[c];
+        cell[c] = isum;
+        for (int t=0; t<nt; t++) npic[ t * ncell + c ] += isum;
+        isum += j;
+    }
 
-            int t = idx[k];
-            idx[k] = -1;
-            k = t;
+    #pragma omp barrier
+
+    // Copy particles to the secondary buffer, removing the cell index offset
+    if ( spec -> layout == PART_SOA ) {
+        const t_part_soa src = spec -> soa;
+        const t_part_soa dst = spec -> soa_tmp;
+        for (int i=i0; i<i1; i++) {
+            const int k = cnt[ src.ix[i] ]++;
+            dst.ix[k] = src.ix[i] - ix_off;
+            dst.x[k]  = src.x[i];
+            dst.ux[k] = src.ux[i];
+            dst.uy[k] = src.uy[i];
+            dst.uz[k] = src.uz[i];
+        }
+    } else if ( spec -> layout == PART_COMPACT ) {
+        const t_part_compact src = spec -> cpt;
+        const t_part_compact dst = spec -> cpt_tmp;
+        for (int i=i0; i<i1; i++) {
+            const int k = cnt[ src.ix[i] ]++;
+            dst.ix[k] = src.ix[i] - ix_off;
+            dst.x[k]  = src.x[i];
+            dst.ux[k] = src.ux[i];
+            dst.uy[k] = src.uy[i];
+            dst.uz[k] = src.uz[i];
+        }
+    } else {
+        const t_part * restrict const src = spec -> part;
+        t_part * restrict const dst = spec -> part_tmp;
+        for (int i=i0; i<i1; i++) {
+            const int k = cnt[ src[i].ix ]++;
+            dst[k] = src[i];
+            dst[k].ix -= ix_off;
         }
     }
 
-    free(idx);
+    #pragma omp barrier
+
+    #pragma omp single
+    {
+        spec_swap_tmp( spec );
+        spec -> ix_off = 0;
+
+        // Store particle buffer offsets of each tile
+        if ( spec -> tile_nx > 0 ) spec_tile_partition( spec, cell );
+    }
+}
+
+/**
+ * @brief Sorts particle buffer.
+ * 
+ * Sorts particles inside the particle buffer according to their cell
+ * index to optimize memory cache use. Note: this is a performance
+ * optimization only and is not required by the algorithm
+ * 
+ * The sort is a parallel (stable) counting sort: each thread builds the
+ * cell histogram of a contiguous section of the particle buffer, the
+ * histograms are converted into per thread cell offsets using a parallel
+ * prefix scan, and particles are then copied into a secondary particle
+ * buffer that replaces the original one. The secondary buffer and the
+ * histograms are kept between calls.
+ * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
+ * @param spec      Particle species
+ */
+void spec_sort( t_species* spec )
+{
+    if ( omp_in_parallel() ) {
+        spec_sort_omp( spec );
+    } else {
+        #pragma omp parallel
+        spec_sort_omp( spec );
+    }
 }
 
 /*********************************************************************************************
@@ -856,50 +1737,1740 @@ void spec_sort( t_species* spec )
 /**
  * @brief Interpolates EM fields at particle position
  * 
- * Routine uses linear interpolation and accounts for a staggered (Yee)
- * mesh, with the charge at the lower corner of the cell
+ * Routine uses the particle shape of the given order and accounts for a
+ * staggered (Yee) mesh, with the charge at the lower corner of the cell
+ * 
+ * The `order` parameter is meant to be a compile time constant.
  * 
  * @param E     Electric field grid
  * @param B     Magnetic field grid
- * @param part  Particle data
+ * @param order Shape order {1,2,3}
+ * @param i     Particle cell index
+ * @param x     Position inside cell
  * @param Ep    E-field interpolated at particle position
  * @param Bp    B-field interpolated at particle position
  */
-void interpolate_fld( const float3* restrict const E, const float3* restrict const B,
-              const t_part* restrict const part, float3* restrict const Ep, float3* restrict const Bp )
+PUSH_INLINE void interpolate_fld( const float3* restrict const E, const float3* restrict const B,
+              const int order, const int i, const float x,
+              float3* restrict const Ep, float3* restrict const Bp )
+{
+    // Cell index and position for the half grid quantities
+    const int ih = i + ( (x < 0.5f) ? -1 : 0 );
+    const float w1h = x + ( (x < 0.5f) ? 0.5f : -0.5f );
+
+    if ( order == 1 ) {
+        const float w1 = x;
+
+        Ep->x = E[ih].x * (1.0f - w1h) + E[ih+1].x * w1h;
+        Ep->y = E[i ].y * (1.0f -  w1) + E[i+1 ].y * w1;
+        Ep->z = E[i ].z * (1.0f -  w1) + E[i+1 ].z * w1;
+
+        Bp->x = B[i ].x * (1.0f  - w1) + B[i+1 ].x * w1;
+        Bp->y = B[ih].y * (1.0f - w1h) + B[ih+1].y * w1h;
+        Bp->z = B[ih].z * (1.0f - w1h) + B[ih+1].z * w1h;
+    } else {
+        float d, dh, w[4], wh[4];
+        const int b  = shape_base( order, i, x, &d );
+        const int bh = shape_base( order, ih, w1h, &dh );
+        shape_weights( order, d, w );
+        shape_weights( order, dh, wh );
+
+        *Ep = (float3) {0, 0, 0};
+        *Bp = (float3) {0, 0, 0};
+        for( int k = 0; k <= order; k++ ) {
+            Ep->x += E[bh+k].x * wh[k];
+            Ep->y += E[b +k].y * w[k];
+            Ep->z += E[b +k].z * w[k];
+
+            Bp->x += B[b +k].x * w[k];
+            Bp->y += B[bh+k].y * wh[k];
+            Bp->z += B[bh+k].z * wh[k];
+        }
+    }
+}
+
+/**
+ * @brief Returns number of cells moved
+ * 
+ * Note that the particle will move at most 1 cell in either direction
+ * 
+ * @param x         End particle position, normalized to cell size
+ * @return ltrim    Number of cells moved, {-1,0,1}
+ */
+int ltrim( float x )
+{
+    return ( x >= 1.0f ) - ( x < 0.0f );
+}
+
+/**
+ * @brief Particle push parameters
+ * 
+ */
+typedef struct PushParam {
+    float tem;      ///< Normalization for the Boris pusher ( 0.5 * dt / m_q )
+    float dt_dx;    ///< Ratio between time step and cell size
+    float q;        ///< Particle charge
+    float qnx;      ///< Normalization for x current (q * cell size / dt)
+    int wrap;       ///< Number of cells for periodic wrapping of the cell index
+    float3 E0;      ///< Uniform external E field
+    float3 B0;      ///< Uniform external B field
+} t_push_param;
+
+/**
+ * @brief Advance a single particle 1 timestep and deposit its current
+ * 
+ * Fields are interpolated from the supplied grids and the current is
+ * deposited on the supplied grid, these may be either the global grids or
+ * tile-local copies.
+ * 
+ * The `order`, `atomic`, `wrap` and `ext` parameters are meant to be compile
+ * time constants, see `push_kernels`.
+ * 
+ * @param part      Particle data
+ * @param E         Electric field grid (pointer to cell 0)
+ * @param B         Magnetic field grid (pointer to cell 0)
+ * @param p         Push parameters
+ * @param J         Current density grid (pointer to cell 0)
+ * @param order     Particle shape order {1,2,3}
+ * @param atomic    Use atomic updates for current deposition
+ * @param wrap      Use periodic wrapping of the cell index
+ * @param ext       Add uniform external fields (p->E0, p->B0) to the interpolated fields
+ * @return          Time centered kinetic energy of the particle (normalized)
+ */
+PUSH_INLINE float advance_part( t_part* restrict const part,
+    const float3* restrict const E, const float3* restrict const B,
+    const t_push_param* restrict const p, float3* restrict const J,
+    const int order, const int atomic, const int wrap, const int ext )
+{
+    float3 Ep, Bp;
+    float utx, uty, utz;
+    float ux, uy, uz, u2;
+    float gamma, rg, gtem, otsq;
+
+    float x1;
+
+    int di;
+    float dx;
+
+    const float tem = p -> tem;
+
+    // Load particle momenta
+    ux = part -> ux;
+    uy = part -> uy;
+    uz = part -> uz;
+
+    // interpolate fields
+    interpolate_fld( E, B, order, part -> ix, part -> x, &Ep, &Bp );
+    // Ep.x = Ep.y = Ep.z = Bp.x = Bp.y = Bp.z = 0;
+
+    // add uniform external fields
+    if ( ext ) {
+        Ep.x += p -> E0.x;
+        Ep.y += p -> E0.y;
+        Ep.z += p -> E0.z;
+
+        Bp.x += p -> B0.x;
+        Bp.y += p -> B0.y;
+        Bp.z += p -> B0.z;
+    }
+
+    // advance u using Boris scheme
+    Ep.x *= tem;
+    Ep.y *= tem;
+    Ep.z *= tem;
+
+    utx = ux + Ep.x;
+    uty = uy + Ep.y;
+    utz = uz + Ep.z;
+
+    // Perform first half of the rotation
+    // Get time centered gamma
+    u2 = utx*utx + uty*uty + utz*utz;
+    gamma = sqrtf( 1 + u2 );
+
+    // Time centered energy
+    const float energy = u2 / ( 1 + gamma );
+
+    gtem = tem / gamma;
+
+    Bp.x *= gtem;
+    Bp.y *= gtem;
+    Bp.z *= gtem;
+
+    otsq = 2.0f / ( 1.0f + Bp.x*Bp.x + Bp.y*Bp.y + Bp.z*Bp.z );
+
+    ux = utx + uty*Bp.z - utz*Bp.y;
+    uy = uty + utz*Bp.x - utx*Bp.z;
+    uz = utz + utx*Bp.y - uty*Bp.x;
+
+    // Perform second half of the rotation
+
+    Bp.x *= otsq;
+    Bp.y *= otsq;
+    Bp.z *= otsq;
+
+    utx += uy*Bp.z - uz*Bp.y;
+    uty += uz*Bp.x - ux*Bp.z;
+    utz += ux*Bp.y - uy*Bp.x;
+
+    // Perform second half of electric field acceleration
+    ux = utx + Ep.x;
+    uy = uty + Ep.y;
+    uz = utz + Ep.z;
+
+    // Store new momenta
+    part -> ux = ux;
+    part -> uy = uy;
+    part -> uz = uz;
+
+    // push particle
+    rg = 1.0f / sqrtf(1.0f + ux*ux + uy*uy + uz*uz);
+
+    dx = p -> dt_dx * rg * ux;
+
+    x1 = part -> x + dx;
+
+    di = ltrim(x1);
+
+    x1 -= di;
+
+    float qvy = p -> q * uy * rg;
+    float qvz = p -> q * uz * rg;
+
+    // deposit current, higher order shapes use the Esirkepov method
+    if ( order == 1 ) {
+        deposit_zamb( part -> ix, di,
+                         part -> x, dx,
+                         p -> qnx, qvy, qvz,
+                         J, atomic );
+    } else {
+        deposit_esk( order, part -> ix, di,
+                         part -> x, x1,
+                         p -> qnx, qvy, qvz,
+                         J, atomic );
+    }
+
+    // Store results
+    part -> x = x1;
+    part -> ix += di;
+
+    // Periodic boundaries
+    if ( wrap ) part -> ix += (( part -> ix < 0 ) ? p -> wrap : 0 ) - (( part -> ix >= p -> wrap ) ? p -> wrap : 0);
+
+    return energy;
+}
+
+/**
+ * @brief Advance a block of particles 1 timestep, structure of arrays version
+ * 
+ * The field interpolation, Boris push and cell crossing (`ltrim()`) steps
+ * are done in a vectorized loop working on SIMD lanes of particles; the
+ * current deposition, which may have write conflicts between lanes, is done
+ * in a second scalar loop. For higher order shapes the deposition stencil
+ * weights are also computed in a vectorized loop, and only the final
+ * scatter to the grid is scalar.
+ * 
+ * With the PART_COMPACT layout positions are converted to single precision
+ * when loaded and back to fixed point when stored. The new
+ * position is rounded to the fixed point grid before the current deposition,
+ * so that the deposited current matches the stored particle motion and
+ * charge is still conserved exactly.
+ * 
+ * The `order`, `compact`, `atomic`, `wrap` and `ext` parameters are meant to
+ * be compile time constants, see `push_kernels`.
+ * 
+ * @param spec      Particle species (must use the PART_SOA or PART_COMPACT layout)
+ * @param i0        Index of first particle
+ * @param np        Number of particles to advance, must be <= SOA_BLOCK
+ * @param E         Electric field grid (pointer to cell 0)
+ * @param B         Magnetic field grid (pointer to cell 0)
+ * @param p         Push parameters
+ * @param J         Current density grid (pointer to cell 0)
+ * @param order     Particle shape order {1,2,3}
+ * @param compact   Particle buffer uses the PART_COMPACT layout
+ * @param atomic    Use atomic updates for current deposition
+ * @param wrap      Use periodic wrapping of the cell index
+ * @param ext       Add uniform external fields (p->E0, p->B0) to the interpolated fields
+ * @return          Time centered kinetic energy of the particles (normalized)
+ */
+PUSH_INLINE double advance_block_soa( t_species* const spec, const int i0, const int np,
+    const float3* restrict const E, const float3* restrict const B,
+    const t_push_param* restrict const p, float3* restrict const J,
+    const int order, const int compact, const int atomic, const int wrap, const int ext )
+{
+    // Single precision copy of fixed point positions
+    float xc[SOA_BLOCK];
+
+    int*   restrict const ix = ( compact ? spec -> cpt.ix : spec -> soa.ix ) + i0;
+    float* restrict const x  = compact ? xc : spec -> soa.x  + i0;
+    float* restrict const ux = ( compact ? spec -> cpt.ux : spec -> soa.ux ) + i0;
+    float* restrict const uy = ( compact ? spec -> cpt.uy : spec -> soa.uy ) + i0;
+    float* restrict const uz = ( compact ? spec -> cpt.uz : spec -> soa.uz ) + i0;
+
+    if ( compact ) {
+        const uint16_t* restrict const xq = spec -> cpt.x + i0;
+        #pragma omp simd
+        for( int k = 0; k < np; k++ ) x[k] = part_fix_to_float( xq[k] );
+    }
+
+    const float tem   = p -> tem;
+    const float dt_dx = p -> dt_dx;
+    const float q     = p -> q;
+    const float3 E0   = p -> E0;
+    const float3 B0   = p -> B0;
+
+    // Per particle values required for the current deposition
+    float dxp[SOA_BLOCK], x1p[SOA_BLOCK], qvy[SOA_BLOCK], qvz[SOA_BLOCK];
+    int dip[SOA_BLOCK];
+
+    double energy = 0;
+
+    #pragma omp simd reduction(+:energy)
+    for( int k = 0; k < np; k++ ) {
+
+        // interpolate fields
+        const float w1 = x[k];
+        float3 Ep, Bp;
+        interpolate_fld( E, B, order, ix[k], w1, &Ep, &Bp );
+
+        float Epx = Ep.x, Epy = Ep.y, Epz = Ep.z;
+        float Bpx = Bp.x, Bpy = Bp.y, Bpz = Bp.z;
+
+        // add uniform external fields
+        if ( ext ) {
+            Epx += E0.x;
+            Epy += E0.y;
+            Epz += E0.z;
+
+            Bpx += B0.x;
+            Bpy += B0.y;
+            Bpz += B0.z;
+        }
+
+        // advance u using Boris scheme
+        Epx *= tem;
+        Epy *= tem;
+        Epz *= tem;
+
+        float utx = ux[k] + Epx;
+        float uty = uy[k] + Epy;
+        float utz = uz[k] + Epz;
+
+        // Perform first half of the rotation
+        const float u2 = utx*utx + uty*uty + utz*utz;
+        const float gamma = sqrtf( 1 + u2 );
+
+        // Accumulate time centered energy
+        energy += u2 / ( 1 + gamma );
+
+        const float gtem = tem / gamma;
+
+        Bpx *= gtem;
+        Bpy *= gtem;
+        Bpz *= gtem;
+
+        const float otsq = 2.0f / ( 1.0f + Bpx*Bpx + Bpy*Bpy + Bpz*Bpz );
+
+        float vx = utx + uty*Bpz - utz*Bpy;
+        float vy = uty + utz*Bpx - utx*Bpz;
+        float vz = utz + utx*Bpy - uty*Bpx;
+
+        // Perform second half of the rotation
+        Bpx *= otsq;
+        Bpy *= otsq;
+        Bpz *= otsq;
+
+        utx += vy*Bpz - vz*Bpy;
+        uty += vz*Bpx - vx*Bpz;
+        utz += vx*Bpy - vy*Bpx;
+
+        // Perform second half of electric field acceleration
+        vx = utx + Epx;
+        vy = uty + Epy;
+        vz = utz + Epz;
+
+        // Store new momenta
+        ux[k] = vx;
+        uy[k] = vy;
+        uz[k] = vz;
+
+        // push particle
+        const float rg = 1.0f / sqrtf(1.0f + vx*vx + vy*vy + vz*vz);
+        float dx = dt_dx * rg * vx;
+        const float x1 = w1 + dx;
+        const int di = ltrim( x1 );
+        float xn = x1 - di;
+
+        // Round new position to the stored precision
+        if ( compact ) {
+            xn = part_fix_to_float( part_float_to_fix( xn ) );
+            dx = ( xn + di ) - w1;
+        }
+
+        dxp[k] = dx;
+        x1p[k] = xn;
+        dip[k] = di;
+        qvy[k] = q * vy * rg;
+        qvz[k] = q * vz * rg;
+    }
+
+    // Deposit current and store new positions
+    const float qnx = p -> qnx;
+    const int nwrap = p -> wrap;
+
+    if ( order > 1 ) {
+        // Esirkepov deposition stencils, weights are stored as [point][particle]
+        float wx[ 4 * SOA_BLOCK ], wy[ 5 * SOA_BLOCK ], wz[ 5 * SOA_BLOCK ];
+        int bp[ SOA_BLOCK ];
+
+        #pragma omp simd
+        for( int k = 0; k < np; k++ )
+            bp[k] = esk_weights( order, ix[k], dip[k], x[k], x1p[k], qnx, qvy[k], qvz[k],
+                &wx[k], &wy[k], &wz[k], SOA_BLOCK );
+
+        for( int k = 0; k < np; k++ )
+            esk_scatter( order, bp[k], &wx[k], &wy[k], &wz[k], SOA_BLOCK, J, atomic );
+    }
+
+    for( int k = 0; k < np; k++ ) {
+        if ( order == 1 ) deposit_zamb( ix[k], dip[k], x[k], dxp[k], qnx, qvy[k], qvz[k], J, atomic );
+
+        x[k]   = x1p[k];
+        ix[k] += dip[k];
+
+        // Periodic boundaries
+        if ( wrap ) ix[k] += (( ix[k] < 0 ) ? nwrap : 0 ) - (( ix[k] >= nwrap ) ? nwrap : 0);
+    }
+
+    if ( compact ) {
+        uint16_t* restrict const xq = spec -> cpt.x + i0;
+        #pragma omp simd
+        for( int k = 0; k < np; k++ ) xq[k] = part_float_to_fix( x[k] );
+    }
+
+    return energy;
+}
+
+/**
+ * @brief Advance a range of particles 1 timestep
+ * 
+ * Template for the specialized push kernels, see `push_kernels`.
+ * 
+ * @param spec      Particle species
+ * @param i0        Index of first particle
+ * @param i1        Index of last particle + 1
+ * @param E         Electric field grid (pointer to cell 0)
+ * @param B         Magnetic field grid (pointer to cell 0)
+ * @param p         Push parameters
+ * @param J         Current density grid (pointer to cell 0)
+ * @param order     Particle shape order {1,2,3}
+ * @param layout    Particle buffer layout
+ * @param atomic    Use atomic updates for current deposition
+ * @param wrap      Use periodic wrapping of the cell index
+ * @param ext       Add uniform external fields to the interpolated fields
+ * @return          Time centered kinetic energy of the particles (normalized)
+ */
+PUSH_INLINE double advance_range( t_species* const spec, const int i0, const int i1,
+    const float3* restrict const E, const float3* restrict const B,
+    const t_push_param* restrict const p, float3* restrict const J,
+    const int order, const enum part_layout layout, const int atomic, const int wrap, const int ext )
+{
+    double energy = 0;
+
+    if ( layout != PART_AOS ) {
+        for( int i = i0; i < i1; i += SOA_BLOCK ) {
+            const int np = ( i1 - i < SOA_BLOCK ) ? i1 - i : SOA_BLOCK;
+            energy += advance_block_soa( spec, i, np, E, B, p, J, order,
+                layout == PART_COMPACT, atomic, wrap, ext );
+        }
+    } else {
+        for( int i = i0; i < i1; i++ )
+            energy += advance_part( &spec -> part[i], E, B, p, J, order, atomic, wrap, ext );
+    }
+
+    return energy;
+}
+
+/**
+ * @brief Push kernel, advances particles [i0, i1[ 1 timestep
+ * 
+ * See `advance_range()` for details.
+ */
+typedef double (*t_push_kernel)( t_species* const spec, const int i0, const int i1,
+    const float3* restrict const E, const float3* restrict const B,
+    const t_push_param* restrict const p, float3* restrict const J );
+
+/**
+ * @brief Generates a push kernel specialized for a given configuration
+ * 
+ * @param name      Kernel name
+ * @param order     Particle shape order {1,2,3}
+ * @param layout    Particle buffer layout
+ * @param atomic    Use atomic updates for current deposition
+ * @param wrap      Use periodic wrapping of the cell index
+ * @param ext       Add uniform external fields to the interpolated fields
+ */
+#define PUSH_KERNEL( name, order, layout, atomic, wrap, ext ) \
+static double name( t_species* const spec, const int i0, const int i1, \
+    const float3* restrict const E, const float3* restrict const B, \
+    const t_push_param* restrict const p, float3* restrict const J ) \
+{ \
+    return advance_range( spec, i0, i1, E, B, p, J, order, layout, atomic, wrap, ext ); \
+}
+
+/**
+ * @brief Generates the push kernels for a given particle shape
+ * 
+ * @param s         Kernel name suffix
+ * @param order     Particle shape order {1,2,3}
+ */
+#define PUSH_KERNEL_SET( s, order ) \
+PUSH_KERNEL( push_aos ## s,             order, PART_AOS,     0, 0, 0 ) \
+PUSH_KERNEL( push_aos_ext ## s,         order, PART_AOS,     0, 0, 1 ) \
+PUSH_KERNEL( push_aos_wrap ## s,        order, PART_AOS,     0, 1, 0 ) \
+PUSH_KERNEL( push_aos_wrap_ext ## s,    order, PART_AOS,     0, 1, 1 ) \
+PUSH_KERNEL( push_aos_at ## s,          order, PART_AOS,     1, 0, 0 ) \
+PUSH_KERNEL( push_aos_at_ext ## s,      order, PART_AOS,     1, 0, 1 ) \
+PUSH_KERNEL( push_aos_at_wrap ## s,     order, PART_AOS,     1, 1, 0 ) \
+PUSH_KERNEL( push_aos_at_wrap_ext ## s, order, PART_AOS,     1, 1, 1 ) \
+PUSH_KERNEL( push_soa ## s,             order, PART_SOA,     0, 0, 0 ) \
+PUSH_KERNEL( push_soa_ext ## s,         order, PART_SOA,     0, 0, 1 ) \
+PUSH_KERNEL( push_soa_wrap ## s,        order, PART_SOA,     0, 1, 0 ) \
+PUSH_KERNEL( push_soa_wrap_ext ## s,    order, PART_SOA,     0, 1, 1 ) \
+PUSH_KERNEL( push_soa_at ## s,          order, PART_SOA,     1, 0, 0 ) \
+PUSH_KERNEL( push_soa_at_ext ## s,      order, PART_SOA,     1, 0, 1 ) \
+PUSH_KERNEL( push_soa_at_wrap ## s,     order, PART_SOA,     1, 1, 0 ) \
+PUSH_KERNEL( push_soa_at_wrap_ext ## s, order, PART_SOA,     1, 1, 1 ) \
+PUSH_KERNEL( push_cpt ## s,             order, PART_COMPACT, 0, 0, 0 ) \
+PUSH_KERNEL( push_cpt_ext ## s,         order, PART_COMPACT, 0, 0, 1 ) \
+PUSH_KERNEL( push_cpt_wrap ## s,        order, PART_COMPACT, 0, 1, 0 ) \
+PUSH_KERNEL( push_cpt_wrap_ext ## s,    order, PART_COMPACT, 0, 1, 1 ) \
+PUSH_KERNEL( push_cpt_at ## s,          order, PART_COMPACT, 1, 0, 0 ) \
+PUSH_KERNEL( push_cpt_at_ext ## s,      order, PART_COMPACT, 1, 0, 1 ) \
+PUSH_KERNEL( push_cpt_at_wrap ## s,     order, PART_COMPACT, 1, 1, 0 ) \
+PUSH_KERNEL( push_cpt_at_wrap_ext ## s, order, PART_COMPACT, 1, 1, 1 )
+
+PUSH_KERNEL_SET( _s1, 1 )
+PUSH_KERNEL_SET( _s2, 2 )
+PUSH_KERNEL_SET( _s3, 3 )
+
+#undef PUSH_KERNEL_SET
+#undef PUSH_KERNEL
+
+/**
+ * @brief Push kernel table entries for a given particle shape, indexed by [layout][atomic][wrap][ext]
+ * 
+ * @param s         Kernel name suffix
+ */
+#define PUSH_KERNEL_TABLE( s ) { \
+    { { { push_aos ## s,    push_aos_ext ## s    }, { push_aos_wrap ## s,    push_aos_wrap_ext ## s    } }, \
+      { { push_aos_at ## s, push_aos_at_ext ## s }, { push_aos_at_wrap ## s, push_aos_at_wrap_ext ## s } } }, \
+    { { { push_soa ## s,    push_soa_ext ## s    }, { push_soa_wrap ## s,    push_soa_wrap_ext ## s    } }, \
+      { { push_soa_at ## s, push_soa_at_ext ## s }, { push_soa_at_wrap ## s, push_soa_at_wrap_ext ## s } } }, \
+    { { { push_cpt ## s,    push_cpt_ext ## s    }, { push_cpt_wrap ## s,    push_cpt_wrap_ext ## s    } }, \
+      { { push_cpt_at ## s, push_cpt_at_ext ## s }, { push_cpt_at_wrap ## s, push_cpt_at_wrap_ext ## s } } } }
+
+/**
+ * @brief Push kernels, indexed by [shape-1][layout][atomic][wrap][ext]
+ * 
+ * Each kernel is specialized for one combination of particle shape, particle
+ * buffer layout, current deposition (atomic or not), boundary conditions
+ * (periodic wrapping of the cell index or not) and external fields (uniform
+ * external fields added in the interpolation or not), so that none of these
+ * are tested inside the particle loops.
+ */
+static const t_push_kernel push_kernels[3][3][2][2][2] = {
+    PUSH_KERNEL_TABLE( _s1 ),
+    PUSH_KERNEL_TABLE( _s2 ),
+    PUSH_KERNEL_TABLE( _s3 )
+};
+
+#undef PUSH_KERNEL_TABLE
+
+/**
+ * @brief Selects the push kernel for the species configuration
+ * 
+ * @param spec      Particle species
+ * @param p         Push parameters
+ * @param atomic    Use atomic updates for current deposition
+ * @return          Push kernel
+ */
+static t_push_kernel spec_push_kernel( const t_species* spec, const t_push_param* p, const int atomic )
+{
+    const int ext = ( p -> E0.x != 0 || p -> E0.y != 0 || p -> E0.z != 0 ||
+                      p -> B0.x != 0 || p -> B0.y != 0 || p -> B0.z != 0 );
+
+    return push_kernels[ spec -> shape - 1 ][ spec -> layout ][ atomic != 0 ][ p -> wrap > 0 ][ ext ];
+}
+
+/**
+ * @brief Sets the particle shape
+ * 
+ * The shape is used for the field interpolation, current deposition and
+ * charge deposition diagnostics. Quadratic and cubic shapes use the
+ * Esirkepov deposition method and require more guard cells than linear
+ * shapes; the EM field and current grids get these from the highest order
+ * shape in use when they are created, so this must be called before
+ * `sim_new()`.
+ * 
+ * @param spec      Particle species
+ * @param shape     Particle shape
+ */
+void spec_set_shape( t_species* spec, const enum part_shape shape )
 {
-    int i, ih;
-    float w1, w1h;
+    if ( shape < PART_SHAPE_LINEAR || shape > PART_SHAPE_CUBIC ) {
+        fprintf(stderr, "(*error*) Invalid particle shape %d for species %s\n", (int) shape, spec -> name );
+        exit(-1);
+    }
+    spec -> shape = shape;
+}
+
+/**
+ * @brief Sets the tile size for the tiled particle advance
+ * 
+ * When tiling is enabled, `spec_sort()` will also store the particle buffer
+ * offsets of each tile (a tile being a group of `tile_nx` consecutive
+ * cells). The particle advance will then process whole tiles, working on
+ * tile local copies of the EM fields and electric current. The particle
+ * buffer is sorted immediately, subsequent sorts will be done at every
+ * `n_sort` iterations.
+ * 
+ * @param spec      Particle species
+ * @param tile_nx   Tile size in cells, set to 0 to disable tiling
+ */
+void spec_set_tiles( t_species* spec, const int tile_nx )
+{
+    free( spec -> tile_cell );
+    free( spec -> tile_off );
+    free( spec -> tile_win );
+    free( spec -> tile_buf );
+
+    spec -> tile_cell = NULL;
+    spec -> tile_off = NULL;
+    spec -> tile_win = NULL;
+    spec -> tile_buf = NULL;
+    spec -> n_tiles = 0;
+    spec -> tile_nx = 0;
+    spec -> tile_max_nx = 0;
+    spec -> tile_imb_sum = 0;
+    spec -> tile_imb_n = 0;
+
+    if ( tile_nx <= 0 ) return;
+
+    spec -> tile_nx = tile_nx;
+    spec -> n_tiles = ( spec -> nx + tile_nx - 1 ) / tile_nx;
+
+    // Load balanced tiles may grow beyond the nominal size
+    spec -> tile_max_nx = spec -> tile_lb ? TILE_LB_MAX * tile_nx : tile_nx;
+
+    // Tile boundaries, offsets and cell windows, includes an extra work item
+    // for the particles injected after the last sort
+    spec -> tile_cell = malloc( ( spec -> n_tiles + 1 ) * sizeof( int ) );
+    spec -> tile_off = malloc( ( spec -> n_tiles + 1 ) * sizeof( int ) );
+    spec -> tile_win = malloc( 4 * ( spec -> n_tiles + 1 ) * sizeof( int ) );
+
+    // Per thread E, B and J tile buffers
+    const int max_win = spec -> tile_max_nx + 2 * TILE_HALO;
+    spec -> tile_buf = malloc( (size_t) omp_get_max_threads() * 3 * max_win * sizeof( float3 ) );
+
+    if ( !spec -> tile_cell || !spec -> tile_off || !spec -> tile_win || !spec -> tile_buf ) {
+        fprintf(stderr, "(*error*) Unable to allocate tile buffers, aborting.\n");
+        exit(-1);
+    }
+
+    // Initial tile boundaries are uniform
+    for (int t=0; t<spec->n_tiles; t++) spec->tile_cell[t] = t * tile_nx;
+    spec->tile_cell[ spec->n_tiles ] = spec -> nx;
+
+    // Generate initial tile offsets
+    spec_sort( spec );
+}
+
+/**
+ * @brief Enables / disables dynamic load balancing of the tile boundaries
+ * 
+ * When enabled, tile boundaries are moved whenever the particles are sorted
+ * (every `n_sort` iterations) so that all tiles hold approximately the same
+ * load, see `spec_tile_partition()`. This is useful when the plasma fills
+ * only part of the box, e.g. moving window simulations with plasma being
+ * injected. The number of tiles does not change, but tiles may grow up to
+ * `TILE_LB_MAX` times the nominal size. May be called before or after
+ * `spec_set_tiles()`.
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_tile_balance( t_species* spec, const int enable )
+{
+    spec -> tile_lb = ( enable != 0 );
+
+    // Reallocate tile buffers for the new maximum tile size
+    if ( spec -> tile_nx > 0 ) spec_set_tiles( spec, spec -> tile_nx );
+}
+
+/**
+ * @brief Average tile load imbalance
+ * 
+ * The imbalance is measured at each sort, as the ratio between the maximum
+ * and the average tile load. A value of 1 corresponds to a perfect balance.
+ * 
+ * @param spec      Particle species
+ * @return          Average imbalance, 0 if tiling is disabled
+ */
+double spec_tile_imbalance( const t_species* spec )
+{
+    return ( spec -> tile_imb_n > 0 ) ? spec -> tile_imb_sum / spec -> tile_imb_n : 0;
+}
+
+/**
+ * @brief Enables / disables the automatic sort frequency
+ * 
+ * Sorting the particles by cell makes the field interpolation and the
+ * current deposition access memory sequentially, but the benefit depends on
+ * the grid size and on how fast particles move. When enabled, the fixed
+ * sorting frequency (`n_sort`) is ignored and the particles are sorted only
+ * when the push time expected to be saved outweighs the cost of sorting:
+ * 
+ * 1. At every iteration the disorder of the particle buffer (the fraction of
+ *    particles out of cell order, see `spec_disorder_omp()`) and the measured
+ *    push time per particle are added to a linear fit of the push time to the
+ *    disorder, weighting older samples less (`SORT_AUTO_DECAY`).
+ * 2. The slope of the fit gives the push time lost due to the disorder; this
+ *    is accumulated since the last sort, and the particles are sorted once
+ *    it exceeds the measured time of the last sort (the push time of one
+ *    iteration is used until a sort has been measured). For a disorder that
+ *    grows linearly in time this gives the sort interval with the lowest
+ *    total cost.
+ * 
+ * If no benefit is measured the particles are still sorted every
+ * `SORT_AUTO_PROBE` iterations, so that the fit follows changes in the
+ * simulation. Sort decisions depend on timing measurements, so they are
+ * not used with the deterministic advance (see `spec_set_deterministic()`),
+ * where `n_sort` applies. The chosen frequency is available from
+ * `spec_sort_interval()`.
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_sort_auto( t_species* spec, const int enable )
+{
+    spec -> sort_auto = ( enable != 0 );
+
+    spec -> sort_count = 0;
+    spec -> sort_iter0 = spec -> iter;
+    spec -> sort_last = spec -> iter;
+    spec -> sort_cost = 0;
+    spec -> sort_push_time = 0;
+    spec -> sort_disorder = 0;
+    spec -> sort_excess = 0;
+    for( int i = 0; i < 5; i++ ) spec -> sort_fit[i] = 0;
+}
+
+/**
+ * @brief Average number of iterations between automatic sorts
+ * 
+ * @param spec      Particle species
+ * @return          Average sort interval, 0 if no automatic sorts were done
+ */
+double spec_sort_interval( const t_species* spec )
+{
+    return ( spec -> sort_count > 0 ) ?
+        (double) ( spec -> iter - spec -> sort_iter0 ) / spec -> sort_count : 0;
+}
+
+/**
+ * @brief Enables / disables the deterministic (reproducible) particle advance
+ * 
+ * The default advance adds up the kinetic energy and the current density of
+ * particles in an order that depends on the number of threads and on thread
+ * scheduling (e.g. atomic current deposition), so results change, at the
+ * floating point rounding level, from run to run. When enabled, the particles
+ * are pushed in fixed work items (the tiles, or blocks of `SPEC_DET_BLOCK`
+ * particles for untiled species) that deposit current on item local buffers.
+ * These are then merged in item order, and the item energies are added in a
+ * fixed (tree) order, so that results are bitwise reproducible for any number
+ * of threads, see `spec_advance_det_omp()`.
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_deterministic( t_species* spec, const int enable )
+{
+    spec -> deterministic = ( enable != 0 );
+}
+
+/**
+ * @brief Gets the cell window and exclusive region of each tile work item
+ * 
+ * Work items are the tiles defined by the last `spec_sort()` call, plus a
+ * final item holding the particles injected since then. For each item the
+ * cell window touched by its particles is determined first; cells that do
+ * not belong to any other window of the species are exclusive to the item.
+ * 
+ * Must be called by all threads of the current parallel region.
+ * 
+ * @param spec      Particle species
+ */
+static void spec_tile_windows( t_species* spec )
+{
+    const int n_items = spec -> n_tiles + 1;
+    const int np      = spec -> np;
+    const int ix_off  = spec -> ix_off;
+
+    int* restrict const off = spec -> tile_off;
+    int* restrict const win = spec -> tile_win;
+
+    // Get cell window [lo, hi] of each work item
+    #pragma omp for schedule(static)
+    for( int t = 0; t < n_items; t++ ) {
+        const int i0 = ( off[ t ] < np ) ? off[ t ] : np;
+        const int i1 = ( t < n_items - 1 && off[ t+1 ] < np ) ? off[ t+1 ] : np;
+
+        int mn = ix_off + spec -> nx, mx = ix_off - 1;
+        for( int i = i0; i < i1; i++ ) {
+            const int ix = PART_IX( spec, i );
+            if ( ix < mn ) mn = ix;
+            if ( ix > mx ) mx = ix;
+        }
+
+        // Cells read by interpolation / written by deposition
+        win[ 4*t     ] = mn - SHAPE_EXT_LO( spec -> shape );
+        win[ 4*t + 1 ] = mx + SHAPE_EXT_HI( spec -> shape );
+    }
+
+    // Get exclusive region of each work item (cells not touched by any other item)
+    #pragma omp single
+    {
+        int prev_hi = INT_MIN;
+        for( int t = 0; t < n_items; t++ ) {
+            win[ 4*t + 2 ] = prev_hi + 1;
+            if ( win[ 4*t ] <= win[ 4*t + 1 ] && win[ 4*t + 1 ] > prev_hi ) prev_hi = win[ 4*t + 1 ];
+        }
+
+        int next_lo = INT_MAX;
+        for( int t = n_items - 1; t >= 0; t-- ) {
+            win[ 4*t + 3 ] = next_lo - 1;
+            if ( win[ 4*t ] <= win[ 4*t + 1 ] && win[ 4*t ] < next_lo ) next_lo = win[ 4*t ];
+        }
+    }
+}
+
+/**
+ * @brief Advances the particles of a single tile work item 1 timestep
+ * 
+ * Items whose window fits the tile buffers copy the E / B fields of the window
+ * into a local buffer and deposit current into a local J buffer, which is then
+ * merged into the grid used by the calling thread. Wider items (e.g. particles
+ * that drifted far since the last sort) are advanced using the global grids.
+ * The item windows must have been set by `spec_tile_windows()`.
+ * 
+ * When depositing on the shared grid, merging into cells that are not
+ * exclusive to the item requires atomic updates. If other species are being
+ * advanced at the same time (see `spec_advance_tasks()`) no cell is
+ * exclusive, and `excl` must be set to 0.
+ * 
+ * @param spec      Particle species
+ * @param t         Work item
+ * @param emf       EM fields
+ * @param current   Current density
+ * @param p         Push parameters
+ * @param excl      Allow non atomic updates inside the exclusive region of the item
+ * @return          Time centered kinetic energy (normalized) of the item particles
+ */
+static double spec_advance_tile( t_species* spec, const int t, t_emf* emf, t_current* current,
+    const t_push_param* p, const int excl )
+{
+    const int n_items = spec -> n_tiles + 1;
+    const int max_win = spec -> tile_max_nx + 2 * TILE_HALO;
+    const int np      = spec -> np;
+
+    const int* restrict const off = spec -> tile_off;
+    const int* restrict const win = spec -> tile_win;
+
+    const int i0 = ( off[ t ] < np ) ? off[ t ] : np;
+    const int i1 = ( t < n_items - 1 && off[ t+1 ] < np ) ? off[ t+1 ] : np;
+
+    if ( i0 >= i1 ) return 0;
+
+    // Private deposition does not require atomic updates
+    const int priv = ( current -> dep_type == CURRENT_DEP_PRIVATE );
+
+    // Grids are shifted to use the particle cell indices directly
+    const int ix_off = spec -> ix_off;
+    const float3* restrict const E_part = emf -> E_part - ix_off;
+    const float3* restrict const B_part = emf -> B_part - ix_off;
+    float3* restrict const J = current_dep_grid( current, omp_get_thread_num() ) - ix_off;
+
+    const int lo = win[ 4*t ];
+    const int hi = win[ 4*t + 1 ];
+    const int nw = hi - lo + 1;
+
+    if ( nw > max_win ) {
+        // Window too large, use global grids
+        const t_push_kernel push_grid = spec_push_kernel( spec, p, !priv );
+        return push_grid( spec, i0, i1, E_part, B_part, p, J );
+    }
+
+    // Tile local buffers, shifted so that they can be indexed using global cell indices
+    float3* restrict const tbuf = spec -> tile_buf + (size_t) omp_get_thread_num() * 3 * max_win;
+    float3* restrict const Et = tbuf - lo;
+    float3* restrict const Bt = tbuf + max_win - lo;
+    float3* restrict const Jt = tbuf + 2 * max_win - lo;
+
+    for( int k = lo; k <= hi; k++ ) {
+        Et[k] = E_part[k];
+        Bt[k] = B_part[k];
+        Jt[k] = (float3) {0, 0, 0};
+    }
+
+    const t_push_kernel push_tile = spec_push_kernel( spec, p, 0 );
+    const double energy = push_tile( spec, i0, i1, Et, Bt, p, Jt );
+
+    // Merge tile current, only cells shared with other items require atomics
+    const int ex0 = excl ? win[ 4*t + 2 ] : INT_MAX;
+    const int ex1 = excl ? win[ 4*t + 3 ] : INT_MIN;
+
+    for( int k = lo; k <= hi; k++ ) {
+        if ( priv || ( k >= ex0 && k <= ex1 ) ) {
+            J[k].x += Jt[k].x;
+            J[k].y += Jt[k].y;
+            J[k].z += Jt[k].z;
+        } else {
+            #pragma omp atomic
+            J[k].x += Jt[k].x;
+            #pragma omp atomic
+            J[k].y += Jt[k].y;
+            #pragma omp atomic
+            J[k].z += Jt[k].z;
+        }
+    }
+
+    return energy;
+}
+
+/**
+ * @brief Advance Particle species 1 timestep using tiles
+ * 
+ * The tile work items (see `spec_tile_windows()`) are distributed dynamically
+ * between threads and advanced using `spec_advance_tile()`.
+ * 
+ * Must be called by all threads of the current parallel region.
+ * 
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ * @param p         Push parameters
+ * @return          Time centered kinetic energy (normalized) of the particles
+ *                  advanced by the calling thread
+ */
+static double spec_advance_tiles( t_species* spec, t_emf* emf, t_current* current, const t_push_param* p )
+{
+    const int n_items = spec -> n_tiles + 1;
+
+    spec_tile_windows( spec );
+
+    double energy = 0;
+
+    // Advance particles
+    #pragma omp for schedule(dynamic)
+    for( int t = 0; t < n_items; t++ ) {
+        energy += spec_advance_tile( spec, t, emf, current, p, 1 );
+    }
+
+    return energy;
+}
+
+/**
+ * @brief Advances particles [i0, i1[ 1 timestep using the global grids
+ * 
+ * Current is deposited on the grid used by the calling thread.
+ * 
+ * @param spec      Particle species
+ * @param i0        First particle
+ * @param i1        Last particle (exclusive)
+ * @param emf       EM fields
+ * @param current   Current density
+ * @param p         Push parameters
+ * @return          Time centered kinetic energy (normalized) of the particles
+ */
+static double spec_advance_range( t_species* spec, const int i0, const int i1,
+    t_emf* emf, t_current* current, const t_push_param* p )
+{
+    if ( i0 >= i1 ) return 0;
+
+    // Private deposition does not require atomic updates
+    const int atomic = ( current -> dep_type != CURRENT_DEP_PRIVATE );
+    const t_push_kernel push = spec_push_kernel( spec, p, atomic );
+
+    // Grids, shifted to use the particle cell indices directly, and current
+    // density grid used by this thread
+    const int ix_off = spec -> ix_off;
+    const float3* restrict const E_part = emf -> E_part - ix_off;
+    const float3* restrict const B_part = emf -> B_part - ix_off;
+    float3* restrict const J = current_dep_grid( current, omp_get_thread_num() ) - ix_off;
+
+    return push( spec, i0, i1, E_part, B_part, p, J );
+}
+
+/**
+ * @brief Advance all particles in the species 1 timestep (no tiling)
+ * 
+ * The particle buffer is split evenly between threads, each thread calling
+ * the push kernel once for its section. Must be called by all threads of the
+ * current parallel region.
+ * 
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ * @param p         Push parameters
+ * @return          Time centered kinetic energy (normalized) of the particles
+ *                  advanced by the calling thread
+ */
+static double spec_advance_part( t_species* spec, t_emf* emf, t_current* current, const t_push_param* p )
+{
+    // Particle range for this thread, the SOA layouts are split on SOA_BLOCK
+    // boundaries so that the vectorized push works on aligned blocks
+    const int nt  = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+    const int blk = ( spec -> layout != PART_AOS ) ? SOA_BLOCK : 1;
+    const int nblocks = ( spec -> np + blk - 1 ) / blk;
+
+    int i0 = blk * (int) ( ( (int64_t) nblocks *  tid      ) / nt );
+    int i1 = blk * (int) ( ( (int64_t) nblocks * (tid + 1) ) / nt );
+    if ( i1 > spec -> np ) i1 = spec -> np;
+
+    return spec_advance_range( spec, i0, i1, emf, current, p );
+}
+
+/**
+ * @brief Adds values in a fixed (pairwise tree) order
+ * 
+ * @param v     Values
+ * @param n     Number of values
+ * @return      Sum of values
+ */
+static double sum_tree( const double* restrict const v, const int n )
+{
+    if ( n < 1 ) return 0;
+    if ( n == 1 ) return v[0];
+
+    const int h = n / 2;
+    return sum_tree( v, h ) + sum_tree( v + h, n - h );
+}
+
+/**
+ * @brief Advance all particles in the species 1 timestep, with deterministic results
+ * 
+ * Work items are the tiles defined by the last sort (plus the item holding
+ * the particles injected since then), or fixed blocks of `SPEC_DET_BLOCK`
+ * particles for untiled species, so they do not depend on the number of
+ * threads. Items are processed in batches of up to `SPEC_DET_BATCH`: each
+ * item of the batch deposits current on its own buffer, spanning the cell
+ * window of its particles, and the item buffers are then added to the grid,
+ * in parallel over grid chunks, always in item order. The kinetic energy of
+ * each item is stored and the item energies are added in a fixed tree
+ * order. This stores the species energy (not normalized).
+ * 
+ * Current is always merged into the shared grid (the private buffers of
+ * `CURRENT_DEP_PRIVATE` are not used). Must be called by all threads of the
+ * current parallel region.
+ * 
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ * @param p         Push parameters
+ */
+static void spec_advance_det_omp( t_species* spec, t_emf* emf, t_current* current, const t_push_param* p )
+{
+    const int np      = spec -> np;
+    const int tiles   = ( spec -> tile_nx > 0 );
+    const int n_items = tiles ? spec -> n_tiles + 1 : ( np + SPEC_DET_BLOCK - 1 ) / SPEC_DET_BLOCK;
+
+    const int* restrict const off = spec -> tile_off;
+
+    // Grids, shifted to use the particle cell indices directly
+    const int ix_off = spec -> ix_off;
+    const float3* restrict const E_part = emf -> E_part - ix_off;
+    const float3* restrict const B_part = emf -> B_part - ix_off;
+    float3* restrict const J = current -> J - ix_off;
+
+    const t_push_kernel push = spec_push_kernel( spec, p, 0 );
+
+    // Item energies, item particle ranges, cell windows and buffer offsets (batch)
+    size_t mark;
+    double* item_en;
+    int* item;
+
+    #pragma omp single copyprivate( mark, item_en, item )
+    {
+        mark = arena_mark( spec -> scratch );
+        item_en = arena_alloc( spec -> scratch, ( n_items > 0 ? n_items : 1 ) * sizeof( double ) );
+        item = arena_alloc( spec -> scratch, 5 * SPEC_DET_BATCH * sizeof( int ) );
+    }
+
+    for( int b0 = 0; b0 < n_items; b0 += SPEC_DET_BATCH ) {
+        const int nb = ( b0 + SPEC_DET_BATCH < n_items ) ? SPEC_DET_BATCH : n_items - b0;
+
+        // Particle range and cell window [lo, hi] of each item
+        #pragma omp for schedule(static)
+        for( int k = 0; k < nb; k++ ) {
+            const int t = b0 + k;
+            int i0, i1;
+            if ( tiles ) {
+                i0 = ( off[ t ] < np ) ? off[ t ] : np;
+                i1 = ( t < n_items - 1 && off[ t+1 ] < np ) ? off[ t+1 ] : np;
+            } else {
+                i0 = t * SPEC_DET_BLOCK;
+                i1 = ( i0 + SPEC_DET_BLOCK < np ) ? i0 + SPEC_DET_BLOCK : np;
+            }
+
+            int mn = ix_off + spec -> nx, mx = ix_off - 1;
+            for( int i = i0; i < i1; i++ ) {
+                const int ix = PART_IX( spec, i );
+                if ( ix < mn ) mn = ix;
+                if ( ix > mx ) mx = ix;
+            }
+
+            item[ 5*k     ] = i0;
+            item[ 5*k + 1 ] = i1;
+            item[ 5*k + 2 ] = mn - SHAPE_EXT_LO( spec -> shape );
+            item[ 5*k + 3 ] = mx + SHAPE_EXT_HI( spec -> shape );
+        }
+
+        // Item current buffers and cell window of the whole batch
+        size_t bmark;
+        float3* jbuf;
+        int lo_b, hi_b;
+
+        #pragma omp single copyprivate( bmark, jbuf, lo_b, hi_b )
+        {
+            int size = 0;
+            lo_b = INT_MAX; hi_b = INT_MIN;
+            for( int k = 0; k < nb; k++ ) {
+                item[ 5*k + 4 ] = size;
+                if ( item[ 5*k ] < item[ 5*k + 1 ] ) {
+                    size += item[ 5*k + 3 ] - item[ 5*k + 2 ] + 1;
+                    if ( item[ 5*k + 2 ] < lo_b ) lo_b = item[ 5*k + 2 ];
+                    if ( item[ 5*k + 3 ] > hi_b ) hi_b = item[ 5*k + 3 ];
+                }
+            }
+            bmark = arena_mark( spec -> scratch );
+            jbuf = arena_alloc( spec -> scratch, (size_t) size * sizeof( float3 ) );
+        }
+
+        // Push particles, depositing current on the item buffers
+        #pragma omp for schedule(dynamic)
+        for( int k = 0; k < nb; k++ ) {
+            const int i0 = item[ 5*k ];
+            const int i1 = item[ 5*k + 1 ];
+            const int lo = item[ 5*k + 2 ];
+            const int hi = item[ 5*k + 3 ];
+
+            item_en[ b0 + k ] = 0;
+            if ( i0 >= i1 ) continue;
+
+            float3* restrict const Jt = jbuf + item[ 5*k + 4 ] - lo;
+            for( int c = lo; c <= hi; c++ ) Jt[c] = (float3) {0, 0, 0};
+
+            item_en[ b0 + k ] = push( spec, i0, i1, E_part, B_part, p, Jt );
+        }
+
+        // Add item buffers to the grid, in item order
+        #pragma omp for schedule(static)
+        for( int c0 = lo_b; c0 <= hi_b; c0 += SPEC_DET_CHUNK ) {
+            const int c1 = ( c0 + SPEC_DET_CHUNK - 1 < hi_b ) ? c0 + SPEC_DET_CHUNK - 1 : hi_b;
+
+            for( int k = 0; k < nb; k++ ) {
+                if ( item[ 5*k ] >= item[ 5*k + 1 ] ) continue;
+
+                const int lo = item[ 5*k + 2 ];
+                const int hi = item[ 5*k + 3 ];
+                const float3* restrict const Jt = jbuf + item[ 5*k + 4 ] - lo;
+
+                const int a = ( lo > c0 ) ? lo : c0;
+                const int z = ( hi < c1 ) ? hi : c1;
+                for( int c = a; c <= z; c++ ) {
+                    J[c].x += Jt[c].x;
+                    J[c].y += Jt[c].y;
+                    J[c].z += Jt[c].z;
+                }
+            }
+        }
+
+        // Release item buffers
+        #pragma omp single
+        arena_release( spec -> scratch, bmark );
+    }
+
+    #pragma omp single
+    {
+        spec -> energy = sum_tree( item_en, n_items );
+        arena_release( spec -> scratch, mark );
+    }
+}
+
+/**
+ * @brief Removes particles that have left the simulation box
+ * 
+ * This is a parallel stream compaction: each thread counts the particles
+ * inside the box in a contiguous section of the particle buffer, the counts
+ * are converted into output offsets using a prefix sum, and the remaining
+ * particles are then copied into the secondary particle buffer, that
+ * replaces the original one. Particle order is preserved, and tile offsets
+ * (if any) are updated accordingly. If no particles left the box the
+ * particle buffer is not changed.
+ * 
+ * Must be called by all threads of the current parallel region.
+ * 
+ * @param spec      Particle species
+ */
+static void spec_compact_omp( t_species* spec )
+{
+    const int np  = spec -> np;
+    const int ix_off = spec -> ix_off;
+    const int nt  = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+
+    // Valid range of particle cell indices
+    const int lo = ix_off;
+    const int hi = ix_off + spec -> nx;
+
+    #pragma omp single
+    spec_grow_sort_buf( spec, nt );
+
+    // Per thread offsets
+    int * restrict const cnt = spec -> sort_buf;
+
+    // Particle range for this thread
+    const int i0 = (int) ( ( (int64_t) np *  tid      ) / nt );
+    const int i1 = (int) ( ( (int64_t) np * (tid + 1) ) / nt );
+
+    int n = 0;
+    if ( spec -> layout != PART_AOS ) {
+        const int * restrict const ix = ( spec -> layout == PART_SOA ) ? spec -> soa.ix : spec -> cpt.ix;
+        for (int i=i0; i<i1; i++) n += ( ix[i] >= lo && ix[i] < hi );
+    } else {
+        const t_part * restrict const part = spec -> part;
+        for (int i=i0; i<i1; i++) n += ( part[i].ix >= lo && part[i].ix < hi );
+    }
+    cnt[tid] = n;
+
+    // Tiles with offsets inside [i0, i1[, the last thread also takes offsets >= np
+    int tt0 = 0, tt1 = 0;
+    int * restrict const off = spec -> tile_off;
+    if ( spec -> tile_nx > 0 ) {
+        const int ntiles = spec -> n_tiles + 1;
+        while( tt0 < ntiles && off[tt0] < i0 ) tt0++;
+        if ( tid == nt - 1 ) {
+            tt1 = ntiles;
+        } else {
+            tt1 = tt0;
+            while( tt1 < ntiles && off[tt1] < i1 ) tt1++;
+        }
+    }
+
+    #pragma omp barrier
+
+    // Number of particles remaining
+    int nkeep;
+
+    #pragma omp single copyprivate( nkeep )
+    {
+        int isum = 0;
+        for (int t=0; t<nt; t++) {
+            int j = cnt[t];
+            cnt[t] = isum;
+            isum += j;
+        }
+        nkeep = isum;
+
+        if ( nkeep < np ) spec_alloc_tmp( spec );
+    }
+
+    // No particles left the box
+    if ( nkeep == np ) return;
+
+    // Copy particles to the secondary buffer, removing the cell index offset
+    int k = cnt[tid];
+    int tt = tt0;
+    if ( spec -> layout == PART_SOA ) {
+        const t_part_soa src = spec -> soa;
+        const t_part_soa dst = spec -> soa_tmp;
+        for (int i=i0; i<i1; i++) {
+            while( tt < tt1 && off[tt] <= i ) off[tt++] = k;
+            if ( src.ix[i] >= lo && src.ix[i] < hi ) {
+                dst.ix[k] = src.ix[i] - ix_off;
+                dst.x[k]  = src.x[i];
+                dst.ux[k] = src.ux[i];
+                dst.uy[k] = src.uy[i];
+                dst.uz[k] = src.uz[i];
+                k++;
+            }
+        }
+    } else if ( spec -> layout == PART_COMPACT ) {
+        const t_part_compact src = spec -> cpt;
+        const t_part_compact dst = spec -> cpt_tmp;
+        for (int i=i0; i<i1; i++) {
+            while( tt < tt1 && off[tt] <= i ) off[tt++] = k;
+            if ( src.ix[i] >= lo && src.ix[i] < hi ) {
+                dst.ix[k] = src.ix[i] - ix_off;
+                dst.x[k]  = src.x[i];
+                dst.ux[k] = src.ux[i];
+                dst.uy[k] = src.uy[i];
+                dst.uz[k] = src.uz[i];
+                k++;
+            }
+        }
+    } else {
+        const t_part * restrict const src = spec -> part;
+        t_part * restrict const dst = spec -> part_tmp;
+        for (int i=i0; i<i1; i++) {
+            while( tt < tt1 && off[tt] <= i ) off[tt++] = k;
+            if ( src[i].ix >= lo && src[i].ix < hi ) {
+                dst[k] = src[i];
+                dst[k].ix -= ix_off;
+                k++;
+            }
+        }
+    }
+    while( tt < tt1 ) off[tt++] = k;
+
+    #pragma omp barrier
+
+    #pragma omp single
+    {
+        spec_swap_tmp( spec );
+        spec -> np = nkeep;
+        spec -> ix_off = 0;
+    }
+}
+
+/**
+ * @brief Starts sending the particles that left the local domain to the neighbouring domains
+ * 
+ * Particles leaving through the lower (upper) boundary are packed, in buffer
+ * order, with their global cell index and sent to the lower (upper)
+ * neighbour. Particles leaving through an open boundary of the global grid
+ * are not sent. The particles are not removed from the buffer, this is done
+ * by `spec_compact_omp()` while the messages are in transit, see
+ * `spec_migrate_finish()`.
+ * 
+ * Must be called by all threads of the current parallel region.
+ * 
+ * @param spec      Particle species
+ * @param periodic  Use periodic boundaries
+ */
+static void spec_migrate_start_omp( t_species* spec, const int periodic )
+{
+    const int np  = spec -> np;
+    const int nx  = spec -> nx;
+    const int ix_off = spec -> ix_off;
+    const int nt  = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+
+    const int send_lo = domain_has_lower( periodic );
+    const int send_hi = domain_has_upper( periodic );
+
+    #pragma omp single
+    spec_grow_sort_buf( spec, 2 * nt );
+
+    // Per thread offsets (lower / upper)
+    int * restrict const cnt = spec -> sort_buf;
+
+    // Particle range for this thread
+    const int i0 = (int) ( ( (int64_t) np *  tid      ) / nt );
+    const int i1 = (int) ( ( (int64_t) np * (tid + 1) ) / nt );
+
+    int n_lo = 0, n_hi = 0;
+    for (int i=i0; i<i1; i++) {
+        const int ix = PART_IX( spec, i ) - ix_off;
+        n_lo += ( ix < 0 );
+        n_hi += ( ix >= nx );
+    }
+    cnt[ 2*tid     ] = send_lo ? n_lo : 0;
+    cnt[ 2*tid + 1 ] = send_hi ? n_hi : 0;
+
+    #pragma omp barrier
+
+    // Total number of particles leaving through each boundary
+    int nsend[2];
+
+    #pragma omp single copyprivate( nsend )
+    {
+        nsend[0] = nsend[1] = 0;
+        for (int t=0; t<nt; t++) {
+            int j = cnt[2*t];
+            cnt[2*t] = nsend[0];
+            nsend[0] += j;
+        }
+        for (int t=0; t<nt; t++) {
+            int j = cnt[2*t+1];
+            cnt[2*t+1] = nsend[0] + nsend[1];
+            nsend[1] += j;
+        }
+
+        const int size = nsend[0] + nsend[1];
+        if ( size > spec -> mig_buf_size ) {
+            free( spec -> mig_buf );
+            spec -> mig_buf_size = size + size / 2;
+            spec -> mig_buf = malloc( spec -> mig_buf_size * sizeof( t_part ) );
+            if ( ! spec -> mig_buf ) {
+                fprintf(stderr, "(*error*) Unable to allocate particle message buffer, aborting.\n");
+                exit(-1);
+            }
+        }
+    }
+
+    // Pack particles using global cell indices
+    if ( nsend[0] + nsend[1] > 0 ) {
+        t_part * restrict const buf = spec -> mig_buf;
+        int k_lo = cnt[ 2*tid ];
+        int k_hi = cnt[ 2*tid + 1 ];
+        for (int i=i0; i<i1; i++) {
+            const int ix = PART_IX( spec, i ) - ix_off;
+            int k;
+            if ( ix < 0 && send_lo ) k = k_lo++;
+            else if ( ix >= nx && send_hi ) k = k_hi++;
+            else continue;
+
+            buf[k] = (t_part) {
+                .ix = ix + spec -> domain_ix0,
+                .x  = PART_X( spec, i ),
+                .ux = PART_UX( spec, i ),
+                .uy = PART_UY( spec, i ),
+                .uz = PART_UZ( spec, i )
+            };
+        }
+    }
+
+    #pragma omp barrier
+
+    #pragma omp single
+    domain_exchange_start( &spec -> mig_msg, spec -> mig_buf, nsend[0],
+        spec -> mig_buf + nsend[0], nsend[1], sizeof( t_part ), periodic );
+}
+
+/**
+ * @brief Adds the particles received from the neighbouring domains to the particle buffer
+ * 
+ * Waits for the messages started by `spec_migrate_start_omp()` and appends
+ * the received particles (lower neighbour first) to the end of the
+ * particle buffer.
+ * 
+ * @param spec      Particle species
+ * @param periodic  Use periodic boundaries
+ */
+static void spec_migrate_finish( t_species* spec, const int periodic )
+{
+    t_domain_msg* const msg = &spec -> mig_msg;
+    domain_wait( msg );
+
+    const int nrecv = msg -> count[0] + msg -> count[1];
+    if ( nrecv == 0 ) return;
+
+    spec_grow_buffer( spec, spec -> np + nrecv );
+
+    const t_part * restrict const buf = msg -> buf;
+    const int nx = spec -> nx;
+    const int nx_global = domain_nx();
+
+    for( int k = 0; k < nrecv; k++ ) {
+        int ix = buf[k].ix - spec -> domain_ix0;
+
+        // Particles crossing the periodic boundary of the global grid
+        if ( periodic ) {
+            if ( ix < 0 ) ix += nx_global;
+            else if ( ix >= nx ) ix -= nx_global;
+        }
+
+        const int i = spec -> np + k;
+        PART_IX( spec, i ) = ix + spec -> ix_off;
+        PART_SET_X( spec, i, buf[k].x );
+        PART_SET_UX( spec, i, buf[k].ux );
+        PART_SET_UY( spec, i, buf[k].uy );
+        PART_SET_UZ( spec, i, buf[k].uz );
+    }
+
+    spec -> np += nrecv;
+}
+
+/**
+ * @brief Gets the push parameters of a species
+ * 
+ * Periodic boundaries are applied during the particle push, unless the grid
+ * is split between domains; uniform external fields are added directly by the
+ * push.
+ * 
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param p         Push parameters (out)
+ */
+static void spec_push_param( const t_species* spec, const t_emf* emf, t_push_param* p )
+{
+    const int open = ( spec -> moving_window || spec -> bc_type == PART_BC_OPEN );
+    const int distributed = ( domain_size() > 1 );
+
+    p -> tem   = 0.5 * spec->dt/spec -> m_q;
+    p -> dt_dx = spec->dt / spec->dx;
+    p -> q     = spec -> q;
+    p -> qnx   = spec -> q *  spec->dx / spec->dt;
+    p -> wrap  = ( open || distributed ) ? 0 : spec -> nx;
+    p -> E0    = ( emf -> ext_fld.E_type == EMF_FLD_TYPE_UNIFORM ) ? emf -> ext_fld.E_0 : (float3) {0, 0, 0};
+    p -> B0    = ( emf -> ext_fld.B_type == EMF_FLD_TYPE_UNIFORM ) ? emf -> ext_fld.B_0 : (float3) {0, 0, 0};
+}
+
+/**
+ * @brief Measures the disorder of the particle buffer
+ * 
+ * Counts the particles whose cell index is lower than the one of the
+ * previous particle in the buffer. This is 0 right after sorting and grows
+ * as particles move away from the cell they were sorted in, approximating
+ * the number of particles that changed cells since the last sort. The
+ * result is stored in `spec -> sort_disorder`.
+ * 
+ * Must be called by all threads of the current parallel region.
+ * 
+ * @param spec      Particle species
+ */
+static void spec_disorder_omp( t_species* spec )
+{
+    const int np  = spec -> np;
+    const int nt  = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+
+    // Particle range for this thread, each particle is compared with the previous one
+    int i0 = (int) ( ( (int64_t) np *  tid      ) / nt );
+    const int i1 = (int) ( ( (int64_t) np * (tid + 1) ) / nt );
+    if ( i0 < 1 ) i0 = 1;
+
+    int n = 0;
+    if ( spec -> layout != PART_AOS ) {
+        const int * restrict const ix = ( spec -> layout == PART_SOA ) ? spec -> soa.ix : spec -> cpt.ix;
+        for (int i=i0; i<i1; i++) n += ( ix[i] < ix[i-1] );
+    } else {
+        const t_part * restrict const part = spec -> part;
+        for (int i=i0; i<i1; i++) n += ( part[i].ix < part[i-1].ix );
+    }
+
+    #pragma omp single
+    spec -> sort_disorder = 0;
+
+    #pragma omp atomic
+    spec -> sort_disorder += n;
+
+    #pragma omp barrier
+}
+
+/**
+ * @brief Checks if the particles should be sorted, using the automatic sort frequency
+ * 
+ * Adds the current disorder and push time to the fit of push time per
+ * particle vs. disorder, and compares the push time lost since the last sort
+ * with the sort cost, see `spec_set_sort_auto()`. Must be called by a single
+ * thread, after `spec_disorder_omp()`.
+ * 
+ * @param spec      Particle species
+ * @return          1 if the particles should be sorted, 0 otherwise
+ */
+static int spec_sort_auto_due( t_species* spec )
+{
+    const int np = spec -> np;
+    if ( np < 2 || spec -> sort_push_time <= 0 ) return 0;
+
+    if ( spec -> iter - spec -> sort_last >= SORT_AUTO_PROBE ) return 1;
+
+    const double x = spec -> sort_disorder / ( np - 1 );
+    const double y = spec -> sort_push_time / np;
+
+    // Weighted sums: weight, x, y, x^2, x*y
+    double* const s = spec -> sort_fit;
+    for( int i = 0; i < 5; i++ ) s[i] *= SORT_AUTO_DECAY;
+    s[0] += 1;
+    s[1] += x;
+    s[2] += y;
+    s[3] += x * x;
+    s[4] += x * y;
+
+    spec -> sort_excess += x * np;
+
+    // The fit requires enough samples with different disorder values
+    const double det = s[0] * s[3] - s[1] * s[1];
+    if ( s[0] < SORT_AUTO_MIN_SAMPLES || det <= 1.0e-12 * s[0] * s[0] ) return 0;
+
+    // Push time lost per particle per unit disorder
+    const double slope = ( s[0] * s[4] - s[1] * s[2] ) / det;
+    if ( slope <= 0 ) return 0;
+
+    const double cost = ( spec -> sort_cost > 0 ) ? spec -> sort_cost : spec -> sort_push_time;
+
+    return ( slope * spec -> sort_excess >= cost );
+}
+
+/**
+ * @brief Completes the advance of a particle species after the particle push
+ * 
+ * Normalizes the kinetic energy, advances the iteration number, moves the
+ * simulation window, applies the particle boundary conditions (including
+ * migration between domains) and sorts the particles if needed.
+ * 
+ * Must be called by all threads of the current parallel region, after the
+ * push of all particles has completed.
+ * 
+ * @param spec      Particle species
+ */
+static void spec_advance_finish_omp( t_species* spec )
+{
+    const int open = ( spec -> moving_window || spec -> bc_type == PART_BC_OPEN );
+    const int distributed = ( domain_size() > 1 );
+
+    uint64_t t1;
+
+    #pragma omp single
+    {
+
+    // Store energy
+    spec -> energy = spec-> q * spec -> m_q * spec -> energy * spec -> dx;
+
+    // Advance internal iteration number
+    spec -> iter += 1;
+
+    // Move simulation window if needed
+    if ( spec -> moving_window ) {
+        const uint64_t t2 = timer_ticks();
+        spec_move_window( spec );
+        timer_phase_add( TIMER_MOVE_WINDOW, timer_ticks() - t2 );
+    }
+
+    }
+
+    if ( distributed ) {
+        // Send particles leaving the local domain to the neighbouring domains,
+        // removing them from the buffer while the messages are in transit
+        t1 = timer_ticks();
+        spec_migrate_start_omp( spec, ! open );
+        spec_compact_omp( spec );
+
+        #pragma omp single
+        spec_migrate_finish( spec, ! open );
+        timer_phase_add( TIMER_BOUNDARY, timer_ticks() - t1 );
+    } else if ( open ) {
+        // Use absorbing boundaries along x
+        t1 = timer_ticks();
+        spec_compact_omp( spec );
+        timer_phase_add( TIMER_BOUNDARY, timer_ticks() - t1 );
+    }
+
+    // Sort species at every n_sort time steps, or when the expected push
+    // speedup outweighs the sort cost
+    int sort = 0;
+    if ( spec -> sort_auto && ! spec -> deterministic ) {
+        t1 = timer_ticks();
+        spec_disorder_omp( spec );
+
+        #pragma omp single copyprivate( sort )
+        sort = spec_sort_auto_due( spec );
+        timer_phase_add( TIMER_SORT, timer_ticks() - t1 );
+    } else if ( spec -> n_sort > 0 ) {
+        sort = ! (spec -> iter % spec -> n_sort);
+    }
+
+    if ( sort ) {
+        t1 = timer_ticks();
+        spec_sort_omp( spec );
+        const uint64_t t2 = timer_ticks();
+        timer_phase_add( TIMER_SORT, t2 - t1 );
+
+        if ( spec -> sort_auto ) {
+            #pragma omp master
+            {
+                spec -> sort_cost = timer_interval_seconds( t1, t2 );
+                spec -> sort_excess = 0;
+                spec -> sort_last = spec -> iter;
+                spec -> sort_count++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Advance Particle species 1 timestep
+ * 
+ * Must be called by all threads of the current parallel region,
+ * see `spec_advance()`
+ * 
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ */
+static void spec_advance_omp( t_species* spec, t_emf* emf, t_current* current )
+{
+
+    uint64_t t0 = 0;
+    #pragma omp master
+    t0 = timer_ticks();
+
+    t_push_param p;
+    spec_push_param( spec, emf, &p );
+
+    // Kinetic energy of the particles advanced by this thread
+    double energy = 0;
+
+    #pragma omp single
+    spec -> energy = 0;
+
+    // Field interpolation, push and current deposition are done in a single loop
+    uint64_t t1 = timer_ticks();
+    if ( spec -> deterministic ) {
+        // Fixed work items, stores the species energy directly
+        spec_advance_det_omp( spec, emf, current, &p );
+    } else if ( spec -> tile_nx > 0 ) {
+        // Advance particles using tiles
+        energy = spec_advance_tiles( spec, emf, current, &p );
+    } else {
+        energy = spec_advance_part( spec, emf, current, &p );
+    }
+    timer_phase_add( TIMER_PUSH, timer_ticks() - t1 );
 
-    i = part->ix;
+    // Add up energy from all threads
+    #pragma omp atomic
+    spec -> energy += energy;
 
-    w1 = part->x;
-    ih = (w1 <0.5f)? -1 : 0;
-    w1h = w1 + ((w1 <0.5f)?0.5f:-0.5f);
+    #pragma omp barrier
 
-    ih += i;
+    // Push time, used by the automatic sort frequency
+    #pragma omp master
+    spec -> sort_push_time = timer_interval_seconds( t1, timer_ticks() );
 
-    Ep->x = E[ih].x * (1.0f - w1h) + E[ih+1].x * w1h;
-    Ep->y = E[i ].y * (1.0f -  w1) + E[i+1 ].y * w1;
-    Ep->z = E[i ].z * (1.0f -  w1) + E[i+1 ].z * w1;
+    // Boundary conditions, moving window and sorting
+    spec_advance_finish_omp( spec );
 
-    Bp->x = B[i ].x * (1.0f  - w1) + B[i+1 ].x * w1;
-    Bp->y = B[ih].y * (1.0f - w1h) + B[ih+1].y * w1h;
-    Bp->z = B[ih].z * (1.0f - w1h) + B[ih+1].z * w1h;
+    // Timing info
+    #pragma omp master
+    {
+        _spec_npush += spec -> np;
+        _spec_time += timer_interval_seconds( t0, timer_ticks() );
+    }
 
+    #pragma omp barrier
 }
 
 /**
- * @brief Returns number of cells moved
+ * @brief Checks that the grids have enough guard cells for the particle shape
  * 
- * Note that the particle will move at most 1 cell in either direction
+ * The routine aborts the code if the check fails.
  * 
- * @param x         End particle position, normalized to cell size
- * @return ltrim    Number of cells moved, {-1,0,1}
+ * @param spec      Particle species
+ * @param emf       EM fields
+ * @param current   Current density
  */
-int ltrim( float x )
+static void spec_check_gc( const t_species* spec, const t_emf* emf, const t_current* current )
 {
-    return ( x >= 1.0f ) - ( x < 0.0f );
+    if ( emf -> gc[0] < SHAPE_EXT_LO( spec -> shape ) || emf -> gc[1] < SHAPE_EXT_HI( spec -> shape ) ||
+         current -> gc[0] < SHAPE_EXT_LO( spec -> shape ) || current -> gc[1] < SHAPE_EXT_HI( spec -> shape ) ) {
+        fprintf(stderr, "(*error*) Not enough guard cells for the particle shape of species %s, "
+                        "the shape must be set before creating the grids\n", spec -> name );
+        exit(-1);
+    }
 }
 
 /**
@@ -916,166 +3487,169 @@ int ltrim( float x )
  * 3. Move simulation window
  * 4. Sort particle buffer
  * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
  * @param spec      Particle species
  * @param emf       EM fields
  * @param current   Current density
  */
 void spec_advance( t_species* spec, t_emf* emf, t_current* current )
 {
+    spec_check_gc( spec, emf, current );
 
-    uint64_t t0;
-    t0 = timer_ticks();
-
-    const float tem   = 0.5 * spec->dt/spec -> m_q;
-    const float dt_dx = spec->dt / spec->dx;
-
-    // Auxiliary values for current deposition
-    const float qnx = spec -> q *  spec->dx / spec->dt;
-
-    const int nx0 = spec -> nx;
-
-    double energy = 0;
-	
-    // Advance particles
-    #pragma omp parallel for reduction(+:energy) default(shared)
-    for (int i=0; i<spec->np; i++) {
-
-        float3 Ep, Bp;
-        float utx, uty, utz;
-        float ux, uy, uz, u2;
-        float gamma, rg, gtem, otsq;
-
-        float x1;
-
-        int di;
-        float dx;
-
-        // Load particle momenta
-        ux = spec -> part[i].ux;
-        uy = spec -> part[i].uy;
-        uz = spec -> part[i].uz;
-
-        // interpolate fields
-        interpolate_fld( emf -> E_part, emf -> B_part, &spec -> part[i], &Ep, &Bp );
-        // Ep.x = Ep.y = Ep.z = Bp.x = Bp.y = Bp.z = 0;
-
-        // advance u using Boris scheme
-        Ep.x *= tem;
-        Ep.y *= tem;
-        Ep.z *= tem;
-
-        utx = ux + Ep.x;
-        uty = uy + Ep.y;
-        utz = uz + Ep.z;
-
-        // Perform first half of the rotation
-        // Get time centered gamma
-        u2 = utx*utx + uty*uty + utz*utz;
-        gamma = sqrtf( 1 + u2 );
-
-        // Accumulate time centered energy
-        energy += u2 / ( 1 + gamma );
-
-        gtem = tem / gamma;
-
-        Bp.x *= gtem;
-        Bp.y *= gtem;
-        Bp.z *= gtem;
-
-        otsq = 2.0f / ( 1.0f + Bp.x*Bp.x + Bp.y*Bp.y + Bp.z*Bp.z );
-
-        ux = utx + uty*Bp.z - utz*Bp.y;
-        uy = uty + utz*Bp.x - utx*Bp.z;
-        uz = utz + utx*Bp.y - uty*Bp.x;
-
-        // Perform second half of the rotation
-
-        Bp.x *= otsq;
-        Bp.y *= otsq;
-        Bp.z *= otsq;
-
-        utx += uy*Bp.z - uz*Bp.y;
-        uty += uz*Bp.x - ux*Bp.z;
-        utz += ux*Bp.y - uy*Bp.x;
-
-        // Perform second half of electric field acceleration
-        ux = utx + Ep.x;
-        uy = uty + Ep.y;
-        uz = utz + Ep.z;
-
-        // Store new momenta
-        spec -> part[i].ux = ux;
-        spec -> part[i].uy = uy;
-        spec -> part[i].uz = uz;
-
-        // push particle
-        rg = 1.0f / sqrtf(1.0f + ux*ux + uy*uy + uz*uz);
-
-        dx = dt_dx * rg * ux;
-
-        x1 = spec -> part[i].x + dx;
-
-        di = ltrim(x1);
-
-        x1 -= di;
-
-        float qvy = spec->q * uy * rg;
-        float qvz = spec->q * uz * rg;
+    if ( omp_in_parallel() ) {
+        spec_advance_omp( spec, emf, current );
+    } else {
+        #pragma omp parallel
+        spec_advance_omp( spec, emf, current );
+    }
+}
 
-        // deposit current using Eskirepov method
-        // dep_current_esk( spec -> part[i].ix, di,
-        // 				 spec -> part[i].x, x1,
-        // 				 qnx, qvy, qvz,
-        // 				 current );
+/**
+ * @brief Advance all Particle species 1 timestep using OpenMP tasks
+ * 
+ * Must be called by all threads of the current parallel region,
+ * see `spec_advance_tasks()`
+ * 
+ * @param species   Particle species
+ * @param n_species Number of particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ */
+static void spec_advance_tasks_omp( t_species* species, const int n_species, t_emf* emf, t_current* current )
+{
+    uint64_t t0 = 0;
+    #pragma omp master
+    t0 = timer_ticks();
 
-        dep_current_zamb( spec -> part[i].ix, di,
-                         spec -> part[i].x, dx,
-                         qnx, qvy, qvz,
-                         current );
+    // Cell windows of the tile work items
+    for( int s = 0; s < n_species; s++ )
+        if ( species[s].tile_nx > 0 && ! species[s].deterministic ) spec_tile_windows( &species[s] );
 
-        // Store results
-        spec -> part[i].x = x1;
-        spec -> part[i].ix += di;
+    #pragma omp single
+    for( int s = 0; s < n_species; s++ ) species[s].energy = 0;
 
+    // Deterministic species are pushed first, one at a time, by all threads
+    uint64_t t1 = timer_ticks();
+    for( int s = 0; s < n_species; s++ ) {
+        if ( species[s].deterministic ) {
+            t_push_param p;
+            spec_push_param( &species[s], emf, &p );
+            spec_advance_det_omp( &species[s], emf, current, &p );
+        }
     }
 
-    // Store energy
-    spec -> energy = spec-> q * spec -> m_q * energy * spec -> dx;
+    // One thread creates the work items of all species, idle threads take
+    // (steal) items from the task pool; the implicit barrier at the end of
+    // the single construct waits for all items to complete
+    #pragma omp single
+    {
+        const int split = SPEC_TASK_SPLIT * omp_get_num_threads();
+
+        for( int s = 0; s < n_species; s++ ) {
+            t_species* const spec = &species[s];
+            if ( spec -> deterministic ) continue;
+
+            t_push_param p;
+            spec_push_param( spec, emf, &p );
+
+            if ( spec -> tile_nx > 0 ) {
+                for( int t = 0; t < spec -> n_tiles + 1; t++ ) {
+                    #pragma omp task firstprivate( t, p )
+                    {
+                        const double energy = spec_advance_tile( spec, t, emf, current, &p, 0 );
+                        #pragma omp atomic
+                        spec -> energy += energy;
+                    }
+                }
+            } else {
+                // Split the buffer in items of (about) equal size, the SOA layouts
+                // are split on SOA_BLOCK boundaries
+                const int blk = ( spec -> layout != PART_AOS ) ? SOA_BLOCK : 1;
+                int chunk = ( spec -> np + split - 1 ) / split;
+                if ( chunk < SPEC_TASK_MIN ) chunk = SPEC_TASK_MIN;
+                chunk = ( ( chunk + blk - 1 ) / blk ) * blk;
+
+                for( int i0 = 0; i0 < spec -> np; i0 += chunk ) {
+                    const int i1 = ( i0 + chunk < spec -> np ) ? i0 + chunk : spec -> np;
+                    #pragma omp task firstprivate( i0, p )
+                    {
+                        const double energy = spec_advance_range( spec, i0, i1, emf, current, &p );
+                        #pragma omp atomic
+                        spec -> energy += energy;
+                    }
+                }
+            }
+        }
+    }
+    timer_phase_add( TIMER_PUSH, timer_ticks() - t1 );
+
+    // Push time of each species (automatic sort frequency), species are pushed
+    // concurrently so this is split in proportion to the number of particles
+    #pragma omp master
+    {
+        const double time = timer_interval_seconds( t1, timer_ticks() );
+        double np = 0;
+        for( int s = 0; s < n_species; s++ ) np += species[s].np;
+        for( int s = 0; s < n_species; s++ )
+            species[s].sort_push_time = ( np > 0 ) ? time * species[s].np / np : 0;
+    }
 
-    // Advance internal iteration number
-    spec -> iter += 1;
+    // Boundary conditions, moving window and sorting
+    for( int s = 0; s < n_species; s++ )
+        spec_advance_finish_omp( &species[s] );
 
-    // Check for particles leaving the box
-    if ( spec -> moving_window || spec -> bc_type == PART_BC_OPEN ){
+    // Timing info
+    #pragma omp master
+    {
+        for( int s = 0; s < n_species; s++ ) _spec_npush += species[s].np;
+        _spec_time += timer_interval_seconds( t0, timer_ticks() );
+    }
 
-        // Move simulation window if needed
-        if (spec -> moving_window )	spec_move_window( spec );
+    #pragma omp barrier
+}
 
-        // Use absorbing boundaries along x
-        int i = 0;
-        while ( i < spec -> np ) {
-            if (( spec -> part[i].ix < 0 ) || ( spec -> part[i].ix >= nx0 )) {
-                spec -> part[i] = spec -> part[ -- spec -> np ];
-                continue;
-            }
-            i++;
-        }
+/**
+ * @brief Advance all Particle species 1 timestep, pushing all species concurrently
+ * 
+ * This is equivalent to calling `spec_advance()` for each species, but the
+ * particle push of all species is done in a single task parallel region:
+ * the work items are the tiles of tiled species (see `spec_set_tiles()`) and
+ * sections of about 1 / SPEC_TASK_SPLIT of the particles per thread for the
+ * others, so that threads that finish a small species continue with the
+ * work of the larger ones instead of waiting at a barrier. Boundary
+ * conditions, moving window and sorting are done afterwards, one species at
+ * a time.
+ * 
+ * Each work item deposits current on the grid of the thread that runs it,
+ * so this is best used with private current deposition (`CURRENT_DEP_PRIVATE`),
+ * where the per-thread buffers are merged only once, in `current_update()`.
+ * With atomic deposition all tile current merges use atomic updates, since
+ * cells are no longer exclusive to one item. The order of the current sums
+ * depends on the task schedule, so results are not bitwise reproducible.
+ * Species using the deterministic advance (see `spec_set_deterministic()`)
+ * are not pushed by tasks, but first, one at a time, by all threads.
+ * 
+ * If called from inside a parallel region it must be called by all threads
+ * of the region, otherwise a new parallel region is created.
+ * 
+ * @param species   Particle species
+ * @param n_species Number of particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ */
+void spec_advance_tasks( t_species* species, const int n_species, t_emf* emf, t_current* current )
+{
+    for( int s = 0; s < n_species; s++ )
+        spec_check_gc( &species[s], emf, current );
 
+    if ( omp_in_parallel() ) {
+        spec_advance_tasks_omp( species, n_species, emf, current );
     } else {
-        // Use periodic boundaries in x
-        for (int i=0; i<spec->np; i++) {
-            spec -> part[i].ix += (( spec -> part[i].ix < 0 ) ? nx0 : 0 ) - (( spec -> part[i].ix >= nx0 ) ? nx0 : 0);
-        }
-    }
-
-    // Sort species at every n_sort time steps
-    if ( spec -> n_sort > 0 ) {
-        if ( ! (spec -> iter % spec -> n_sort) ) spec_sort( spec );
+        #pragma omp parallel
+        spec_advance_tasks_omp( species, n_species, emf, current );
     }
-
-    // Timing info
-    _spec_npush += spec -> np;
-    _spec_time += timer_interval_seconds( t0, timer_ticks() );
 }
 
 /*********************************************************************************************
@@ -1087,10 +3661,16 @@ void spec_advance( t_species* spec, t_emf* emf, t_current* current )
 /**
  * @brief Deposits particle species charge density
  * 
- * Deposition is done using linear interpolation, charge grid is expected
- * to have 1 guard cell at the upper boundary.
+ * Deposition is done using the species particle shape, charge grid is
+ * expected to have 1 guard cell at the upper boundary.
  * 
- * Used for diagnostics purposes only.
+ * Particles are split among threads, each depositing on a private copy of
+ * the grid; the private grids are then added to the charge grid. When called
+ * from inside a parallel region (e.g. from `sim_report()` in persistent mode)
+ * only the threads of the nested region are used.
+ * 
+ * Used for diagnostics purposes only. When using domain decomposition this
+ * must be called by all domains.
  * 
  * @param spec      Particle species
  * @param charge    Electric charge density
@@ -1098,22 +3678,66 @@ void spec_advance( t_species* spec, t_emf* emf, t_current* current )
 void spec_deposit_charge( const t_species* spec, float* charge )
 {
     const float q = spec -> q;
+    const int order = spec -> shape;
+    const int nx = spec -> nx;
+
+    // Private grids include the guard cells required by the particle shape
+    const int gc[2] = { order > 1 ? 1 : 0, order > 1 ? 2 : 1 };
+    const int ngrid = gc[0] + nx + gc[1];
+
+    // Per thread grids, padded to avoid false sharing
+    const int stride = ( ngrid + 15 ) & ~15;
+    const size_t mark = arena_mark( spec -> scratch );
+    float* const priv = arena_alloc( spec -> scratch, (size_t) ( omp_get_max_threads() + 1 ) * stride * sizeof( float ) );
+
+    // Sum of all private grids
+    float* restrict const rho_sum = priv + (size_t) omp_get_max_threads() * stride + gc[0];
+
+    #pragma omp parallel
+    {
+        float* restrict const rho = priv + omp_get_thread_num() * stride + gc[0];
+        for( int i = -gc[0]; i < nx + gc[1]; i++ ) rho[i] = 0;
+
+        #pragma omp for schedule(static)
+        for (int i=0; i<spec->np; i++) {
+            int idx = PART_IX( spec, i ) - spec -> ix_off;
+            float w1 = PART_X( spec, i );
 
-    // Charge array is expected to have 1 guard cell at the upper boundary
-    for (int i=0; i<spec->np; i++) {
-        int idx = spec->part[i].ix;
-        float w1 = spec->part[i].x;
+            if ( order == PART_SHAPE_LINEAR ) {
+                rho[ idx            ] += ( 1.0f - w1 ) * q;
+                rho[ idx + 1        ] += (        w1 ) * q;
+            } else {
+                float d, w[4];
+                const int b = shape_base( order, idx, w1, &d );
+                shape_weights( order, d, w );
+                for( int k = 0; k <= order; k++ ) rho[ b + k ] += w[k] * q;
+            }
+        }
 
-        charge[ idx            ] += ( 1.0f - w1 ) * q;
-        charge[ idx + 1        ] += (        w1 ) * q;
+        // Add private grids in thread order
+        const int nthreads = omp_get_num_threads();
+        #pragma omp for schedule(static)
+        for( int i = 0; i < ngrid; i++ ) {
+            float s = 0;
+            for( int tid = 0; tid < nthreads; tid++ ) s += priv[ tid * stride + i ];
+            rho_sum[ i - gc[0] ] = s;
+        }
     }
 
     // Correct boundary values
 
     // x
-    if ( ! spec -> moving_window ){
-        charge[ 0 ] += charge[ spec -> nx ];
+    if ( domain_size() > 1 ) {
+        // Add guard cells to the neighbours
+        domain_halo_add( rho_sum, 1, nx, gc, ! spec -> moving_window );
+    } else if ( ! spec -> moving_window ){
+        for( int i = -gc[0]; i < 0; i++ ) rho_sum[ nx + i ] += rho_sum[ i ];
+        for( int i = 0; i < gc[1]; i++ ) rho_sum[ i ] += rho_sum[ nx + i ];
     }
+
+    for( int i = 0; i <= nx; i++ ) charge[i] += rho_sum[i];
+
+    arena_release( spec -> scratch, mark );
 }
 
 /*********************************************************************************************
@@ -1127,15 +3751,13 @@ void spec_deposit_charge( const t_species* spec, float* charge )
  * 
  * Saves all particle positions and momenta. Positions are converted to
  * distance from simulation box corner before saving. Data is saved in the
- * "PARTICLES/sp_name" directory.
+ * "PARTICLES/sp_name" directory. When using domain decomposition the
+ * particles of all domains are gathered in the root domain.
  *
  * @param spec 		Particle species
  */
 void spec_rep_particles( const t_species *spec )
 {
-
-    t_zdf_file part_file;
-
     int i;
 
     const char * quants[] = {
@@ -1160,8 +3782,6 @@ void spec_rep_particles( const t_species *spec )
         .time_units = "1/\\omega_p"
     };
 
-    // Allocate buffer for positions
-
     t_zdf_part_info info = {
         .name = (char *) spec -> name,
         .label = (char *) spec -> name,
@@ -1172,35 +3792,46 @@ void spec_rep_particles( const t_species *spec )
         .np = spec ->np
     };
 
-    // Create file and add description
     char path[1024];
     snprintf(path, 1024, "PARTICLES/%s", spec -> name );
-    zdf_open_part_file( &part_file, &info, &iter, path );
 
-    // Add positions and generalized velocities
+    // Positions and generalized velocities
     size_t size = ( spec -> np ) * sizeof( float );
-    float* data = malloc( size );
+    const size_t mark = arena_mark( spec -> scratch );
+    float* data = arena_alloc( spec -> scratch, 4 * size );
+    float* x  = data;
+    float* ux = data +     spec -> np;
+    float* uy = data + 2 * spec -> np;
+    float* uz = data + 3 * spec -> np;
+
+    for( i = 0; i < spec ->np; i++ ) {
+        x[i]  = (spec -> n_move + spec -> domain_ix0 + PART_IX( spec, i ) - spec -> ix_off + PART_X( spec, i ) ) * spec -> dx;
+        ux[i] = PART_UX( spec, i );
+        uy[i] = PART_UY( spec, i );
+        uz[i] = PART_UZ( spec, i );
+    }
 
-    // x
-    for( i = 0; i < spec ->np; i++ )
-        data[i] = (spec -> n_move + spec -> part[i].ix + spec -> part[i].x ) * spec -> dx;
-    zdf_add_quant_part_file( &part_file, quants[0], data, spec ->np );
+    if ( domain_size() > 1 ) {
+        // Gather particles from all domains
+        float* gdata[4];
+        int np_total = 0;
+        for( i = 0; i < 4; i++ ) gdata[i] = domain_gather( data + i * spec -> np, spec -> np, &np_total );
+        arena_release( spec -> scratch, mark );
+        if ( ! gdata[0] ) return;
 
-    // ux
-    for( i = 0; i < spec ->np; i++ ) data[i] = spec -> part[i].ux;
-    zdf_add_quant_part_file( &part_file, quants[1], data, spec ->np );
+        info.np = np_total;
 
-    // uy
-    for( i = 0; i < spec ->np; i++ ) data[i] = spec -> part[i].uy;
-    zdf_add_quant_part_file( &part_file, quants[2], data, spec ->np );
+        const float * const quant_data[] = { gdata[0], gdata[1], gdata[2], gdata[3] };
+        zdf_save_part_file( quant_data, &info, &iter, path );
 
-    // uz
-    for( i = 0; i < spec ->np; i++ ) data[i] = spec -> part[i].uz;
-    zdf_add_quant_part_file( &part_file, quants[3], data, spec ->np );
+        for( i = 0; i < 4; i++ ) free( gdata[i] );
+        return;
+    }
 
-    free( data );
+    const float * const quant_data[] = { x, ux, uy, uz };
+    zdf_save_part_file( quant_data, &info, &iter, path );
 
-    zdf_close_file( &part_file );
+    arena_release( spec -> scratch, mark );
 }
 
 /**
@@ -1212,7 +3843,8 @@ void spec_rep_charge( const t_species *spec )
 {
     // Add 1 guard cell to the upper boundary
     size_t size = ( spec -> nx + 1 ) * sizeof( float );
-    float *charge = malloc( size );
+    const size_t mark = arena_mark( spec -> scratch );
+    float *charge = arena_alloc( spec -> scratch, size );
     memset( charge, 0, size );
 
     // Deposit the charge
@@ -1225,7 +3857,14 @@ void spec_rep_charge( const t_species *spec )
         buffer[i] = charge[i];
     }
 
-    free( charge );
+    arena_release( spec -> scratch, mark );
+
+    // Gather data from all domains, only the root domain saves the data
+    float* gbuf = NULL;
+    if ( domain_size() > 1 ) {
+        gbuf = domain_gather( buffer, spec -> nx, NULL );
+        if ( ! gbuf ) return;
+    }
 
     // Set grid boundaries accounting for moving window
     t_zdf_grid_axis axis = {
@@ -1248,7 +3887,7 @@ void spec_rep_charge( const t_species *spec )
         .axis  = &axis
     };
 
-    info.count[0] = spec->nx;
+    info.count[0] = gbuf ? domain_nx() : spec->nx;
 
     t_zdf_iteration iter = {
         .name = "ITERATION",
@@ -1259,7 +3898,8 @@ void spec_rep_charge( const t_species *spec )
 
     char path[1024];
     snprintf(path, 1024, "CHARGE/%s", spec -> name );
-    zdf_save_grid( (void *) buffer, zdf_float32, &info, &iter, path );
+    zdf_save_grid( gbuf ? gbuf : buffer, zdf_float32, &info, &iter, path );
+    free( gbuf );
 }
 
 /**
@@ -1280,19 +3920,19 @@ void spec_pha_axis( const t_species *spec, int i0, int np, int quant,
     switch (quant) {
         case X1:
             for (int i = 0; i < np; i++)
-                axis[i] = ( spec -> part[i0+i].x + spec -> part[i0+i].ix ) * spec -> dx;
+                axis[i] = ( PART_X( spec, i0+i ) + ( PART_IX( spec, i0+i ) - spec -> ix_off + spec -> domain_ix0 ) ) * spec -> dx;
             break;
         case U1:
             for (int i = 0; i < np; i++)
-                axis[i] = spec -> part[i0+i].ux;
+                axis[i] = PART_UX( spec, i0+i );
             break;
         case U2:
             for (int i = 0; i < np; i++)
-                axis[i] = spec -> part[i0+i].uy;
+                axis[i] = PART_UY( spec, i0+i );
             break;
         case U3:
             for (int i = 0; i < np; i++)
-                axis[i] = spec -> part[i0+i].uz;
+                axis[i] = PART_UZ( spec, i0+i );
             break;
     }
 }
@@ -1317,100 +3957,174 @@ const char * spec_pha_axis_units( int quant ) {
 }
 
 /**
- * @brief Deposit 2D phasespace density.
+ * @brief Deposits a block of particles on a 2D phasespace density grid
  * 
- * @param spec      Particle species
- * @param rep_type  Type of phasespace, use the PHASESPACE macro to define
- * @param pha_nx    Number of grid points in the phasespace density grid
- * @param pha_range Physical range of each of the phasespace axis
+ * @param np        Number of particles in block
+ * @param pha_x1    Phasespace x axis quantity of each particle
+ * @param pha_x2    Phasespace y axis quantity of each particle
+ * @param pha       Phasespace parameters
+ * @param q         Particle charge
  * @param buf       Phasespace density grid
  */
-void spec_deposit_pha( const t_species *spec, const int rep_type,
-              const int pha_nx[], const float pha_range[][2], float* restrict buf )
+static void pha_deposit_block( const int np, const float* restrict pha_x1, const float* restrict pha_x2,
+    const t_spec_pha* pha, const float q, float* restrict buf )
 {
-    const int BUF_SIZE = 1024;
-    float pha_x1[BUF_SIZE], pha_x2[BUF_SIZE];
+    const int nrow = pha -> nx[0];
+
+    const float x1min = pha -> range[0][0];
+    const float x2min = pha -> range[1][0];
+
+    const float rdx1 = pha -> nx[0] / ( pha -> range[0][1] - pha -> range[0][0] );
+    const float rdx2 = pha -> nx[1] / ( pha -> range[1][1] - pha -> range[1][0] );
 
+    for ( int k = 0; k < np; k++ ) {
 
-    const int nrow = pha_nx[0];
+        float nx1 = ( pha_x1[k] - x1min ) * rdx1;
+        float nx2 = ( pha_x2[k] - x2min ) * rdx2;
 
-    const int quant1 = rep_type & 0x000F;
-    const int quant2 = (rep_type & 0x00F0)>>4;
+        int i1 = (int)(nx1 + 0.5f);
+        int i2 = (int)(nx2 + 0.5f);
 
-    const float x1min = pha_range[0][0];
-    const float x2min = pha_range[1][0];
+        float w1 = nx1 - i1 + 0.5f;
+        float w2 = nx2 - i2 + 0.5f;
 
-    const float rdx1 = pha_nx[0] / ( pha_range[0][1] - pha_range[0][0] );
-    const float rdx2 = pha_nx[1] / ( pha_range[1][1] - pha_range[1][0] );
+        int idx = i1 + nrow*i2;
 
-    for ( int i = 0; i<spec->np; i+=BUF_SIZE ) {
-        int np = ( i + BUF_SIZE > spec->np )? spec->np - i : BUF_SIZE;
+        if ( i2 >= 0 && i2 < pha -> nx[1] ) {
 
-        spec_pha_axis( spec, i, np, quant1, pha_x1 );
-        spec_pha_axis( spec, i, np, quant2, pha_x2 );
+            if (i1 >= 0 && i1 < pha -> nx[0]) {
+                buf[ idx ] += (1.0f-w1)*(1.0f-w2)*q;
+            }
 
-        for ( int k = 0; k < np; k++ ) {
+            if (i1+1 >= 0 && i1+1 < pha -> nx[0] ) {
+                buf[ idx + 1 ] += w1*(1.0f-w2)*q;
+            }
+        }
 
-            float nx1 = ( pha_x1[k] - x1min ) * rdx1;
-            float nx2 = ( pha_x2[k] - x2min ) * rdx2;
+        idx += nrow;
+        if ( i2+1 >= 0 && i2+1 < pha -> nx[1] ) {
 
-            int i1 = (int)(nx1 + 0.5f);
-            int i2 = (int)(nx2 + 0.5f);
+            if (i1 >= 0 && i1 < pha -> nx[0]) {
+                buf[ idx ] += (1.0f-w1)*w2*q;
+            }
 
-            float w1 = nx1 - i1 + 0.5f;
-            float w2 = nx2 - i2 + 0.5f;
+            if (i1+1 >= 0 && i1+1 < pha -> nx[0] ) {
+                buf[ idx + 1 ] += w1*w2*q;
+            }
+        }
+    }
+}
 
-            int idx = i1 + nrow*i2;
+/**
+ * @brief Deposits several 2D phasespace densities in a single pass over the particles
+ * 
+ * Particles are processed in blocks of PHA_BLOCK particles split among
+ * threads. For each block the required axis quantities are calculated only
+ * once and deposited on per thread private copies of all phasespace grids,
+ * which are then added to the output grids. When called from inside a
+ * parallel region (e.g. from `sim_report()` in persistent mode) only the
+ * threads of the nested region are used.
+ * 
+ * @param spec      Particle species
+ * @param n_pha     Number of phasespaces
+ * @param pha       Phasespace parameters
+ * @param buf       Phasespace density grids, one per phasespace
+ */
+void spec_deposit_pha_n( const t_species *spec, const int n_pha, const t_spec_pha pha[],
+    float* const buf[] )
+{
+    if ( n_pha < 1 ) return;
+
+    // Axis quantities required and private grid offsets (padded to avoid false sharing)
+    int need[U3+1] = {0};
+    size_t off[ n_pha + 1 ];
+    off[0] = 0;
+    for( int p = 0; p < n_pha; p++ ) {
+        need[ pha[p].rep_type & 0x000F ] = 1;
+        need[ (pha[p].rep_type & 0x00F0)>>4 ] = 1;
+        off[p+1] = off[p] + ( ( (size_t) pha[p].nx[0] * pha[p].nx[1] + 15 ) & ~((size_t) 15) );
+    }
+    const size_t stride = off[ n_pha ];
 
-            if ( i2 >= 0 && i2 < pha_nx[1] ) {
+    const size_t mark = arena_mark( spec -> scratch );
+    float* const priv = arena_alloc( spec -> scratch, omp_get_max_threads() * stride * sizeof( float ) );
 
-                if (i1 >= 0 && i1 < pha_nx[0]) {
-                    buf[ idx ] += (1.0f-w1)*(1.0f-w2)*spec->q;
-                }
+    const float q = spec -> q;
+    const int nblocks = ( spec -> np + PHA_BLOCK - 1 ) / PHA_BLOCK;
 
-                if (i1+1 >= 0 && i1+1 < pha_nx[0] ) {
-                    buf[ idx + 1 ] += w1*(1.0f-w2)*spec->q;
-                }
-            }
+    #pragma omp parallel
+    {
+        float* restrict const local = priv + omp_get_thread_num() * stride;
+        for( size_t i = 0; i < stride; i++ ) local[i] = 0;
 
-            idx += nrow;
-            if ( i2+1 >= 0 && i2+1 < pha_nx[1] ) {
+        float pha_x[U3+1][PHA_BLOCK];
 
-                if (i1 >= 0 && i1 < pha_nx[0]) {
-                    buf[ idx ] += (1.0f-w1)*w2*spec->q;
-                }
+        #pragma omp for schedule(static)
+        for( int b = 0; b < nblocks; b++ ) {
+            const int i = b * PHA_BLOCK;
+            const int np = ( i + PHA_BLOCK > spec->np )? spec->np - i : PHA_BLOCK;
 
-                if (i1+1 >= 0 && i1+1 < pha_nx[0] ) {
-                    buf[ idx + 1 ] += w1*w2*spec->q;
-                }
-            }
+            for( int quant = 0; quant <= U3; quant++ )
+                if ( need[quant] ) spec_pha_axis( spec, i, np, quant, pha_x[quant] );
 
+            for( int p = 0; p < n_pha; p++ ) {
+                const int quant1 = pha[p].rep_type & 0x000F;
+                const int quant2 = (pha[p].rep_type & 0x00F0)>>4;
+                pha_deposit_block( np, pha_x[quant1], pha_x[quant2], &pha[p], q, local + off[p] );
+            }
         }
 
+        // Add private grids in thread order
+        const int nthreads = omp_get_num_threads();
+        for( int p = 0; p < n_pha; p++ ) {
+            const int size = pha[p].nx[0] * pha[p].nx[1];
+            float* restrict const grid = buf[p];
+
+            #pragma omp for schedule(static) nowait
+            for( int i = 0; i < size; i++ ) {
+                float s = 0;
+                for( int tid = 0; tid < nthreads; tid++ ) s += priv[ tid * stride + off[p] + i ];
+                grid[i] += s;
+            }
+        }
     }
+
+    arena_release( spec -> scratch, mark );
 }
 
 /**
- * @brief Saves particle species phasespace density information to disk
+ * @brief Deposit 2D phasespace density.
  * 
  * @param spec      Particle species
  * @param rep_type  Type of phasespace, use the PHASESPACE macro to define
  * @param pha_nx    Number of grid points in the phasespace density grid
  * @param pha_range Physical range of each of the phasespace axis
+ * @param buf       Phasespace density grid
  */
-void spec_rep_pha( const t_species *spec, const int rep_type,
-              const int pha_nx[], const float pha_range[][2] )
+void spec_deposit_pha( const t_species *spec, const int rep_type,
+              const int pha_nx[], const float pha_range[][2], float* restrict buf )
 {
+    t_spec_pha pha = {
+        .rep_type = rep_type,
+        .nx = { pha_nx[0], pha_nx[1] },
+        .range = { { pha_range[0][0], pha_range[0][1] }, { pha_range[1][0], pha_range[1][1] } }
+    };
 
-    // Allocate phasespace buffer
-    float* restrict buf = malloc( pha_nx[0] * pha_nx[1] * sizeof( float ));
-    memset( buf, 0, pha_nx[0] * pha_nx[1] * sizeof( float ));
-
-    // Deposit the phasespace
-    spec_deposit_pha( spec, rep_type, pha_nx, pha_range, buf );
+    float* grid[] = { buf };
+    spec_deposit_pha_n( spec, 1, &pha, grid );
+}
 
-    int quant1 = rep_type & 0x000F;
-    int quant2 = (rep_type & 0x00F0)>>4;
+/**
+ * @brief Saves a phasespace density grid to disk
+ * 
+ * @param spec      Particle species
+ * @param pha       Phasespace parameters
+ * @param buf       Phasespace density grid
+ */
+static void spec_save_pha( const t_species *spec, const t_spec_pha* pha, const float* buf )
+{
+    int quant1 = pha -> rep_type & 0x000F;
+    int quant2 = (pha -> rep_type & 0x00F0)>>4;
 
     const char * pha_ax1_units = spec_pha_axis_units(quant1);
     const char * pha_ax2_units = spec_pha_axis_units(quant2);
@@ -1420,16 +4134,16 @@ void spec_rep_pha( const t_species *spec, const int rep_type,
 
     t_zdf_grid_axis axis[2];
     axis[0] = (t_zdf_grid_axis) {
-        .min = pha_range[0][0],
-        .max = pha_range[0][1],
+        .min = pha -> range[0][0],
+        .max = pha -> range[0][1],
         .name  = (char *) pha_ax_name[ quant1 - 1 ],
         .label = (char *) pha_ax_label[ quant1 - 1 ],
         .units = (char *) pha_ax1_units
     };
 
     axis[1] = (t_zdf_grid_axis) {
-        .min = pha_range[1][0],
-        .max = pha_range[1][1],
+        .min = pha -> range[1][0],
+        .max = pha -> range[1][1],
         .name  = (char *) pha_ax_name[ quant2 - 1 ],
         .label = (char *) pha_ax_label[ quant2 - 1 ],
         .units = (char *) pha_ax2_units
@@ -1451,8 +4165,8 @@ void spec_rep_pha( const t_species *spec, const int rep_type,
         .axis  = axis
     };
 
-    info.count[0] = pha_nx[0];
-    info.count[1] = pha_nx[1];
+    info.count[0] = pha -> nx[0];
+    info.count[1] = pha -> nx[1];
 
     t_zdf_iteration iter = {
         .name = "ITERATION",
@@ -1464,9 +4178,65 @@ void spec_rep_pha( const t_species *spec, const int rep_type,
     char path[1024];
     snprintf(path, 1024, "PHASESPACE/%s", spec -> name );
     zdf_save_grid( (void *) buf, zdf_float32, &info, &iter, path );
+}
+
+/**
+ * @brief Saves several particle species phasespace densities to disk
+ * 
+ * All phasespaces are deposited in a single pass over the particle buffer,
+ * see `spec_deposit_pha_n()`.
+ * 
+ * @param spec      Particle species
+ * @param n_pha     Number of phasespaces
+ * @param pha       Phasespace parameters
+ */
+void spec_report_pha_n( const t_species *spec, const int n_pha, const t_spec_pha pha[] )
+{
+    if ( n_pha < 1 ) return;
+
+    // Allocate phasespace buffers
+    const size_t mark = arena_mark( spec -> scratch );
+    float* buf[ n_pha ];
+    for( int p = 0; p < n_pha; p++ ) {
+        const size_t size = (size_t) pha[p].nx[0] * pha[p].nx[1] * sizeof( float );
+        buf[p] = arena_alloc( spec -> scratch, size );
+        memset( buf[p], 0, size );
+    }
+
+    // Deposit the phasespaces
+    spec_deposit_pha_n( spec, n_pha, pha, buf );
+
+    // Add data from all domains, only the root domain saves the data
+    int root = 1;
+    if ( domain_size() > 1 ) {
+        for( int p = 0; p < n_pha; p++ )
+            root = domain_reduce( buf[p], pha[p].nx[0] * pha[p].nx[1] );
+    }
+
+    for( int p = 0; p < n_pha; p++ )
+        if ( root ) spec_save_pha( spec, &pha[p], buf[p] );
+
+    arena_release( spec -> scratch, mark );
+}
+
+/**
+ * @brief Saves particle species phasespace density information to disk
+ * 
+ * @param spec      Particle species
+ * @param rep_type  Type of phasespace, use the PHASESPACE macro to define
+ * @param pha_nx    Number of grid points in the phasespace density grid
+ * @param pha_range Physical range of each of the phasespace axis
+ */
+void spec_rep_pha( const t_species *spec, const int rep_type,
+              const int pha_nx[], const float pha_range[][2] )
+{
+    t_spec_pha pha = {
+        .rep_type = rep_type,
+        .nx = { pha_nx[0], pha_nx[1] },
+        .range = { { pha_range[0][0], pha_range[0][1] }, { pha_range[1][0], pha_range[1][1] } }
+    };
 
-    // Free temp. buffer
-    free( buf );
+    spec_report_pha_n( spec, 1, &pha );
 }
 
 /**
@@ -1496,3 +4266,215 @@ void spec_report( const t_species *spec, const int rep_type,
             break;
     }
 }
+
+/*********************************************************************************************
+
+ Checkpoint / Restart
+
+ *********************************************************************************************/
+
+/// Particle quantities stored in checkpoint files
+static const char* ckp_quants[] = { "ix", "x", "ux", "uy", "uz" };
+
+/**
+ * @brief Writes a particle quantity to a checkpoint file
+ * 
+ * Quantities that are not stored contiguously (AOS layout) are first copied
+ * into a temporary buffer.
+ * 
+ * @param spec      Particle species
+ * @param zdf       Checkpoint file
+ * @param iq        Quantity, index in `ckp_quants`
+ * @param start     Global position of the first local particle
+ * @param total     Total number of particles
+ * @return          Returns 1 on success, 0 on error
+ */
+static int spec_checkpoint_quant( t_species* spec, t_zdf_file* zdf, const int iq,
+    const uint64_t start, const uint64_t total )
+{
+    const int np = spec -> np;
+
+    // Compact positions are stored in fixed point
+    const enum zdf_data_type type = ( iq == 0 ) ? zdf_int32 :
+        ( iq == 1 && spec -> layout == PART_COMPACT ) ? zdf_uint16 : zdf_float32;
+
+    const void* data;
+    size_t mark = arena_mark( spec -> scratch );
+
+    if ( spec -> layout == PART_SOA ) {
+        const void* soa[] = { spec -> soa.ix, spec -> soa.x, spec -> soa.ux, spec -> soa.uy, spec -> soa.uz };
+        data = soa[ iq ];
+    } else if ( spec -> layout == PART_COMPACT ) {
+        const void* cpt[] = { spec -> cpt.ix, spec -> cpt.x, spec -> cpt.ux, spec -> cpt.uy, spec -> cpt.uz };
+        data = cpt[ iq ];
+    } else {
+        float* restrict const buf = arena_alloc( spec -> scratch, np * sizeof(float) );
+        const t_part* restrict const part = spec -> part;
+
+        #pragma omp parallel for schedule(static)
+        for( int i = 0; i < np; i++ ) {
+            switch( iq ) {
+                case 0: memcpy( &buf[i], &part[i].ix, sizeof(int) ); break;
+                case 1: buf[i] = part[i].x; break;
+                case 2: buf[i] = part[i].ux; break;
+                case 3: buf[i] = part[i].uy; break;
+                default: buf[i] = part[i].uz;
+            }
+        }
+        data = buf;
+    }
+
+    char name[MAX_SPNAME_LEN+16];
+    snprintf( name, sizeof( name ), "%s.%s", spec -> name, ckp_quants[ iq ] );
+    const int ok = checkpoint_write( zdf, name, type, data, np, start, total );
+
+    arena_release( spec -> scratch, mark );
+    return ok;
+}
+
+/**
+ * @brief Writes the particle species state to a checkpoint file
+ * 
+ * Stores the particle buffer (in the current layout, each quantity as a
+ * separate dataset), the tile offsets of the last sort, the iteration number,
+ * the moving window counters and the density injection state.
+ * 
+ * When using domain decomposition this must be called by all domains.
+ * 
+ * @param spec      Particle species
+ * @param zdf       Checkpoint file, see `checkpoint_open()`
+ * @return          Returns 1 on success, 0 on error
+ */
+int spec_checkpoint( t_species* spec, t_zdf_file* zdf )
+{
+    const uint64_t start = domain_exscan( spec -> np );
+    double total = spec -> np;
+    domain_allreduce( &total, 1 );
+
+    char name[MAX_SPNAME_LEN+16];
+
+    const int64_t state[] = { spec -> np, spec -> iter, spec -> n_move, spec -> ix_off, spec -> layout,
+        ( spec -> tile_nx > 0 ) ? spec -> n_tiles : -1, (int64_t) spec -> density.total_np_inj,
+        spec -> nx, spec -> domain_ix0 };
+    snprintf( name, sizeof( name ), "%s.state", spec -> name );
+    if ( ! checkpoint_write( zdf, name, zdf_int64, state, 9, 0, 9 ) ) return 0;
+
+    const double state_f[] = { spec -> energy, spec -> density.custom_q_inj };
+    snprintf( name, sizeof( name ), "%s.state_f", spec -> name );
+    if ( ! checkpoint_write( zdf, name, zdf_float64, state_f, 2, 0, 2 ) ) return 0;
+
+    for( int k = 0; k < 5; k++ )
+        if ( ! spec_checkpoint_quant( spec, zdf, k, start, (uint64_t) total ) ) return 0;
+
+    if ( spec -> tile_nx > 0 ) {
+        const int n = spec -> n_tiles + 1;
+        size_t mark = arena_mark( spec -> scratch );
+        int32_t* tiles = arena_alloc( spec -> scratch, 2 * n * sizeof( int32_t ) );
+        for( int t = 0; t < n; t++ ) {
+            tiles[ t ]     = spec -> tile_cell[ t ];
+            tiles[ n + t ] = spec -> tile_off[ t ];
+        }
+        snprintf( name, sizeof( name ), "%s.tiles", spec -> name );
+        const int ok = checkpoint_write( zdf, name, zdf_int32, tiles, 2 * n, 0, 2 * n );
+        arena_release( spec -> scratch, mark );
+        if ( ! ok ) return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Restores the particle species state from a checkpoint file
+ * 
+ * The particles are copied from the mapped file into the particle buffer,
+ * converting them to the current particle layout if it differs from the
+ * one used when the checkpoint was written (positions stored in the compact
+ * format are copied without loss). If the tiling configuration changed the
+ * tile offsets are regenerated by sorting the particles.
+ * 
+ * The grid and domain decomposition must be the same used when the
+ * checkpoint was written, otherwise the routine aborts the code.
+ * 
+ * @param spec      Particle species
+ * @param map       Mapped checkpoint file, see `checkpoint_map()`
+ */
+void spec_restart( t_species* spec, const t_zdf_map* map )
+{
+    char name[MAX_SPNAME_LEN+16];
+
+    int64_t state[9];
+    snprintf( name, sizeof( name ), "%s.state", spec -> name );
+    memcpy( state, checkpoint_read( map, name, zdf_int64, 9 ), sizeof( state ) );
+
+    if ( state[7] != spec -> nx || state[8] != spec -> domain_ix0 ) {
+        fprintf(stderr, "(*error*) Checkpoint grid of species %s does not match the simulation grid, aborting.\n",
+            spec -> name );
+        exit(-1);
+    }
+
+    const int np = state[0];
+    const enum part_layout layout = state[4];
+    const int n_tiles = state[5];
+
+    spec -> iter   = state[1];
+    spec -> n_move = state[2];
+    spec -> ix_off = state[3];
+    spec -> density.total_np_inj = state[6];
+
+    double state_f[2];
+    snprintf( name, sizeof( name ), "%s.state_f", spec -> name );
+    memcpy( state_f, checkpoint_read( map, name, zdf_float64, 2 ), sizeof( state_f ) );
+    spec -> energy = state_f[0];
+    spec -> density.custom_q_inj = state_f[1];
+
+    // Particle data, the current buffer contents are discarded
+    const void* data[5];
+    for( int k = 0; k < 5; k++ ) {
+        const enum zdf_data_type type = ( k == 0 ) ? zdf_int32 :
+            ( k == 1 && layout == PART_COMPACT ) ? zdf_uint16 : zdf_float32;
+        snprintf( name, sizeof( name ), "%s.%s", spec -> name, ckp_quants[k] );
+        data[k] = checkpoint_read( map, name, type, np );
+    }
+
+    spec -> np = 0;
+    spec_grow_buffer( spec, np );
+    spec -> np = np;
+
+    const int* restrict const ix = data[0];
+    const float* restrict const ux = data[2];
+    const float* restrict const uy = data[3];
+    const float* restrict const uz = data[4];
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < np; i++ ) {
+        PART_IX( spec, i ) = ix[i];
+        if ( layout == PART_COMPACT ) {
+            const uint16_t x = ( (const uint16_t *) data[1] )[i];
+            if ( spec -> layout == PART_COMPACT ) spec -> cpt.x[i] = x;
+            else PART_SET_X( spec, i, part_fix_to_float( x ) );
+        } else {
+            PART_SET_X( spec, i, ( (const float *) data[1] )[i] );
+        }
+        PART_SET_UX( spec, i, ux[i] );
+        PART_SET_UY( spec, i, uy[i] );
+        PART_SET_UZ( spec, i, uz[i] );
+    }
+
+    // Tile offsets
+    if ( spec -> tile_nx > 0 ) {
+        if ( n_tiles == spec -> n_tiles ) {
+            const int n = spec -> n_tiles + 1;
+            snprintf( name, sizeof( name ), "%s.tiles", spec -> name );
+            const int32_t* tiles = checkpoint_read( map, name, zdf_int32, 2 * n );
+            for( int t = 0; t < n; t++ ) {
+                spec -> tile_cell[ t ] = tiles[ t ];
+                spec -> tile_off[ t ]  = tiles[ n + t ];
+            }
+        } else {
+            spec_sort( spec );
+        }
+    }
+
+    // Automatic sort statistics start again from the restart iteration
+    if ( spec -> sort_auto ) spec_set_sort_auto( spec, 1 );
+}
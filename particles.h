@@ -13,6 +13,8 @@
 #include "zpic.h"
 #include "emf.h"
 #include "current.h"
+#include "domain.h"
+#include "arena.h"
 
 #include <stdint.h>
 
@@ -34,6 +36,66 @@ typedef struct Particle {
 	float uz;	///< Generalized velocity along z
 } t_part;
 
+/**
+ * @brief Particle buffer memory layouts
+ * 
+ */
+enum part_layout {
+	PART_AOS,		///< Array of structures (t_part)
+	PART_SOA,		///< Structure of arrays (t_part_soa)
+	PART_COMPACT	///< Structure of arrays, reduced precision (t_part_compact)
+};
+
+/**
+ * @brief Particle shapes
+ * 
+ * B-spline shapes used both for the field interpolation and the current
+ * (and charge) deposition, the value is the interpolation order.
+ */
+enum part_shape {
+	PART_SHAPE_LINEAR    = 1,	///< Linear (2 point stencil)
+	PART_SHAPE_QUADRATIC = 2,	///< Quadratic (3 point stencil)
+	PART_SHAPE_CUBIC     = 3	///< Cubic (4 point stencil)
+};
+
+/**
+ * @brief Particle data stored as a structure of arrays
+ * 
+ * All arrays are aligned to PART_ALIGN bytes
+ */
+typedef struct ParticleSoA {
+	int   *ix;	///< Particle cell index
+	float *x;	///< Position inside cell
+	float *ux;	///< Generalized velocity along x
+	float *uy;	///< Generalized velocity along y
+	float *uz;	///< Generalized velocity along z
+} t_part_soa;
+
+/**
+ * @brief Particle data stored as a structure of arrays, using reduced precision positions
+ * 
+ * Positions inside the cell are stored as 16 bit fixed point values (units
+ * of 1/65536 cell), for a total of 18 bytes per particle (20 bytes for the
+ * other layouts). All calculations are done in single precision, positions
+ * are only converted when loading / storing the particle data, see
+ * `part_fix_to_float()`. Momenta are kept in single precision: with half
+ * precision values the small momentum changes of each time step are lost to
+ * rounding. All arrays are aligned to PART_ALIGN bytes.
+ */
+typedef struct ParticleCompact {
+	int      *ix;	///< Particle cell index
+	uint16_t *x; 	///< Position inside cell (fixed point)
+	float    *ux;	///< Generalized velocity along x
+	float    *uy;	///< Generalized velocity along y
+	float    *uz;	///< Generalized velocity along z
+} t_part_compact;
+
+/**
+ * @brief Alignment (bytes) of structure of arrays particle data
+ * 
+ */
+#define PART_ALIGN ARENA_ALIGN
+
 /**
  * @brief Types of density profile
  * 
@@ -89,7 +151,10 @@ typedef struct Species {
 	char name[MAX_SPNAME_LEN+1];
 
 	// Particles
-	t_part *part;	///< Particle buffer
+	enum part_layout layout;	///< Particle buffer memory layout
+	t_part *part;	///< Particle buffer (PART_AOS layout)
+	t_part_soa soa;	///< Particle buffer (PART_SOA layout)
+	t_part_compact cpt;	///< Particle buffer (PART_COMPACT layout)
 	int np;			///< Number of particles in buffer
 	int np_max;		///< Maximum number of particles in buffer
 
@@ -105,6 +170,9 @@ typedef struct Species {
 	/// Number of particles per cell
 	int ppc;
 
+	/// Particle shape
+	enum part_shape shape;
+
 	/// Density profile to inject
 	t_density density;
 	
@@ -116,6 +184,12 @@ typedef struct Species {
 	float dx;		///< Cell size in simulation units
 	float box;		///< Simulation box size in simulation units
 
+	// Domain decomposition
+	int domain_ix0;		///< Global index of local cell 0 (see `domain_decompose()`)
+	t_part *mig_buf;	///< Particles leaving the local domain (lower / upper neighbour)
+	int mig_buf_size;	///< Size of mig_buf
+	t_domain_msg mig_msg;	///< Pending particle messages
+
 	/// Time step
 	float dt;
 
@@ -125,6 +199,7 @@ typedef struct Species {
 	// Moving window
 	int moving_window;  ///< Active moving window
 	int n_move;			///< Number of cells moved by the moving window algorithm
+	int ix_off;			///< Cell index offset of particle data: the cell of particle i is PART_IX(spec,i) - ix_off
 
 	/// Boundary conditions
 	enum part_boundary bc_type;
@@ -132,8 +207,98 @@ typedef struct Species {
 	/// Sorting frequency
 	int n_sort;
 
+	// Automatic sort frequency (see spec_set_sort_auto())
+	int sort_auto;			///< Sort when the estimated push slowdown exceeds the sort cost (n_sort is ignored)
+	int sort_count;			///< Number of automatic sorts
+	int sort_iter0;			///< Iteration at which automatic sorting was enabled
+	int sort_last;			///< Iteration of the last automatic sort
+	double sort_cost;		///< Measured time of the last sort (s), 0 if not measured yet
+	double sort_push_time;	///< Push time of the last iteration (s)
+	double sort_disorder;	///< Number of particles out of cell order (see spec_disorder_omp())
+	double sort_excess;		///< Sum of the disorder times the number of particles since the last sort
+	double sort_fit[5];		///< Weighted sums for fitting the push time per particle to the disorder
+
+	// Sorting work buffers (reused across spec_sort() calls)
+	t_part *part_tmp;	///< Secondary particle buffer (PART_AOS layout)
+	t_part_soa soa_tmp;	///< Secondary particle buffer (PART_SOA layout)
+	t_part_compact cpt_tmp;	///< Secondary particle buffer (PART_COMPACT layout)
+	int np_tmp;			///< Size of secondary particle buffer
+	int *sort_buf;		///< Per thread cell histograms and prefix sums
+	int sort_buf_size;	///< Size of sort_buf
+
+	/// Scratch memory for temporary buffers (injection and diagnostics), reused across calls
+	t_arena* scratch;
+
+	// Tiled advance
+	int tile_nx;		///< Tile size in cells (0 disables tiling)
+	int n_tiles;		///< Number of tiles
+	int tile_max_nx;	///< Maximum tile size in cells
+	int tile_lb;		///< Dynamic load balancing of the tile boundaries
+	int *tile_cell;		///< First cell of each tile, set by spec_sort()
+	int *tile_off;		///< Particle buffer offset of each tile, set by spec_sort()
+	int *tile_win;		///< Cell window and exclusive region of each tile (work buffer)
+	float3 *tile_buf;	///< Per thread tile local E, B and J buffers
+	double tile_imb_sum;	///< Sum of the tile load imbalance measured at each sort
+	int tile_imb_n;		///< Number of tile load imbalance measurements
+
+	/// Deterministic advance (results independent of the number of threads)
+	int deterministic;
+
 } t_species;
 
+/**
+ * @brief Converts a fixed point position (PART_COMPACT layout) to single precision
+ * 
+ * @param x     Fixed point position, in units of 1/65536 cell
+ * @return      Position inside cell
+ */
+static inline float part_fix_to_float( const uint16_t x )
+{
+	return x * ( 1.0f / 65536.0f );
+}
+
+/**
+ * @brief Converts a position inside the cell to fixed point (PART_COMPACT layout)
+ * 
+ * The value is rounded to the nearest fixed point value, and clamped so that
+ * any position in [0,1[ stays inside the cell.
+ * 
+ * @param x     Position inside cell, must be in the range [0,1[
+ * @return      Fixed point position, in units of 1/65536 cell
+ */
+static inline uint16_t part_float_to_fix( const float x )
+{
+	const int v = (int) ( x * 65536.0f + 0.5f );
+	return ( v < 65535 ) ? v : 65535;
+}
+
+/**
+ * @brief Access particle data independently of the buffer layout
+ * 
+ * These macros evaluate to the particle quantity, they are meant for code
+ * outside the performance critical sections. The cell index macro is
+ * assignable (e.g. `PART_IX( spec, i ) = 0;`), positions and momenta must be
+ * set using the `PART_SET_*` macros since the PART_COMPACT layout stores
+ * positions in reduced precision.
+ */
+#define PART_IX(spec,i) (*( (spec)->layout == PART_SOA ? &(spec)->soa.ix[i] : (spec)->layout == PART_COMPACT ? &(spec)->cpt.ix[i] : &(spec)->part[i].ix ))	///< Particle cell index
+#define PART_X(spec,i)  ( (spec)->layout == PART_SOA ? (spec)->soa.x[i]  : (spec)->layout == PART_COMPACT ? part_fix_to_float( (spec)->cpt.x[i] )   : (spec)->part[i].x  )	///< Position inside cell
+#define PART_UX(spec,i) ( (spec)->layout == PART_SOA ? (spec)->soa.ux[i] : (spec)->layout == PART_COMPACT ? (spec)->cpt.ux[i] : (spec)->part[i].ux )	///< Generalized velocity along x
+#define PART_UY(spec,i) ( (spec)->layout == PART_SOA ? (spec)->soa.uy[i] : (spec)->layout == PART_COMPACT ? (spec)->cpt.uy[i] : (spec)->part[i].uy )	///< Generalized velocity along y
+#define PART_UZ(spec,i) ( (spec)->layout == PART_SOA ? (spec)->soa.uz[i] : (spec)->layout == PART_COMPACT ? (spec)->cpt.uz[i] : (spec)->part[i].uz )	///< Generalized velocity along z
+
+/// Sets particle quantity `q` (x, ux, uy or uz) independently of the buffer layout, `cvt` converts the value for the PART_COMPACT layout
+#define PART_SET( spec, i, q, cvt, v ) do { \
+	if ( (spec)->layout == PART_SOA ) (spec)->soa.q[i] = (v); \
+	else if ( (spec)->layout == PART_COMPACT ) (spec)->cpt.q[i] = cvt( v ); \
+	else (spec)->part[i].q = (v); \
+} while(0)
+
+#define PART_SET_X(spec,i,v)  PART_SET( spec, i, x,  part_float_to_fix, v )	///< Sets position inside cell
+#define PART_SET_UX(spec,i,v) PART_SET( spec, i, ux, (float), v )	///< Sets generalized velocity along x
+#define PART_SET_UY(spec,i,v) PART_SET( spec, i, uy, (float), v )	///< Sets generalized velocity along y
+#define PART_SET_UZ(spec,i,v) PART_SET( spec, i, uz, (float), v )	///< Sets generalized velocity along z
+
 /**
  * @brief Initialize particle Species object
  * 
@@ -146,7 +311,7 @@ typedef struct Species {
  * @param ppc       Reference number of particles per cell
  * @param ufl       Initial fluid momentum of particles, may be set to NULL 
  * @param uth       Initial thermal momentum of particles, may be set to NULL
- * @param nx        Number of grid points
+ * @param nx        Number of grid points (global)
  * @param box       Simulation box size in simulation units
  * @param dt        Simulation time step, in simulation units
  * @param density   Density profile for particle injection, may be set to NULL
@@ -166,13 +331,80 @@ void spec_delete( t_species* spec );
  * @brief Grows particle buffer to specified size.
  * 
  * If the new size is smaller than the previous size the buffer size is not changed
- * and the function returns silently.
+ * and the function returns silently. The buffer grows by at least 50 %, so
+ * that repeated injection (e.g. moving window) does not reallocate the
+ * buffer every time step.
  * 
  * @param spec  Particle species
  * @param size  New buffer size (will be rounded up to next multiple of 1024)
  **/
 void spec_grow_buffer( t_species* spec, const int size );
 
+/**
+ * @brief Sets the memory layout of the particle buffer
+ * 
+ * @param spec      Particle species
+ * @param layout    New memory layout
+ */
+void spec_set_layout( t_species* spec, const enum part_layout layout );
+
+/**
+ * @brief Sets the particle shape
+ * 
+ * @param spec      Particle species
+ * @param shape     Particle shape
+ */
+void spec_set_shape( t_species* spec, const enum part_shape shape );
+
+/**
+ * @brief Sets the tile size for the tiled particle advance
+ * 
+ * @param spec      Particle species
+ * @param tile_nx   Tile size in cells, set to 0 to disable tiling
+ */
+void spec_set_tiles( t_species* spec, const int tile_nx );
+
+/**
+ * @brief Enables / disables dynamic load balancing of the tile boundaries
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_tile_balance( t_species* spec, const int enable );
+
+/**
+ * @brief Average tile load imbalance
+ * 
+ * @param spec      Particle species
+ * @return          Average ratio between the maximum and the average tile
+ *                  load, 0 if not available
+ */
+double spec_tile_imbalance( const t_species* spec );
+
+/**
+ * @brief Enables / disables the automatic sort frequency
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_sort_auto( t_species* spec, const int enable );
+
+/**
+ * @brief Average number of iterations between automatic sorts
+ * 
+ * @param spec      Particle species
+ * @return          Average sort interval, 0 if no automatic sorts were done
+ */
+double spec_sort_interval( const t_species* spec );
+
+/**
+ * @brief Enables / disables the deterministic (reproducible) particle advance
+ * 
+ * @param spec      Particle species
+ * @param enable    Set to 1 to enable, 0 to disable
+ */
+void spec_set_deterministic( t_species* spec, const int enable );
+
 /**
  * @brief Advance Particle species 1 timestep
  * 
@@ -193,6 +425,58 @@ void spec_grow_buffer( t_species* spec, const int size );
  */
 void spec_advance( t_species* spec, t_emf* emf, t_current* current );
 
+/**
+ * @brief Advance all Particle species 1 timestep, pushing all species concurrently
+ * 
+ * Same as calling `spec_advance()` for each species, but the particle push of
+ * all species is done by a single pool of OpenMP tasks, best used with private
+ * current deposition.
+ * 
+ * @param species   Particle species
+ * @param n_species Number of particle species
+ * @param emf       EM fields
+ * @param current   Current density
+ */
+void spec_advance_tasks( t_species* species, const int n_species, t_emf* emf, t_current* current );
+
+/**
+ * @brief Sorts particle buffer by cell index
+ * 
+ * @param spec      Particle species
+ */
+void spec_sort( t_species* spec );
+
+/**
+ * @brief Deposit single particle current using Esirkepov method (reference implementation)
+ * 
+ * @param ix0       Initial cell index of particle
+ * @param di        Number of cells moved {-1,0,1}
+ * @param x0        Initial position of particle inside cell
+ * @param x1        Final position of particle inside cell
+ * @param qnx       Normalization for x current (q * cell size / dt)
+ * @param qvy       Y current ( q * vy )
+ * @param qvz       Z current ( q * vz )
+ * @param current   Electric current density
+ */
+void dep_current_esk( int ix0, int di, float x0, float x1,
+	float qnx, float qvy, float qvz, t_current *current );
+
+/**
+ * @brief Deposit single particle current using zamb method
+ * 
+ * @param ix0       Initial cell index of particle
+ * @param di        Number of cells moved {-1,0,1}
+ * @param x0        Initial position of particle inside cell
+ * @param dx        Particle motion normalized to cell size
+ * @param qnx       Normalization for x current (q * cell size / dt)
+ * @param qvy       Y current ( q * vy )
+ * @param qvz       Z current ( q * vz )
+ * @param J         Current density grid (pointer to cell 0)
+ * @param atomic    Use atomic updates (required when J is shared by multiple threads)
+ */
+void dep_current_zamb( int ix0, int di, float x0, float dx,
+	float qnx, float qvy, float qvz, float3* restrict const J, const int atomic );
+
 /**
  * @brief Returns the total time spent pushing particles (includes boundaries and moving window)
  * @return  Total time in seconds
@@ -234,6 +518,16 @@ double spec_perf( void );
  */
 #define PHASESPACE(a,b) ((a) + (b)*16 + PHA)
 
+/**
+ * @brief Phasespace density diagnostic parameters
+ * 
+ */
+typedef struct SpecPhasespace {
+	int rep_type;			///< Type of phasespace, use the PHASESPACE macro to define
+	int nx[2];				///< Number of grid points in the phasespace density grid
+	float range[2][2];		///< Physical range of each of the phasespace axis
+} t_spec_pha;
+
 /**
  * @brief Deposit 2D phasespace density.
  * 
@@ -246,10 +540,21 @@ double spec_perf( void );
 void spec_deposit_pha( const t_species *spec, const int rep_type,
 			  const int pha_nx[], const float pha_range[][2], float* buf );
 
+/**
+ * @brief Deposits several 2D phasespace densities in a single pass over the particles
+ * 
+ * @param spec      Particle species
+ * @param n_pha     Number of phasespaces
+ * @param pha       Phasespace parameters
+ * @param buf       Phasespace density grids, one per phasespace
+ */
+void spec_deposit_pha_n( const t_species *spec, const int n_pha, const t_spec_pha pha[],
+	float* const buf[] );
+
 /**
  * @brief Deposits particle species charge density
  * 
- * Deposition is done using linear interpolation. Used for diagnostics
+ * Deposition is done using the species particle shape. Used for diagnostics
  * purpose only.
  * 
  * @param spec      Particle species
@@ -270,4 +575,32 @@ void spec_deposit_charge( const t_species* spec, float* charge );
 void spec_report( const t_species *spec, const int rep_type,
 				  const int pha_nx[], const float pha_range[][2] );
 
+/**
+ * @brief Saves several particle species phasespace densities to disk
+ * 
+ * All phasespaces are deposited in a single pass over the particle buffer.
+ * 
+ * @param spec      Particle species
+ * @param n_pha     Number of phasespaces
+ * @param pha       Phasespace parameters
+ */
+void spec_report_pha_n( const t_species *spec, const int n_pha, const t_spec_pha pha[] );
+
+/**
+ * @brief Writes the particle species state to a checkpoint file
+ * 
+ * @param spec      Particle species
+ * @param zdf       Checkpoint file
+ * @return          Returns 1 on success, 0 on error
+ */
+int spec_checkpoint( t_species* spec, t_zdf_file* zdf );
+
+/**
+ * @brief Restores the particle species state from a checkpoint file
+ * 
+ * @param spec      Particle species
+ * @param map       Mapped checkpoint file
+ */
+void spec_restart( t_species* spec, const t_zdf_map* map );
+
 #endif
@@ -11,11 +11,31 @@
 
 #include "random.h"
 #include <math.h>
+#include <string.h>
 
 
 uint32_t m_w = 12345;    ///< Random seed w, must not be zero nor 0x464fffff
 uint32_t m_z = 67890;    ///< Random seed z, must not be zero nor 0x9068ffff
 
+static int iset = 0;        ///< A normal variate is stored in gset, see `rand_norm()`
+static double gset = 0.0;   ///< Stored normal variate
+
+/**
+ * @brief splitmix64 finalizer
+ * 
+ * See Steele, G. L., Lea, D. and Flood, C. H. (2014). "Fast splittable
+ * pseudorandom number generators". OOPSLA 2014. doi:10.1145/2660193.2660195
+ * 
+ * @param z     Input value
+ * @return      Mixed value
+ */
+static inline uint64_t mix64( uint64_t z )
+{
+    z = ( z ^ ( z >> 30 ) ) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = ( z ^ ( z >> 27 ) ) * UINT64_C(0x94d049bb133111eb);
+    return z ^ ( z >> 31 );
+}
+
 /**
  * @brief Sets the seed for the pseudo random number generator
  * 
@@ -66,9 +86,6 @@ uint32_t rand_uint32( void )
  */
 double rand_norm( void )
 {
-	static int iset = 0;
-	static double gset = 0.0;
-
 	if (iset) {
 		iset = 0;
 		return gset;
@@ -99,3 +116,91 @@ double rand_norm( void )
 	}
 
 }
+
+/**
+ * @brief Gets the state of the pseudo random number generator
+ * 
+ * The counter based generator (`rand_norm_n()`) has no state of its own.
+ * 
+ * @param state (out) Generator state
+ */
+void rand_get_state( t_rand_state* state )
+{
+	state -> m_w = m_w;
+	state -> m_z = m_z;
+	state -> iset = iset;
+	state -> gset = gset;
+}
+
+/**
+ * @brief Restores the state of the pseudo random number generator
+ * 
+ * @param state Generator state, from `rand_get_state()`
+ */
+void rand_set_state( const t_rand_state* state )
+{
+	m_w = state -> m_w;
+	m_z = state -> m_z;
+	iset = state -> iset;
+	gset = state -> gset;
+}
+
+/**
+ * @brief Gets a key for the counter based random number generator
+ * 
+ * The key combines the current seed values (see `set_rand_seed()`) with
+ * a hash (FNV-1a) of the stream name, so that different streams (e.g.
+ * particle species) get uncorrelated values. The seed is also mixed with
+ * the splitmix64 increment (golden ratio), which for the default seed gives the
+ * shipped thermal decks (twostream, magnetized) the same energy
+ * conservation margin as the original MWC generator.
+ * 
+ * @param name  Stream name (e.g. species name)
+ * @return      Random stream key
+ */
+uint64_t rand_key( const char* name )
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    const size_t len = strlen( name );
+    for( size_t i = 0; i < len; i++ ) {
+        h ^= (unsigned char) name[i];
+        h *= UINT64_C(0x100000001b3);
+    }
+
+    const uint64_t seed = ( (uint64_t) m_w << 32 ) | m_z;
+
+    return mix64( h ^ seed ^ UINT64_C(0x9e3779b97f4a7c15) );
+}
+
+/**
+ * @brief Returns n variates of the normal distribution (mean 0, stdev 1)
+ * using a counter based generator
+ * 
+ * Value i is obtained from the counter value `ctr + i` alone: the pair
+ * (key, counter) is hashed using the splitmix64 finalizer, and the two 32
+ * bit halves of the result are used as uniform deviates for the (non polar)
+ * Box-Muller method. The routine keeps no internal state, so it can be
+ * called concurrently from multiple threads, and the results do not depend
+ * on the order in which values are generated. The main loop does not
+ * branch and can be vectorized.
+ * 
+ * @param out   Output buffer
+ * @param n     Number of values
+ * @param key   Random stream key, see `rand_key()`
+ * @param ctr   Counter value for the first variate
+ */
+void rand_norm_n( double* restrict out, const int n, const uint64_t key, const uint64_t ctr )
+{
+    const double two_pi = 6.283185307179586;
+
+    #pragma omp simd
+    for( int i = 0; i < n; i++ ) {
+        const uint64_t h = mix64( mix64( ctr + i ) ^ key );
+
+        // u1 in ]0,1[, u2 in [0,1[
+        const double u1 = ( (double) ( h >> 32 ) + 0.5 ) * ( 1.0 / 4294967296.0 );
+        const double u2 = (double) ( h & 0xffffffff ) * ( 1.0 / 4294967296.0 );
+
+        out[i] = sqrt( -2.0 * log( u1 ) ) * cos( two_pi * u2 );
+    }
+}
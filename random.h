@@ -12,6 +12,17 @@
 
 #include <stdint.h>
 
+/**
+ * @brief State of the (sequential) pseudo random number generator
+ * 
+ */
+typedef struct RandState {
+	uint32_t m_w;	///< Random seed w
+	uint32_t m_z;	///< Random seed z
+	int iset;		///< A normal variate is stored in gset
+	double gset;	///< Stored normal variate (Box-Muller values come in pairs)
+} t_rand_state;
+
 /**
  * @brief Sets the seed for the pseudo random number generator
  * 
@@ -27,4 +38,37 @@ void set_rand_seed( uint32_t m_z_, uint32_t m_w_ );
  */
 double rand_norm( void );
 
+/**
+ * @brief Gets the state of the pseudo random number generator
+ * 
+ * @param state (out) Generator state
+ */
+void rand_get_state( t_rand_state* state );
+
+/**
+ * @brief Restores the state of the pseudo random number generator
+ * 
+ * @param state Generator state, from `rand_get_state()`
+ */
+void rand_set_state( const t_rand_state* state );
+
+/**
+ * @brief Gets a key for the counter based random number generator
+ * 
+ * @param name  Stream name (e.g. species name)
+ * @return      Random stream key
+ */
+uint64_t rand_key( const char* name );
+
+/**
+ * @brief Returns n variates of the normal distribution (mean 0, stdev 1)
+ * using a counter based generator
+ * 
+ * @param out   Output buffer
+ * @param n     Number of values
+ * @param key   Random stream key, see `rand_key()`
+ * @param ctr   Counter value for the first variate
+ */
+void rand_norm_n( double* restrict out, const int n, const uint64_t key, const uint64_t ctr );
+
 #endif
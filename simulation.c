@@ -12,8 +12,15 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
 #include "simulation.h"
 #include "timer.h"
+#include "zdf.h"
+#include "domain.h"
+#include "random.h"
+#include "checkpoint.h"
 
 /**
  * @brief Checks if there should be a report at this timestep
@@ -31,22 +38,345 @@ int report( int n, int ndump )
 	}
 }
 
+/*********************************************************************************************
+
+ Runtime parameter overrides
+
+ *********************************************************************************************/
+
+/**
+ * @brief Runtime parameter override
+ * 
+ */
+typedef struct SimParam {
+	const char* name;	///< Parameter name
+	int integer;		///< Parameter must be an integer
+	const char* const* keys;	///< Valid keyword values (NULL terminated), stored as the keyword index
+	int string;			///< Parameter is a string (e.g. a file name)
+	int set;			///< Parameter has been set
+	double value;		///< Parameter value
+	char str[256];		///< Parameter value (string parameters)
+} t_sim_param;
+
+/// Keyword values of the "deposit" parameter, in `enum current_deposit` order
+static const char* const deposit_keys[] = { "atomic", "private", NULL };
+
+/// Parameters that may be overridden at runtime
+static t_sim_param sim_params[] = {
+	{ .name = "nx",     .integer = 1 },
+	{ .name = "ppc",    .integer = 1 },
+	{ .name = "tmax",   .integer = 0 },
+	{ .name = "ndump",  .integer = 1 },
+	{ .name = "n_sort", .integer = 1 },
+	{ .name = "sort_auto", .integer = 1 },
+	{ .name = "tile_nx", .integer = 1 },
+	{ .name = "tile_lb", .integer = 1 },
+	{ .name = "shape",  .integer = 1 },
+	{ .name = "layout", .integer = 1 },
+	{ .name = "persistent", .integer = 1 },
+	{ .name = "tasks",  .integer = 1 },
+	{ .name = "deposit", .integer = 1, .keys = deposit_keys },
+	{ .name = "checkpoint", .integer = 1 },
+	{ .name = "deterministic", .integer = 1 },
+	{ .name = "reference", .integer = 1 },
+	{ .name = "compare", .integer = 1 },
+	{ .name = "insitu", .integer = 1 },
+	{ .name = "series", .integer = 1 },
+	{ .name = "timing", .string = 1 },
+};
+
+/// Number of parameters that may be overridden
+static const int n_sim_params = sizeof( sim_params ) / sizeof( sim_params[0] );
+
+/**
+ * @brief Finds runtime parameter by name
+ * 
+ * @param name 	Parameter name
+ * @return 		Pointer to parameter, NULL if not found
+ */
+static t_sim_param* sim_param_find( const char* name )
+{
+	for( int i = 0; i < n_sim_params; i++ ) {
+		if ( ! strcmp( sim_params[i].name, name ) ) return &sim_params[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Overrides a simulation parameter
+ * 
+ * Valid parameters are "nx", "ppc", "tmax", "ndump", "n_sort", "sort_auto"
+ * (automatic sort frequency, see `sim_set_sort_auto()`), "tile_nx",
+ * "tile_lb" (see `sim_set_tiles()` and `sim_set_tile_balance()`), "shape"
+ * (particle shape order of all species, see `spec_set_shape()`), "layout"
+ * (particle buffer layout of all species, 0 - AOS, 1 - SOA, 2 - compact, see
+ * `spec_set_layout()`), "persistent" (run the time loop inside a single
+ * parallel region, see `sim_set_omp_persistent()`), "tasks" (push all
+ * species concurrently, see `sim_set_task_advance()`), "deposit" (current
+ * deposition, "atomic" or "private", see `sim_set_current_deposit()`),
+ * "checkpoint" (iterations between checkpoints, 0 for checkpoints on signals
+ * only, see `sim_set_checkpoint()`), "deterministic" (reproducible particle
+ * advance, see `sim_set_deterministic()`), "reference" and "compare"
+ * (iteration at which the state is saved as reference, or compared with it,
+ * see `sim_set_diff()`), "timing" (per phase timings output file, see
+ * `sim_set_timing_dump()`), "series" (single file time series for grid
+ * diagnostics, see `sim_set_diag_series()`) and "insitu" (enables the example
+ * in-situ diagnostics of the input decks, see `sim_add_insitu()`). The "nx",
+ * "ppc" and "insitu" overrides (and "persistent", for decks that set it) are
+ * used by the input decks (see `sim_param_grid()` and `sim_param_int()`),
+ * while the remaining ones are applied by `sim_new()`.
+ * Parameters must be set before calling the deck `sim_init()` routine.
+ * 
+ * @param name 		Parameter name
+ * @param value 	Parameter value
+ * @return 			Returns 0 on success, -1 on error (invalid parameter name or value)
+ */
+int sim_set_param( const char* name, const char* value )
+{
+	t_sim_param* p = sim_param_find( name );
+	if ( ! p ) {
+		fprintf(stderr, "(*error*) Invalid parameter '%s'\n", name );
+		return -1;
+	}
+
+	if ( p -> string ) {
+		if ( value[0] == 0 || strlen( value ) >= sizeof( p -> str ) ) {
+			fprintf(stderr, "(*error*) Invalid value '%s' for parameter '%s'\n", value, name );
+			return -1;
+		}
+		strcpy( p -> str, value );
+		p -> set = 1;
+		return 0;
+	}
+
+	double v;
+	if ( p -> keys ) {
+		// Keyword parameter, the value is the index of the keyword
+		int k = 0;
+		while( p -> keys[k] && strcmp( p -> keys[k], value ) ) k++;
+		if ( ! p -> keys[k] ) {
+			fprintf(stderr, "(*error*) Invalid value '%s' for parameter '%s', must be one of", value, name );
+			for( k = 0; p -> keys[k]; k++ ) fprintf(stderr, " %s", p -> keys[k] );
+			fprintf(stderr, "\n");
+			return -1;
+		}
+		v = k;
+	} else {
+		char* end;
+		v = p -> integer ? (double) strtol( value, &end, 10 ) : strtod( value, &end );
+		if ( end == value || *end != 0 || v < 0 ) {
+			fprintf(stderr, "(*error*) Invalid value '%s' for parameter '%s'\n", value, name );
+			return -1;
+		}
+	}
+	if ( ( ! strcmp( name, "nx" ) || ! strcmp( name, "ppc" ) ||
+	       ! strcmp( name, "reference" ) || ! strcmp( name, "compare" ) ) && v < 1 ) {
+		fprintf(stderr, "(*error*) Parameter '%s' must be > 0\n", name );
+		return -1;
+	}
+	if ( ! strcmp( name, "shape" ) && ( v < PART_SHAPE_LINEAR || v > PART_SHAPE_CUBIC ) ) {
+		fprintf(stderr, "(*error*) Parameter '%s' must be in the range [%d,%d]\n", name,
+			PART_SHAPE_LINEAR, PART_SHAPE_CUBIC );
+		return -1;
+	}
+	if ( ! strcmp( name, "layout" ) && v > PART_COMPACT ) {
+		fprintf(stderr, "(*error*) Parameter '%s' must be in the range [%d,%d]\n", name,
+			PART_AOS, PART_COMPACT );
+		return -1;
+	}
+	if ( ! strcmp( name, "tasks" ) && v > 1 ) {
+		fprintf(stderr, "(*error*) Parameter '%s' must be 0 or 1\n", name );
+		return -1;
+	}
+
+	p -> set = 1;
+	p -> value = v;
+	return 0;
+}
+
+/**
+ * @brief Sets a parameter override from a "name=value" string
+ * 
+ * Whitespace around the name and the value is ignored.
+ * 
+ * @param str 	Parameter string
+ * @return 		Returns 0 on success, -1 on error
+ */
+int sim_set_param_str( const char* str )
+{
+	char buf[256];
+	strncpy( buf, str, sizeof(buf) - 1 );
+	buf[ sizeof(buf) - 1 ] = 0;
+
+	char* eq = strchr( buf, '=' );
+	if ( ! eq ) {
+		fprintf(stderr, "(*error*) Invalid parameter '%s', must be name=value\n", str );
+		return -1;
+	}
+	*eq = 0;
+
+	// Trim whitespace
+	char* name = buf;
+	char* value = eq + 1;
+	while( isspace( (unsigned char) *name ) ) name++;
+	while( isspace( (unsigned char) *value ) ) value++;
+	for( char* c = eq - 1; c >= name && isspace( (unsigned char) *c ); c-- ) *c = 0;
+	for( char* c = value + strlen( value ) - 1; c >= value && isspace( (unsigned char) *c ); c-- ) *c = 0;
+
+	return sim_set_param( name, value );
+}
+
+/**
+ * @brief Reads parameter overrides from a configuration file
+ * 
+ * The file holds one "name = value" pair per line, empty lines and anything
+ * after a '#' character are ignored, e.g.:
+ * 
+ *     # Weak scaling run
+ *     nx   = 8000
+ *     ppc  = 64
+ *     tmax = 10.0
+ * 
+ * @param filename 	Configuration file name
+ * @return 			Returns 0 on success, -1 on error
+ */
+int sim_read_params( const char* filename )
+{
+	FILE* fp = fopen( filename, "r" );
+	if ( ! fp ) {
+		fprintf(stderr, "(*error*) Unable to open configuration file %s\n", filename );
+		return -1;
+	}
+
+	char line[256];
+	int ln = 0;
+	int ierr = 0;
+	while( fgets( line, sizeof( line ), fp ) ) {
+		ln++;
+
+		// Remove comments and skip empty lines
+		char* c = strchr( line, '#' );
+		if ( c ) *c = 0;
+		for( c = line; isspace( (unsigned char) *c ); c++ );
+		if ( *c == 0 ) continue;
+
+		if ( sim_set_param_str( c ) ) {
+			fprintf(stderr, "(*error*) %s:%d\n", filename, ln );
+			ierr = -1;
+			break;
+		}
+	}
+
+	fclose( fp );
+	return ierr;
+}
+
+/**
+ * @brief Gets the value of an integer parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value (used if the parameter was not overridden)
+ * @return 			Parameter value
+ */
+int sim_param_int( const char* name, int value )
+{
+	const t_sim_param* p = sim_param_find( name );
+	return ( p && p -> set ) ? (int) p -> value : value;
+}
+
+/**
+ * @brief Gets the value of a floating point parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value (used if the parameter was not overridden)
+ * @return 			Parameter value
+ */
+float sim_param_float( const char* name, float value )
+{
+	const t_sim_param* p = sim_param_find( name );
+	return ( p && p -> set ) ? (float) p -> value : value;
+}
+
+/**
+ * @brief Gets the value of a string parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value (used if the parameter was not overridden)
+ * @return 			Parameter value, overridden values remain valid until the
+ * 					end of the program
+ */
+const char* sim_param_string( const char* name, const char* value )
+{
+	const t_sim_param* p = sim_param_find( name );
+	return ( p && p -> set ) ? p -> str : value;
+}
+
+/**
+ * @brief Applies the "nx" override to the simulation grid
+ * 
+ * The cell size is kept constant, so the box size is scaled by the same
+ * factor as the number of cells. This keeps the time step valid and the
+ * physical resolution unchanged (e.g. weak scaling studies).
+ * 
+ * @param nx 	(in/out) Number of cells
+ * @param box 	(in/out) Simulation box size
+ */
+void sim_param_grid( int* nx, float* box )
+{
+	const int new_nx = sim_param_int( "nx", *nx );
+	if ( new_nx != *nx ) {
+		*box *= (float) new_nx / *nx;
+		*nx = new_nx;
+	}
+}
+
+/**
+ * @brief Prints the list of parameters that have been overridden
+ * 
+ * @param fp 	Output stream
+ */
+void sim_print_params( FILE* fp )
+{
+	for( int i = 0; i < n_sim_params; i++ ) {
+		if ( ! sim_params[i].set ) continue;
+		if ( sim_params[i].string ) fprintf( fp, "Parameter override: %s = %s\n",
+			sim_params[i].name, sim_params[i].str );
+		else if ( sim_params[i].keys ) fprintf( fp, "Parameter override: %s = %s\n",
+			sim_params[i].name, sim_params[i].keys[ (int) sim_params[i].value ] );
+		else fprintf( fp, "Parameter override: %s = %g\n",
+			sim_params[i].name, sim_params[i].value );
+	}
+}
+
 /**
  * @brief Advance simulation 1 iteration
  * 
  * A complete iteration consists of:
+ * 0. Running in-situ diagnostics that are due (see `sim_add_insitu()`)
  * 1. Zeroing current density
- * 2. Advancing particle species and depositing electric current
+ * 2. Advancing particle species and depositing electric current, one species
+ *    at a time or all species concurrently (see `sim_set_task_advance()`)
  * 3. Updating electric current boundary
  * 4. Advancing the EM fields
  * 
+ * If called from inside a parallel region (see `sim_set_omp_persistent()`)
+ * it must be called by all threads of the region; each step then uses the
+ * threads of the enclosing region instead of opening a new one.
+ * 
  * @param sim 	EM1D Simulation
  */
 void sim_iter( t_simulation* sim ) {
+	// In-situ diagnostics
+	insitu_run( sim -> insitu, sim -> n_insitu, &sim -> emf, sim -> species );
+
 	// Advance particles and deposit current
 	current_zero( &sim -> current );
-	for (int i = 0; i<sim -> n_species; i++)
-		spec_advance(&sim -> species[i], &sim -> emf, &sim -> current );
+	if ( sim -> task_advance ) {
+		spec_advance_tasks( sim -> species, sim -> n_species, &sim -> emf, &sim -> current );
+	} else {
+		for (int i = 0; i<sim -> n_species; i++)
+			spec_advance(&sim -> species[i], &sim -> emf, &sim -> current );
+	}
 
 	// Update current boundary conditions and advance iteration
 	current_update( &sim -> current );
@@ -58,12 +388,18 @@ void sim_iter( t_simulation* sim ) {
 /**
  * @brief Prints out report on simulation timings
  * 
+ * When using domain decomposition only the timings of the root domain are
+ * reported.
+ * 
  * @param sim 	EM1D Simulaiton
  * @param t0 	Simulation start time (ticks)
  * @param t1 	Simulation end time (ticks)
  */
 void sim_timings( t_simulation* sim, uint64_t t0, uint64_t t1 ){
 
+	// Only the root domain reports timings
+	if ( ! domain_root() ) return;
+
 	fprintf(stderr, "Time for spec. advance = %f s\n", spec_time());
 	fprintf(stderr, "Time for emf   advance = %f s\n", emf_time());
 	fprintf(stderr, "Total simulation time  = %f s\n", timer_interval_seconds(t0, t1));
@@ -74,11 +410,69 @@ void sim_timings( t_simulation* sim, uint64_t t0, uint64_t t1 ){
 		fprintf(stderr, "Particle advance [nsec/part] = %f \n", 1.e9*perf);
 		fprintf(stderr, "Particle advance [Mpart/sec] = %f \n", 1.e-6/perf);
 	}
+	fprintf(stderr, "\n");
+
+	// Tile load imbalance
+	int tiles = 0;
+	for (int i = 0; i < sim -> n_species; i++) {
+		const double imb = spec_tile_imbalance( &sim -> species[i] );
+		if ( imb > 0 ) {
+			fprintf(stderr, "Tile load imbalance (max/avg), %s = %f%s\n", sim -> species[i].name,
+				imb, sim -> species[i].tile_lb ? " (balanced)" : "" );
+			tiles = 1;
+		}
+	}
+	if ( tiles ) fprintf(stderr, "\n");
+
+	// Automatic sort frequency
+	int sort_auto = 0;
+	for (int i = 0; i < sim -> n_species; i++) {
+		const t_species* spec = &sim -> species[i];
+		if ( spec -> sort_auto && ! spec -> deterministic ) {
+			if ( spec -> sort_count > 0 )
+				fprintf(stderr, "Sort interval (auto), %s = %.1f iterations (%d sorts)\n", spec -> name,
+					spec_sort_interval( spec ), spec -> sort_count );
+			else
+				fprintf(stderr, "Sort interval (auto), %s = not sorted\n", spec -> name );
+			sort_auto = 1;
+		}
+	}
+	if ( sort_auto ) fprintf(stderr, "\n");
+
+	// Per phase / per thread breakdown
+	timer_phase_report( stderr );
+	if ( sim -> timing_dump ) {
+		if ( ! timer_phase_dump( sim -> timing_dump, timer_interval_seconds(t0, t1) ) )
+			fprintf(stderr, "Phase timings saved to %s\n", sim -> timing_dump );
+	}
+}
+
+/**
+ * @brief Sets a file for saving the per phase / per thread timings at the end of the simulation
+ * 
+ * Timings are saved by `sim_timings()`. If the filename ends in ".json" the
+ * data is saved as a JSON object, otherwise it is saved in CSV format. The
+ * filename string is not copied and must remain valid until then.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param filename 	Output file name, set to NULL to disable
+ */
+void sim_set_timing_dump( t_simulation* sim, const char* filename ){
+	sim -> timing_dump = filename;
 }
 
 /**
  * @brief Initialize simulation object
  * 
+ * The `tmax`, `ndump`, species sort frequency, tiling, particle shape,
+ * particle buffer layout, current deposition, persistent parallel region,
+ * task advance, checkpoint frequency, deterministic advance, bitwise
+ * comparison, grid diagnostic series and timing output file values may be
+ * overridden at runtime, see `sim_set_param()`. The number of guard cells of the EM
+ * field and current grids is set from the highest order particle shape in
+ * use, so species shapes must be set (see `spec_set_shape()`) before
+ * calling this routine.
+ * 
  * @param sim 			EM1D Simulation
  * @param nx 			Number of grid points
  * @param box 			Simulation box size in simulation units
@@ -91,16 +485,78 @@ void sim_timings( t_simulation* sim, uint64_t t0, uint64_t t1 ){
  */
 void sim_new( t_simulation* sim, int nx, float box, float dt, float tmax, int ndump, t_species* species, int n_species ){
 
+	// Runtime overrides
+	tmax  = sim_param_float( "tmax", tmax );
+	ndump = sim_param_int( "ndump", ndump );
+
 	sim -> dt = dt;
 	sim -> tmax = tmax;
 	sim -> ndump = ndump;
 
-	emf_new( &sim -> emf, nx, box, dt );
-	current_new(&sim -> current, nx, box, dt);
+	// Particle shape overrides, grids need guard cells for the highest order shape
+	int order = PART_SHAPE_LINEAR;
+	for( int i = 0; i < n_species; i++ ) {
+		spec_set_shape( &species[i], sim_param_int( "shape", species[i].shape ) );
+		if ( (int) species[i].shape > order ) order = species[i].shape;
+	}
+
+	emf_new( &sim -> emf, nx, box, dt, order );
+	current_new(&sim -> current, nx, box, dt, order);
+
+	const int dep_type = sim_param_int( "deposit", sim -> current.dep_type );
+	if ( dep_type != (int) sim -> current.dep_type )
+		sim_set_current_deposit( sim, (enum current_deposit) dep_type );
 
 	sim -> n_species = n_species;
 	sim -> species = species;
 
+	// Sort frequency, tiling and layout overrides
+	for( int i = 0; i < n_species; i++ ) {
+		species[i].n_sort = sim_param_int( "n_sort", species[i].n_sort );
+		if ( sim_param_int( "sort_auto", species[i].sort_auto ) != species[i].sort_auto )
+			spec_set_sort_auto( &species[i], ! species[i].sort_auto );
+
+		spec_set_layout( &species[i], sim_param_int( "layout", species[i].layout ) );
+
+		const int tile_lb = sim_param_int( "tile_lb", species[i].tile_lb );
+		if ( tile_lb != species[i].tile_lb ) spec_set_tile_balance( &species[i], tile_lb );
+
+		const int tile_nx = sim_param_int( "tile_nx", species[i].tile_nx );
+		if ( tile_nx != species[i].tile_nx ) spec_set_tiles( &species[i], tile_nx );
+	}
+
+	// Each step opens its own parallel region by default
+	sim_set_omp_persistent( sim, sim_param_int( "persistent", 0 ) );
+
+	// Species are advanced one at a time by default
+	sim -> task_advance = 0;
+	if ( sim_param_int( "tasks", 0 ) ) sim_set_task_advance( sim, 1 );
+
+	// Checkpoints are disabled by default
+	sim -> n_checkpoint = -1;
+	const int n_checkpoint = sim_param_int( "checkpoint", -1 );
+	if ( n_checkpoint >= 0 ) sim_set_checkpoint( sim, n_checkpoint );
+
+	// Results may depend on the number of threads by default
+	if ( sim_param_int( "deterministic", 0 ) ) sim_set_deterministic( sim, 1 );
+
+	// No bitwise comparison with a reference state
+	sim_set_diff( sim, sim_param_int( "reference", -1 ), sim_param_int( "compare", -1 ) );
+	sim -> diff_count = 0;
+
+	// No in-situ diagnostics
+	sim -> n_insitu = 0;
+	sim -> insitu = NULL;
+
+	// No timing output file by default
+	sim_set_timing_dump( sim, sim_param_string( "timing", NULL ) );
+
+	// Diagnostic files are written by a background thread by default
+	if ( ndump > 0 ) sim_set_async_diag( sim, 2 );
+
+	// Grid diagnostics are saved one file per iteration by default
+	if ( sim_param_int( "series", 0 ) ) sim_set_diag_series( sim, 1 );
+
 	// Check time step
 	float cour = sim->emf.dx;
 	if ( dt >= cour ){
@@ -123,6 +579,33 @@ void sim_add_laser( t_simulation* sim,  t_emf_laser* laser ){
 	emf_add_laser( &sim->emf, laser );
 }
 
+/**
+ * @brief Adds an in-situ diagnostic to the simulation
+ * 
+ * In-situ diagnostics are computed in parallel at the start of `sim_iter()`
+ * every `diag->n_iter` iterations and appended to a time series file in the
+ * "INSITU" directory. The diagnostic parameters are copied, see `t_insitu`
+ * for details.
+ * 
+ * @param sim 		EM1D simulation
+ * @param diag 		In-situ diagnostic parameters
+ */
+void sim_add_insitu( t_simulation* sim, t_insitu* diag ){
+
+	const int part_diag = ( diag -> type == INSITU_ENERGY_HIST || diag -> type == INSITU_MOMENTS );
+	if ( part_diag && ( diag -> species < 0 || diag -> species >= sim -> n_species ) ) {
+		fprintf(stderr, "(*error*) Invalid species for in-situ diagnostic %s\n", diag -> name );
+		exit(-1);
+	}
+	if ( diag -> species >= sim -> n_species ) diag -> species = -1;
+
+	sim -> insitu = realloc( sim -> insitu, ( sim -> n_insitu + 1 ) * sizeof( t_insitu ) );
+	t_insitu* d = &sim -> insitu[ sim -> n_insitu++ ];
+	*d = *diag;
+
+	insitu_new( d, &sim -> emf, ( d -> species >= 0 ) ? &sim -> species[ d -> species ] : NULL );
+}
+
 /**
  * @brief Sets external EM fields for the simulation
  * 
@@ -151,6 +634,188 @@ void sim_set_smooth( t_simulation* sim,  t_smooth* smooth ){
 	sim -> current.smooth = *smooth;
 }
 
+/**
+ * @brief Sets the electric current deposition type
+ * 
+ * When using `CURRENT_DEP_PRIVATE` each thread deposits current on a private
+ * copy of the grid, avoiding atomic operations; the private copies are added
+ * together in `current_update()`. This must come after `sim_new()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param dep_type 	Type of current deposition
+ */
+void sim_set_current_deposit( t_simulation* sim, enum current_deposit dep_type ){
+	current_set_deposit( &sim -> current, dep_type );
+}
+
+/**
+ * @brief Sets the automatic sort frequency of all species
+ * 
+ * When enabled, particles are sorted only when the push time expected to be
+ * saved outweighs the cost of sorting, instead of every `n_sort`
+ * iterations, see `spec_set_sort_auto()`. The resulting sort interval is
+ * reported by `sim_timings()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_sort_auto( t_simulation* sim, int enable ){
+	for (int i = 0; i < sim -> n_species; i++)
+		spec_set_sort_auto( &sim -> species[i], enable );
+}
+
+/**
+ * @brief Sets the tile size for the tiled particle advance of all species
+ * 
+ * Tiles are groups of `tile_nx` cells; particles are advanced one tile at a
+ * time using tile local copies of the EM fields and electric current. Tile
+ * boundaries are updated whenever the particles are sorted, so a sorting
+ * frequency (`n_sort`) > 0 should be used. This must come after `sim_new()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param tile_nx 	Tile size in cells, set to 0 to disable tiling
+ */
+void sim_set_tiles( t_simulation* sim, int tile_nx ){
+	for (int i = 0; i < sim -> n_species; i++)
+		spec_set_tiles( &sim -> species[i], tile_nx );
+}
+
+/**
+ * @brief Enables / disables dynamic load balancing of the tiles of all species
+ * 
+ * Tile boundaries are moved whenever the particles are sorted so that all
+ * tiles hold approximately the same number of particles (see
+ * `spec_set_tile_balance()`), which helps when the plasma fills only part of
+ * the box, e.g. moving window simulations with injected plasma. The average
+ * tile load imbalance is printed by `sim_timings()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_tile_balance( t_simulation* sim, int enable ){
+	for (int i = 0; i < sim -> n_species; i++)
+		spec_set_tile_balance( &sim -> species[i], enable );
+}
+
+/**
+ * @brief Sets the particle buffer memory layout of all species
+ * 
+ * The `PART_SOA` layout stores each particle quantity in a separate aligned
+ * array, allowing the particle push to be vectorized. The `PART_COMPACT`
+ * layout also stores positions in reduced precision, lowering the memory
+ * traffic of the particle push. This must come after `sim_new()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param layout 	Particle buffer memory layout
+ */
+void sim_set_part_layout( t_simulation* sim, enum part_layout layout ){
+	for (int i = 0; i < sim -> n_species; i++)
+		spec_set_layout( &sim -> species[i], layout );
+}
+
+/**
+ * @brief Sets the use of a single OpenMP parallel region for the whole time loop
+ * 
+ * When enabled the main time loop runs inside a single parallel region,
+ * and `sim_iter()` is called by all threads; the simulation steps use
+ * orphaned worksharing constructs and barriers instead of opening (and
+ * closing) one parallel region for each step. Diagnostics and other
+ * serial code in the time loop must be run by a single thread.
+ * 
+ * @param sim 			EM1D Simulation
+ * @param persistent 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_omp_persistent( t_simulation* sim, int persistent ){
+	sim -> omp_persistent = persistent;
+}
+
+/**
+ * @brief Sets the concurrent (task parallel) advance of all particle species
+ * 
+ * When enabled the particle push of all species is done in a single OpenMP
+ * task parallel region, see `spec_advance_tasks()`, instead of one species
+ * after the other. This helps simulations with several species of very
+ * different sizes, where small species do not have enough work to keep all
+ * threads busy. Enabling this also selects private current deposition (see
+ * `sim_set_current_deposit()`), so that tasks never update the same grid.
+ * This must come after `sim_new()`.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_task_advance( t_simulation* sim, int enable ){
+	sim -> task_advance = enable;
+	if ( enable && sim -> current.dep_type != CURRENT_DEP_PRIVATE )
+		current_set_deposit( &sim -> current, CURRENT_DEP_PRIVATE );
+}
+
+/**
+ * @brief Sets the deterministic (reproducible) particle advance of all species
+ * 
+ * When enabled, results (fields, particles and energies) are bitwise
+ * identical for any number of threads and from run to run, at some cost in
+ * performance, see `emf_set_deterministic()` and `spec_set_deterministic()`.
+ * The automatic sort frequency (see `sim_set_sort_auto()`) is not used, the
+ * particles are sorted every `n_sort` iterations.
+ * This is meant for validating new kernels and for performance comparisons,
+ * where the energy conservation check must not change between runs. This
+ * also holds for task parallel advance (see `sim_set_task_advance()`).
+ * Results still depend on the number of domains when using domain
+ * decomposition.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_deterministic( t_simulation* sim, int enable ){
+	emf_set_deterministic( &sim -> emf, enable );
+	for( int i = 0; i < sim -> n_species; i++ )
+		spec_set_deterministic( &sim -> species[i], enable );
+}
+
+/**
+ * @brief Sets the use of a background thread for writing diagnostic files
+ * 
+ * When enabled, the report functions only copy the diagnostic data into a
+ * pooled buffer and queue it for writing, so that file I/O overlaps with the
+ * simulation. At most `queue_size` files may be waiting to be written, further
+ * reports will block until the writer catches up. Enabled by default (with
+ * `queue_size = 2`) by `sim_new()` when `ndump > 0`.
+ * 
+ * @param sim 			EM1D Simulation
+ * @param queue_size 	Maximum number of files waiting to be written, set to 0 to
+ * 						disable (diagnostic files are then written synchronously)
+ */
+void sim_set_async_diag( t_simulation* sim, int queue_size ){
+
+	(void) sim;
+
+	// Stop (and flush) any running writer so that the new setting takes effect
+	zdf_async_stop();
+
+	if ( queue_size > 0 ) {
+		if ( ! zdf_async_start( queue_size ) ) {
+			fprintf(stderr, "(*warning*) Unable to start diagnostic writer thread, using synchronous writes\n");
+		}
+	}
+}
+
+/**
+ * @brief Sets the use of single file time series for grid diagnostics
+ * 
+ * When enabled, each grid diagnostic (EM fields, current, charge density and
+ * phasespaces) is saved to a single "path/name.zdf" file, with each report
+ * appended as a new chunk, instead of one file per iteration. The files
+ * include an iteration index (see `zdf_close_grid_series()`) and are closed
+ * in `sim_delete()`. Particle data is still saved one file per iteration.
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_diag_series( t_simulation* sim, int enable ){
+	(void) sim;
+	zdf_set_grid_series_mode( enable );
+}
+
 /**
  * @brief Sets a moving window algorithm for the simulation
  * 
@@ -160,7 +825,7 @@ void sim_set_moving_window( t_simulation* sim ){
 
 	// Set moving window flag and disable boundary conditions
 	// for EM fields
-	sim -> emf.moving_window = 1;
+	emf_set_moving_window( &sim -> emf );
     sim -> emf.bc_type = EMF_BC_NONE;
 
 	// Disable boundary conditions for electric current
@@ -174,6 +839,8 @@ void sim_set_moving_window( t_simulation* sim ){
 /**
  * @brief Print report on simulation energy (fields/particles/total)
  * 
+ * When using domain decomposition this must be called by all domains.
+ * 
  * @param sim 	EM1D Simulation
  */
 void sim_report_energy( t_simulation* sim )
@@ -195,6 +862,13 @@ void sim_report_energy( t_simulation* sim )
 		tot_part += part_energy[i];
 	}
 
+	// Add energy from all domains
+	if ( domain_size() > 1 ) {
+		double tot[2] = { tot_emf, tot_part };
+		domain_allreduce( tot, 2 );
+		tot_emf = tot[0]; tot_part = tot[1];
+	}
+
 	printf("Energy (fields | particles | total) = %e %e %e\n",
 		tot_emf, tot_part, tot_emf+tot_part);
 
@@ -203,6 +877,8 @@ void sim_report_energy( t_simulation* sim )
 /**
  * @brief Print report on simulation energy (fields/particles/total)
  * 
+ * When using domain decomposition this must be called by all domains.
+ * 
  * @param sim 	EM1D Simulation
  */
 void sim_report_energy_ret( t_simulation* sim, double* energy )
@@ -223,6 +899,13 @@ void sim_report_energy_ret( t_simulation* sim, double* energy )
 		part_energy[i] = sim -> species[i].energy;
 		tot_part += part_energy[i];
 	}
+
+	// Add energy from all domains
+	if ( domain_size() > 1 ) {
+		double tot[2] = { tot_emf, tot_part };
+		domain_allreduce( tot, 2 );
+		tot_emf = tot[0]; tot_part = tot[1];
+	}
     energy[0]=tot_emf+tot_part; 	
 }
 
@@ -233,6 +916,12 @@ void sim_report_energy_ret( t_simulation* sim, double* energy )
  */
 void sim_delete( t_simulation* sim ) {
 
+	// Finish writing any pending diagnostic files
+	zdf_finalize();
+
+	for (int i = 0; i < sim->n_insitu; i++) insitu_delete( &sim->insitu[i] );
+	free( sim->insitu );
+
 	for (int i = 0; i<sim->n_species; i++) spec_delete( &sim->species[i] );
 
 	free( sim->species );
@@ -241,3 +930,277 @@ void sim_delete( t_simulation* sim ) {
 	emf_delete( &sim->emf );
 
 }
+
+/*********************************************************************************************
+
+ Checkpoint / Restart
+
+ *********************************************************************************************/
+
+/// Checkpoint requested by a signal (SIGUSR1)
+static volatile sig_atomic_t _sim_ckp_signal = 0;
+
+/// Checkpoint and stop requested by a signal (SIGTERM)
+static volatile sig_atomic_t _sim_stop_signal = 0;
+
+/**
+ * @brief Signal handler, flags a checkpoint request
+ * 
+ * @param sig 	Signal number
+ */
+static void sim_signal_handler( int sig )
+{
+	if ( sig == SIGTERM ) _sim_stop_signal = 1;
+	else _sim_ckp_signal = 1;
+}
+
+/**
+ * @brief Sets the checkpoint frequency
+ * 
+ * A checkpoint is written every `n_checkpoint` iterations (see
+ * `sim_checkpoint_step()`). Checkpoints may also be requested by sending
+ * the process a signal: SIGUSR1 writes a checkpoint at the end of the current
+ * iteration, SIGTERM (e.g. job preemption) also stops the simulation after
+ * the checkpoint is written. The signal handlers are installed by this routine.
+ * 
+ * @param sim 			EM1D Simulation
+ * @param n_checkpoint 	Number of iterations between checkpoints, set to 0 for
+ * 						checkpoints on signals only, or to -1 to disable
+ */
+void sim_set_checkpoint( t_simulation* sim, int n_checkpoint ){
+	sim -> n_checkpoint = n_checkpoint;
+
+	if ( n_checkpoint >= 0 ) {
+		signal( SIGUSR1, sim_signal_handler );
+		signal( SIGTERM, sim_signal_handler );
+	}
+}
+
+/**
+ * @brief Writes the simulation state to the checkpoint file of the local domain
+ * 
+ * The routine aborts the code if the file cannot be written.
+ * 
+ * @param sim 	EM1D Simulation
+ * @param path 	Checkpoint directory
+ */
+static void sim_write_state( t_simulation* sim, const char* path ){
+
+	const int n = sim -> emf.iter;
+
+	t_zdf_iteration iter = {
+		.name = "ITERATION",
+		.n = n,
+		.t = n * sim -> dt,
+		.time_units = "1/\\omega_p"
+	};
+
+	t_rand_state rnd;
+	rand_get_state( &rnd );
+	const uint32_t rnd_state[] = { rnd.m_w, rnd.m_z, rnd.iset };
+
+	const int32_t state[] = { n, sim -> n_species, domain_size() };
+
+	t_zdf_file zdf;
+	int ok = checkpoint_open( &zdf, path, &iter ) &&
+		checkpoint_write( &zdf, "SIM.state", zdf_int32, state, 3, 0, 3 ) &&
+		checkpoint_write( &zdf, "RAND.state", zdf_uint32, rnd_state, 3, 0, 3 ) &&
+		checkpoint_write( &zdf, "RAND.gset", zdf_float64, &rnd.gset, 1, 0, 1 ) &&
+		emf_checkpoint( &sim -> emf, &zdf ) &&
+		current_checkpoint( &sim -> current, &zdf );
+
+	for( int i = 0; i < sim -> n_species; i++ )
+		ok = spec_checkpoint( &sim -> species[i], &zdf ) && ok;
+
+	if ( ! ok || ! checkpoint_close( &zdf ) ) {
+		fprintf(stderr, "(*error*) Unable to write checkpoint file, aborting.\n" );
+		exit(-1);
+	}
+}
+
+/**
+ * @brief Writes a checkpoint of the simulation state
+ * 
+ * The checkpoint holds the EM fields, current density and particles (see
+ * `emf_checkpoint()`, `current_checkpoint()` and `spec_checkpoint()`), the
+ * iteration number and the state of the random number generator. Each domain
+ * writes its own file in directory CHECKPOINT_PATH, replacing the previous
+ * checkpoint once the new one is complete. In-situ diagnostics are not
+ * stored.
+ * 
+ * When using domain decomposition this must be called by all domains.
+ * 
+ * @param sim 	EM1D Simulation
+ */
+void sim_checkpoint( t_simulation* sim ){
+
+	const uint64_t t0 = timer_ticks();
+	const int n = sim -> emf.iter;
+
+	sim_write_state( sim, CHECKPOINT_PATH );
+
+	timer_phase_add( TIMER_DIAG, timer_ticks() - t0 );
+
+	if ( domain_root() ) printf("Checkpoint written, n = %d, t = %f\n", n, n * sim -> dt );
+}
+
+/**
+ * @brief Writes a checkpoint if one is due
+ * 
+ * To be called at the end of each iteration (after `sim_iter()`), by a
+ * single thread. A checkpoint is written every `n_checkpoint` iterations
+ * or when requested by a signal, see `sim_set_checkpoint()`. When using
+ * domain decomposition the signal requests of all domains are combined, so
+ * that all domains write the checkpoint at the same iteration; this must then
+ * be called by all domains.
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		1 if the simulation should stop (SIGTERM received), 0 otherwise
+ */
+int sim_checkpoint_step( t_simulation* sim ){
+
+	if ( sim -> n_checkpoint < 0 ) return 0;
+
+	double req[2] = { _sim_ckp_signal, _sim_stop_signal };
+	if ( domain_size() > 1 ) domain_allreduce( req, 2 );
+
+	const int stop = ( req[1] > 0 );
+	const int due  = ( sim -> n_checkpoint > 0 ) && ! ( sim -> emf.iter % sim -> n_checkpoint );
+
+	if ( stop || due || req[0] > 0 ) {
+		_sim_ckp_signal = 0;
+		sim_checkpoint( sim );
+	}
+
+	return stop;
+}
+
+/**
+ * @brief Restores the simulation state from the last checkpoint
+ * 
+ * Must be called after the simulation has been initialized (i.e. after the
+ * input deck `sim_init()` routine), with the same input deck and parameters,
+ * and with the same number of domains used to write the checkpoint. The
+ * checkpoint file of each domain is mapped into memory and all buffers are
+ * copied directly from it. The routine aborts the code if the checkpoint is
+ * missing or does not match the simulation.
+ * 
+ * When using domain decomposition this must be called by all domains.
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		Iteration number of the checkpoint, i.e. the first iteration
+ * 				to be run
+ */
+int sim_restart( t_simulation* sim ){
+
+	t_zdf_map map;
+	if ( ! checkpoint_map( &map, CHECKPOINT_PATH ) ) {
+		fprintf(stderr, "(*error*) Unable to open checkpoint file, aborting.\n" );
+		exit(-1);
+	}
+
+	int32_t state[3];
+	memcpy( state, checkpoint_read( &map, "SIM.state", zdf_int32, 3 ), sizeof( state ) );
+	if ( state[1] != sim -> n_species || state[2] != domain_size() ) {
+		fprintf(stderr, "(*error*) Checkpoint does not match the simulation (%d species, %d domains), aborting.\n",
+			state[1], state[2] );
+		exit(-1);
+	}
+
+	// All domains must restart from the same iteration (zero variance)
+	double n[2] = { state[0], (double) state[0] * state[0] };
+	if ( domain_size() > 1 ) domain_allreduce( n, 2 );
+	if ( n[0] * n[0] != domain_size() * n[1] ) {
+		fprintf(stderr, "(*error*) Checkpoint files of different iterations, aborting.\n" );
+		exit(-1);
+	}
+
+	uint32_t rnd_state[3];
+	memcpy( rnd_state, checkpoint_read( &map, "RAND.state", zdf_uint32, 3 ), sizeof( rnd_state ) );
+	t_rand_state rnd = { .m_w = rnd_state[0], .m_z = rnd_state[1], .iset = rnd_state[2] };
+	memcpy( &rnd.gset, checkpoint_read( &map, "RAND.gset", zdf_float64, 1 ), sizeof( double ) );
+	rand_set_state( &rnd );
+
+	emf_restart( &sim -> emf, &map );
+	current_restart( &sim -> current, &map );
+	for( int i = 0; i < sim -> n_species; i++ )
+		spec_restart( &sim -> species[i], &map );
+
+	zdf_map_close( &map );
+
+	if ( domain_root() ) printf("Restarting from checkpoint, n = %d, t = %f\n", state[0], state[0] * sim -> dt );
+
+	return state[0];
+}
+
+/**
+ * @brief Sets the bitwise comparison of the simulation state with a reference run
+ * 
+ * This is a test harness for new (candidate) kernels. The reference run
+ * saves its state after `n_reference` iterations, in the checkpoint format
+ * (directory CHECKPOINT_REF_PATH), and stops. The candidate run, using the
+ * same input deck and parameters, saves its state after `n_compare`
+ * iterations (directory CHECKPOINT_CAND_PATH), compares it value by value
+ * with the reference state and stops, see `sim_diff_step()`. Particle data
+ * is compared in the native buffer layout and order, and to get comparable
+ * results for different numbers of threads both runs should use the
+ * deterministic advance (see `sim_set_deterministic()`).
+ * 
+ * @param sim 			EM1D Simulation
+ * @param n_reference 	Iteration at which the reference state is saved, -1 to disable
+ * @param n_compare 	Iteration at which the state is compared with the reference, -1 to disable
+ */
+void sim_set_diff( t_simulation* sim, int n_reference, int n_compare ){
+	sim -> n_reference = n_reference;
+	sim -> n_compare = n_compare;
+}
+
+/**
+ * @brief Saves or compares the simulation state with the reference state, if due
+ * 
+ * To be called at the end of each iteration (after `sim_iter()`), by a
+ * single thread, see `sim_set_diff()`. Datasets that differ are reported,
+ * and the total number of differing datasets (all domains) is stored in
+ * `sim -> diff_count`. When using domain decomposition this must be called
+ * by all domains.
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		1 if the simulation should stop (state saved or compared), 0 otherwise
+ */
+int sim_diff_step( t_simulation* sim ){
+
+	const int n = sim -> emf.iter;
+
+	if ( n == sim -> n_reference ) {
+		sim_write_state( sim, CHECKPOINT_REF_PATH );
+		if ( domain_root() ) printf("Reference state written, n = %d, t = %f\n", n, n * sim -> dt );
+		return 1;
+	}
+
+	if ( n != sim -> n_compare ) return 0;
+
+	sim_write_state( sim, CHECKPOINT_CAND_PATH );
+
+	t_zdf_map ref, cand;
+	if ( ! checkpoint_map( &ref, CHECKPOINT_REF_PATH ) || ! checkpoint_map( &cand, CHECKPOINT_CAND_PATH ) ) {
+		fprintf(stderr, "(*error*) Unable to open reference state file, aborting.\n" );
+		exit(-1);
+	}
+
+	if ( domain_root() ) printf("Comparing state with reference, n = %d, t = %f\n", n, n * sim -> dt );
+
+	// Standard output is only available on the root domain
+	double ndiff = checkpoint_compare( &ref, &cand, domain_root() ? stdout : stderr );
+	if ( domain_size() > 1 ) domain_allreduce( &ndiff, 1 );
+	sim -> diff_count = ndiff;
+
+	zdf_map_close( &cand );
+	zdf_map_close( &ref );
+
+	if ( domain_root() ) {
+		if ( sim -> diff_count > 0 ) printf("State differs from reference (%d datasets)\n", sim -> diff_count );
+		else printf("State is bitwise identical to reference\n");
+	}
+
+	return 1;
+}
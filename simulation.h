@@ -2,9 +2,11 @@
 #define __SIMULATION__
 
 #include <stdint.h>
+#include <stdio.h>
 #include "particles.h"
 #include "emf.h"
 #include "current.h"
+#include "insitu.h"
 
 /**
  * @brief EM1D PIC Simulation
@@ -26,14 +28,28 @@ typedef struct Simulation {
 
 	int moving_window;		///< Use moving window
 
+	int omp_persistent;		///< Run the time loop inside a single OpenMP parallel region
+	int task_advance;		///< Push all species concurrently using OpenMP tasks
+
+	int n_checkpoint;		///< Iterations between checkpoints (0 - signals only, -1 - disabled)
+
+	int n_reference;		///< Iteration at which the state is saved as reference (-1 - disabled)
+	int n_compare;			///< Iteration at which the state is compared with the reference (-1 - disabled)
+	int diff_count;			///< Number of datasets that differ from the reference state
+
+	int n_insitu;			///< Number of in-situ diagnostics
+	t_insitu* insitu;		///< In-situ diagnostics
+
+	const char* timing_dump;	///< Phase timings output file (NULL for no output)
+
 } t_simulation;
 
 
 /**
  * @brief Initializes simulation parameters
  * 
- * This routine __MUST__ be supplied by the user, see the `input` directory
- * for examples
+ * This routine __MUST__ be supplied by each input deck, see the `input`
+ * directory for examples. Decks are registered in `input/decks.c`.
  * 
  * @param sim	EM1D simulation 
  */
@@ -42,8 +58,8 @@ void sim_init( t_simulation* sim );
 /**
  * @brief Saves diagnostic information
  *
- * This routine __MUST__ be supplied by the user, see the `input` directory
- * for examples
+ * This routine __MUST__ be supplied by each input deck, see the `input`
+ * directory for examples. Decks are registered in `input/decks.c`.
  * 
  * This routine will be called every `ndump` iterations
  * 
@@ -51,6 +67,73 @@ void sim_init( t_simulation* sim );
  */
 void sim_report( t_simulation* sim );
 
+/**
+ * @brief Overrides a simulation parameter ("nx", "ppc", "tmax", "ndump" or "n_sort")
+ * 
+ * @param name 		Parameter name
+ * @param value 	Parameter value
+ * @return 			Returns 0 on success, -1 on error
+ */
+int sim_set_param( const char* name, const char* value );
+
+/**
+ * @brief Sets a parameter override from a "name=value" string
+ * 
+ * @param str 	Parameter string
+ * @return 		Returns 0 on success, -1 on error
+ */
+int sim_set_param_str( const char* str );
+
+/**
+ * @brief Reads parameter overrides from a configuration file ("name = value" lines)
+ * 
+ * @param filename 	Configuration file name
+ * @return 			Returns 0 on success, -1 on error
+ */
+int sim_read_params( const char* filename );
+
+/**
+ * @brief Gets the value of an integer parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value
+ * @return 			Parameter value
+ */
+int sim_param_int( const char* name, int value );
+
+/**
+ * @brief Gets the value of a floating point parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value
+ * @return 			Parameter value
+ */
+float sim_param_float( const char* name, float value );
+
+/**
+ * @brief Gets the value of a string parameter, accounting for runtime overrides
+ * 
+ * @param name 		Parameter name
+ * @param value 	Default value
+ * @return 			Parameter value
+ */
+const char* sim_param_string( const char* name, const char* value );
+
+/**
+ * @brief Applies the "nx" override to the simulation grid, keeping the cell size
+ * 
+ * @param nx 	(in/out) Number of cells
+ * @param box 	(in/out) Simulation box size
+ */
+void sim_param_grid( int* nx, float* box );
+
+/**
+ * @brief Prints the list of parameters that have been overridden
+ * 
+ * @param fp 	Output stream
+ */
+void sim_print_params( FILE* fp );
+
 /**
  * @brief Advance simulation 1 iteration
  * 
@@ -90,6 +173,14 @@ void sim_new( t_simulation* sim, int nx, float box, float dt, float tmax, int nd
  */
 void sim_timings( t_simulation* sim, uint64_t t0, uint64_t t1 );
 
+/**
+ * @brief Sets a file for saving the per phase / per thread timings at the end of the simulation
+ * 
+ * @param sim 		EM1D Simulation
+ * @param filename 	Output file name (".json" extension for JSON, CSV otherwise), NULL to disable
+ */
+void sim_set_timing_dump( t_simulation* sim, const char* filename );
+
 /**
  * @brief Adds laser pulse to simulation
  * 
@@ -120,6 +211,144 @@ void sim_set_moving_window( t_simulation* sim );
  */
 void sim_set_smooth( t_simulation* sim,  t_smooth* smooth );
 
+/**
+ * @brief Sets the electric current deposition type
+ * 
+ * @param sim 		EM1D Simulation
+ * @param dep_type 	Type of current deposition (atomic or per-thread private buffers)
+ */
+void sim_set_current_deposit( t_simulation* sim, enum current_deposit dep_type );
+
+/**
+ * @brief Sets the automatic sort frequency of all species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_sort_auto( t_simulation* sim, int enable );
+
+/**
+ * @brief Sets the tile size for the tiled particle advance of all species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param tile_nx 	Tile size in cells, set to 0 to disable tiling
+ */
+void sim_set_tiles( t_simulation* sim, int tile_nx );
+
+/**
+ * @brief Enables / disables dynamic load balancing of the tiles of all species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_tile_balance( t_simulation* sim, int enable );
+
+/**
+ * @brief Sets the particle buffer memory layout of all species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param layout 	Particle buffer memory layout
+ */
+void sim_set_part_layout( t_simulation* sim, enum part_layout layout );
+
+/**
+ * @brief Sets the use of a single OpenMP parallel region for the whole time loop
+ * 
+ * @param sim 			EM1D Simulation
+ * @param persistent 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_omp_persistent( t_simulation* sim, int persistent );
+
+/**
+ * @brief Sets the concurrent (task parallel) advance of all particle species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_task_advance( t_simulation* sim, int enable );
+
+/**
+ * @brief Sets the checkpoint frequency
+ * 
+ * @param sim 			EM1D Simulation
+ * @param n_checkpoint 	Number of iterations between checkpoints, set to 0 for
+ * 						checkpoints on signals only, or to -1 to disable
+ */
+void sim_set_checkpoint( t_simulation* sim, int n_checkpoint );
+
+/**
+ * @brief Writes a checkpoint of the simulation state
+ * 
+ * @param sim 	EM1D Simulation
+ */
+void sim_checkpoint( t_simulation* sim );
+
+/**
+ * @brief Writes a checkpoint if one is due
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		1 if the simulation should stop, 0 otherwise
+ */
+int sim_checkpoint_step( t_simulation* sim );
+
+/**
+ * @brief Restores the simulation state from the last checkpoint
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		Iteration number of the checkpoint
+ */
+int sim_restart( t_simulation* sim );
+
+/**
+ * @brief Sets the bitwise comparison of the simulation state with a reference run
+ * 
+ * @param sim 			EM1D Simulation
+ * @param n_reference 	Iteration at which the reference state is saved, -1 to disable
+ * @param n_compare 	Iteration at which the state is compared with the reference, -1 to disable
+ */
+void sim_set_diff( t_simulation* sim, int n_reference, int n_compare );
+
+/**
+ * @brief Saves or compares the simulation state with the reference state, if due
+ * 
+ * @param sim 	EM1D Simulation
+ * @return 		1 if the simulation should stop, 0 otherwise
+ */
+int sim_diff_step( t_simulation* sim );
+
+/**
+ * @brief Sets the deterministic (reproducible) particle advance of all species
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_deterministic( t_simulation* sim, int enable );
+
+/**
+ * @brief Sets the use of a background thread for writing diagnostic files
+ * 
+ * @param sim 			EM1D Simulation
+ * @param queue_size 	Maximum number of files waiting to be written, set to 0 to
+ * 						disable (diagnostic files are then written synchronously)
+ */
+void sim_set_async_diag( t_simulation* sim, int queue_size );
+
+/**
+ * @brief Sets the use of single file time series for grid diagnostics
+ * 
+ * @param sim 		EM1D Simulation
+ * @param enable 	Set to 1 to enable, 0 to disable
+ */
+void sim_set_diag_series( t_simulation* sim, int enable );
+
+/**
+ * @brief Adds an in-situ diagnostic to the simulation
+ * 
+ * @param sim 		EM1D simulation
+ * @param diag 		In-situ diagnostic parameters
+ */
+void sim_add_insitu( t_simulation* sim, t_insitu* diag );
+
 /**
  * @brief Sets external EM fields for the simulation
  * 
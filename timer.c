@@ -9,23 +9,34 @@
  * 
  */
 
+/**
+ * @brief  Use 1993 edition of the POSIX standard (required for clock_gettime)
+ * 
+ */
+#define _POSIX_C_SOURCE 199309L
+
 #include "timer.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <sys/time.h>
+#include <omp.h>
 
 /**
  * @brief Gets current number of timer ticks
  * 
- * This implementation is based on `gettimeofday()`, so ticks correspond
- * to microsseconds since midnight (0 hour), January 1, 1970
+ * This implementation is based on `clock_gettime()` using the monotonic
+ * clock, so ticks correspond to nanosseconds since an arbitrary (fixed)
+ * point in the past
  * 
  * @return Number of timer ticks
  */
 uint64_t timer_ticks( void )
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	return ((uint64_t)tv.tv_sec)*1000000 + (uint64_t)tv.tv_usec;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec)*1000000000 + (uint64_t)ts.tv_nsec;
 }
 
 /**
@@ -37,7 +48,7 @@ uint64_t timer_ticks( void )
  */
 double timer_interval_seconds(uint64_t start, uint64_t end)
 {
-	return (end - start) * 1.0e-6;
+	return (end - start) * 1.0e-9;
 }
 
 /**
@@ -61,24 +72,221 @@ double timer_cpu_seconds( void )
 /**
  * @brief Gets timer resolution in seconds
  * 
- * This implementation is based on `gettimeofday()`, so the minimum
- * resolution value will be 1 microssecond.
- * 
- * Resolution is determined empirically; the routine will do successive
- * calls to `gettimeofday()` until the return time is different
+ * This implementation is based on `clock_getres()` for the clock used by
+ * `timer_ticks()`
  * 
  * @return Timer resolution 
  */
 double timer_resolution( void )
 {
-	struct timeval tv1, tv2;
-	gettimeofday(&tv1, NULL);
-	do {
-		gettimeofday(&tv2, NULL);
-	} while (tv1.tv_usec == tv2.tv_usec);
+	struct timespec ts;
+	clock_getres(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/*********************************************************************************************
+
+ Phase timers
+
+ *********************************************************************************************/
+
+/**
+ * @brief Per thread phase timers, padded to avoid false sharing
+ * 
+ */
+typedef struct PhaseTimers {
+	uint64_t ticks[TIMER_NPHASE];	///< Accumulated ticks for each phase
+	uint64_t calls[TIMER_NPHASE];	///< Number of timed intervals for each phase
+} __attribute__((aligned(64))) t_phase_timers;
+
+/// Phase timers for each thread
+static t_phase_timers _phase_timers[ TIMER_MAX_THREADS ];
+
+/// Phase names (machine readable)
+static const char * const _phase_name[ TIMER_NPHASE ] = {
+	"push", "dep_reduce", "sort", "boundary", "move_window",
+	"current_gc", "smooth", "yee", "mur", "part_fld", "emf_gc", "diag"
+};
+
+/// Phase descriptions
+static const char * const _phase_desc[ TIMER_NPHASE ] = {
+	"Particle push + deposit", "Current reduction", "Particle sort",
+	"Particle boundaries", "Moving window", "Current guard cells",
+	"Current smoothing", "Field solver (Yee)", "Mur boundaries",
+	"Particle fields", "EMF guard cells", "Diagnostics"
+};
+
+/**
+ * @brief Adds a time interval to a phase timer of the calling thread
+ * 
+ * @param phase 	Phase
+ * @param ticks 	Number of ticks to add
+ */
+void timer_phase_add( enum timer_phase phase, uint64_t ticks )
+{
+	int tid = omp_get_thread_num();
+	if ( tid >= TIMER_MAX_THREADS ) tid = TIMER_MAX_THREADS - 1;
+
+	_phase_timers[tid].ticks[phase] += ticks;
+	_phase_timers[tid].calls[phase] ++;
+}
+
+/**
+ * @brief Gets time spent in a phase by a thread
+ * 
+ * @param phase 	Phase
+ * @param tid 		Thread id
+ * @return 			Time in seconds
+ */
+double timer_phase_seconds( enum timer_phase phase, int tid )
+{
+	if ( tid < 0 || tid >= TIMER_MAX_THREADS ) return 0;
+	return timer_interval_seconds( 0, _phase_timers[tid].ticks[phase] );
+}
+
+/**
+ * @brief Gets the phase name
+ * 
+ * @param phase 	Phase
+ * @return 			Phase name
+ */
+const char * timer_phase_name( enum timer_phase phase )
+{
+	return _phase_name[ phase ];
+}
+
+/**
+ * @brief Sets all phase timers to zero
+ * 
+ */
+void timer_phase_reset( void )
+{
+	memset( _phase_timers, 0, sizeof( _phase_timers ) );
+}
+
+/**
+ * @brief Number of threads considered in phase timer reports
+ * 
+ * @return 	Maximum number of OpenMP threads (limited to TIMER_MAX_THREADS)
+ */
+static int phase_nthreads( void )
+{
+	int nthreads = omp_get_max_threads();
+	return ( nthreads > TIMER_MAX_THREADS ) ? TIMER_MAX_THREADS : nthreads;
+}
+
+/**
+ * @brief Gets phase statistics over all threads
+ * 
+ * @param phase 	Phase
+ * @param nthreads 	Number of threads
+ * @param calls 	(out) Total number of timed intervals
+ * @param min 		(out) Minimum time spent by a thread
+ * @param avg 		(out) Average time spent per thread
+ * @param max 		(out) Maximum time spent by a thread
+ */
+static void phase_stats( enum timer_phase phase, int nthreads, uint64_t* calls,
+	double* min, double* avg, double* max )
+{
+	*calls = 0;
+	*min = *max = timer_phase_seconds( phase, 0 );
+	double sum = 0;
+	for( int tid = 0; tid < nthreads; tid++ ) {
+		double t = timer_phase_seconds( phase, tid );
+		*calls += _phase_timers[tid].calls[phase];
+		sum += t;
+		if ( t < *min ) *min = t;
+		if ( t > *max ) *max = t;
+	}
+	*avg = sum / nthreads;
+}
+
+/**
+ * @brief Prints phase timing table
+ * 
+ * For each phase, the table shows the number of timed intervals and the
+ * minimum, average and maximum time spent by each thread. The load imbalance
+ * is given by max / avg - 1; phases run by a single thread will show an
+ * imbalance of (nthreads - 1). A second table shows the total time spent
+ * by each thread in all phases.
+ * 
+ * @param fp 	Output stream
+ */
+void timer_phase_report( FILE* fp )
+{
+	const int nthreads = phase_nthreads();
+
+	fprintf( fp, "Phase timings (%d threads):\n", nthreads );
+	fprintf( fp, "  %-24s %10s %12s %12s %12s %10s\n",
+		"Phase", "Calls", "Min [s]", "Avg [s]", "Max [s]", "Imbalance" );
+
+	for( int p = 0; p < TIMER_NPHASE; p++ ) {
+		uint64_t calls;
+		double min, avg, max;
+		phase_stats( p, nthreads, &calls, &min, &avg, &max );
+		if ( calls == 0 ) continue;
+
+		fprintf( fp, "  %-24s %10llu %12.6f %12.6f %12.6f %9.1f%%\n", _phase_desc[p],
+			(unsigned long long) calls, min, avg, max, ( avg > 0 ) ? 100 * ( max / avg - 1 ) : 0.0 );
+	}
+
+	fprintf( fp, "\n  %-8s %12s\n", "Thread", "Busy [s]" );
+	for( int tid = 0; tid < nthreads; tid++ ) {
+		double busy = 0;
+		for( int p = 0; p < TIMER_NPHASE; p++ ) busy += timer_phase_seconds( p, tid );
+		fprintf( fp, "  %-8d %12.6f\n", tid, busy );
+	}
+	fprintf( fp, "\n" );
+}
+
+/**
+ * @brief Saves phase timers to file
+ * 
+ * If the filename ends in ".json" data is saved as a JSON object, otherwise
+ * it is saved as CSV with one line per phase and thread. In both cases the
+ * per thread times (in seconds) and number of timed intervals are stored for
+ * every phase.
+ * 
+ * @param filename 	Output file name
+ * @param total 	Total simulation time (seconds), stored in the JSON output
+ * @return 			Returns 0 on success, -1 on error
+ */
+int timer_phase_dump( const char* filename, double total )
+{
+	FILE *fp = fopen( filename, "w" );
+	if ( ! fp ) {
+		fprintf(stderr, "(*error*) Unable to open timings file %s\n", filename );
+		return -1;
+	}
+
+	const int nthreads = phase_nthreads();
+	const size_t len = strlen( filename );
+	const int json = ( len >= 5 && ! strcmp( filename + len - 5, ".json" ) );
+
+	if ( json ) {
+		fprintf( fp, "{\n  \"nthreads\": %d,\n  \"total\": %.9f,\n  \"phases\": {\n", nthreads, total );
+		for( int p = 0; p < TIMER_NPHASE; p++ ) {
+			uint64_t calls;
+			double min, avg, max;
+			phase_stats( p, nthreads, &calls, &min, &avg, &max );
 
-	// Protection against going over to next second
-	if (tv1.tv_sec < tv2.tv_sec ) tv2.tv_sec += 1000000;
+			fprintf( fp, "    \"%s\": { \"calls\": %llu, \"min\": %.9f, \"avg\": %.9f, \"max\": %.9f, \"seconds\": [",
+				_phase_name[p], (unsigned long long) calls, min, avg, max );
+			for( int tid = 0; tid < nthreads; tid++ )
+				fprintf( fp, "%s%.9f", tid ? ", " : "", timer_phase_seconds( p, tid ) );
+			fprintf( fp, "] }%s\n", ( p < TIMER_NPHASE - 1 ) ? "," : "" );
+		}
+		fprintf( fp, "  }\n}\n" );
+	} else {
+		fprintf( fp, "phase,thread,calls,seconds\n" );
+		for( int p = 0; p < TIMER_NPHASE; p++ ) {
+			for( int tid = 0; tid < nthreads; tid++ ) {
+				fprintf( fp, "%s,%d,%llu,%.9f\n", _phase_name[p], tid,
+					(unsigned long long) _phase_timers[tid].calls[p], timer_phase_seconds( p, tid ) );
+			}
+		}
+	}
 
-	return (double)(tv2.tv_usec - tv1.tv_usec) * 1.0e-6;
+	fclose( fp );
+	return 0;
 }
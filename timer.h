@@ -12,6 +12,30 @@
 
 
 #include <stdint.h>
+#include <stdio.h>
+
+/// Maximum number of threads tracked by the phase timers
+#define TIMER_MAX_THREADS 256
+
+/**
+ * @brief Simulation phases tracked by the phase timers
+ * 
+ */
+enum timer_phase {
+	TIMER_PUSH,			///< Particle field interpolation, push and current deposition (single fused loop)
+	TIMER_DEP_REDUCE,	///< Addition of private current buffers
+	TIMER_SORT,			///< Particle sorting
+	TIMER_BOUNDARY,		///< Particle boundary conditions (removal of particles leaving the box)
+	TIMER_MOVE_WINDOW,	///< Moving window (particles and fields)
+	TIMER_CURRENT_GC,	///< Electric current guard cells / boundary conditions
+	TIMER_SMOOTH,		///< Electric current digital filtering
+	TIMER_YEE,			///< Field solver (Yee sweep, excluding Mur boundaries)
+	TIMER_MUR,			///< Mur open boundaries
+	TIMER_PART_FLD,		///< Update of the fields seen by particles (external fields)
+	TIMER_EMF_GC,		///< EM field guard cells
+	TIMER_DIAG,			///< Diagnostics (reports and in-situ diagnostics)
+	TIMER_NPHASE		///< Number of phases
+};
 
 /**
  * @brief Gets current number of timer ticks
@@ -39,14 +63,58 @@ double timer_cpu_seconds( void );
 /**
  * @brief Gets timer resolution in seconds
  * 
- * This implementation is based on `gettimeofday()`, so the minimum
- * resolution value will be 1 microssecond.
- * 
- * Resolution is determined empirically; the routine will do successive
- * calls to `gettimeofday()` until the return time is different
- * 
  * @return Timer resolution 
  */
 double timer_resolution( void );
 
+/**
+ * @brief Adds a time interval to a phase timer of the calling thread
+ * 
+ * Each thread accumulates time on its own (cache line padded) timers, so this
+ * may be called concurrently by all threads without synchronization.
+ * 
+ * @param phase 	Phase
+ * @param ticks 	Number of ticks to add (e.g. `timer_ticks() - t0`)
+ */
+void timer_phase_add( enum timer_phase phase, uint64_t ticks );
+
+/**
+ * @brief Gets time spent in a phase by a thread
+ * 
+ * @param phase 	Phase
+ * @param tid 		Thread id
+ * @return 			Time in seconds
+ */
+double timer_phase_seconds( enum timer_phase phase, int tid );
+
+/**
+ * @brief Gets the phase name
+ * 
+ * @param phase 	Phase
+ * @return 			Phase name
+ */
+const char * timer_phase_name( enum timer_phase phase );
+
+/**
+ * @brief Sets all phase timers to zero
+ * 
+ */
+void timer_phase_reset( void );
+
+/**
+ * @brief Prints phase timing table, including per thread load imbalance
+ * 
+ * @param fp 	Output stream
+ */
+void timer_phase_report( FILE* fp );
+
+/**
+ * @brief Saves phase timers to file (JSON if the filename ends in ".json", CSV otherwise)
+ * 
+ * @param filename 	Output file name
+ * @param total 	Total simulation time (seconds), stored in the JSON output
+ * @return 			Returns 0 on success, -1 on error
+ */
+int timer_phase_dump( const char* filename, double total );
+
 #endif
@@ -1489,6 +1489,17 @@ int zdf_extend_dataset( t_zdf_file* zdf, t_zdf_dataset* dataset, uint64_t* new_c
   zdf high level interface
 -------------------------------------------------------------------------------------------------- */
 
+static void register_cleanup( void );
+
+static int series_save_grid( const void * data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration, char const path[] );
+
+static int async_save_grid( const void * data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration, char const path[] );
+
+static int async_save_part( const float * const data[], const t_zdf_part_info *info,
+    const t_zdf_iteration *iteration, char const path[] );
+
 /**
  * Opens ZDF file and adds TYPE, GRID, and ITERATION metadata
  * @param  zdf       File handle
@@ -1529,7 +1540,8 @@ int zdf_open_grid_file( t_zdf_file *zdf, const t_zdf_grid_info *info,
 
 
 /**
- * Saves a ZDF grid file
+ * Saves a ZDF grid file (or appends it to the corresponding time series file),
+ * always writing from the calling thread
  * @param  data       Pointer to grid data
  * @param  data_type  ZDF Data type of grid data
  * @param  info       Grid information
@@ -1537,9 +1549,12 @@ int zdf_open_grid_file( t_zdf_file *zdf, const t_zdf_grid_info *info,
  * @param  path       File path
  * @return            Returns 1 on success, 0 on error
  */
-int zdf_save_grid( const void * data, const enum zdf_data_type data_type, const t_zdf_grid_info *info,
+static int save_grid_sync( const void * data, const enum zdf_data_type data_type, const t_zdf_grid_info *info,
     const t_zdf_iteration *iteration, char const path[] )
 {
+    // Append to time series file if enabled
+    if ( zdf_grid_series_mode() )
+        return( series_save_grid( data, data_type, info, iteration, path ) );
 
     t_zdf_file zdf;
 
@@ -1561,6 +1576,25 @@ int zdf_save_grid( const void * data, const enum zdf_data_type data_type, const
     return( zdf_close_file( &zdf ) );
 }
 
+/**
+ * Saves a ZDF grid file
+ * @param  data       Pointer to grid data
+ * @param  data_type  ZDF Data type of grid data
+ * @param  info       Grid information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_save_grid( const void * data, const enum zdf_data_type data_type, const t_zdf_grid_info *info,
+    const t_zdf_iteration *iteration, char const path[] )
+{
+    // Hand the data over to the writer thread if active
+    if ( zdf_async_active() )
+        return( async_save_grid( data, data_type, info, iteration, path ) );
+
+    return( save_grid_sync( data, data_type, info, iteration, path ) );
+}
+
 /**
  * Opens ZDF file and adds TYPE, PARTICLES, and ITERATION metadata
  * @param  zdf        File handle
@@ -1623,6 +1657,1134 @@ int zdf_add_quant_part_file( t_zdf_file *zdf, const char *name, const float* dat
 
 }
 
+/**
+ * Saves a ZDF particle file with all particle quantities
+ * @param  data       Array of pointers to particle quantity data (float32), one
+ *                    per quantity in `info->quants`, each holding `info->np` values
+ * @param  info       Particles information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_save_part_file( const float * const data[], const t_zdf_part_info *info,
+    const t_zdf_iteration *iteration, char const path[] )
+{
+    // Hand the data over to the writer thread if active
+    if ( zdf_async_active() )
+        return( async_save_part( data, info, iteration, path ) );
+
+    t_zdf_file zdf;
+
+    if ( !zdf_open_part_file( &zdf, (t_zdf_part_info *) info, iteration, path ) ) return(0);
+
+    for( unsigned q = 0; q < info -> nquants; q++ ) {
+        if ( !zdf_add_quant_part_file( &zdf, info -> quants[q], data[q], info -> np ) ) return(0);
+    }
+
+    return( zdf_close_file( &zdf ) );
+}
+
+/* -----------------------------------------------------------------------------------------------
+  Grid time series
+
+  A grid time series file stores all iterations of a grid diagnostic in a single file. The grid
+  data is stored as a chunked dataset with an additional (slowest varying) time dimension, and
+  each iteration is appended as a new chunk. The dataset header is updated after every chunk,
+  so the file is readable even if it is never closed. When the series is closed an iteration
+  index is added to the file with the following datasets:
+
+  - ITER_N      int32 [nframes], iteration number of each frame
+  - ITER_T      float64 [nframes], simulation time of each frame
+  - ITER_OFFSET uint64 [nframes], file position of the chunk record holding each frame
+  - AXIS_MIN, AXIS_MAX  float64 [ndims, nframes], axis range of each frame (only if
+                the grid has axis information)
+-------------------------------------------------------------------------------------------------- */
+
+/**
+ * Opens a grid time series file and adds TYPE, GRID, and ITERATION metadata (for the first
+ * iteration) and the chunked dataset header. The file is named "path/name.zdf".
+ * @param  series     Grid time series object
+ * @param  info       Grid information
+ * @param  iteration  Iteration information of the first frame
+ * @param  data_type  ZDF Data type of grid data
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_open_grid_series( t_zdf_grid_series* series, const t_zdf_grid_info *info,
+    const t_zdf_iteration *iteration, const enum zdf_data_type data_type, char const path[] ) {
+
+    char filename[1024];
+
+    if ( info -> ndims >= zdf_max_dims ) {
+        fprintf(stderr,"(*error*) Grid time series only supports grids with up to %d dimensions\n",
+            zdf_max_dims - 1 );
+        return(0);
+    }
+
+    // Ensure that the path is available
+    create_path( path );
+
+    // Build filename
+    snprintf( filename, 1024, "%s/%s.zdf", path, info->name );
+
+    // Create ZDF file
+    if ( !zdf_open_file( &series -> file, filename, ZDF_CREATE ) ) {
+        fprintf(stderr,"(*error*) Unable to open ZDF file, aborting.\n");
+        return(0);
+    }
+
+    if ( !zdf_add_string( &series -> file, "TYPE", "grid_series") ) return(0);
+    if ( !zdf_add_grid_info( &series -> file, info ) ) return(0);
+    if ( !zdf_add_iteration( &series -> file, iteration ) ) return(0);
+
+    // Chunked dataset, time is the last dimension
+    series -> ndims = info -> ndims;
+    series -> dataset = (t_zdf_dataset) {
+        .name = strdup( info -> name ),
+        .data_type = data_type,
+        .ndims = info -> ndims + 1
+    };
+    for( unsigned i = 0; i < info -> ndims; i++ ) series -> dataset.count[i] = info -> count[i];
+    series -> dataset.count[ info -> ndims ] = 0;
+
+    if ( !zdf_start_cdset( &series -> file, &series -> dataset ) ) return(0);
+
+    series -> has_axis = ( info -> axis != NULL );
+    series -> nframes = 0;
+    series -> max_frames = 0;
+    series -> iter_n = NULL;
+    series -> iter_t = NULL;
+    series -> offset = NULL;
+    series -> axis_min = NULL;
+    series -> axis_max = NULL;
+
+    return(1);
+}
+
+/**
+ * Appends one iteration of grid data to a grid time series file
+ * @param  series     Grid time series object
+ * @param  data       Pointer to grid data
+ * @param  data_type  ZDF Data type of grid data, must match the series data type
+ * @param  info       Grid information, grid dimensions must match the series dimensions
+ * @param  iteration  Iteration information
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_add_grid_series( t_zdf_grid_series* series, const void* data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration ) {
+
+    const unsigned ndims = series -> ndims;
+
+    int valid = ( data_type == series -> dataset.data_type ) &&
+                ( info -> ndims == ndims ) &&
+                ( ( info -> axis != NULL ) == series -> has_axis );
+    for( unsigned i = 0; valid && i < ndims; i++ )
+        valid = ( info -> count[i] == series -> dataset.count[i] );
+
+    if ( !valid ) {
+        fprintf(stderr,"(*error*) Grid %s does not match time series grid, unable to add iteration %d\n",
+            info -> name, iteration -> n );
+        return(0);
+    }
+
+    // Grow index
+    if ( series -> nframes == series -> max_frames ) {
+        uint64_t max_frames = ( series -> max_frames > 0 ) ? 2 * series -> max_frames : 64;
+        series -> iter_n = realloc( series -> iter_n, max_frames * sizeof(int32_t) );
+        series -> iter_t = realloc( series -> iter_t, max_frames * sizeof(double) );
+        series -> offset = realloc( series -> offset, max_frames * sizeof(uint64_t) );
+        if ( series -> has_axis ) {
+            series -> axis_min = realloc( series -> axis_min, max_frames * ndims * sizeof(double) );
+            series -> axis_max = realloc( series -> axis_max, max_frames * ndims * sizeof(double) );
+        }
+        if ( !series -> iter_n || !series -> iter_t || !series -> offset ||
+             ( series -> has_axis && ( !series -> axis_min || !series -> axis_max ) ) ) {
+            fprintf(stderr,"(*error*) Unable to allocate grid time series index\n");
+            return(0);
+        }
+        series -> max_frames = max_frames;
+    }
+
+    const uint64_t frame = series -> nframes;
+
+    off_t offset = ftello( series -> file.fp );
+    if ( offset < 0 ) return(0);
+
+    // Write chunk
+    t_zdf_chunk chunk = { .data = (void *) data };
+    for( unsigned i = 0; i < ndims; i++ ) {
+        chunk.count[i] = info -> count[i];
+        chunk.start[i] = 0;
+        chunk.stride[i] = 1;
+    }
+    chunk.count[ndims] = 1;
+    chunk.start[ndims] = frame;
+    chunk.stride[ndims] = 1;
+
+    if ( !zdf_write_cdset( &series -> file, &series -> dataset, &chunk ) ) return(0);
+
+    // Update dataset dimensions
+    uint64_t new_count[zdf_max_dims];
+    for( unsigned i = 0; i < ndims; i++ ) new_count[i] = series -> dataset.count[i];
+    new_count[ndims] = frame + 1;
+    if ( zdf_extend_dataset( &series -> file, &series -> dataset, new_count ) != 1 ) return(0);
+
+    // Update index
+    series -> iter_n[frame] = iteration -> n;
+    series -> iter_t[frame] = iteration -> t;
+    series -> offset[frame] = offset;
+    if ( series -> has_axis ) {
+        for( unsigned i = 0; i < ndims; i++ ) {
+            series -> axis_min[ frame * ndims + i ] = info -> axis[i].min;
+            series -> axis_max[ frame * ndims + i ] = info -> axis[i].max;
+        }
+    }
+    series -> nframes = frame + 1;
+
+    return(1);
+}
+
+/**
+ * Closes a grid time series file, adding the chunked dataset end marker and the
+ * iteration index
+ * @param  series     Grid time series object
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_close_grid_series( t_zdf_grid_series* series ) {
+
+    int ok = ( zdf_end_cdset( &series -> file, &series -> dataset ) > 0 );
+
+    t_zdf_dataset index[] = {
+        { .name = "ITER_N",      .data_type = zdf_int32,   .ndims = 1, .data = series -> iter_n },
+        { .name = "ITER_T",      .data_type = zdf_float64, .ndims = 1, .data = series -> iter_t },
+        { .name = "ITER_OFFSET", .data_type = zdf_uint64,  .ndims = 1, .data = series -> offset },
+        { .name = "AXIS_MIN",    .data_type = zdf_float64, .ndims = 2, .data = series -> axis_min },
+        { .name = "AXIS_MAX",    .data_type = zdf_float64, .ndims = 2, .data = series -> axis_max }
+    };
+    const int nindex = ( series -> has_axis ) ? 5 : 3;
+
+    for( int k = 0; ok && k < nindex; k++ ) {
+        index[k].count[0] = ( index[k].ndims == 1 ) ? series -> nframes : series -> ndims;
+        index[k].count[1] = series -> nframes;
+        ok = ( zdf_add_dataset( &series -> file, &index[k] ) > 0 );
+    }
+
+    if ( !zdf_close_file( &series -> file ) ) ok = 0;
+
+    free( series -> dataset.name );
+    free( series -> iter_n );
+    free( series -> iter_t );
+    free( series -> offset );
+    free( series -> axis_min );
+    free( series -> axis_max );
+
+    return( ok );
+}
+
+/**
+ * Open time series file, identified by the path and grid name
+ */
+typedef struct ZDF_GridSeriesEntry {
+    char* key;                              ///< "path/name"
+    t_zdf_grid_series series;               ///< Time series object
+    struct ZDF_GridSeriesEntry* next;       ///< Next open series
+} t_zdf_grid_series_entry;
+
+/**
+ * Grid time series mode state
+ */
+static struct {
+    int enabled;                        ///< `zdf_save_grid()` appends to time series files
+    t_zdf_grid_series_entry* list;      ///< Open time series files
+} zdf_series = { .enabled = 0, .list = NULL };
+
+/**
+ * Appends grid data to the time series file for the grid, opening a new file on first use
+ * @param  data       Pointer to grid data
+ * @param  data_type  ZDF Data type of grid data
+ * @param  info       Grid information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+static int series_save_grid( const void * data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration, char const path[] ) {
+
+    char key[1024];
+    snprintf( key, 1024, "%s/%s", path, info -> name );
+
+    t_zdf_grid_series_entry* entry = zdf_series.list;
+    while( entry && strcmp( entry -> key, key ) ) entry = entry -> next;
+
+    if ( entry == NULL ) {
+        entry = malloc( sizeof( t_zdf_grid_series_entry ) );
+        if ( entry == NULL ) {
+            fprintf(stderr,"(*error*) Unable to allocate grid time series\n");
+            return(0);
+        }
+        if ( !zdf_open_grid_series( &entry -> series, info, iteration, data_type, path ) ) {
+            free( entry );
+            return(0);
+        }
+        entry -> key = strdup( key );
+        entry -> next = zdf_series.list;
+        zdf_series.list = entry;
+    }
+
+    return( zdf_add_grid_series( &entry -> series, data, data_type, info, iteration ) );
+}
+
+/**
+ * Closes all grid time series files opened by `zdf_save_grid()`
+ */
+static void series_close_all( void ) {
+    while( zdf_series.list ) {
+        t_zdf_grid_series_entry* entry = zdf_series.list;
+        zdf_series.list = entry -> next;
+        if ( !zdf_close_grid_series( &entry -> series ) ) {
+            fprintf(stderr,"(*error*) Unable to close time series file %s.zdf\n", entry -> key );
+        }
+        free( entry -> key );
+        free( entry );
+    }
+}
+
+/**
+ * Sets grid time series mode. When enabled, `zdf_save_grid()` appends each iteration
+ * to a single "path/name.zdf" file per grid instead of creating one file per iteration.
+ * Disabling the mode closes all open time series files.
+ * @param  enable   Set to 1 to enable, 0 to disable
+ */
+void zdf_set_grid_series_mode( int enable ) {
+
+    // Pending asynchronous writes must use the previous setting
+    zdf_async_flush();
+
+    if ( ! enable ) series_close_all();
+    zdf_series.enabled = enable;
+
+    if ( enable ) register_cleanup();
+}
+
+/**
+ * Checks if grid time series mode is enabled
+ * @return  Returns 1 if enabled, 0 otherwise
+ */
+int zdf_grid_series_mode( void ) {
+    return zdf_series.enabled;
+}
+
+/**
+ * Finishes all pending ZDF output: stops the asynchronous writer (after writing all
+ * queued files) and closes all time series files. Registered with `atexit()` so that
+ * output is complete even if the program does not call it explicitly.
+ */
+void zdf_finalize( void ) {
+    zdf_async_stop();
+    series_close_all();
+}
+
+/**
+ * Registers `zdf_finalize()` to run at program exit (only once)
+ */
+static void register_cleanup( void ) {
+    static int registered = 0;
+    if ( ! registered ) {
+        atexit( zdf_finalize );
+        registered = 1;
+    }
+}
+
+/* -----------------------------------------------------------------------------------------------
+  Memory mapped reader
+
+  The whole file is mapped read-only and the record headers are scanned once to build a small
+  index (record type, name, payload position, and dataset id for datasets and chunks). Dataset
+  and chunk headers are only parsed when requested, and the returned data pointers point
+  directly into the mapped file, so no data is copied. Payloads are aligned to
+  BYTES_PER_ZDF_UNIT (4) bytes. ZDF files are little endian, so the reader is only available
+  on little endian systems.
+-------------------------------------------------------------------------------------------------- */
+
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+
+int zdf_map_open( t_zdf_map* map, const char* filename ) {
+    (void) filename;
+    map -> base = NULL;
+    map -> size = 0;
+    map -> nrecords = 0;
+    map -> records = NULL;
+    fprintf(stderr,"(*error*) Memory mapped ZDF reader is not available on this system\n");
+    return(0);
+}
+
+void zdf_map_close( t_zdf_map* map ) { (void) map; }
+
+int zdf_map_dataset( const t_zdf_map* map, t_zdf_dataset* dataset ) {
+    (void) map; (void) dataset;
+    return(0);
+}
+
+uint32_t zdf_map_nchunks( const t_zdf_map* map, const t_zdf_dataset* dataset ) {
+    (void) map; (void) dataset;
+    return(0);
+}
+
+int zdf_map_chunk( const t_zdf_map* map, const t_zdf_dataset* dataset, uint32_t n, t_zdf_chunk* chunk ) {
+    (void) map; (void) dataset; (void) n; (void) chunk;
+    return(0);
+}
+
+int zdf_map_chunk_at( const t_zdf_map* map, const t_zdf_dataset* dataset, uint64_t offset, t_zdf_chunk* chunk ) {
+    (void) map; (void) dataset; (void) offset; (void) chunk;
+    return(0);
+}
+
+#else
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Reads uint32 value from mapped file
+ * @param  map      Mapped file
+ * @param  pos      File position
+ * @return          Value
+ */
+static inline uint32_t map_uint32( const t_zdf_map* map, uint64_t pos ) {
+    uint32_t u;
+    memcpy( &u, map -> base + pos, sizeof(uint32_t) );
+    return u;
+}
+
+/**
+ * Reads uint64 value from mapped file
+ * @param  map      Mapped file
+ * @param  pos      File position
+ * @return          Value
+ */
+static inline uint64_t map_uint64( const t_zdf_map* map, uint64_t pos ) {
+    uint64_t u;
+    memcpy( &u, map -> base + pos, sizeof(uint64_t) );
+    return u;
+}
+
+/**
+ * Maps a ZDF file into memory and builds the record index
+ * @param  map      Mapped file object
+ * @param  filename Filename of the ZDF file, including path
+ * @return          Returns 1 on success, 0 on error
+ */
+int zdf_map_open( t_zdf_map* map, const char* filename ) {
+
+    map -> base = NULL;
+    map -> size = 0;
+    map -> nrecords = 0;
+    map -> records = NULL;
+
+    int fd = open( filename, O_RDONLY );
+    if ( fd < 0 ) {
+        perror("(*error*) Unable to open ZDF file for mapping");
+        return(0);
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) || st.st_size < ZDF_MAGIC_LENGTH ) {
+        fprintf(stderr,"(*error*) Invalid ZDF file %s\n", filename );
+        close( fd );
+        return(0);
+    }
+
+    void* base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( base == MAP_FAILED ) {
+        perror("(*error*) Unable to map ZDF file");
+        return(0);
+    }
+
+    map -> base = base;
+    map -> size = st.st_size;
+
+    if ( memcmp( map -> base, zdf_magic, ZDF_MAGIC_LENGTH ) ) {
+        fprintf(stderr,"(*error*) Invalid ZDF file %s, magic number doesn't match\n", filename );
+        zdf_map_close( map );
+        return(0);
+    }
+
+    // Build record index
+    uint32_t max_records = 0;
+    uint64_t pos = ZDF_MAGIC_LENGTH;
+    while( pos < map -> size ) {
+
+        // Record header: id_version, name length, name (padded), length
+        if ( pos + 2 * size_zdf_uint32 > map -> size ) break;
+        uint32_t id_version = map_uint32( map, pos );
+        uint32_t name_len   = map_uint32( map, pos + size_zdf_uint32 );
+        uint64_t name_pos   = pos + 2 * size_zdf_uint32;
+        uint64_t len_pos    = name_pos + RNDUP( (uint64_t) name_len );
+        if ( len_pos + size_zdf_uint64 > map -> size ) break;
+        uint64_t length     = map_uint64( map, len_pos );
+        uint64_t offset     = len_pos + size_zdf_uint64;
+        if ( offset + length > map -> size ) break;
+
+        if ( map -> nrecords == max_records ) {
+            max_records = ( max_records > 0 ) ? 2 * max_records : 64;
+            t_zdf_map_record* records = realloc( map -> records, max_records * sizeof( t_zdf_map_record ) );
+            if ( records == NULL ) {
+                fprintf(stderr,"(*error*) Unable to allocate ZDF record index\n");
+                zdf_map_close( map );
+                return(0);
+            }
+            map -> records = records;
+        }
+
+        t_zdf_map_record* rec = &map -> records[ map -> nrecords ];
+        rec -> id_version = id_version;
+        rec -> name = malloc( name_len + 1 );
+        if ( rec -> name ) {
+            memcpy( rec -> name, map -> base + name_pos, name_len );
+            rec -> name[ name_len ] = 0;
+        }
+        rec -> pos = pos;
+        rec -> offset = offset;
+        rec -> length = length;
+
+        // Datasets, chunked datasets and chunks all start with the dataset id
+        switch( id_version ) {
+            case ZDF_DATASET_ID:
+            case ZDF_CDSET_START_ID:
+            case ZDF_CDSET_CHUNK_ID:
+                rec -> dataset_id = ( length >= size_zdf_uint32 ) ? map_uint32( map, offset ) : 0;
+                break;
+            default:
+                rec -> dataset_id = 0;
+        }
+
+        map -> nrecords++;
+        pos = offset + length;
+    }
+
+    if ( pos != map -> size ) {
+        fprintf(stderr,"(*warning*) ZDF file %s is truncated, ignoring data after position %" PRIu64 "\n",
+            filename, pos );
+    }
+
+    return(1);
+}
+
+/**
+ * Unmaps ZDF file and frees the record index. Data pointers returned by
+ * `zdf_map_dataset()` and `zdf_map_chunk()` are no longer valid after this call.
+ * @param  map      Mapped file object
+ */
+void zdf_map_close( t_zdf_map* map ) {
+
+    if ( map -> base ) munmap( (void *) map -> base, map -> size );
+
+    for( uint32_t i = 0; i < map -> nrecords; i++ ) free( map -> records[i].name );
+    free( map -> records );
+
+    map -> base = NULL;
+    map -> size = 0;
+    map -> nrecords = 0;
+    map -> records = NULL;
+}
+
+/**
+ * Locates a dataset (regular or chunked) by name and reads the header. For regular
+ * datasets the `data` field points to the dataset data in the mapped file, for
+ * chunked datasets it is set to NULL (see `zdf_map_chunk()`).
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object, `name` must be set to the name of the dataset
+ * @return          Returns 1 on success, 0 on error (e.g. dataset not found)
+ */
+int zdf_map_dataset( const t_zdf_map* map, t_zdf_dataset* dataset ) {
+
+    for( uint32_t i = 0; i < map -> nrecords; i++ ) {
+        const t_zdf_map_record* rec = &map -> records[i];
+
+        if ( ( rec -> id_version == ZDF_DATASET_ID || rec -> id_version == ZDF_CDSET_START_ID ) &&
+             rec -> name && ! strcmp( rec -> name, dataset -> name ) ) {
+
+            // Dataset header: id, data type, ndims, count[ndims]
+            uint64_t pos = rec -> offset;
+            uint32_t ndims = map_uint32( map, pos + 2 * size_zdf_uint32 );
+            if ( ndims > zdf_max_dims || rec -> length < 3 * size_zdf_uint32 + ndims * size_zdf_uint64 ) {
+                fprintf(stderr,"(*error*) Invalid header for dataset %s\n", dataset -> name );
+                return(0);
+            }
+
+            dataset -> offset = pos;
+            dataset -> id = rec -> dataset_id;
+            dataset -> data_type = (enum zdf_data_type) map_uint32( map, pos + size_zdf_uint32 );
+            dataset -> ndims = ndims;
+            pos += 3 * size_zdf_uint32;
+            for( unsigned d = 0; d < ndims; d++, pos += size_zdf_uint64 )
+                dataset -> count[d] = map_uint64( map, pos );
+
+            if ( rec -> id_version == ZDF_DATASET_ID ) {
+                size_t size = zdf_sizeof( dataset -> data_type );
+                for( unsigned d = 0; d < ndims; d++ ) size *= dataset -> count[d];
+                if ( pos + size > rec -> offset + rec -> length ) {
+                    fprintf(stderr,"(*error*) Invalid size for dataset %s\n", dataset -> name );
+                    return(0);
+                }
+                dataset -> data = (void *) ( map -> base + pos );
+            } else {
+                dataset -> data = NULL;
+            }
+
+            return(1);
+        }
+    }
+
+    fprintf(stderr,"(*error*) Unable to find dataset %s\n", dataset -> name);
+    return(0);
+}
+
+/**
+ * Returns the number of chunks stored for a chunked dataset
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @return          Number of chunks
+ */
+uint32_t zdf_map_nchunks( const t_zdf_map* map, const t_zdf_dataset* dataset ) {
+
+    uint32_t n = 0;
+    for( uint32_t i = 0; i < map -> nrecords; i++ ) {
+        if ( map -> records[i].id_version == ZDF_CDSET_CHUNK_ID &&
+             map -> records[i].dataset_id == dataset -> id ) n++;
+    }
+    return n;
+}
+
+/**
+ * Reads chunk header from a chunk record
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object
+ * @param  rec      Chunk record
+ * @param  chunk    Chunk object
+ * @return          Returns 1 on success, 0 on error
+ */
+static int map_chunk_read( const t_zdf_map* map, const t_zdf_dataset* dataset,
+    const t_zdf_map_record* rec, t_zdf_chunk* chunk ) {
+
+    const unsigned ndims = dataset -> ndims;
+    uint64_t pos = rec -> offset + size_zdf_uint32;
+
+    if ( rec -> length < size_zdf_uint32 + 3 * ndims * size_zdf_uint64 ) return(0);
+
+    for( unsigned d = 0; d < ndims; d++, pos += size_zdf_uint64 ) chunk -> count[d]  = map_uint64( map, pos );
+    for( unsigned d = 0; d < ndims; d++, pos += size_zdf_uint64 ) chunk -> start[d]  = map_uint64( map, pos );
+    for( unsigned d = 0; d < ndims; d++, pos += size_zdf_uint64 ) chunk -> stride[d] = map_uint64( map, pos );
+
+    size_t size = zdf_sizeof( dataset -> data_type );
+    for( unsigned d = 0; d < ndims; d++ ) size *= chunk -> count[d];
+    if ( pos + size > rec -> offset + rec -> length ) return(0);
+
+    chunk -> data = (void *) ( map -> base + pos );
+    return(1);
+}
+
+/**
+ * Reads the header of the n-th chunk of a chunked dataset. The `data` field of
+ * the chunk points to the chunk data in the mapped file.
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @param  n        Chunk index (in file order)
+ * @param  chunk    Chunk object
+ * @return          Returns 1 on success, 0 on error (e.g. chunk not found)
+ */
+int zdf_map_chunk( const t_zdf_map* map, const t_zdf_dataset* dataset, uint32_t n, t_zdf_chunk* chunk ) {
+
+    for( uint32_t i = 0; i < map -> nrecords; i++ ) {
+        const t_zdf_map_record* rec = &map -> records[i];
+        if ( rec -> id_version == ZDF_CDSET_CHUNK_ID && rec -> dataset_id == dataset -> id ) {
+            if ( n == 0 ) {
+                if ( !map_chunk_read( map, dataset, rec, chunk ) ) {
+                    fprintf(stderr,"(*error*) Invalid chunk for dataset %s\n", dataset -> name );
+                    return(0);
+                }
+                return(1);
+            }
+            n--;
+        }
+    }
+
+    fprintf(stderr,"(*error*) Unable to find chunk for dataset %s\n", dataset -> name);
+    return(0);
+}
+
+/**
+ * Reads the header of the chunk of a chunked dataset stored at a given file position,
+ * e.g. from the ITER_OFFSET index of a grid time series file. The `data` field of
+ * the chunk points to the chunk data in the mapped file.
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @param  offset   File position of the chunk record
+ * @param  chunk    Chunk object
+ * @return          Returns 1 on success, 0 on error (e.g. no chunk at offset)
+ */
+int zdf_map_chunk_at( const t_zdf_map* map, const t_zdf_dataset* dataset, uint64_t offset, t_zdf_chunk* chunk ) {
+
+    // Records are stored in file order, use binary search
+    uint32_t lo = 0, hi = map -> nrecords;
+    while( lo < hi ) {
+        uint32_t mid = lo + ( hi - lo ) / 2;
+        if ( map -> records[mid].pos < offset ) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if ( lo < map -> nrecords ) {
+        const t_zdf_map_record* rec = &map -> records[lo];
+        if ( rec -> pos == offset && rec -> id_version == ZDF_CDSET_CHUNK_ID &&
+             rec -> dataset_id == dataset -> id && map_chunk_read( map, dataset, rec, chunk ) )
+            return(1);
+    }
+
+    fprintf(stderr,"(*error*) No valid chunk for dataset %s at position %" PRIu64 "\n",
+        dataset -> name, offset );
+    return(0);
+}
+
+#endif
+
+/* -----------------------------------------------------------------------------------------------
+  Asynchronous writer
+
+  When active, `zdf_save_grid()` and `zdf_save_part_file()` copy the data and metadata into a
+  job taken from a pool and queue it for a background writer thread, returning immediately.
+  The queue is bounded: if it is full the caller blocks until the writer frees a slot. Job
+  buffers are recycled, so once the pool is warm no further allocations are required.
+-------------------------------------------------------------------------------------------------- */
+
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64)
+
+// No POSIX threads available, files are always written synchronously
+
+int zdf_async_start( int queue_size ) {
+    (void) queue_size;
+    fprintf(stderr,"(*warning*) Asynchronous ZDF writer not available, using synchronous writes.\n");
+    return(0);
+}
+
+void zdf_async_flush( void ) {}
+void zdf_async_stop( void ) {}
+int zdf_async_active( void ) { return(0); }
+
+static int async_save_grid( const void * data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration, char const path[] ) {
+    (void) data; (void) data_type; (void) info; (void) iteration; (void) path;
+    return(0);
+}
+
+static int async_save_part( const float * const data[], const t_zdf_part_info *info,
+    const t_zdf_iteration *iteration, char const path[] ) {
+    (void) data; (void) info; (void) iteration; (void) path;
+    return(0);
+}
+
+#else
+
+#include <pthread.h>
+
+/**
+ * Type of asynchronous write job
+ */
+enum zdf_async_job_type {
+    ZDF_JOB_GRID,   ///< Grid file
+    ZDF_JOB_PART    ///< Particle file
+};
+
+/**
+ * Asynchronous write job. All metadata strings are private copies and `data`
+ * is a pooled buffer holding a snapshot of the dataset(s)
+ */
+typedef struct ZDF_AsyncJob {
+    enum zdf_async_job_type type;           ///< Job type
+    char* path;                             ///< File path
+    t_zdf_iteration iter;                   ///< Iteration information
+    t_zdf_grid_info grid;                   ///< Grid information (grid jobs)
+    t_zdf_grid_axis axis[zdf_max_dims];     ///< Grid axis information (grid jobs)
+    enum zdf_data_type data_type;           ///< Grid data type (grid jobs)
+    t_zdf_part_info part;                   ///< Particle information (particle jobs)
+    void* data;                             ///< Data buffer
+    size_t data_size;                       ///< Data buffer capacity (bytes)
+    struct ZDF_AsyncJob* next;              ///< Next job in queue / pool
+} t_zdf_async_job;
+
+/**
+ * Asynchronous writer state
+ */
+static struct {
+    int active;                 ///< Writer thread is running
+    int stop;                   ///< Writer thread should exit once the queue is empty
+    int busy;                   ///< Writer thread is processing a job
+    int max_queue;              ///< Maximum number of queued jobs
+    int nqueue;                 ///< Current number of queued jobs
+    t_zdf_async_job* head;      ///< First job in queue
+    t_zdf_async_job* tail;      ///< Last job in queue
+    t_zdf_async_job* pool;      ///< Free jobs
+    pthread_t thread;           ///< Writer thread
+    pthread_mutex_t lock;       ///< Queue lock
+    pthread_cond_t not_empty;   ///< Signaled when a job is queued (or on stop)
+    pthread_cond_t not_full;    ///< Signaled when a job is removed from the queue
+    pthread_cond_t idle;        ///< Signaled when the writer finishes a job
+} zdf_async = { .active = 0 };
+
+/**
+ * Copies a (possibly NULL) string
+ * @param  s    String to copy
+ * @return      Newly allocated copy of s, or NULL if s is NULL
+ */
+static char* async_strdup( const char* s ) {
+    return ( s ) ? strdup( s ) : NULL;
+}
+
+/**
+ * Frees the metadata strings held by a job, keeping the data buffer for reuse
+ * @param  job  Job to clear
+ */
+static void async_job_clear( t_zdf_async_job* job ) {
+
+    free( job -> path );
+    free( job -> iter.name );
+    free( job -> iter.time_units );
+
+    if ( job -> type == ZDF_JOB_GRID ) {
+        free( job -> grid.name );
+        free( job -> grid.label );
+        free( job -> grid.units );
+        if ( job -> grid.axis ) {
+            for( unsigned i = 0; i < job -> grid.ndims; i++ ) {
+                free( job -> axis[i].name );
+                free( job -> axis[i].label );
+                free( job -> axis[i].units );
+            }
+        }
+    } else {
+        free( job -> part.name );
+        free( job -> part.label );
+        for( unsigned q = 0; q < job -> part.nquants; q++ ) {
+            free( job -> part.quants[q] );
+            free( job -> part.qlabels[q] );
+            free( job -> part.qunits[q] );
+        }
+        free( job -> part.quants );
+        free( job -> part.qlabels );
+        free( job -> part.qunits );
+    }
+}
+
+/**
+ * Writer thread main loop
+ * @param  arg  Unused
+ * @return      NULL
+ */
+static void* async_writer( void* arg ) {
+
+    (void) arg;
+
+    pthread_mutex_lock( &zdf_async.lock );
+    for(;;) {
+        while ( zdf_async.nqueue == 0 && ! zdf_async.stop )
+            pthread_cond_wait( &zdf_async.not_empty, &zdf_async.lock );
+
+        if ( zdf_async.nqueue == 0 ) break;
+
+        // Remove job from queue
+        t_zdf_async_job* job = zdf_async.head;
+        zdf_async.head = job -> next;
+        if ( zdf_async.head == NULL ) zdf_async.tail = NULL;
+        zdf_async.nqueue--;
+        zdf_async.busy = 1;
+        pthread_cond_signal( &zdf_async.not_full );
+        pthread_mutex_unlock( &zdf_async.lock );
+
+        // Write file
+        int ok;
+        if ( job -> type == ZDF_JOB_GRID ) {
+            ok = save_grid_sync( job -> data, job -> data_type, &job -> grid, &job -> iter, job -> path );
+        } else {
+            const float* data[ job -> part.nquants ];
+            for( unsigned q = 0; q < job -> part.nquants; q++ )
+                data[q] = (float *) job -> data + q * job -> part.np;
+
+            t_zdf_file zdf;
+            ok = zdf_open_part_file( &zdf, &job -> part, &job -> iter, job -> path );
+            for( unsigned q = 0; ok && q < job -> part.nquants; q++ )
+                ok = zdf_add_quant_part_file( &zdf, job -> part.quants[q], data[q], job -> part.np );
+            if ( ok ) ok = zdf_close_file( &zdf );
+        }
+
+        if ( !ok ) {
+            fprintf(stderr,"(*error*) Asynchronous ZDF writer failed to write %s file to %s\n",
+                ( job -> type == ZDF_JOB_GRID ) ? job -> grid.name : job -> part.name, job -> path );
+        }
+
+        async_job_clear( job );
+
+        // Return job to pool
+        pthread_mutex_lock( &zdf_async.lock );
+        job -> next = zdf_async.pool;
+        zdf_async.pool = job;
+        zdf_async.busy = 0;
+        pthread_cond_broadcast( &zdf_async.idle );
+    }
+    pthread_mutex_unlock( &zdf_async.lock );
+
+    return NULL;
+}
+
+/**
+ * Gets a free job from the pool, waiting for a free queue slot if required
+ * @param  size     Required data buffer size (bytes)
+ * @return          Pointer to job, or NULL on error
+ */
+static t_zdf_async_job* async_get_job( size_t size ) {
+
+    pthread_mutex_lock( &zdf_async.lock );
+
+    // Back-pressure: wait for the writer to catch up
+    while ( zdf_async.nqueue >= zdf_async.max_queue )
+        pthread_cond_wait( &zdf_async.not_full, &zdf_async.lock );
+
+    t_zdf_async_job* job = zdf_async.pool;
+    if ( job ) zdf_async.pool = job -> next;
+
+    pthread_mutex_unlock( &zdf_async.lock );
+
+    if ( job == NULL ) {
+        job = calloc( 1, sizeof( t_zdf_async_job ) );
+        if ( job == NULL ) return NULL;
+    }
+
+    if ( job -> data_size < size ) {
+        free( job -> data );
+        job -> data = malloc( size );
+        if ( job -> data == NULL ) {
+            free( job );
+            return NULL;
+        }
+        job -> data_size = size;
+    }
+
+    job -> next = NULL;
+    return job;
+}
+
+/**
+ * Adds job to the writer queue
+ * @param  job  Job to add
+ */
+static void async_queue_job( t_zdf_async_job* job ) {
+
+    pthread_mutex_lock( &zdf_async.lock );
+    if ( zdf_async.tail ) zdf_async.tail -> next = job;
+    else zdf_async.head = job;
+    zdf_async.tail = job;
+    zdf_async.nqueue++;
+    pthread_cond_signal( &zdf_async.not_empty );
+    pthread_mutex_unlock( &zdf_async.lock );
+}
+
+/**
+ * Copies iteration information and file path into job
+ * @param  job          Job
+ * @param  iteration    Iteration information
+ * @param  path         File path
+ */
+static void async_copy_iter( t_zdf_async_job* job, const t_zdf_iteration *iteration, char const path[] ) {
+    job -> path = async_strdup( path );
+    job -> iter.name = async_strdup( iteration -> name );
+    job -> iter.n = iteration -> n;
+    job -> iter.t = iteration -> t;
+    job -> iter.time_units = async_strdup( iteration -> time_units );
+}
+
+/**
+ * Queues a grid file for writing
+ * @param  data       Pointer to grid data
+ * @param  data_type  ZDF Data type of grid data
+ * @param  info       Grid information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+static int async_save_grid( const void * data, const enum zdf_data_type data_type,
+    const t_zdf_grid_info *info, const t_zdf_iteration *iteration, char const path[] ) {
+
+    size_t size = zdf_sizeof( data_type );
+    for( unsigned i = 0; i < info -> ndims; i++ ) size *= info -> count[i];
+
+    t_zdf_async_job* job = async_get_job( size );
+    if ( job == NULL ) {
+        fprintf(stderr,"(*error*) Unable to allocate asynchronous ZDF write job\n");
+        return(0);
+    }
+
+    job -> type = ZDF_JOB_GRID;
+    async_copy_iter( job, iteration, path );
+
+    job -> grid.name = async_strdup( info -> name );
+    job -> grid.ndims = info -> ndims;
+    for( unsigned i = 0; i < info -> ndims; i++ ) job -> grid.count[i] = info -> count[i];
+    job -> grid.label = async_strdup( info -> label );
+    job -> grid.units = async_strdup( info -> units );
+    if ( info -> axis ) {
+        for( unsigned i = 0; i < info -> ndims; i++ ) {
+            job -> axis[i].name  = async_strdup( info -> axis[i].name );
+            job -> axis[i].type  = info -> axis[i].type;
+            job -> axis[i].min   = info -> axis[i].min;
+            job -> axis[i].max   = info -> axis[i].max;
+            job -> axis[i].label = async_strdup( info -> axis[i].label );
+            job -> axis[i].units = async_strdup( info -> axis[i].units );
+        }
+        job -> grid.axis = job -> axis;
+    } else {
+        job -> grid.axis = NULL;
+    }
+
+    job -> data_type = data_type;
+    memcpy( job -> data, data, size );
+
+    async_queue_job( job );
+    return(1);
+}
+
+/**
+ * Queues a particle file for writing
+ * @param  data       Array of pointers to particle quantity data (float32)
+ * @param  info       Particles information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+static int async_save_part( const float * const data[], const t_zdf_part_info *info,
+    const t_zdf_iteration *iteration, char const path[] ) {
+
+    const size_t qsize = info -> np * sizeof(float);
+
+    t_zdf_async_job* job = async_get_job( info -> nquants * qsize );
+    if ( job == NULL ) {
+        fprintf(stderr,"(*error*) Unable to allocate asynchronous ZDF write job\n");
+        return(0);
+    }
+
+    job -> type = ZDF_JOB_PART;
+    async_copy_iter( job, iteration, path );
+
+    job -> part.name = async_strdup( info -> name );
+    job -> part.label = async_strdup( info -> label );
+    job -> part.np = info -> np;
+    job -> part.nquants = info -> nquants;
+    job -> part.quants  = malloc( info -> nquants * sizeof( char * ) );
+    job -> part.qlabels = malloc( info -> nquants * sizeof( char * ) );
+    job -> part.qunits  = malloc( info -> nquants * sizeof( char * ) );
+    for( unsigned q = 0; q < info -> nquants; q++ ) {
+        job -> part.quants[q]  = async_strdup( info -> quants[q] );
+        job -> part.qlabels[q] = async_strdup( info -> qlabels[q] );
+        job -> part.qunits[q]  = async_strdup( info -> qunits[q] );
+        memcpy( (char *) job -> data + q * qsize, data[q], qsize );
+    }
+
+    async_queue_job( job );
+    return(1);
+}
+
+/**
+ * Starts the asynchronous writer thread. Subsequent calls to `zdf_save_grid()` and
+ * `zdf_save_part_file()` will return as soon as the data has been copied. Does nothing
+ * if the writer is already running.
+ * @param  queue_size   Maximum number of files waiting to be written, must be >= 1
+ * @return              Returns 1 on success, 0 on error
+ */
+int zdf_async_start( int queue_size ) {
+
+    if ( zdf_async.active ) return(1);
+
+    if ( queue_size < 1 ) {
+        fprintf(stderr,"(*error*) Invalid asynchronous ZDF writer queue size, must be >= 1\n");
+        return(0);
+    }
+
+    zdf_async.stop = 0;
+    zdf_async.busy = 0;
+    zdf_async.max_queue = queue_size;
+    zdf_async.nqueue = 0;
+    zdf_async.head = zdf_async.tail = zdf_async.pool = NULL;
+
+    pthread_mutex_init( &zdf_async.lock, NULL );
+    pthread_cond_init( &zdf_async.not_empty, NULL );
+    pthread_cond_init( &zdf_async.not_full, NULL );
+    pthread_cond_init( &zdf_async.idle, NULL );
+
+    if ( pthread_create( &zdf_async.thread, NULL, async_writer, NULL ) ) {
+        fprintf(stderr,"(*error*) Unable to start asynchronous ZDF writer thread\n");
+        return(0);
+    }
+
+    zdf_async.active = 1;
+
+    // Ensure pending files are written if the program exits early
+    register_cleanup();
+
+    return(1);
+}
+
+/**
+ * Waits for all queued files to be written. Does nothing if the writer is not running.
+ */
+void zdf_async_flush( void ) {
+
+    if ( ! zdf_async.active ) return;
+
+    pthread_mutex_lock( &zdf_async.lock );
+    while ( zdf_async.nqueue > 0 || zdf_async.busy )
+        pthread_cond_wait( &zdf_async.idle, &zdf_async.lock );
+    pthread_mutex_unlock( &zdf_async.lock );
+}
+
+/**
+ * Writes all queued files, stops the writer thread and frees the job pool. Subsequent
+ * writes will be synchronous. Does nothing if the writer is not running.
+ */
+void zdf_async_stop( void ) {
+
+    if ( ! zdf_async.active ) return;
+
+    pthread_mutex_lock( &zdf_async.lock );
+    zdf_async.stop = 1;
+    pthread_cond_signal( &zdf_async.not_empty );
+    pthread_mutex_unlock( &zdf_async.lock );
+
+    pthread_join( zdf_async.thread, NULL );
+    zdf_async.active = 0;
+
+    while( zdf_async.pool ) {
+        t_zdf_async_job* job = zdf_async.pool;
+        zdf_async.pool = job -> next;
+        free( job -> data );
+        free( job );
+    }
+
+    pthread_cond_destroy( &zdf_async.idle );
+    pthread_cond_destroy( &zdf_async.not_full );
+    pthread_cond_destroy( &zdf_async.not_empty );
+    pthread_mutex_destroy( &zdf_async.lock );
+}
+
+/**
+ * Checks if the asynchronous writer is running
+ * @return  Returns 1 if the writer thread is running, 0 otherwise
+ */
+int zdf_async_active( void ) {
+    return zdf_async.active;
+}
+
+#endif
+
 #ifdef __TEST_ZDF__
 
 #include <math.h>
@@ -202,6 +202,48 @@ typedef struct ZDF_TrackInfo {
 	char** qunits;		///< Units for quantities
 } t_zdf_track_info;
 
+/**
+ * @brief Time series of grid data stored in a single file
+ *
+ * Each iteration is appended as a chunk of a chunked dataset that has an additional
+ * (last) time dimension. An iteration index is added when the file is closed.
+ */
+typedef struct ZDF_GridSeries {
+	t_zdf_file file;			///< File handle
+	t_zdf_dataset dataset;		///< Chunked dataset (grid dimensions + time)
+	uint32_t ndims;				///< Number of grid dimensions
+	int has_axis;				///< Grid has axis information
+	uint64_t nframes;			///< Number of iterations stored
+	uint64_t max_frames;		///< Capacity of the index arrays
+	int32_t* iter_n;			///< Iteration number of each frame
+	double* iter_t;				///< Simulation time of each frame
+	uint64_t* offset;			///< File position of the chunk record of each frame
+	double* axis_min;			///< Axis minimum of each frame (ndims values per frame)
+	double* axis_max;			///< Axis maximum of each frame (ndims values per frame)
+} t_zdf_grid_series;
+
+/**
+ * @brief Record index entry of a memory mapped ZDF file
+ */
+typedef struct ZDF_MapRecord {
+	uint32_t id_version;	///< Record id & version
+	char* name;				///< Record name
+	uint64_t pos;			///< File position of record header
+	uint64_t offset;		///< File position of record payload
+	uint64_t length;		///< Record payload length
+	uint32_t dataset_id;	///< Dataset id for dataset and chunk records, 0 otherwise
+} t_zdf_map_record;
+
+/**
+ * @brief Memory mapped ZDF file (read only)
+ */
+typedef struct ZDF_Map {
+	const unsigned char* base;	///< Start of mapped file
+	uint64_t size;				///< File size
+	uint32_t nrecords;			///< Number of records in file
+	t_zdf_map_record* records;	///< Record index (in file order)
+} t_zdf_map;
+
 // Low level interface
 
 /**
@@ -417,6 +459,160 @@ int zdf_open_part_file( t_zdf_file *file, t_zdf_part_info *info,
 int zdf_add_quant_part_file( t_zdf_file *zdf, const char *name, const float* data,
 	const uint64_t np );
 
+/**
+ * Saves a ZDF particle file with all particle quantities
+ * @param  data       Array of pointers to particle quantity data (float32), one
+ *                    per quantity in `info->quants`, each holding `info->np` values
+ * @param  info       Particles information
+ * @param  iteration  Iteration information
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_save_part_file( const float * const data[], const t_zdf_part_info *info,
+	const t_zdf_iteration *iteration, char const path[] );
+
+// Memory mapped reader
+
+/**
+ * Maps a ZDF file into memory and builds the record index
+ * @param  map      Mapped file object
+ * @param  filename Filename of the ZDF file, including path
+ * @return          Returns 1 on success, 0 on error
+ */
+int zdf_map_open( t_zdf_map* map, const char* filename );
+
+/**
+ * Unmaps ZDF file and frees the record index. Data pointers returned by
+ * `zdf_map_dataset()` and `zdf_map_chunk()` are no longer valid after this call.
+ * @param  map      Mapped file object
+ */
+void zdf_map_close( t_zdf_map* map );
+
+/**
+ * Locates a dataset (regular or chunked) by name and reads the header. For regular
+ * datasets the `data` field points to the dataset data in the mapped file, for
+ * chunked datasets it is set to NULL (see `zdf_map_chunk()`).
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object, `name` must be set to the name of the dataset
+ * @return          Returns 1 on success, 0 on error (e.g. dataset not found)
+ */
+int zdf_map_dataset( const t_zdf_map* map, t_zdf_dataset* dataset );
+
+/**
+ * Returns the number of chunks stored for a chunked dataset
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @return          Number of chunks
+ */
+uint32_t zdf_map_nchunks( const t_zdf_map* map, const t_zdf_dataset* dataset );
+
+/**
+ * Reads the header of the n-th chunk of a chunked dataset. The `data` field of
+ * the chunk points to the chunk data in the mapped file.
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @param  n        Chunk index (in file order)
+ * @param  chunk    Chunk object
+ * @return          Returns 1 on success, 0 on error (e.g. chunk not found)
+ */
+int zdf_map_chunk( const t_zdf_map* map, const t_zdf_dataset* dataset, uint32_t n, t_zdf_chunk* chunk );
+
+/**
+ * Reads the header of the chunk of a chunked dataset stored at a given file position,
+ * e.g. from the ITER_OFFSET index of a grid time series file. The `data` field of
+ * the chunk points to the chunk data in the mapped file.
+ * @param  map      Mapped file object
+ * @param  dataset  Dataset object (from `zdf_map_dataset()`)
+ * @param  offset   File position of the chunk record
+ * @param  chunk    Chunk object
+ * @return          Returns 1 on success, 0 on error (e.g. no chunk at offset)
+ */
+int zdf_map_chunk_at( const t_zdf_map* map, const t_zdf_dataset* dataset, uint64_t offset, t_zdf_chunk* chunk );
+
+// Grid time series
+
+/**
+ * Opens a grid time series file and adds TYPE, GRID, and ITERATION metadata (for the first
+ * iteration) and the chunked dataset header. The file is named "path/name.zdf".
+ * @param  series     Grid time series object
+ * @param  info       Grid information
+ * @param  iteration  Iteration information of the first frame
+ * @param  data_type  ZDF Data type of grid data
+ * @param  path       File path
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_open_grid_series( t_zdf_grid_series* series, const t_zdf_grid_info *info,
+	const t_zdf_iteration *iteration, const enum zdf_data_type data_type, char const path[] );
+
+/**
+ * Appends one iteration of grid data to a grid time series file
+ * @param  series     Grid time series object
+ * @param  data       Pointer to grid data
+ * @param  data_type  ZDF Data type of grid data, must match the series data type
+ * @param  info       Grid information, grid dimensions must match the series dimensions
+ * @param  iteration  Iteration information
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_add_grid_series( t_zdf_grid_series* series, const void* data, const enum zdf_data_type data_type,
+	const t_zdf_grid_info *info, const t_zdf_iteration *iteration );
+
+/**
+ * Closes a grid time series file, adding the chunked dataset end marker and the
+ * iteration index
+ * @param  series     Grid time series object
+ * @return            Returns 1 on success, 0 on error
+ */
+int zdf_close_grid_series( t_zdf_grid_series* series );
+
+/**
+ * Sets grid time series mode. When enabled, `zdf_save_grid()` appends each iteration
+ * to a single "path/name.zdf" file per grid instead of creating one file per iteration.
+ * Disabling the mode closes all open time series files.
+ * @param  enable   Set to 1 to enable, 0 to disable
+ */
+void zdf_set_grid_series_mode( int enable );
+
+/**
+ * Checks if grid time series mode is enabled
+ * @return  Returns 1 if enabled, 0 otherwise
+ */
+int zdf_grid_series_mode( void );
+
+/**
+ * Finishes all pending ZDF output: stops the asynchronous writer (after writing all
+ * queued files) and closes all time series files. Registered with `atexit()` so that
+ * output is complete even if the program does not call it explicitly.
+ */
+void zdf_finalize( void );
+
+// Asynchronous writer
+
+/**
+ * Starts the asynchronous writer thread. Subsequent calls to `zdf_save_grid()` and
+ * `zdf_save_part_file()` will return as soon as the data has been copied. Does nothing
+ * if the writer is already running.
+ * @param  queue_size   Maximum number of files waiting to be written, must be >= 1
+ * @return              Returns 1 on success, 0 on error
+ */
+int zdf_async_start( int queue_size );
+
+/**
+ * Waits for all queued files to be written. Does nothing if the writer is not running.
+ */
+void zdf_async_flush( void );
+
+/**
+ * Writes all queued files, stops the writer thread and frees the job pool. Subsequent
+ * writes will be synchronous. Does nothing if the writer is not running.
+ */
+void zdf_async_stop( void );
+
+/**
+ * Checks if the asynchronous writer is running
+ * @return  Returns 1 if the writer thread is running, 0 otherwise
+ */
+int zdf_async_active( void );
+
 
 #endif
 